@@ -0,0 +1,40 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/* Helpers shared by host benchmarks */
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include "max30003_sim.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* CPU cycles on x86, nanoseconds everywhere else */
+static inline uint64_t benchCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+static inline double benchSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*  Synthetic ECG in MAX30003 counts: P wave, QRS complex and T wave
+    at 60 bpm plus a little baseline wander, sample n at sampleRate
+*/
+static inline int32_t benchSyntheticEcg(uint32_t n, uint32_t sampleRate)
+{
+    return max30003SimEcg(n, sampleRate, 60);
+}
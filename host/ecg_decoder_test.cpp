@@ -0,0 +1,218 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  ecgDecodeFifo() cases and FIFO overflow recovery of driver against simulated MAX30003
+    ctest runs it, exit code is number of failed checks
+*/
+
+#include "ecg_decoder.h"
+#include "test_util.h"
+#include <string.h>
+
+#define DECODE_TEST_WORDS 6
+
+typedef struct
+{
+    int32_t sample;
+    uint8_t eTag;
+} FifoWord;
+
+typedef struct
+{
+    const char *name;
+    FifoWord in[DECODE_TEST_WORDS];
+    int words;
+    /* Expected output */
+    int32_t samples[DECODE_TEST_WORDS];
+    uint8_t flags[DECODE_TEST_WORDS];
+    uint8_t count;
+    uint8_t fast;
+    uint8_t consumed;
+    uint8_t status;
+} DecodeCase;
+
+static const DecodeCase decodeCases[] = {
+    {"valid", {{100, ECG_ETAG_VALID}, {-100, ECG_ETAG_VALID}, {0, ECG_ETAG_VALID}}, 3,
+     {100, -100, 0}, {0, 0, 0}, 3, 0, 3, 0},
+    {"full_scale", {{131071, ECG_ETAG_VALID}, {-131072, ECG_ETAG_VALID}, {-1, ECG_ETAG_VALID_EOF}}, 3,
+     {131071, -131072, -1}, {0, 0, 0}, 3, 0, 3, ECG_DECODE_EOF},
+    {"fast_zeroed", {{500, ECG_ETAG_VALID}, {-7000, ECG_ETAG_FAST}, {9000, ECG_ETAG_FAST}, {42, ECG_ETAG_VALID}}, 4,
+     {500, 0, 0, 42}, {0, ECG_FLAG_FAST, ECG_FLAG_FAST, 0}, 4, 2, 4, 0},
+    {"eof_stops", {{1, ECG_ETAG_VALID}, {2, ECG_ETAG_VALID_EOF}, {3, ECG_ETAG_VALID}}, 3,
+     {1, 2}, {0, 0}, 2, 0, 2, ECG_DECODE_EOF},
+    {"fast_eof_stops", {{1, ECG_ETAG_VALID}, {2, ECG_ETAG_FAST_EOF}, {3, ECG_ETAG_VALID}}, 3,
+     {1, 0}, {0, ECG_FLAG_FAST}, 2, 1, 2, ECG_DECODE_EOF},
+    {"empty_discarded", {{1, ECG_ETAG_VALID}, {2, ECG_ETAG_EMPTY}, {3, ECG_ETAG_VALID}}, 3,
+     {1}, {0}, 1, 0, 2, ECG_DECODE_EMPTY},
+    {"empty_first", {{7, ECG_ETAG_EMPTY}, {8, ECG_ETAG_VALID}}, 2,
+     {}, {}, 0, 0, 1, ECG_DECODE_EMPTY},
+    {"overflow_discarded", {{1, ECG_ETAG_VALID}, {2, ECG_ETAG_VALID}, {3, ECG_ETAG_OVERFLOW}, {4, ECG_ETAG_VALID}}, 4,
+     {1, 2}, {0, 0}, 2, 0, 3, ECG_DECODE_OVERFLOW},
+    {"reserved_4", {{1, ECG_ETAG_VALID}, {2, 4}, {3, ECG_ETAG_VALID}}, 3,
+     {1}, {0}, 1, 0, 2, ECG_DECODE_INVALID},
+    {"reserved_6", {{2, 6}}, 1,
+     {}, {}, 0, 0, 1, ECG_DECODE_INVALID},
+    {"word_limit", {{1, ECG_ETAG_VALID}, {2, ECG_ETAG_VALID}, {3, ECG_ETAG_VALID_EOF}}, 2,
+     {1, 2}, {0, 0}, 2, 0, 2, 0},
+    {"no_words", {}, 0,
+     {}, {}, 0, 0, 0, 0},
+};
+
+static void encode(const FifoWord *in, int words, uint8_t *buf)
+{
+    for (int i = 0; i < words; i++)
+    {
+        ecgEncodeFifoWord(in[i].sample, in[i].eTag, &buf[i * 3]);
+    }
+}
+
+static void testDecodeCases()
+{
+    for (const DecodeCase &c : decodeCases)
+    {
+        uint8_t buf[DECODE_TEST_WORDS * 3];
+        int32_t samples[DECODE_TEST_WORDS];
+        uint8_t flags[DECODE_TEST_WORDS];
+        EcgDecodeSummary s;
+        memset(&s, 0xFF, sizeof(s));
+        encode(c.in, c.words, buf);
+        int n = ecgDecodeFifo(buf, c.words, samples, flags, &s);
+        CHECK(c.name, n == c.count);
+        CHECK(c.name, s.count == c.count);
+        CHECK(c.name, s.fast == c.fast);
+        CHECK(c.name, s.words == c.consumed);
+        CHECK(c.name, s.status == c.status);
+        for (int i = 0; i < c.count && i < n; i++)
+        {
+            CHECK(c.name, samples[i] == c.samples[i]);
+            CHECK(c.name, flags[i] == c.flags[i]);
+        }
+    }
+}
+
+/* Reading goes on after summary.words, stop word is not decoded twice */
+static void testResume()
+{
+    const FifoWord in[] = {{10, ECG_ETAG_VALID}, {11, ECG_ETAG_VALID_EOF}, {12, ECG_ETAG_FAST}, {13, ECG_ETAG_VALID}, {14, ECG_ETAG_EMPTY}};
+    const int words = sizeof(in) / sizeof(in[0]);
+    uint8_t buf[words * 3];
+    encode(in, words, buf);
+    int32_t samples[words];
+    uint8_t flags[words];
+    EcgDecodeSummary s;
+    ecgDecodeFifo(buf, words, samples, flags, &s);
+    CHECK("resume", s.count == 2 && s.words == 2 && s.status == ECG_DECODE_EOF);
+    ecgDecodeFifo(&buf[s.words * 3], words - s.words, samples, flags, &s);
+    CHECK("resume", s.count == 2 && s.fast == 1 && s.words == 3 && s.status == ECG_DECODE_EMPTY);
+    CHECK("resume", samples[0] == 0 && flags[0] == ECG_FLAG_FAST);
+    CHECK("resume", samples[1] == 13 && flags[1] == 0);
+}
+
+/*  Driver against simulator: processing stops longer than the FIFO holds, device overflows,
+    driver resets FIFO and the first sample after it carries ECG_FLAG_GAP. FAST recovery
+    samples come through flagged and zeroed
+*/
+#define TEST_RATE 512
+
+static uint32_t testSamples;
+static uint32_t testGapBlocks;
+static uint32_t testGapSamples;
+static uint32_t testFast;
+static uint32_t testFastNonZero;
+static uint32_t testNextIndex;
+static uint32_t testIndexJumps;
+
+static void testBlock(const MAX30003SampleBlock *block, void *ctx)
+{
+    if (block->count == 0)
+    {
+        return;
+    }
+    if (testSamples > 0 && block->firstIndex != testNextIndex)
+    {
+        testIndexJumps++;
+    }
+    testNextIndex = block->firstIndex + block->count;
+    for (uint16_t i = 0; i < block->count; i++)
+    {
+        if (block->flags[i] & ECG_FLAG_GAP)
+        {
+            testGapSamples++;
+            testGapBlocks += i == 0;
+        }
+        if (block->flags[i] & ECG_FLAG_FAST)
+        {
+            testFast++;
+            testFastNonZero += block->samples[i] != 0;
+        }
+    }
+    testSamples += block->count;
+}
+
+static void testRecovery()
+{
+    SimDriverFixture sim;
+    MAX30003 driver(TEST_CS, &sim.bus, nullptr);
+    sim.configure(&driver, TEST_RATE);
+    driver.setBlockCallBack(testBlock, nullptr, nullptr);
+    sim.start();
+
+    simRun(1000000);
+    CHECK("recovery", testSamples > TEST_RATE - MAX30003_FIFO_DEPTH);
+    CHECK("recovery", testGapSamples == 0 && testIndexJumps == 0);
+
+    /* Intruppts held off for 100 ms, FIFO of 32 words lasts 62.5 ms */
+    simAdvanceNs(100000000ull);
+    uint32_t before = testSamples;
+    simRun(1000000);
+    MAX30003Telemetry t;
+    driver.getTelemetry(&t);
+    CHECK("recovery", sim.device.stats().overflows >= 1);
+    CHECK("recovery", t.overflows >= 1);
+    CHECK("recovery", t.lostSamples > 0);
+    CHECK("recovery", testGapBlocks == 1 && testGapSamples == 1);
+    /* Index counts delivered samples, the gap is only in flags */
+    CHECK("recovery", testIndexJumps == 0);
+    CHECK("recovery", testSamples - before > TEST_RATE / 2);
+
+    sim.device.injectFastRecovery(20);
+    simRun(1000000);
+    CHECK("recovery", testFast == 20);
+    CHECK("recovery", testFastNonZero == 0);
+    CHECK("recovery", testGapBlocks == 1);
+}
+
+static uint32_t testReadValue;
+
+static void testReadDone(const MAX30003Command *command, void *ctx)
+{
+    testReadValue = command->value;
+}
+
+/* Writes that would leave FIFO threshold or sampling rate of driver stale are refused */
+static void testCommandRules()
+{
+    SimDriverFixture sim;
+    MAX30003 driver(TEST_CS, &sim.bus, nullptr);
+    sim.configure(&driver, TEST_RATE);
+    CHECK("commands", !driver.postCommand(CMD_WRITE, MNGR_INT, 0x000004, nullptr, nullptr));
+    CHECK("commands", !driver.postCommand(CMD_WRITE, CNFG_ECG, 0x000000, nullptr, nullptr));
+    CHECK("commands", !driver.postCommand(CMD_READ, ECG_FIFO, 0, nullptr, nullptr));
+    CHECK("commands", driver.postCommand(CMD_SAMPLING_RATE, 0, 256, nullptr, nullptr));
+    CHECK("commands", driver.postCommand(CMD_READ, CNFG_ECG, 0, testReadDone, nullptr));
+    driver.runCommands();
+    CHECK("commands", driver.pendingCommands() == 0);
+    CHECK("commands", (testReadValue >> 22) == ecgRateBits(256));
+}
+
+int main()
+{
+    testDecodeCases();
+    testResume();
+    testRecovery();
+    testCommandRules();
+    return testResult();
+}
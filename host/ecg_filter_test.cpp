@@ -0,0 +1,230 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Compile time filter coefficients against golden Q30 values and libm, fixed-point
+    filter output against a double precision model of the same chain
+    ctest runs it, exit code is number of failed checks
+*/
+
+#include "ecg_filter.h"
+#include "bench_util.h"
+#include "test_util.h"
+#include <math.h>
+#include <stdlib.h>
+
+/* Largest difference of fixed-point output to the double model, in LSB of 18 bit samples */
+#define FILTER_TEST_MAX_ERROR 6
+#define FILTER_TEST_SECONDS 20
+
+typedef struct
+{
+    uint16_t sampleRate;
+    uint8_t mainsHz;
+    uint8_t baselineShift;
+    EcgBiquadCoeffs notch;
+    EcgBiquadCoeffs lowpass;
+} GoldenCoeffs;
+
+/* Computed once with libm in double precision */
+static const GoldenCoeffs goldenCoeffs[] = {
+    {512, 50, 7, {1044178383, -1707408776, 1044178383, -1703077517, 1010283682}, {47544975, 95089950, 47544975, -1420439484, 536877561}},
+    {256, 60, 6, {1042065260, -204280514, 1042065260, -204175500, 1010283682}, {150258665, 300517330, 150258665, -751337987, 278630823}},
+};
+
+static const EcgFilterCoeffs *findCoeffs(uint16_t sampleRate, uint8_t mainsHz)
+{
+    for (const EcgFilterCoeffs &c : ECG_FILTER_COEFFS)
+    {
+        if (c.sampleRate == sampleRate && c.mainsHz == mainsHz)
+        {
+            return &c;
+        }
+    }
+    return nullptr;
+}
+
+static bool sameBiquad(const EcgBiquadCoeffs &a, const EcgBiquadCoeffs &b, int32_t lsb)
+{
+    return abs(a.b0 - b.b0) <= lsb && abs(a.b1 - b.b1) <= lsb && abs(a.b2 - b.b2) <= lsb &&
+           abs(a.a1 - b.a1) <= lsb && abs(a.a2 - b.a2) <= lsb;
+}
+
+static void testGoldenCoeffs()
+{
+    for (const GoldenCoeffs &g : goldenCoeffs)
+    {
+        const EcgFilterCoeffs *c = findCoeffs(g.sampleRate, g.mainsHz);
+        CHECK("golden", c != nullptr);
+        if (c == nullptr)
+        {
+            continue;
+        }
+        CHECK("golden", c->baselineShift == g.baselineShift);
+        CHECK("golden", sameBiquad(c->notch, g.notch, 0));
+        CHECK("golden", sameBiquad(c->lowpass, g.lowpass, 0));
+    }
+}
+
+static double dcGain(const EcgBiquadCoeffs &c)
+{
+    return ((double)c.b0 + c.b1 + c.b2) / ((double)(1L << ECG_FILTER_Q) + c.a1 + c.a2);
+}
+
+static int32_t qRef(double v)
+{
+    return (int32_t)lround(v * (double)(1L << ECG_FILTER_Q));
+}
+
+/* Same design as ecg_filter_constexpr with libm sin/cos/tan, rounding may differ by 1 LSB */
+static void testCoeffsAgainstLibm()
+{
+    for (const EcgFilterCoeffs &c : ECG_FILTER_COEFFS)
+    {
+        double fs = c.sampleRate;
+        double w = 2 * M_PI * c.mainsHz / fs;
+        double r = ECG_NOTCH_RADIUS;
+        double gain = (1 - 2 * r * cos(w) + r * r) / (2 - 2 * cos(w));
+        EcgBiquadCoeffs notch = {qRef(gain), qRef(-2 * cos(w) * gain), qRef(gain), qRef(-2 * r * cos(w)), qRef(r * r)};
+        double k = tan(M_PI * ECG_LOWPASS_HZ / fs);
+        double norm = 1 / (1 + k * M_SQRT2 + k * k);
+        EcgBiquadCoeffs lowpass = {qRef(k * k * norm), qRef(2 * k * k * norm), qRef(k * k * norm),
+                                   qRef(2 * (k * k - 1) * norm), qRef((1 - k * M_SQRT2 + k * k) * norm)};
+        CHECK("libm", sameBiquad(c.notch, notch, 1));
+        CHECK("libm", sameBiquad(c.lowpass, lowpass, 1));
+        /* Baseline corner fs / (2 pi 2^k) closest to ECG_BASELINE_HZ */
+        double corner = fs / (2 * M_PI * (double)(1L << c.baselineShift));
+        double lower = fs / (2 * M_PI * (double)(1L << (c.baselineShift + 1)));
+        double upper = fs / (2 * M_PI * (double)(1L << (c.baselineShift - 1)));
+        CHECK("libm", fabs(corner - ECG_BASELINE_HZ) <= fabs(lower - ECG_BASELINE_HZ));
+        CHECK("libm", fabs(corner - ECG_BASELINE_HZ) <= fabs(upper - ECG_BASELINE_HZ));
+        /* Notch and low-pass of EcgFilter have unity gain at DC */
+        CHECK("libm", fabs(dcGain(c.notch) - 1) < 1e-6);
+        CHECK("libm", fabs(dcGain(c.lowpass) - 1) < 1e-6);
+    }
+}
+
+/* Double precision model of EcgFilter with the unquantised design */
+typedef struct
+{
+    double b0, b1, b2, a1, a2;
+    double x1, x2, y1, y2;
+} RefBiquad;
+
+static double refBiquad(RefBiquad &s, double x)
+{
+    double y = s.b0 * x + s.b1 * s.x1 + s.b2 * s.x2 - s.a1 * s.y1 - s.a2 * s.y2;
+    s.x2 = s.x1;
+    s.x1 = x;
+    s.y2 = s.y1;
+    s.y1 = y;
+    return y;
+}
+
+static void refPrime(RefBiquad &s, double v)
+{
+    s.x1 = s.x2 = s.y1 = s.y2 = v;
+}
+
+static double testSignal(uint32_t n, uint16_t rate)
+{
+    /* ECG, mains hum, drifting baseline and noise, stays inside 18 bits */
+    return benchSyntheticEcg(n, rate) + 2000 * sin(2 * M_PI * 50 * n / rate) + 5000 * sin(2 * M_PI * 0.2 * n / rate) +
+           (rand() % 401 - 200);
+}
+
+static void testFilterOutput(uint16_t rate, uint8_t mainsHz, uint8_t stages)
+{
+    char name[40];
+    snprintf(name, sizeof(name), "output_%u_%u_%x", rate, mainsHz, stages);
+    const EcgFilterCoeffs *c = findCoeffs(rate, mainsHz);
+    EcgFilter filter;
+    CHECK(name, filter.configure(rate, mainsHz, stages));
+    if (c == nullptr)
+    {
+        return;
+    }
+    double fs = rate;
+    double w = 2 * M_PI * mainsHz / fs;
+    double r = ECG_NOTCH_RADIUS;
+    double gain = (1 - 2 * r * cos(w) + r * r) / (2 - 2 * cos(w));
+    RefBiquad notch = {gain, -2 * cos(w) * gain, gain, -2 * r * cos(w), r * r, 0, 0, 0, 0};
+    double k = tan(M_PI * ECG_LOWPASS_HZ / fs);
+    double norm = 1 / (1 + k * M_SQRT2 + k * k);
+    RefBiquad lowpass = {k * k * norm, 2 * k * k * norm, k * k * norm, 2 * (k * k - 1) * norm, (1 - k * M_SQRT2 + k * k) * norm, 0, 0, 0, 0};
+    double pole = 1 - 1.0 / (1 << c->baselineShift);
+
+    srand(1);
+    double baseline = 0;
+    double lastX = 0;
+    double last = 0;
+    bool primed = false;
+    double maxError = 0;
+    uint32_t count = FILTER_TEST_SECONDS * rate;
+    for (uint32_t n = 0; n < count; n++)
+    {
+        int32_t x = (int32_t)lround(testSignal(n, rate));
+        /* A FAST recovery burst and a gap in the middle, both handled like EcgFilter */
+        uint8_t flags = 0;
+        if (n >= count / 3 && n < count / 3 + 20)
+        {
+            flags = ECG_FLAG_FAST;
+        }
+        else if (n == 2 * count / 3)
+        {
+            flags = ECG_FLAG_GAP;
+        }
+        int32_t y = filter.processSample(x, flags);
+
+        double v = flags & ECG_FLAG_FAST ? last : x;
+        if (!primed || (flags & ECG_FLAG_GAP))
+        {
+            baseline = 0;
+            lastX = v;
+            double p = (stages & ECG_FILTER_BASELINE) ? 0 : v;
+            refPrime(notch, p);
+            refPrime(lowpass, p);
+            primed = true;
+        }
+        last = v;
+        double ref = v;
+        if (stages & ECG_FILTER_BASELINE)
+        {
+            baseline = pole * (baseline + ref - lastX);
+            lastX = ref;
+            ref = baseline;
+        }
+        if (stages & ECG_FILTER_NOTCH)
+        {
+            ref = refBiquad(notch, ref);
+        }
+        if (stages & ECG_FILTER_LOWPASS)
+        {
+            ref = refBiquad(lowpass, ref);
+        }
+        double err = fabs(y - ref);
+        maxError = err > maxError ? err : maxError;
+    }
+    printf("%s max error %.2f LSB\n", name, maxError);
+    CHECK(name, maxError <= FILTER_TEST_MAX_ERROR);
+}
+
+int main()
+{
+    testGoldenCoeffs();
+    testCoeffsAgainstLibm();
+    const uint16_t rates[] = {128, 256, 512};
+    const uint8_t mains[] = {50, 60};
+    for (uint16_t rate : rates)
+    {
+        for (uint8_t hz : mains)
+        {
+            testFilterOutput(rate, hz, ECG_FILTER_ALL);
+        }
+    }
+    testFilterOutput(512, 50, ECG_FILTER_BASELINE);
+    testFilterOutput(512, 50, ECG_FILTER_NOTCH | ECG_FILTER_LOWPASS);
+    return testResult();
+}
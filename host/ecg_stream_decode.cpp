@@ -0,0 +1,85 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Decode binary ECG stream (see src/ecg_stream.h) captured from UART
+    ecg_stream_decode [capture.bin]   (stdin if no file is given)
+    Prints one sample per line, RR intervals as "RR <sample index> <ms>",
+    software beats as "BEAT <sample index> <ms>",
+    driver counters as "TELEMETRY <first word> <values...>" (see src/max30003_telemetry.h),
+    HRV summaries as "HRV <sample index> window_s beats ectopic hr sdnn rmssd pnn50 lf hf lf/hf"
+*/
+#include <stdio.h>
+#include "ecg_stream.h"
+
+static void onConfig(uint16_t sampleRate, uint8_t samplesPerFrame, void *ctx)
+{
+    fprintf(stderr, "config: %u sps, %u samples/frame\n", sampleRate, samplesPerFrame);
+}
+
+static void onSample(uint32_t sampleIndex, int32_t sample, void *ctx)
+{
+    printf("%ld\n", (long)sample);
+}
+
+static void onRR(uint32_t sampleIndex, uint16_t rrMs, void *ctx)
+{
+    printf("RR %lu %u\n", (unsigned long)sampleIndex, rrMs);
+}
+
+static void onBeat(uint32_t sampleIndex, uint16_t rrMs, void *ctx)
+{
+    printf("BEAT %lu %u\n", (unsigned long)sampleIndex, rrMs);
+}
+
+static void onTelemetry(uint8_t first, const uint32_t *values, int count, void *ctx)
+{
+    printf("TELEMETRY %u", first);
+    for (int i = 0; i < count; i++)
+    {
+        printf(" %lu", (unsigned long)values[i]);
+    }
+    printf("\n");
+}
+
+static void onHrv(uint32_t sampleIndex, const HrvSummary *hrv, void *ctx)
+{
+    printf("HRV %lu %lu %u %u %u.%u %u.%u %u.%u %u.%u %lu %lu %u.%02u\n", (unsigned long)sampleIndex,
+           (unsigned long)(hrv->windowMs / 1000), hrv->beats, hrv->ectopic, hrv->meanHrX10 / 10, hrv->meanHrX10 % 10,
+           hrv->sdnnX10 / 10, hrv->sdnnX10 % 10, hrv->rmssdX10 / 10, hrv->rmssdX10 % 10,
+           hrv->pnn50X10 / 10, hrv->pnn50X10 % 10, (unsigned long)hrv->lfPower, (unsigned long)hrv->hfPower,
+           hrv->lfHfX100 / 100, hrv->lfHfX100 % 100);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    if (argc > 1)
+    {
+        in = fopen(argv[1], "rb");
+        if (in == nullptr)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+    EcgStreamDecoder decoder;
+    decoder.onConfig = onConfig;
+    decoder.onSample = onSample;
+    decoder.onRR = onRR;
+    decoder.onBeat = onBeat;
+    decoder.onTelemetry = onTelemetry;
+    decoder.onHrv = onHrv;
+    uint8_t buff[4096];
+    size_t n;
+    while ((n = fread(buff, 1, sizeof(buff), in)) > 0)
+    {
+        decoder.feed(buff, (int)n);
+    }
+    fprintf(stderr, "frames: %lu crc errors: %lu missing frames: %lu bad compressed blocks: %lu\n",
+            (unsigned long)decoder.frames, (unsigned long)decoder.crcErrors, (unsigned long)decoder.seqGaps,
+            (unsigned long)decoder.blockErrors);
+    return decoder.crcErrors == 0 && decoder.seqGaps == 0 && decoder.blockErrors == 0 ? 0 : 2;
+}
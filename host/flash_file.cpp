@@ -0,0 +1,140 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "flash_file.h"
+#include <string.h>
+
+FlashFile::FlashFile()
+{
+    _file = nullptr;
+    memset(&_backend, 0, sizeof(_backend));
+    memset(_sectorErases, 0, sizeof(_sectorErases));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+FlashFile::~FlashFile()
+{
+    close();
+}
+
+bool FlashFile::open(const char *path, uint32_t size)
+{
+    close();
+    size -= size % FLASH_STORE_SECTOR;
+    if (size > FLASH_STORE_MAX_SECTORS * FLASH_STORE_SECTOR)
+    {
+        size = FLASH_STORE_MAX_SECTORS * FLASH_STORE_SECTOR;
+    }
+    _file = fopen(path, "r+b");
+    if (_file == nullptr)
+    {
+        _file = fopen(path, "w+b");
+    }
+    if (_file == nullptr)
+    {
+        return false;
+    }
+    fseek(_file, 0, SEEK_END);
+    long length = ftell(_file);
+    uint8_t erased[FLASH_STORE_SECTOR];
+    memset(erased, FLASH_STORE_ERASED, sizeof(erased));
+    for (long pos = length - length % FLASH_STORE_SECTOR; pos < (long)size; pos += FLASH_STORE_SECTOR)
+    {
+        fseek(_file, pos, SEEK_SET);
+        fwrite(erased, 1, sizeof(erased), _file);
+    }
+    fflush(_file);
+    _backend.erase = erase;
+    _backend.program = program;
+    _backend.read = read;
+    _backend.ctx = this;
+    _backend.size = size;
+    memset(_sectorErases, 0, sizeof(_sectorErases));
+    memset(&_stats, 0, sizeof(_stats));
+    return true;
+}
+
+void FlashFile::close()
+{
+    if (_file != nullptr)
+    {
+        fclose(_file);
+        _file = nullptr;
+    }
+}
+
+FlashFileStats FlashFile::stats() const
+{
+    FlashFileStats s = _stats;
+    uint32_t sectors = _backend.size / FLASH_STORE_SECTOR;
+    for (uint32_t i = 0; i < sectors; i++)
+    {
+        if (i == 0 || _sectorErases[i] < s.minSectorErases)
+        {
+            s.minSectorErases = _sectorErases[i];
+        }
+        if (_sectorErases[i] > s.maxSectorErases)
+        {
+            s.maxSectorErases = _sectorErases[i];
+        }
+    }
+    return s;
+}
+
+bool FlashFile::erase(uint32_t offset, void *ctx)
+{
+    FlashFile *f = static_cast<FlashFile *>(ctx);
+    if (offset % FLASH_STORE_SECTOR != 0 || offset >= f->_backend.size)
+    {
+        return false;
+    }
+    uint8_t erased[FLASH_STORE_SECTOR];
+    memset(erased, FLASH_STORE_ERASED, sizeof(erased));
+    fseek(f->_file, offset, SEEK_SET);
+    fwrite(erased, 1, sizeof(erased), f->_file);
+    f->_sectorErases[offset / FLASH_STORE_SECTOR]++;
+    f->_stats.erases++;
+    f->_stats.busyUs += FLASH_FILE_ERASE_US;
+    return true;
+}
+
+bool FlashFile::program(uint32_t offset, const uint8_t *data, void *ctx)
+{
+    FlashFile *f = static_cast<FlashFile *>(ctx);
+    if (offset % FLASH_STORE_PAGE != 0 || offset >= f->_backend.size)
+    {
+        return false;
+    }
+    uint8_t page[FLASH_STORE_PAGE];
+    fseek(f->_file, offset, SEEK_SET);
+    if (fread(page, 1, sizeof(page), f->_file) != sizeof(page))
+    {
+        return false;
+    }
+    for (int i = 0; i < FLASH_STORE_PAGE; i++)
+    {
+        if (data[i] & ~page[i])
+        {
+            f->_stats.programErrors++;
+        }
+        page[i] &= data[i];
+    }
+    fseek(f->_file, offset, SEEK_SET);
+    fwrite(page, 1, sizeof(page), f->_file);
+    f->_stats.programs++;
+    f->_stats.busyUs += FLASH_FILE_PROGRAM_US;
+    return true;
+}
+
+void FlashFile::read(uint32_t offset, uint8_t *data, uint32_t len, void *ctx)
+{
+    FlashFile *f = static_cast<FlashFile *>(ctx);
+    fseek(f->_file, offset, SEEK_SET);
+    if (fread(data, 1, len, f->_file) != len)
+    {
+        memset(data, FLASH_STORE_ERASED, len);
+    }
+}
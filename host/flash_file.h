@@ -0,0 +1,56 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  NOR flash image in a file, FlashBackend (src/flash_store.h) for host builds
+
+    Behaves like QSPI flash of the Pico: erase sets a 4K sector to 0xFF,
+    program ANDs a 256 Byte page into the image so bits only go from 1 to 0.
+    Programming a 0 bit back to 1 is counted as error, it would be lost on real flash.
+    Flash busy time is modelled with typical W25Q16JV timings.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "flash_store.h"
+
+/* Typical W25Q16JV sector erase and page program time */
+#define FLASH_FILE_ERASE_US 45000
+#define FLASH_FILE_PROGRAM_US 700
+
+typedef struct
+{
+    uint32_t erases;
+    uint32_t programs;
+    /* Bits a program tried to set from 0 to 1 */
+    uint32_t programErrors;
+    /* Erases of least and most erased sector */
+    uint32_t minSectorErases;
+    uint32_t maxSectorErases;
+    /* Modelled time flash was busy */
+    uint64_t busyUs;
+} FlashFileStats;
+
+class FlashFile
+{
+public:
+    FlashFile();
+    ~FlashFile();
+    /* Open image, a new or short file is extended with erased sectors */
+    bool open(const char *path, uint32_t size);
+    void close();
+    const FlashBackend *backend() const { return &_backend; }
+    FlashFileStats stats() const;
+
+private:
+    static bool erase(uint32_t offset, void *ctx);
+    static bool program(uint32_t offset, const uint8_t *data, void *ctx);
+    static void read(uint32_t offset, uint8_t *data, uint32_t len, void *ctx);
+    FILE *_file;
+    FlashBackend _backend;
+    uint32_t _sectorErases[FLASH_STORE_MAX_SECTORS];
+    FlashFileStats _stats;
+};
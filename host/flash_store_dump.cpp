@@ -0,0 +1,75 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Bulk readout of a flash recording image (see src/flash_store.h)
+    flash_store_dump [-s sample index] image.bin | ecg_stream_decode
+    Writes recording from sample index (default: oldest) as binary ECG stream,
+    same frames the firmware sends for readout command 'D'.
+    Image is a copy of the recording region, e.g. picotool save -r 0x10100000 0x10200000 image.bin
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_file.h"
+
+static void stdoutWrite(const uint8_t *buf, int len, void *ctx)
+{
+    fwrite(buf, 1, len, stdout);
+}
+
+int main(int argc, char **argv)
+{
+    int arg = 1;
+    bool seek = false;
+    uint32_t from = 0;
+    while (arg < argc && argv[arg][0] == '-')
+    {
+        if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+        {
+            seek = true;
+            from = (uint32_t)strtoul(argv[++arg], nullptr, 0);
+        }
+        arg++;
+    }
+    if (arg >= argc)
+    {
+        fprintf(stderr, "usage: flash_store_dump [-s sample index] image.bin\n");
+        return 1;
+    }
+    FILE *probe = fopen(argv[arg], "rb");
+    if (probe == nullptr)
+    {
+        perror(argv[arg]);
+        return 1;
+    }
+    fseek(probe, 0, SEEK_END);
+    long size = ftell(probe);
+    fclose(probe);
+    FlashFile flash;
+    if (!flash.open(argv[arg], (uint32_t)size))
+    {
+        perror(argv[arg]);
+        return 1;
+    }
+    static FlashStore store(flash.backend());
+    if (!store.mount(0))
+    {
+        fprintf(stderr, "image too small\n");
+        return 1;
+    }
+    fprintf(stderr, "recording: %lu sectors, samples %lu..%lu\n", (unsigned long)store.sectorCount(),
+            (unsigned long)store.firstSampleIndex(), (unsigned long)store.nextSampleIndex());
+    EcgStreamEncoder stream(stdoutWrite, nullptr, store.sampleRate(), ECG_STREAM_MAX_SAMPLES);
+    FlashStoreCursor cursor = store.seek(seek ? from : store.firstSampleIndex());
+    uint32_t records = 0;
+    uint32_t n;
+    while ((n = store.readout(&cursor, &stream, 1024)) > 0)
+    {
+        records += n;
+    }
+    fprintf(stderr, "records: %lu, %lu Bytes\n", (unsigned long)records, (unsigned long)stream.bytesWritten());
+    return 0;
+}
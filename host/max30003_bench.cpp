@@ -0,0 +1,1512 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Host benchmarks for MAX30003 processing path
+    max30003_bench [-j] [-e recording.txt] [seconds of ECG at 512 sps, default 600]
+    -j: one JSON object per line {"name": .., "metric": .., "value": ..} for regression tracking
+    -e: recorded ECG for compression results, one sample per line (ecg_stream_decode output)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include "bench_util.h"
+#include "ecg_stream.h"
+#include "ecg_compress.h"
+#include "ecg_decoder.h"
+#include "ecg_filter.h"
+#include "qrs_detector.h"
+#include "hrv_engine.h"
+#include "latency_probe.h"
+#include "max30003_sim.h"
+#include "max30003_manager.h"
+#include "flash_file.h"
+#include "raw_dump.h"
+#include "raw_replay.h"
+#include "output_loopback.h"
+#include "ecg_fanout.h"
+#include "stage_scheduler.h"
+
+#define BENCH_SAMPLE_RATE 512
+#define MAX_DECODE_WORDS 32
+/* Simulated acquisition is limited, virtual time is cheap but not free */
+#define MAX_DRIVER_SECONDS 120
+
+static bool benchJson;
+
+static void benchReport(const char *name, const char *metric, double value)
+{
+    if (benchJson)
+    {
+        printf("{\"name\": \"%s\", \"metric\": \"%s\", \"value\": %.4f}\n", name, metric, value);
+        return;
+    }
+    printf("%-36s %-20s %12.2f\n", name, metric, value);
+}
+
+static std::vector<int32_t> makeSamples(uint32_t count)
+{
+    std::vector<int32_t> samples(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        samples[i] = benchSyntheticEcg(i, BENCH_SAMPLE_RATE);
+    }
+    return samples;
+}
+
+/* Output link: text printf("%ld\n") against binary frames */
+static uint64_t sinkBytes;
+static void countingWrite(const uint8_t *buf, int len, void *ctx)
+{
+    sinkBytes += len;
+}
+
+/* Encoder -> decoder through compressed frames, returns samples that differ */
+static std::vector<uint8_t> streamBytes;
+static void collectWrite(const uint8_t *buf, int len, void *ctx)
+{
+    streamBytes.insert(streamBytes.end(), buf, buf + len);
+}
+
+static void collectSample(uint32_t sampleIndex, int32_t sample, void *ctx)
+{
+    std::vector<int32_t> *out = static_cast<std::vector<int32_t> *>(ctx);
+    if (sampleIndex == out->size())
+    {
+        out->push_back(sample);
+    }
+}
+
+static uint64_t streamRoundTrip(const std::vector<int32_t> &samples)
+{
+    streamBytes.clear();
+    EcgStreamEncoder encoder(collectWrite, nullptr, BENCH_SAMPLE_RATE, ECG_STREAM_MAX_SAMPLES);
+    encoder.setCompression(true);
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        encoder.addSample(samples[i]);
+    }
+    encoder.flush();
+    std::vector<int32_t> decoded;
+    EcgStreamDecoder decoder;
+    decoder.onSample = collectSample;
+    decoder.ctx = &decoded;
+    decoder.feed(streamBytes.data(), (int)streamBytes.size());
+    uint64_t mismatches = samples.size() > decoded.size() ? samples.size() - decoded.size() : 0;
+    for (size_t i = 0; i < decoded.size() && i < samples.size(); i++)
+    {
+        mismatches += decoded[i] != samples[i];
+    }
+    return mismatches;
+}
+
+static void benchOutputFormat(const std::vector<int32_t> &samples)
+{
+    char line[32];
+    uint64_t bytes = 0;
+    /* 1 RR interval per second like the 60 bpm synthetic signal */
+    uint64_t start = benchCycles();
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        bytes += snprintf(line, sizeof(line), "%ld\n", (long)samples[i]);
+        if (i % BENCH_SAMPLE_RATE == 0)
+        {
+            bytes += snprintf(line, sizeof(line), "RR Interval: %ld\n", 1000L);
+        }
+    }
+    uint64_t cycles = benchCycles() - start;
+    double seconds = (double)samples.size() / BENCH_SAMPLE_RATE;
+    benchReport("output_text", "bytes_per_second", bytes / seconds);
+    benchReport("output_text", "cycles_per_sample", (double)cycles / samples.size());
+
+    for (int compress = 0; compress <= 1; compress++)
+    {
+        const char *name = compress ? "output_compressed" : "output_binary";
+        sinkBytes = 0;
+        EcgStreamEncoder encoder(countingWrite, nullptr, BENCH_SAMPLE_RATE, ECG_STREAM_MAX_SAMPLES);
+        encoder.setCompression(compress != 0);
+        start = benchCycles();
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            encoder.addSample(samples[i]);
+            if (i % BENCH_SAMPLE_RATE == 0)
+            {
+                encoder.addRR(1000);
+            }
+        }
+        encoder.flush();
+        cycles = benchCycles() - start;
+        benchReport(name, "bytes_per_second", sinkBytes / seconds);
+        benchReport(name, "cycles_per_sample", (double)cycles / samples.size());
+    }
+    benchReport("output_compressed", "stream_mismatches", (double)streamRoundTrip(samples));
+}
+
+/* Decoder shaped like the old if/else chain in getEcgSamples(), kept as reference */
+static int branchyDecode(const uint8_t *buf, int words, int32_t *samples)
+{
+    int count = 0;
+    for (int i = 0; i < words * 3; i += 3)
+    {
+        int eTag = (buf[i + 2] >> 3) & 0x7;
+        if (eTag == 0 || eTag == 2)
+        {
+            unsigned int data = (buf[i] << 16 | buf[i + 1] << 8 | (buf[i + 2] & 0xc0)) >> 6;
+            if ((data & 0x20000) == 0x20000)
+            {
+                samples[count++] = (int32_t)data - 262144;
+            }
+            else
+            {
+                samples[count++] = (int32_t)data;
+            }
+            if (eTag == 2)
+            {
+                return count;
+            }
+        }
+        else if (eTag == 1)
+        {
+            samples[count++] = 0;
+        }
+        else
+        {
+            return count;
+        }
+    }
+    return count;
+}
+
+/* FIFO decode cost for every block size the EFIT threshold allows */
+static void benchDecoder(const std::vector<int32_t> &samples)
+{
+    const int blocks = 4096;
+    std::vector<uint8_t> fifo(blocks * MAX_DECODE_WORDS * 3);
+    int32_t out[MAX_DECODE_WORDS];
+    uint8_t flags[MAX_DECODE_WORDS];
+    char name[32];
+    for (int words = 1; words <= MAX_DECODE_WORDS; words++)
+    {
+        /* Every block ends with EOF tag, some FAST samples are mixed in */
+        for (int b = 0; b < blocks; b++)
+        {
+            for (int w = 0; w < words; w++)
+            {
+                size_t n = (size_t)b * words + w;
+                uint8_t eTag = (w == words - 1) ? ECG_ETAG_VALID_EOF : (n % 97 == 0 ? ECG_ETAG_FAST : ECG_ETAG_VALID);
+                ecgEncodeFifoWord(samples[n % samples.size()], eTag, &fifo[n * 3]);
+            }
+        }
+        EcgDecodeSummary summary;
+        int64_t check = 0;
+        uint64_t start = benchCycles();
+        for (int b = 0; b < blocks; b++)
+        {
+            check += ecgDecodeFifo(&fifo[(size_t)b * words * 3], words, out, flags, &summary);
+        }
+        uint64_t tableCycles = benchCycles() - start;
+        start = benchCycles();
+        for (int b = 0; b < blocks; b++)
+        {
+            check -= branchyDecode(&fifo[(size_t)b * words * 3], words, out);
+        }
+        uint64_t branchyCycles = benchCycles() - start;
+        if (check != 0)
+        {
+            printf("decoder mismatch for %d words\n", words);
+        }
+        snprintf(name, sizeof(name), "decode_%02d", words);
+        benchReport(name, "cycles_per_sample", (double)tableCycles / ((double)blocks * words));
+        benchReport(name, "branchy_cycles", (double)branchyCycles / ((double)blocks * words));
+    }
+}
+
+/* Peak output / peak input of a sine after filter settled */
+static double filterGain(uint16_t sampleRate, uint8_t stages, double hz)
+{
+    EcgFilter filter;
+    filter.configure(sampleRate, 50, stages);
+    int n = sampleRate * 20;
+    double peak = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int32_t y = filter.processSample((int32_t)(50000 * sin(2 * M_PI * hz * i / sampleRate)), 0);
+        if (i > n / 2 && fabs(y) > peak)
+        {
+            peak = fabs(y);
+        }
+    }
+    return peak / 50000;
+}
+
+/* Filter chain cost per sampling rate and response at a few frequencies */
+static void benchFilter(const std::vector<int32_t> &samples)
+{
+    const uint16_t rates[] = {128, 256, 512};
+    std::vector<int32_t> out(samples.size());
+    char name[32];
+    for (uint16_t rate : rates)
+    {
+        EcgFilter filter;
+        filter.configure(rate, 50, ECG_FILTER_ALL);
+        uint64_t start = benchCycles();
+        for (size_t i = 0; i < samples.size(); i += MAX_DECODE_WORDS)
+        {
+            size_t n = samples.size() - i < MAX_DECODE_WORDS ? samples.size() - i : MAX_DECODE_WORDS;
+            filter.process(&samples[i], &out[i], (int)n, nullptr);
+        }
+        uint64_t cycles = benchCycles() - start;
+        snprintf(name, sizeof(name), "filter_%u", rate);
+        benchReport(name, "cycles_per_sample", (double)cycles / samples.size());
+        benchReport(name, "gain_10hz", filterGain(rate, ECG_FILTER_ALL, 10));
+        benchReport(name, "gain_50hz", filterGain(rate, ECG_FILTER_ALL, 50));
+        benchReport(name, "gain_0.1hz", filterGain(rate, ECG_FILTER_ALL, 0.1));
+    }
+}
+
+static void countBeat(const QrsBeat *beat, void *ctx)
+{
+    (*(uint32_t *)ctx)++;
+}
+
+/*  QRS detector on filtered synthetic ECG with noise and mains hum,
+    hardware RR is simulated ~0.17 s after every R peak
+*/
+static void benchQrs(const std::vector<int32_t> &samples)
+{
+    std::vector<int32_t> filtered(samples.size());
+    EcgFilter filter;
+    filter.configure(BENCH_SAMPLE_RATE, 50, ECG_FILTER_ALL);
+    srand(1);
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        int32_t noise = rand() % 600 - 300 + (int32_t)(400 * sin(2 * M_PI * 50 * i / BENCH_SAMPLE_RATE));
+        filtered[i] = filter.processSample(samples[i] + noise, 0);
+    }
+    QrsDetector qrs;
+    qrs.configure(BENCH_SAMPLE_RATE);
+    uint32_t beats = 0;
+    qrs.setBeatCallBack(countBeat, &beats);
+    double start = benchSeconds();
+    uint64_t cycles = benchCycles();
+    for (size_t i = 0; i < filtered.size(); i += MAX_DECODE_WORDS)
+    {
+        size_t n = filtered.size() - i < MAX_DECODE_WORDS ? filtered.size() - i : MAX_DECODE_WORDS;
+        qrs.process(&filtered[i], nullptr, (int)n, (uint32_t)i);
+        /* RTOR of R peak at phase 0.38 is read with the block containing phase 0.55 */
+        size_t hw = (i / BENCH_SAMPLE_RATE) * BENCH_SAMPLE_RATE + BENCH_SAMPLE_RATE * 55 / 100;
+        if (hw >= i && hw < i + n)
+        {
+            qrs.onHardwareRR(1000, (uint32_t)(i + n));
+        }
+    }
+    cycles = benchCycles() - cycles;
+    double seconds = benchSeconds() - start;
+    const QrsAgreement &a = qrs.agreement();
+    benchReport("qrs", "cycles_per_sample", (double)cycles / filtered.size());
+    benchReport("qrs", "x_realtime", (double)filtered.size() / BENCH_SAMPLE_RATE / seconds);
+    benchReport("qrs", "beats", beats);
+    benchReport("qrs", "expected_beats", (double)filtered.size() / BENCH_SAMPLE_RATE);
+    benchReport("qrs", "hw_rr_matched", a.matched);
+    benchReport("qrs", "hw_rr_agree", a.rrAgree);
+    benchReport("qrs", "hw_missed", a.hwMissed);
+    benchReport("qrs", "sw_missed", a.swMissed);
+}
+
+/*  Synthetic RR series: 800 ms with 0.095 Hz (LF) and 0.27 Hz (HF) modulation,
+    every 97th beat premature at 60% with compensatory pause of 140%.
+    Engine results are compared against a double precision reference over the same
+    5 minute window, with the ectopic beats known.
+*/
+#define HRV_BENCH_LF_MS 30.0
+#define HRV_BENCH_HF_MS 20.0
+
+static void benchHrv()
+{
+    const uint32_t beats = 20000;
+    std::vector<uint16_t> rr(beats);
+    std::vector<bool> ectopic(beats);
+    double t = 0;
+    for (uint32_t i = 0; i < beats; i++)
+    {
+        double v = 800 + HRV_BENCH_LF_MS * sin(2 * M_PI * 0.095 * t / 1000) + HRV_BENCH_HF_MS * sin(2 * M_PI * 0.27 * t / 1000);
+        if (i % 97 == 96)
+        {
+            v *= 0.6;
+            ectopic[i] = true;
+        }
+        else if (i % 97 == 0 && i > 0)
+        {
+            v *= 1.4;
+            ectopic[i] = true;
+        }
+        rr[i] = (uint16_t)lround(v);
+        t += rr[i];
+    }
+
+    HrvEngine hrv;
+    hrv.configure(HRV_WINDOW_MS);
+    uint64_t start = benchCycles();
+    for (uint32_t i = 0; i < beats; i++)
+    {
+        hrv.addRR(rr[i]);
+    }
+    uint64_t addCycles = benchCycles() - start;
+    HrvSummary h;
+    start = benchCycles();
+    hrv.summary(&h);
+    uint64_t summaryCycles = benchCycles() - start;
+
+    /* Reference over the intervals the window holds */
+    uint32_t first = beats - h.beats;
+    double sum = 0, sum2 = 0, diff2 = 0;
+    uint32_t n = 0, diffs = 0, nn50 = 0, refEctopic = 0;
+    for (uint32_t i = first; i < beats; i++)
+    {
+        if (ectopic[i])
+        {
+            refEctopic++;
+            continue;
+        }
+        sum += rr[i];
+        sum2 += (double)rr[i] * rr[i];
+        n++;
+        if (i > first && !ectopic[i - 1])
+        {
+            double d = (double)rr[i] - rr[i - 1];
+            diff2 += d * d;
+            diffs++;
+            nn50 += fabs(d) > HRV_NN50_MS;
+        }
+    }
+    double mean = sum / n;
+    double sdnn = sqrt((sum2 - sum * mean) / (n - 1));
+    double rmssd = sqrt(diff2 / diffs);
+    double pnn50 = 100.0 * nn50 / diffs;
+
+    benchReport("hrv", "cycles_per_beat", (double)addCycles / beats);
+    benchReport("hrv", "cycles_per_summary", (double)summaryCycles);
+    benchReport("hrv", "window_beats", h.beats);
+    benchReport("hrv", "ectopic", h.ectopic);
+    benchReport("hrv", "expected_ectopic", refEctopic);
+    benchReport("hrv", "hr_error_bpm", fabs(h.meanHrX10 / 10.0 - 60000.0 / mean));
+    benchReport("hrv", "sdnn_error_ms", fabs(h.sdnnX10 / 10.0 - sdnn));
+    benchReport("hrv", "rmssd_error_ms", fabs(h.rmssdX10 / 10.0 - rmssd));
+    benchReport("hrv", "pnn50_error_percent", fabs(h.pnn50X10 / 10.0 - pnn50));
+    /* Sine of amplitude A has power A^2 / 2 */
+    benchReport("hrv", "lf_ms2", h.lfPower);
+    benchReport("hrv", "expected_lf_ms2", HRV_BENCH_LF_MS * HRV_BENCH_LF_MS / 2);
+    benchReport("hrv", "hf_ms2", h.hfPower);
+    benchReport("hrv", "expected_hf_ms2", HRV_BENCH_HF_MS * HRV_BENCH_HF_MS / 2);
+    /* One summary per minute against RR frames for every beat at 75 bpm */
+    uint32_t frame = ECG_STREAM_HEADER_LEN + ECG_STREAM_HRV_LEN + 2;
+    benchReport("hrv", "summary_bytes_per_hour", frame * 60.0);
+    benchReport("hrv", "rr_bytes_per_hour", (ECG_STREAM_HEADER_LEN + 6 + 2) * 75.0 * 60);
+}
+
+/* Driver against simulated MAX30003, see host/max30003_sim.h */
+#define DRIVER_CS 17
+#define DRIVER_INTPIN 20
+
+static MAX30003 *benchDriver;
+static LatencyProbe benchProbe;
+static std::vector<uint64_t> irqCycles;
+static uint64_t driverSamples;
+static const char *probePrefix;
+
+static void driverIrq(uint gpio, uint32_t events)
+{
+    uint64_t start = benchCycles();
+    benchDriver->getDataIntrupptCallback();
+    irqCycles.push_back(benchCycles() - start);
+}
+
+static void driverDmaIrq()
+{
+    benchDriver->dmaCompleteCallback();
+}
+
+static void probeWrite(const uint8_t *buf, int len, void *ctx)
+{
+    benchProbe.output();
+}
+
+static void driverSamplesCallBack(const MAX30003SampleBlock *block, void *ctx)
+{
+    EcgStreamEncoder *encoder = (EcgStreamEncoder *)ctx;
+    for (uint16_t i = 0; i < block->count; i++)
+    {
+        encoder->addSample(block->samples[i]);
+    }
+    driverSamples += block->count;
+}
+
+static void probeReport(const char *name, const char *metric, double value)
+{
+    char full[64];
+    snprintf(full, sizeof(full), "%s_%s", probePrefix, name);
+    benchReport(full, metric, value);
+}
+
+static uint64_t percentileOf(std::vector<uint64_t> &v, int pct)
+{
+    if (v.empty())
+    {
+        return 0;
+    }
+    size_t k = (v.size() * pct + 99) / 100;
+    k = k == 0 ? 0 : k - 1;
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+/*  Intruppt to callback / output latency in virtual time (SPI bus time, what
+    the RP2040 can not do faster) and host CPU cost of intruppt path
+*/
+static void benchDriverMode(const char *name, bool dma, bool pipeline, uint32_t seconds)
+{
+    simReset();
+    spi_inst_t bus = {2000000};
+    Max30003Sim device(&bus, DRIVER_CS, DRIVER_INTPIN);
+    MAX30003 driver(DRIVER_CS, &bus, nullptr);
+    MAX30003BlockRing ring;
+    EcgStreamEncoder encoder(probeWrite, nullptr, BENCH_SAMPLE_RATE, ECG_STREAM_MAX_SAMPLES);
+    benchDriver = &driver;
+
+    driver.max30003Configure(BENCH_SAMPLE_RATE);
+
+    driver.setBlockCallBack(driverSamplesCallBack, nullptr, &encoder);
+    if (pipeline)
+    {
+        driver.setPipeline(&ring);
+    }
+    if (dma)
+    {
+        driver.enableDmaAcquisition();
+        simSetDmaIrq(driverDmaIrq);
+    }
+    benchProbe.reset();
+    driver.setLatencyProbe(&benchProbe);
+    irqCycles.clear();
+    driverSamples = 0;
+    simSetGpioIrq(DRIVER_INTPIN, driverIrq);
+    /* INTB may already be low, no falling edge would come for it */
+    driver.getDataIntrupptCallback();
+
+    uint64_t busStart = bus.busyNs;
+    uint64_t startNs = simTimeNs();
+    uint64_t threadCycles = 0;
+    for (uint32_t ms = 0; ms < seconds * 1000; ms++)
+    {
+        simRun(1000);
+        uint64_t start = benchCycles();
+        if (pipeline)
+        {
+            const MAX30003RawBlock *block;
+            while ((block = ring.peek()) != nullptr)
+            {
+                driver.processRawBlock(block);
+                ring.release();
+            }
+        }
+        else if (dma)
+        {
+            while (driver.processDmaBlock())
+                ;
+        }
+        threadCycles += benchCycles() - start;
+    }
+    double runNs = (double)(simTimeNs() - startNs);
+
+    probePrefix = name;
+    benchProbe.report(probeReport);
+    uint64_t irqTotal = 0;
+    for (uint64_t c : irqCycles)
+    {
+        irqTotal += c;
+    }
+    char full[64];
+    snprintf(full, sizeof(full), "%s_host", name);
+    benchReport(full, "irq_p50_cycles", (double)percentileOf(irqCycles, 50));
+    benchReport(full, "irq_p99_cycles", (double)percentileOf(irqCycles, 99));
+    benchReport(full, "irq_max_cycles", (double)percentileOf(irqCycles, 100));
+    benchReport(full, "cycles_per_sample", driverSamples ? (double)(irqTotal + threadCycles) / driverSamples : 0);
+    snprintf(full, sizeof(full), "%s_link", name);
+    benchReport(full, "samples_delivered", (double)driverSamples);
+    benchReport(full, "samples_lost", (double)device.stats().samplesLost);
+    benchReport(full, "spi_busy_percent", 100.0 * (double)(bus.busyNs - busStart) / runNs);
+    /* Time left before FIFO overflows at the worst block seen */
+    uint32_t peak = benchProbe.histogram(LATENCY_FIFO_WORDS).max;
+    benchReport(full, "fifo_headroom_ms", (MAX30003_FIFO_DEPTH - (double)peak) * 1000 / BENCH_SAMPLE_RATE);
+    simSetGpioIrq(DRIVER_INTPIN, nullptr);
+    simSetDmaIrq(nullptr);
+    benchDriver = nullptr;
+}
+
+static void benchDriverPath(uint32_t seconds)
+{
+    if (seconds > MAX_DRIVER_SECONDS)
+    {
+        seconds = MAX_DRIVER_SECONDS;
+    }
+    benchDriverMode("driver_direct", false, false, seconds);
+    benchDriverMode("driver_dma", true, false, seconds);
+    benchDriverMode("driver_pipeline", true, true, seconds);
+}
+
+static std::vector<uint8_t> captureBytes;
+static void collectOutput(const uint8_t *buf, int len, void *ctx)
+{
+    std::vector<uint8_t> *v = (std::vector<uint8_t> *)ctx;
+    v->insert(v->end(), buf, buf + len);
+}
+
+/*  Parity of replay (host/raw_replay.h) with live path: driver in pipeline mode feeds
+    ReplayProcessor directly and every raw block is captured; replaying the capture has to
+    give the same output stream Byte for Byte. stallMs: consumer stops once per second,
+    ring overflows and blocks after it carry the gap flag
+*/
+static void benchReplay(const char *name, uint32_t seconds, uint32_t stallMs)
+{
+    simReset();
+    spi_inst_t bus = {2000000};
+    Max30003Sim device(&bus, DRIVER_CS, DRIVER_INTPIN);
+    MAX30003 driver(DRIVER_CS, &bus, nullptr);
+    MAX30003BlockRing ring;
+    benchDriver = &driver;
+    driver.max30003Configure(BENCH_SAMPLE_RATE);
+
+    ReplayOptions options;
+    replayDefaultOptions(&options);
+    options.hrvSummaryMs = 10000;
+    std::vector<uint8_t> live;
+    ReplayProcessor processor(BENCH_SAMPLE_RATE, &options, collectOutput, &live);
+    driver.setBlockCallBack(ReplayProcessor::samplesCallBack, ReplayProcessor::rrCallBack, &processor);
+    driver.setPipeline(&ring);
+    driver.enableDmaAcquisition();
+    simSetDmaIrq(driverDmaIrq);
+    simSetGpioIrq(DRIVER_INTPIN, driverIrq);
+    driver.getDataIntrupptCallback();
+
+    captureBytes.clear();
+    uint8_t record[RAW_DUMP_MAX_RECORD];
+    collectOutput(record, rawDumpConfig(BENCH_SAMPLE_RATE, record), &captureBytes);
+    for (uint32_t ms = 0; ms < seconds * 1000; ms++)
+    {
+        simRun(1000);
+        if (stallMs > 0 && ms % 1000 < stallMs)
+        {
+            continue;
+        }
+        const MAX30003RawBlock *block;
+        while ((block = ring.peek()) != nullptr)
+        {
+            collectOutput(record, rawDumpBlock(block, record), &captureBytes);
+            driver.processRawBlock(block);
+            ring.release();
+        }
+    }
+    processor.finish();
+    ReplayResult liveResult;
+    processor.getResult(&liveResult);
+    simSetGpioIrq(DRIVER_INTPIN, nullptr);
+    simSetDmaIrq(nullptr);
+    benchDriver = nullptr;
+
+    std::vector<uint8_t> replayed;
+    ReplayResult r;
+    replayRecording(captureBytes.data(), captureBytes.size(), &options, collectOutput, &replayed, &r);
+    uint64_t mismatches = live.size() > replayed.size() ? live.size() - replayed.size() : replayed.size() - live.size();
+    for (size_t i = 0; i < live.size() && i < replayed.size(); i++)
+    {
+        mismatches += live[i] != replayed[i];
+    }
+    benchReport(name, "samples", (double)r.samples);
+    benchReport(name, "gaps", (double)r.gaps);
+    benchReport(name, "live_gaps", (double)liveResult.gaps);
+    benchReport(name, "output_mismatches", (double)mismatches);
+    benchReport(name, "capture_bytes_per_second", (double)captureBytes.size() / seconds);
+    benchReport(name, "samples_per_second", r.processSeconds > 0 ? r.samples / r.processSeconds : 0);
+    benchReport(name, "x_realtime", r.processSeconds > 0 ? r.recordedSeconds / r.processSeconds : 0);
+}
+
+static void benchReplayPath(uint32_t seconds)
+{
+    if (seconds > MAX_DRIVER_SECONDS)
+    {
+        seconds = MAX_DRIVER_SECONDS;
+    }
+    benchReplay("replay", seconds, 0);
+    benchReplay("replay_gaps", seconds, 300);
+}
+
+/*  Output transport: encoder builds frames in DMA buffers, OutputLoopback drains them
+    at UART speed in virtual time. Same frames written blocking stall the output core,
+    stall beyond what the block ring holds loses blocks
+*/
+#define OUTPUT_BENCH_BURST 8
+static EcgStreamDecoder outputDecoder;
+static void outputSink(const uint8_t *buf, int len, void *ctx)
+{
+    outputDecoder.feed(buf, len);
+}
+
+typedef struct
+{
+    uint32_t baud;
+    uint64_t lineFreeUs;
+    uint64_t nowUs;
+    uint64_t stallUs;
+} BlockingLink;
+
+static void blockingWrite(const uint8_t *buf, int len, void *ctx)
+{
+    BlockingLink *l = static_cast<BlockingLink *>(ctx);
+    uint64_t from = l->lineFreeUs > l->nowUs ? l->lineFreeUs : l->nowUs;
+    l->lineFreeUs = from + (uint64_t)len * 10 * 1000000 / l->baud;
+    l->stallUs += l->lineFreeUs - l->nowUs;
+    l->nowUs = l->lineFreeUs;
+}
+
+static void benchOutputTransport(const std::vector<int32_t> &samples, uint32_t baud, bool compress)
+{
+    char name[48];
+    snprintf(name, sizeof(name), "output_dma_%lu%s", (unsigned long)baud, compress ? "_compressed" : "");
+    outputDecoder = EcgStreamDecoder();
+    outputDecoder.onSample = nullptr;
+    OutputLoopback loopback(baud, outputSink, nullptr);
+    OutputTransport transport(loopback.link());
+    loopback.attach(&transport);
+    transport.configure(256, 20000);
+    EcgStreamEncoder encoder(countingWrite, nullptr, BENCH_SAMPLE_RATE, ECG_STREAM_MAX_SAMPLES);
+    encoder.setCompression(compress);
+    encoder.setTransport(&transport);
+    uint64_t cycles = 0;
+    uint32_t maxBacklog = 0;
+    uint64_t nowUs = 0;
+    for (size_t i = 0; i < samples.size(); i += OUTPUT_BENCH_BURST)
+    {
+        nowUs = (uint64_t)i * 1000000 / BENCH_SAMPLE_RATE;
+        loopback.service(nowUs);
+        uint64_t start = benchCycles();
+        for (size_t j = i; j < i + OUTPUT_BENCH_BURST && j < samples.size(); j++)
+        {
+            encoder.addSample(samples[j]);
+        }
+        transport.poll(nowUs);
+        cycles += benchCycles() - start;
+        if (transport.backlogPercent() > maxBacklog)
+        {
+            maxBacklog = transport.backlogPercent();
+        }
+    }
+    encoder.flush();
+    transport.flush();
+    loopback.service(UINT64_MAX);
+    OutputTransportStats s;
+    transport.getStats(&s);
+    double seconds = (double)samples.size() / BENCH_SAMPLE_RATE;
+    benchReport(name, "bytes_per_second", s.bytesSent / seconds);
+    benchReport(name, "line_busy_percent", 100.0 * loopback.busyUs() / (seconds * 1e6));
+    benchReport(name, "producer_cycles_per_sample", (double)cycles / samples.size());
+    benchReport(name, "frames_dropped", encoder.framesDropped());
+    benchReport(name, "decoder_seq_gaps", outputDecoder.seqGaps);
+    benchReport(name, "buffers_high_water", s.highWater);
+    benchReport(name, "max_backlog_percent", maxBacklog);
+
+    /* Same frames through uart_write_blocking() */
+    snprintf(name, sizeof(name), "output_blocking_%lu%s", (unsigned long)baud, compress ? "_compressed" : "");
+    BlockingLink link = {baud, 0, 0, 0};
+    EcgStreamEncoder blocking(blockingWrite, &link, BENCH_SAMPLE_RATE, ECG_STREAM_MAX_SAMPLES);
+    blocking.setCompression(compress);
+    uint64_t maxLagUs = 0;
+    uint64_t blocksLost = 0;
+    uint64_t ringUs = (uint64_t)MAX30003_RING_BLOCKS * OUTPUT_BENCH_BURST * 1000000 / BENCH_SAMPLE_RATE;
+    for (size_t i = 0; i < samples.size(); i += OUTPUT_BENCH_BURST)
+    {
+        uint64_t blockUs = (uint64_t)i * 1000000 / BENCH_SAMPLE_RATE;
+        if (link.nowUs > blockUs + ringUs)
+        {
+            /* Ring full when block arrived, acquisition drops it */
+            blocksLost++;
+            continue;
+        }
+        if (link.nowUs < blockUs)
+        {
+            link.nowUs = blockUs;
+        }
+        maxLagUs = std::max(maxLagUs, link.nowUs - blockUs);
+        for (size_t j = i; j < i + OUTPUT_BENCH_BURST && j < samples.size(); j++)
+        {
+            blocking.addSample(samples[j]);
+        }
+    }
+    benchReport(name, "stall_percent", 100.0 * link.stallUs / (seconds * 1e6));
+    benchReport(name, "max_lag_ms", maxLagUs / 1000.0);
+    benchReport(name, "blocks_lost", (double)blocksLost);
+}
+
+static void benchOutputTransportPath(const std::vector<int32_t> &samples, uint32_t seconds)
+{
+    if (seconds > MAX_DRIVER_SECONDS)
+    {
+        seconds = MAX_DRIVER_SECONDS;
+    }
+    std::vector<int32_t> part(samples.begin(), samples.begin() + std::min(samples.size(), (size_t)seconds * BENCH_SAMPLE_RATE));
+    /* 9600 baud can not carry uncompressed samples, shows drop accounting */
+    benchOutputTransport(part, 9600, false);
+    benchOutputTransport(part, 9600, true);
+    benchOutputTransport(part, 115200, false);
+    benchOutputTransport(part, 921600, false);
+}
+
+/*  Fan-out: anti-alias response of decimated branches and cost as subscribers are added
+    Subscriber mix: full rate recording, 128 Hz displays, beat telemetry, stats
+*/
+static int64_t fanoutSum;
+static double fanoutPeak;
+static void fanoutSink(const EcgFanoutBlock *block, void *ctx)
+{
+    for (uint16_t i = 0; i < block->count; i++)
+    {
+        fanoutSum += block->samples[i];
+    }
+    fanoutSum += block->rrMs + (block->stats != nullptr ? block->stats->mean : 0);
+}
+
+static void fanoutPeakSink(const EcgFanoutBlock *block, void *ctx)
+{
+    /* Skip start up transient of FIR */
+    for (uint16_t i = 0; i < block->count; i++)
+    {
+        if (block->firstIndex + i > (uint32_t)block->rate && fabs(block->samples[i]) > fanoutPeak)
+        {
+            fanoutPeak = fabs(block->samples[i]);
+        }
+    }
+}
+
+static void fanoutPublish(EcgFanout *fanout, const std::vector<int32_t> &samples)
+{
+    uint8_t flags[OUTPUT_BENCH_BURST] = {0};
+    for (size_t i = 0; i + OUTPUT_BENCH_BURST <= samples.size(); i += OUTPUT_BENCH_BURST)
+    {
+        MAX30003SampleBlock block = {&samples[i], flags, OUTPUT_BENCH_BURST, (uint32_t)i, 0, (uint32_t)(i / OUTPUT_BENCH_BURST)};
+        fanout->publish(&block);
+        if (i % BENCH_SAMPLE_RATE == 0)
+        {
+            fanout->publishRR(1000, (uint32_t)i);
+        }
+    }
+}
+
+static double fanoutGain(uint16_t rate, double hz)
+{
+    EcgFanout fanout;
+    fanout.configure(BENCH_SAMPLE_RATE, 50, 0);
+    fanout.subscribe(ECG_FANOUT_RAW, rate, fanoutPeakSink, nullptr);
+    std::vector<int32_t> tone(BENCH_SAMPLE_RATE * 10);
+    for (size_t i = 0; i < tone.size(); i++)
+    {
+        tone[i] = (int32_t)(50000 * sin(2 * M_PI * hz * i / BENCH_SAMPLE_RATE));
+    }
+    fanoutPeak = 0;
+    fanoutPublish(&fanout, tone);
+    return fanoutPeak / 50000;
+}
+
+static void benchFanout(const std::vector<int32_t> &samples)
+{
+    static const uint16_t rates[] = {256, 128, 64, 32};
+    for (uint16_t rate : rates)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "fanout_aa_%u", rate);
+        benchReport(name, "gain_10hz", fanoutGain(rate, 10));
+        benchReport(name, "gain_passband_edge", fanoutGain(rate, rate * 0.3));
+        /* Would alias to 0.25 x rate, inside ECG band of output */
+        benchReport(name, "gain_alias", fanoutGain(rate, rate * 0.75));
+        benchReport(name, "gain_alias_far", fanoutGain(rate, rate * 1.25));
+    }
+
+    static const struct
+    {
+        EcgFanoutStream stream;
+        uint16_t rate;
+    } mix[] = {
+        {ECG_FANOUT_RAW, 512},
+        {ECG_FANOUT_FILTERED, 128},
+        {ECG_FANOUT_RR, 0},
+        {ECG_FANOUT_STATS, 1},
+        {ECG_FANOUT_FILTERED, 128},
+        {ECG_FANOUT_FILTERED, 64},
+        {ECG_FANOUT_RAW, 256},
+        {ECG_FANOUT_FILTERED, 512},
+    };
+    const int n = sizeof(mix) / sizeof(mix[0]);
+    int ids[n];
+    for (int k = 1; k <= n; k++)
+    {
+        EcgFanout fanout;
+        fanout.configure(BENCH_SAMPLE_RATE, 50, ECG_FILTER_ALL);
+        for (int i = 0; i < k; i++)
+        {
+            ids[i] = fanout.subscribe(mix[i].stream, mix[i].rate, fanoutSink, nullptr);
+        }
+        uint64_t start = benchCycles();
+        fanoutPublish(&fanout, samples);
+        uint64_t cycles = benchCycles() - start;
+        EcgFanoutUsage u;
+        fanout.getUsage(&u);
+        char name[32];
+        snprintf(name, sizeof(name), "fanout_%d_subscribers", k);
+        benchReport(name, "cycles_per_sample", (double)cycles / samples.size());
+        benchReport(name, "branches", u.branches);
+        benchReport(name, "macs_per_second", u.macsPerSecond);
+        benchReport(name, "memory_bytes", u.memoryBytes);
+        if (k != n)
+        {
+            continue;
+        }
+        static const char *streamNames[] = {"raw", "filtered", "rr", "stats"};
+        for (int i = 0; i < n; i++)
+        {
+            EcgFanoutSubscriberInfo info;
+            if (!fanout.getSubscriberInfo(ids[i], &info))
+            {
+                continue;
+            }
+            snprintf(name, sizeof(name), "fanout_sub%d_%s_%u", i, streamNames[info.stream], info.rate);
+            benchReport(name, "shared_with", info.sharedWith);
+            benchReport(name, "macs_per_second", info.macsPerSecond);
+            benchReport(name, "memory_bytes", info.memoryBytes);
+            benchReport(name, "blocks", info.blocks);
+            benchReport(name, "samples", info.samples);
+        }
+    }
+}
+
+/*  Scheduler on simulated clock: acquisition pushes a block every 15.6 ms into a ring of
+    MAX30003_RING_BLOCKS, stages cost fixed virtual time. Between 10 s and 20 s the report
+    stage takes longer than the ring holds. Without shedding every report run loses blocks,
+    with shedding only the first run and one retry after every restore do.
+    Output stage has the firmware period (OUTPUT_MAX_DELAY_US / 4). Idle core sleeps like
+    runScheduler(): until next block, or until the alarm at nextReleaseUs() if alarm is set.
+    Without alarm output is only released when a block wakes the core
+*/
+#define SCHED_BENCH_BLOCK_US (1000000 * OUTPUT_BENCH_BURST / BENCH_SAMPLE_RATE)
+#define SCHED_BENCH_OUTPUT_US (20000 / 4)
+typedef struct
+{
+    uint64_t nowUs;
+    uint64_t nextBlockUs;
+    uint32_t ring;
+    /* Arrival time of oldest block in ring */
+    uint64_t ringTimeUs[MAX30003_RING_BLOCKS];
+    uint32_t ringTail;
+    uint64_t lost;
+    uint64_t blocks;
+} SchedSim;
+static SchedSim schedSim;
+
+static uint64_t schedClock(void *ctx)
+{
+    return schedSim.nowUs;
+}
+
+/* Move simulated time, acquisition intruppts keep filling the ring meanwhile */
+static void schedAdvance(uint64_t us)
+{
+    schedSim.nowUs += us;
+    while (schedSim.nextBlockUs <= schedSim.nowUs)
+    {
+        schedSim.blocks++;
+        if (schedSim.ring < MAX30003_RING_BLOCKS)
+        {
+            schedSim.ringTimeUs[(schedSim.ringTail + schedSim.ring) % MAX30003_RING_BLOCKS] = schedSim.nextBlockUs;
+            schedSim.ring++;
+        }
+        else
+            schedSim.lost++;
+        schedSim.nextBlockUs += SCHED_BENCH_BLOCK_US;
+    }
+}
+
+static bool schedDecodeReady(void *ctx, uint64_t *releaseUs)
+{
+    if (schedSim.ring == 0)
+    {
+        return false;
+    }
+    *releaseUs = schedSim.ringTimeUs[schedSim.ringTail];
+    return true;
+}
+
+static void schedDecode(void *ctx)
+{
+    schedSim.ringTail = (schedSim.ringTail + 1) % MAX30003_RING_BLOCKS;
+    schedSim.ring--;
+    schedAdvance(2000);
+}
+
+static void schedCost(void *ctx)
+{
+    schedAdvance((uint64_t)(uintptr_t)ctx);
+}
+
+static void schedReport(void *ctx)
+{
+    bool overload = schedSim.nowUs >= 10000000 && schedSim.nowUs < 20000000;
+    schedAdvance(overload ? 150000 : 15000);
+}
+
+static void benchScheduler(bool shedding, bool alarm)
+{
+    memset(&schedSim, 0, sizeof(schedSim));
+    schedSim.nextBlockUs = SCHED_BENCH_BLOCK_US;
+    StageScheduler scheduler(schedClock, nullptr);
+    scheduler.configureShedding(shedding ? 50 : 0xFF, 2000000);
+    const StageConfig stages[] = {
+        {"decode", schedDecode, schedDecodeReady, nullptr, STAGE_DATA, 0, SCHED_BENCH_BLOCK_US, 0, false},
+        {"output", schedCost, nullptr, (void *)(uintptr_t)500, STAGE_PERIODIC, SCHED_BENCH_OUTPUT_US, SCHED_BENCH_OUTPUT_US, 1, false},
+        {"telemetry", schedCost, nullptr, (void *)(uintptr_t)5000, STAGE_PERIODIC, 1000000, 100000, 2, shedding},
+        {"report", schedReport, nullptr, nullptr, STAGE_PERIODIC, 100000, 100000, 3, shedding},
+        {"hrv", schedCost, nullptr, (void *)(uintptr_t)40000, STAGE_PERIODIC, 5000000, 1000000, 3, shedding},
+    };
+    int ids[5];
+    for (int i = 0; i < 5; i++)
+    {
+        ids[i] = scheduler.addStage(&stages[i]);
+    }
+    const uint64_t endUs = 40000000;
+    while (schedSim.nowUs < endUs)
+    {
+        scheduler.setBacklog((uint8_t)(schedSim.ring * 100 / MAX30003_RING_BLOCKS));
+        if (!scheduler.runOnce())
+        {
+            /* Idle until next block intruppt, or alarm at next periodic release */
+            uint64_t wake = alarm ? std::min(schedSim.nextBlockUs, scheduler.nextReleaseUs()) : schedSim.nextBlockUs;
+            schedAdvance(wake > schedSim.nowUs ? wake - schedSim.nowUs : 1);
+        }
+    }
+    const char *prefix = !alarm ? "sched_noalarm" : shedding ? "sched_shed" : "sched_noshed";
+    char name[40];
+    snprintf(name, sizeof(name), "%s", prefix);
+    benchReport(name, "blocks", (double)schedSim.blocks);
+    benchReport(name, "blocks_lost", (double)schedSim.lost);
+    benchReport(name, "shed_steps", scheduler.shedSteps());
+    for (int i = 0; i < 5; i++)
+    {
+        StageStats st;
+        scheduler.getStageStats(ids[i], &st);
+        snprintf(name, sizeof(name), "%s_%s", prefix, scheduler.stageName(ids[i]));
+        benchReport(name, "runs", st.runs);
+        benchReport(name, "misses", st.misses);
+        benchReport(name, "shed", st.shed);
+        benchReport(name, "wcet_us", st.wcetUs);
+        benchReport(name, "max_latency_us", st.maxLatencyUs);
+    }
+}
+
+/* Synthetic ECG with input noise of a few LSB and 50Hz mains, closer to a real recording */
+static std::vector<int32_t> makeNoisySamples(const std::vector<int32_t> &clean)
+{
+    std::vector<int32_t> samples(clean.size());
+    uint32_t lcg = 12345;
+    for (size_t i = 0; i < clean.size(); i++)
+    {
+        lcg = lcg * 1664525 + 1013904223;
+        int32_t noise = (int32_t)(lcg >> 27) - 16;
+        int32_t mains = (int32_t)(60 * sin(2 * M_PI * 50 * (double)i / BENCH_SAMPLE_RATE));
+        samples[i] = clean[i] + noise + mains;
+    }
+    return samples;
+}
+
+/* Samples of ecg_stream_decode output, RR/BEAT/TELEMETRY lines are skipped */
+static std::vector<int32_t> loadRecording(const char *path)
+{
+    std::vector<int32_t> samples;
+    FILE *in = fopen(path, "r");
+    if (in == nullptr)
+    {
+        perror(path);
+        return samples;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), in) != nullptr)
+    {
+        char *end;
+        long v = strtol(line, &end, 10);
+        if (end != line && (*end == '\n' || *end == '\0' || *end == '\r'))
+        {
+            /* Keep 18 bit range of MAX30003 */
+            samples.push_back((int32_t)(v << 14) >> 14);
+        }
+    }
+    fclose(in);
+    return samples;
+}
+
+/* Compression ratio against 18 bit packed samples, encode/decode cost and bit exact round trip */
+static void benchCompression(const char *source, const std::vector<int32_t> &samples)
+{
+    char name[64];
+    for (int blockLen = 8; blockLen <= ECG_COMPRESS_MAX_SAMPLES; blockLen *= 4)
+    {
+        size_t blocks = samples.size() / blockLen;
+        if (blocks == 0)
+        {
+            continue;
+        }
+        std::vector<uint8_t> packed(blocks * ECG_COMPRESS_MAX_BYTES);
+        std::vector<int> lens(blocks);
+        uint64_t bytes = 0;
+        uint64_t worst = 0;
+        uint64_t start = benchCycles();
+        for (size_t b = 0; b < blocks; b++)
+        {
+            uint64_t t = benchCycles();
+            lens[b] = ecgCompressBlock(&samples[b * blockLen], blockLen, &packed[b * ECG_COMPRESS_MAX_BYTES]);
+            t = benchCycles() - t;
+            worst = t > worst ? t : worst;
+            bytes += lens[b];
+        }
+        uint64_t encodeCycles = benchCycles() - start;
+
+        int32_t out[ECG_COMPRESS_MAX_SAMPLES];
+        uint64_t mismatches = 0;
+        start = benchCycles();
+        for (size_t b = 0; b < blocks; b++)
+        {
+            int n = ecgDecompressBlock(&packed[b * ECG_COMPRESS_MAX_BYTES], lens[b], out, ECG_COMPRESS_MAX_SAMPLES);
+            if (n != blockLen || memcmp(out, &samples[b * blockLen], sizeof(int32_t) * blockLen) != 0)
+            {
+                mismatches++;
+            }
+        }
+        uint64_t decodeCycles = benchCycles() - start;
+        double count = (double)blocks * blockLen;
+        snprintf(name, sizeof(name), "compress_%s_%02d", source, blockLen);
+        benchReport(name, "ratio", count * 18 / 8 / (double)bytes);
+        benchReport(name, "bits_per_sample", (double)bytes * 8 / count);
+        benchReport(name, "cycles_per_sample", (double)encodeCycles / count);
+        benchReport(name, "worst_block_cycles", (double)worst);
+        benchReport(name, "decode_cycles_per_sample", (double)decodeCycles / count);
+        benchReport(name, "roundtrip_mismatches", (double)mismatches);
+    }
+}
+
+/*  Holter recording into a file backed flash image, region is smaller than
+    recording so ring wraps and oldest sectors are reused
+*/
+#define FLASH_BENCH_SECTORS 64
+/* Readout over stdio UART at 115200 baud */
+#define FLASH_BENCH_UART_BPS 11520
+static uint64_t readoutBytes;
+static void readoutWrite(const uint8_t *buf, int len, void *ctx)
+{
+    readoutBytes += len;
+}
+
+static void benchFlashStore(const std::vector<int32_t> &samples)
+{
+    const char *name = "flash_store";
+    char path[] = "/tmp/max30003_flash_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        return;
+    }
+    close(fd);
+    FlashFile flash;
+    flash.open(path, FLASH_BENCH_SECTORS * FLASH_STORE_SECTOR);
+    static FlashStore store(flash.backend());
+    store.mount(BENCH_SAMPLE_RATE);
+    /* service() once per FIFO block of 8 samples, like output context of firmware */
+    uint64_t worst = 0;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        store.addSample(samples[i]);
+        if (i % BENCH_SAMPLE_RATE == BENCH_SAMPLE_RATE - 1)
+        {
+            store.addRR(1000);
+        }
+        if (i % 8 == 7)
+        {
+            uint64_t t = benchCycles();
+            store.service();
+            t = benchCycles() - t;
+            worst = t > worst ? t : worst;
+        }
+    }
+    store.flush();
+    double seconds = (double)samples.size() / BENCH_SAMPLE_RATE;
+    FlashFileStats f = flash.stats();
+    const FlashStoreStats &st = store.stats();
+    benchReport(name, "flash_bytes_per_s", (double)f.programs * FLASH_STORE_PAGE / seconds);
+    benchReport(name, "hours_per_mb", 1024.0 * 1024 / ((double)f.programs * FLASH_STORE_PAGE / seconds) / 3600);
+    benchReport(name, "flash_busy_percent", (double)f.busyUs / (seconds * 1e6) * 100);
+    benchReport(name, "dropped_records", st.dropped);
+    benchReport(name, "program_errors", f.programErrors);
+    benchReport(name, "sector_erases_min", f.minSectorErases);
+    benchReport(name, "sector_erases_max", f.maxSectorErases);
+    benchReport(name, "worst_service_cycles", (double)worst);
+
+    /* Read back from a fresh mount, what power cycle would see */
+    static FlashStore reader(flash.backend());
+    reader.mount(0);
+    uint32_t first = reader.firstSampleIndex();
+    benchReport(name, "remount_index_ok", reader.nextSampleIndex() == samples.size() ? 1 : 0);
+    FlashStoreCursor cursor = reader.seek(first);
+    uint8_t payload[255];
+    uint8_t len;
+    uint8_t type;
+    int32_t block[ECG_COMPRESS_MAX_SAMPLES];
+    uint64_t mismatches = 0;
+    uint64_t checked = 0;
+    while ((type = reader.next(&cursor, payload, &len)) != 0)
+    {
+        if (type != FLASH_RECORD_SAMPLES)
+        {
+            continue;
+        }
+        uint32_t index = (uint32_t)payload[0] | ((uint32_t)payload[1] << 8) | ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24);
+        int n = ecgDecompressBlock(&payload[4], len - 4, block, ECG_COMPRESS_MAX_SAMPLES);
+        if (n <= 0 || index + n > samples.size() || memcmp(block, &samples[index], sizeof(int32_t) * n) != 0)
+        {
+            mismatches++;
+            continue;
+        }
+        checked += n;
+    }
+    benchReport(name, "retained_seconds", (double)checked / BENCH_SAMPLE_RATE);
+    benchReport(name, "roundtrip_mismatches", (double)mismatches);
+
+    /* Seek to random sample index of retained window */
+    const int seeks = 10000;
+    uint64_t start = benchCycles();
+    uint32_t misses = 0;
+    for (int i = 0; i < seeks; i++)
+    {
+        uint32_t target = first + (uint32_t)(((uint64_t)i * 2654435761u) % (samples.size() - first));
+        cursor = reader.seek(target);
+        bool found = false;
+        while (!found && (type = reader.next(&cursor, payload, &len)) != 0)
+        {
+            uint32_t index = (uint32_t)payload[0] | ((uint32_t)payload[1] << 8) | ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24);
+            found = type == FLASH_RECORD_SAMPLES && index + (payload[4] & 0x3F) > target;
+        }
+        misses += found ? 0 : 1;
+    }
+    benchReport(name, "seek_cycles", (double)(benchCycles() - start) / seeks);
+    benchReport(name, "seek_misses", misses);
+
+    EcgStreamEncoder stream(readoutWrite, nullptr, BENCH_SAMPLE_RATE, ECG_STREAM_MAX_SAMPLES);
+    readoutBytes = 0;
+    cursor = reader.seek(first);
+    start = benchCycles();
+    while (reader.readout(&cursor, &stream, 256) > 0)
+    {
+    }
+    uint64_t readoutCycles = benchCycles() - start;
+    benchReport(name, "readout_cycles_per_sample", (double)readoutCycles / checked);
+    benchReport(name, "readout_x_realtime_uart", (double)checked / BENCH_SAMPLE_RATE / ((double)readoutBytes / FLASH_BENCH_UART_BPS));
+    flash.close();
+    unlink(path);
+}
+
+/*  Flash lockout: flash_safe_execute() holds core 0 and its intruppts while flash is busy,
+    modelled by moving simulated time without dispatching intruppts, FIFO keeps filling.
+    aligned: service() only within FLASH_LOCKOUT_ALIGN_US after a FIFO read (firmware
+    flashRecordTick()), otherwise every 10 ms like a free running periodic stage
+*/
+#define FLASH_LOCKOUT_SECTORS 4
+#define FLASH_LOCKOUT_ALIGN_US 2000
+static const FlashBackend *lockoutInner;
+
+static bool lockoutErase(uint32_t offset, void *ctx)
+{
+    bool ok = lockoutInner->erase(offset, lockoutInner->ctx);
+    simAdvanceNs((uint64_t)FLASH_FILE_ERASE_US * 1000);
+    return ok;
+}
+
+static bool lockoutProgram(uint32_t offset, const uint8_t *data, void *ctx)
+{
+    bool ok = lockoutInner->program(offset, data, lockoutInner->ctx);
+    simAdvanceNs((uint64_t)FLASH_FILE_PROGRAM_US * 1000);
+    return ok;
+}
+
+static void lockoutRead(uint32_t offset, uint8_t *data, uint32_t len, void *ctx)
+{
+    lockoutInner->read(offset, data, len, lockoutInner->ctx);
+}
+
+static void lockoutSamplesCallBack(const MAX30003SampleBlock *block, void *ctx)
+{
+    FlashStore *store = (FlashStore *)ctx;
+    for (uint16_t i = 0; i < block->count; i++)
+    {
+        store->addSample(block->samples[i]);
+    }
+}
+
+static void benchFlashLockout(const char *name, bool aligned, MAX30003CoalesceMode mode, uint32_t seconds)
+{
+    char path[] = "/tmp/max30003_flash_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        return;
+    }
+    close(fd);
+    FlashFile flash;
+    flash.open(path, FLASH_LOCKOUT_SECTORS * FLASH_STORE_SECTOR);
+    lockoutInner = flash.backend();
+    FlashBackend backend = *lockoutInner;
+    backend.erase = lockoutErase;
+    backend.program = lockoutProgram;
+    backend.read = lockoutRead;
+    /* Big sector buffer, off the stack */
+    FlashStore *store = new FlashStore(&backend);
+    store->mount(BENCH_SAMPLE_RATE);
+
+    simReset();
+    spi_inst_t bus = {2000000};
+    Max30003Sim device(&bus, DRIVER_CS, DRIVER_INTPIN);
+    MAX30003 driver(DRIVER_CS, &bus, nullptr);
+    MAX30003BlockRing ring;
+    benchDriver = &driver;
+    driver.setCoalescing(mode);
+    driver.max30003Configure(BENCH_SAMPLE_RATE);
+    driver.setBlockCallBack(lockoutSamplesCallBack, nullptr, store);
+    driver.setPipeline(&ring);
+    driver.enableDmaAcquisition();
+    simSetDmaIrq(driverDmaIrq);
+    simSetGpioIrq(DRIVER_INTPIN, driverIrq);
+    driver.getDataIntrupptCallback();
+
+    uint32_t servedReadUs = driver.lastFifoReadUs();
+    uint64_t nextServiceUs = 0;
+    const uint64_t endNs = simTimeNs() + (uint64_t)seconds * 1000000000ull;
+    while (simTimeNs() < endNs)
+    {
+        simRun(250);
+        const MAX30003RawBlock *block;
+        while ((block = ring.peek()) != nullptr)
+        {
+            driver.processRawBlock(block);
+            ring.release();
+        }
+        uint64_t nowUs = simTimeNs() / 1000;
+        if (aligned)
+        {
+            uint32_t readUs = driver.lastFifoReadUs();
+            if (readUs != servedReadUs && (uint32_t)nowUs - readUs < FLASH_LOCKOUT_ALIGN_US)
+            {
+                servedReadUs = readUs;
+                store->service();
+            }
+        }
+        else if (nowUs >= nextServiceUs)
+        {
+            nextServiceUs = nowUs + 10000;
+            store->service();
+        }
+    }
+
+    MAX30003Telemetry t;
+    driver.getTelemetry(&t);
+    const FlashStoreStats &st = store->stats();
+    benchReport(name, "erases", st.erases);
+    benchReport(name, "erase_max_us", st.eraseMaxUs);
+    benchReport(name, "fifo_headroom_us", (MAX30003_FIFO_DEPTH - 1) * 1e6 / BENCH_SAMPLE_RATE - (aligned ? FLASH_LOCKOUT_ALIGN_US : 0));
+    benchReport(name, "fifo_overflows", t.overflows);
+    benchReport(name, "samples_lost", (double)device.stats().samplesLost);
+    benchReport(name, "records_dropped", st.dropped);
+    simSetGpioIrq(DRIVER_INTPIN, nullptr);
+    simSetDmaIrq(nullptr);
+    benchDriver = nullptr;
+    delete store;
+    flash.close();
+    unlink(path);
+}
+
+static void benchFlashLockoutPath(uint32_t seconds)
+{
+    if (seconds > MAX_DRIVER_SECONDS)
+    {
+        seconds = MAX_DRIVER_SECONDS;
+    }
+    benchFlashLockout("flash_lockout_periodic_record", false, COALESCE_RECORD, seconds);
+    benchFlashLockout("flash_lockout_aligned_live", true, COALESCE_LIVE, seconds);
+}
+
+/* Several devices behind MAX30003Manager */
+static uint64_t multiSamples;
+static uint32_t multiSequenceGaps;
+static uint32_t multiNextSequence[MAX30003_MAX_DEVICES];
+
+static void multiBlockCallBack(const MAX30003DeviceBlock *block, void *ctx)
+{
+    /* Sequence is given when FIFO is read, a jump is reads lost before decoding */
+    if (block->sequence != multiNextSequence[block->device])
+    {
+        multiSequenceGaps += block->sequence - multiNextSequence[block->device];
+    }
+    multiNextSequence[block->device] = block->sequence + 1;
+    multiSamples += block->block->count;
+}
+
+/*  devices spread over buses SPI buses (1: all share one bus), DMA or direct acquisition
+    Throughput is what reaches the merged callback in virtual time
+    stallMs: thread context does not decode for that long once per second, DMA buffers fill up
+*/
+static void benchMultiDevice(int devices, int buses, bool dma, uint32_t seconds, uint32_t stallMs = 0)
+{
+    simReset();
+    spi_inst_t bus[2] = {{2000000}, {2000000}};
+    Max30003Sim *sim[MAX30003_MAX_DEVICES];
+    MAX30003 *driver[MAX30003_MAX_DEVICES];
+    MAX30003Manager manager;
+    for (int i = 0; i < devices; i++)
+    {
+        spi_inst_t *spi = &bus[i % buses];
+        sim[i] = new Max30003Sim(spi, 2 + i, 20 + i);
+        sim[i]->setHeartRate((uint16_t)(60 + 5 * i));
+        driver[i] = new MAX30003(2 + i, spi, nullptr);
+        manager.addDevice(driver[i], 20 + i);
+        simSetGpioIrq(20 + i, MAX30003Manager::gpioIntruppt);
+    }
+    manager.setBlockCallBack(multiBlockCallBack, nullptr, nullptr);
+    manager.makeActive();
+    manager.configureAll(BENCH_SAMPLE_RATE);
+    if (dma && !manager.enableDmaAll())
+    {
+        fprintf(stderr, "multi: out of DMA channels\n");
+    }
+    simSetDmaIrq(MAX30003Manager::dmaIntruppt);
+    multiSamples = 0;
+    multiSequenceGaps = 0;
+    memset(multiNextSequence, 0, sizeof(multiNextSequence));
+    manager.kick();
+
+    uint64_t busStart[2] = {bus[0].busyNs, bus[1].busyNs};
+    uint64_t startNs = simTimeNs();
+    uint64_t cycles = 0;
+    for (uint32_t ms = 0; ms < seconds * 1000; ms++)
+    {
+        uint64_t start = benchCycles();
+        simRun(1000);
+        if (ms % 1000 >= stallMs)
+        {
+            manager.process();
+        }
+        cycles += benchCycles() - start;
+    }
+    double runNs = (double)(simTimeNs() - startNs);
+
+    uint64_t lost = 0;
+    uint64_t dropped = 0;
+    for (int i = 0; i < devices; i++)
+    {
+        lost += sim[i]->stats().samplesLost;
+        MAX30003Telemetry t;
+        driver[i]->getTelemetry(&t);
+        dropped += t.dmaDropped;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "multi_%s_%dbus_%ddev%s", dma ? "dma" : "direct", buses, devices, stallMs ? "_stall" : "");
+    benchReport(name, "samples_per_second", multiSamples * 1e9 / runNs);
+    benchReport(name, "samples_lost", (double)lost);
+    benchReport(name, "sequence_gaps", multiSequenceGaps);
+    benchReport(name, "dma_dropped", (double)dropped);
+    benchReport(name, "bus_waits", manager.busWaits());
+    benchReport(name, "host_cycles_per_sample", multiSamples ? (double)cycles / multiSamples : 0);
+    for (int b = 0; b < buses; b++)
+    {
+        char metric[32];
+        snprintf(metric, sizeof(metric), "spi%d_busy_percent", b);
+        benchReport(name, metric, 100.0 * (double)(bus[b].busyNs - busStart[b]) / runNs);
+    }
+    simSetDmaIrq(nullptr);
+    for (int i = 0; i < devices; i++)
+    {
+        simSetGpioIrq(20 + i, nullptr);
+        delete driver[i];
+        delete sim[i];
+    }
+}
+
+static void benchMultiDevicePath(uint32_t seconds)
+{
+    if (seconds > MAX_DRIVER_SECONDS)
+    {
+        seconds = MAX_DRIVER_SECONDS;
+    }
+    static const int counts[] = {1, 2, 4, 6};
+    for (int buses = 1; buses <= 2; buses++)
+    {
+        for (int n : counts)
+        {
+            benchMultiDevice(n, buses, false, seconds);
+            /* 2 DMA channels per device, RP2040 has 12 */
+            benchMultiDevice(n, buses, true, seconds);
+        }
+    }
+    benchMultiDevice(8, 2, false, seconds);
+    /* Decoding stalls 100 ms every second, reads lost in DMA show up as sequence gaps */
+    benchMultiDevice(2, 1, true, seconds, 100);
+}
+
+int main(int argc, char **argv)
+{
+    int arg = 1;
+    const char *recording = nullptr;
+    while (arg < argc && argv[arg][0] == '-')
+    {
+        if (strcmp(argv[arg], "-j") == 0)
+        {
+            benchJson = true;
+        }
+        else if (strcmp(argv[arg], "-e") == 0 && arg + 1 < argc)
+        {
+            recording = argv[++arg];
+        }
+        arg++;
+    }
+    uint32_t seconds = arg < argc ? (uint32_t)atoi(argv[arg]) : 600;
+    /* Init sequence prints register values, keep them out of results */
+    simSetLog(stderr);
+    std::vector<int32_t> samples = makeSamples(seconds * BENCH_SAMPLE_RATE);
+    benchOutputFormat(samples);
+    benchDecoder(samples);
+    benchFilter(samples);
+    benchQrs(samples);
+    benchHrv();
+    benchCompression("synthetic", samples);
+    benchCompression("noisy", makeNoisySamples(samples));
+    if (recording != nullptr)
+    {
+        benchCompression("recorded", loadRecording(recording));
+    }
+    benchFlashStore(samples);
+    benchFlashLockoutPath(seconds);
+    benchDriverPath(seconds);
+    benchReplayPath(seconds);
+    benchOutputTransportPath(samples, seconds);
+    benchFanout(samples);
+    benchScheduler(false, true);
+    benchScheduler(true, true);
+    benchScheduler(true, false);
+    benchMultiDevicePath(seconds);
+    return 0;
+}
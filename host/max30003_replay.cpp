@@ -0,0 +1,191 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Replay raw FIFO / RTOR captures (src/raw_dump.h) through firmware decode and processing
+    max30003_replay [-j threads] [-o dir] [-n 50|60] [-f none|all] [-u] [-q] [-h ms] [-H] capture.raw...
+    -j: recordings are spread over threads (default: number of CPUs)
+    -o: write binary ECG stream of every recording to dir/<name>.ecg (ecg_stream_decode reads it)
+    -n: mains frequency of notch filter, -f none: samples are not filtered
+    -u: uncompressed sample frames, -q: no QRS detector, -h: HRV summary every ms of recording,
+    -H: only HRV summaries in output (MAX30003_HRV_ONLY)
+    Prints one line per recording: samples, beats, time to process, samples per second and
+    digest of the output stream; same capture and options always give the same digest.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "raw_replay.h"
+
+typedef struct
+{
+    const char *path;
+    bool ok;
+    ReplayResult result;
+} ReplayJob;
+
+static ReplayOptions options;
+static const char *outputDir;
+static std::vector<ReplayJob> jobs;
+static std::atomic<size_t> nextJob;
+
+static void fileWrite(const uint8_t *buf, int len, void *ctx)
+{
+    fwrite(buf, 1, len, (FILE *)ctx);
+}
+
+static bool replayFile(ReplayJob *job)
+{
+    int fd = open(job->path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    FILE *out = nullptr;
+    if (outputDir != nullptr)
+    {
+        const char *name = strrchr(job->path, '/');
+        std::string path = std::string(outputDir) + "/" + (name != nullptr ? name + 1 : job->path) + ".ecg";
+        out = fopen(path.c_str(), "wb");
+    }
+    bool ok = replayRecording((const uint8_t *)map, (uint64_t)st.st_size, &options,
+                              out != nullptr ? fileWrite : nullptr, out, &job->result);
+    if (out != nullptr)
+    {
+        fclose(out);
+    }
+    munmap(map, (size_t)st.st_size);
+    return ok;
+}
+
+static void worker()
+{
+    size_t i;
+    while ((i = nextJob.fetch_add(1)) < jobs.size())
+    {
+        jobs[i].ok = replayFile(&jobs[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    replayDefaultOptions(&options);
+    int threads = (int)std::thread::hardware_concurrency();
+    int opt;
+    while ((opt = getopt(argc, argv, "j:o:n:f:uqh:H")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'o':
+            outputDir = optarg;
+            break;
+        case 'n':
+            options.mainsHz = (uint8_t)atoi(optarg);
+            break;
+        case 'f':
+            options.filterStages = strcmp(optarg, "none") == 0 ? 0 : ECG_FILTER_ALL;
+            break;
+        case 'u':
+            options.compress = false;
+            break;
+        case 'q':
+            options.qrs = false;
+            break;
+        case 'h':
+            options.hrvSummaryMs = (uint32_t)atoi(optarg);
+            break;
+        case 'H':
+            options.hrvOnly = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-j threads] [-o dir] [-n 50|60] [-f none|all] [-u] [-q] [-h ms] [-H] capture.raw...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-j threads] [-o dir] [-n 50|60] [-f none|all] [-u] [-q] [-h ms] [-H] capture.raw...\n", argv[0]);
+        return 1;
+    }
+    for (int i = optind; i < argc; i++)
+    {
+        ReplayJob job;
+        memset(&job, 0, sizeof(job));
+        job.path = argv[i];
+        jobs.push_back(job);
+    }
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    if ((size_t)threads > jobs.size())
+    {
+        threads = (int)jobs.size();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int i = 0; i < threads; i++)
+    {
+        pool.emplace_back(worker);
+    }
+    for (std::thread &t : pool)
+    {
+        t.join();
+    }
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t samples = 0;
+    double recorded = 0;
+    int failed = 0;
+    for (const ReplayJob &job : jobs)
+    {
+        const ReplayResult &r = job.result;
+        if (!job.ok)
+        {
+            fprintf(stderr, "%s: no blocks (crc errors %lu)\n", job.path, (unsigned long)r.crcErrors);
+            failed++;
+            continue;
+        }
+        printf("%s: %u sps %lu samples (%.0f s) fast %lu gaps %lu rr %lu beats %lu crc errors %lu, "
+               "%.3f s, %.0f samples/s, %.0fx real time, %lu Bytes digest %016llx\n",
+               job.path, r.sampleRate, (unsigned long)r.samples, r.recordedSeconds, (unsigned long)r.fastSamples,
+               (unsigned long)r.gaps, (unsigned long)r.rrIntervals, (unsigned long)r.beats, (unsigned long)r.crcErrors,
+               r.processSeconds, r.processSeconds > 0 ? r.samples / r.processSeconds : 0,
+               r.processSeconds > 0 ? r.recordedSeconds / r.processSeconds : 0, (unsigned long)r.outputBytes,
+               (unsigned long long)r.digest);
+        samples += r.samples;
+        recorded += r.recordedSeconds;
+    }
+    printf("total: %lu recordings on %d threads, %lu samples (%.1f h) in %.3f s, %.0f samples/s\n",
+           (unsigned long)jobs.size(), threads, (unsigned long)samples, recorded / 3600, wallSeconds,
+           wallSeconds > 0 ? samples / wallSeconds : 0);
+    return failed == 0 ? 0 : 2;
+}
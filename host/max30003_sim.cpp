@@ -0,0 +1,713 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "max30003_sim.h"
+#include <math.h>
+#include <stdarg.h>
+
+#define SIM_DEFAULT_BAUDRATE 2000000
+#define SIM_NEVER UINT64_MAX
+
+/* STATUS bits */
+#define ST_EINT (1u << 23)
+#define ST_EOVF (1u << 22)
+#define ST_FSTINT (1u << 21)
+#define ST_RRINT (1u << 10)
+#define ST_SAMP (1u << 9)
+
+#define ETAG_SHIFT 3
+
+static struct
+{
+    uint64_t nowNs;
+    Max30003Sim *devices[SIM_MAX_DEVICES];
+    int deviceCount;
+    void (*gpioIrq[SIM_MAX_PINS])(uint, uint32_t);
+    /* INTB was low at last dispatch, zero is idle (high) */
+    bool intbLow[SIM_MAX_PINS];
+    void (*dmaIrq)();
+    bool dmaClaimed[SIM_DMA_CHANNELS];
+    bool dmaPending[SIM_DMA_CHANNELS];
+    bool dmaIrqStatus[SIM_DMA_CHANNELS];
+    uint64_t dmaDoneNs[SIM_DMA_CHANNELS];
+    spi_inst_t *dmaBus[SIM_DMA_CHANNELS];
+} sim;
+/* Not simulation state, survives simReset() */
+static FILE *simLog = stdout;
+
+/*------------------------------------------simulator core------------------------------------------*/
+
+void simReset()
+{
+    sim = {};
+}
+
+uint64_t simTimeNs()
+{
+    return sim.nowNs;
+}
+
+void simAdvanceNs(uint64_t ns)
+{
+    uint64_t target = sim.nowNs + ns;
+    for (int i = 0; i < sim.deviceCount; i++)
+    {
+        sim.devices[i]->advanceTo(target);
+    }
+    sim.nowNs = target;
+}
+
+static void simDispatch()
+{
+    for (int ch = 0; ch < SIM_DMA_CHANNELS; ch++)
+    {
+        if (sim.dmaPending[ch] && sim.dmaDoneNs[ch] <= sim.nowNs)
+        {
+            sim.dmaPending[ch] = false;
+            sim.dmaIrqStatus[ch] = true;
+            if (sim.dmaIrq != nullptr)
+            {
+                sim.dmaIrq();
+            }
+        }
+    }
+    for (int i = 0; i < sim.deviceCount; i++)
+    {
+        Max30003Sim *dev = sim.devices[i];
+        uint pin = dev->intPin();
+        if (pin >= SIM_MAX_PINS)
+        {
+            continue;
+        }
+        bool low = !dev->intb();
+        if (!sim.intbLow[pin] && low)
+        {
+            dev->noteIntbEdge();
+            if (sim.gpioIrq[pin] != nullptr)
+            {
+                sim.gpioIrq[pin](pin, 0x4);
+                low = !dev->intb();
+            }
+        }
+        sim.intbLow[pin] = low;
+    }
+}
+
+void simRun(uint64_t us)
+{
+    uint64_t end = sim.nowNs + us * 1000;
+    while (true)
+    {
+        uint64_t next = end;
+        for (int i = 0; i < sim.deviceCount; i++)
+        {
+            uint64_t t = sim.devices[i]->nextEventNs();
+            if (t < next)
+                next = t;
+        }
+        for (int ch = 0; ch < SIM_DMA_CHANNELS; ch++)
+        {
+            if (sim.dmaPending[ch] && sim.dmaDoneNs[ch] < next)
+                next = sim.dmaDoneNs[ch];
+        }
+        if (next < sim.nowNs)
+            next = sim.nowNs;
+        simAdvanceNs(next - sim.nowNs);
+        simDispatch();
+        if (sim.nowNs >= end)
+            break;
+    }
+}
+
+void simSetGpioIrq(uint pin, void (*handler)(uint gpio, uint32_t events))
+{
+    if (pin < SIM_MAX_PINS)
+    {
+        sim.gpioIrq[pin] = handler;
+    }
+}
+
+void simSetDmaIrq(void (*handler)())
+{
+    sim.dmaIrq = handler;
+}
+
+/* Heart beat shaped like the one used by host benchmarks, R peak at 38% of the beat */
+int32_t max30003SimEcg(uint32_t n, uint32_t sampleRate, uint32_t bpm)
+{
+    double t = (double)n / sampleRate;
+    double beat = t * bpm / 60.0;
+    double phase = beat - floor(beat);
+    double v = 0;
+    v += 1500 * exp(-pow((phase - 0.20) / 0.025, 2));
+    v -= 1200 * exp(-pow((phase - 0.36) / 0.008, 2));
+    v += 12000 * exp(-pow((phase - 0.38) / 0.010, 2));
+    v -= 2500 * exp(-pow((phase - 0.40) / 0.008, 2));
+    v += 3000 * exp(-pow((phase - 0.62) / 0.040, 2));
+    v += 800 * sin(2 * M_PI * 0.3 * t);
+    return (int32_t)v;
+}
+
+/*------------------------------------------HAL for host build------------------------------------------*/
+
+static uint64_t byteNs(spi_inst_t *spi)
+{
+    uint32_t baud = spi->baudrate != 0 ? spi->baudrate : SIM_DEFAULT_BAUDRATE;
+    return 8000000000ull / baud;
+}
+
+static Max30003Sim *selectedDevice(spi_inst_t *spi)
+{
+    for (int i = 0; i < sim.deviceCount; i++)
+    {
+        if (sim.devices[i]->bus() == spi && sim.devices[i]->selected())
+        {
+            return sim.devices[i];
+        }
+    }
+    return nullptr;
+}
+
+static bool dmaOwnsBus(spi_inst_t *spi)
+{
+    for (int ch = 0; ch < SIM_DMA_CHANNELS; ch++)
+    {
+        if (sim.dmaPending[ch] && sim.dmaBus[ch] == spi)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void spiTransfer(spi_inst_t *spi, const uint8_t *tx, uint8_t *rx, size_t len, bool advanceTime)
+{
+    if (advanceTime && dmaOwnsBus(spi))
+    {
+        spi->collisions++;
+    }
+    Max30003Sim *dev = selectedDevice(spi);
+    uint64_t bt = byteNs(spi);
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t miso = dev != nullptr ? dev->transfer(tx != nullptr ? tx[i] : 0) : 0xFF;
+        if (rx != nullptr)
+        {
+            rx[i] = miso;
+        }
+        if (advanceTime)
+        {
+            simAdvanceNs(bt);
+        }
+    }
+    spi->bytes += len;
+    spi->busyNs += bt * len;
+}
+
+void halGpioPut(uint pin, bool value)
+{
+    for (int i = 0; i < sim.deviceCount; i++)
+    {
+        Max30003Sim *dev = sim.devices[i];
+        if (dev->csPin() != pin)
+        {
+            continue;
+        }
+        if (dmaOwnsBus(dev->bus()))
+        {
+            dev->bus()->collisions++;
+        }
+        if (!value && !dev->selected())
+        {
+            dev->bus()->transactions++;
+            dev->select();
+            simAdvanceNs(dev->bus()->latencyNs);
+        }
+        else if (value && dev->selected())
+        {
+            dev->deselect();
+        }
+    }
+}
+
+/* INTB level of device on this pin, other pins read high */
+bool halGpioGet(uint pin)
+{
+    for (int i = 0; i < sim.deviceCount; i++)
+    {
+        if (sim.devices[i]->intPin() == pin)
+        {
+            return sim.devices[i]->intb();
+        }
+    }
+    return true;
+}
+
+void halSpiWrite(spi_inst_t *spi, const uint8_t *buf, size_t len)
+{
+    spiTransfer(spi, buf, nullptr, len, true);
+}
+
+void halSpiRead(spi_inst_t *spi, uint8_t *buf, size_t len)
+{
+    spiTransfer(spi, nullptr, buf, len, true);
+}
+
+void simSetLog(FILE *out)
+{
+    simLog = out;
+}
+
+void halLog(const char *format, ...)
+{
+    if (simLog == nullptr)
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    vfprintf(simLog, format, args);
+    va_end(args);
+}
+
+/* Devices keep sampling during sleep, intruppts are not dispatched */
+void halSleepMs(uint32_t ms)
+{
+    simAdvanceNs((uint64_t)ms * 1000000);
+}
+
+uint64_t halTimeUs()
+{
+    return sim.nowNs / 1000;
+}
+
+uint32_t halTimeUs32()
+{
+    return (uint32_t)(sim.nowNs / 1000);
+}
+
+void halCycleCounterInit()
+{
+}
+
+/* Virtual time counted as 125MHz clk_sys cycles, only bus time is visible here */
+uint32_t halCycles()
+{
+    return (uint32_t)(sim.nowNs / 8) & 0xFFFFFF;
+}
+
+void halNotify()
+{
+}
+
+/* Intruppts are only dispatched by simRun(), nothing can preempt the caller */
+uint32_t halIrqSave()
+{
+    return 0;
+}
+
+void halIrqRestore(uint32_t state)
+{
+}
+
+bool halDmaInit(spi_inst_t *spi, int *txChannel, int *rxChannel)
+{
+    int found[2];
+    int n = 0;
+    for (int ch = 0; ch < SIM_DMA_CHANNELS && n < 2; ch++)
+    {
+        if (!sim.dmaClaimed[ch])
+        {
+            found[n++] = ch;
+        }
+    }
+    if (n < 2)
+    {
+        return false;
+    }
+    sim.dmaClaimed[found[0]] = true;
+    sim.dmaClaimed[found[1]] = true;
+    *txChannel = found[0];
+    *rxChannel = found[1];
+    return true;
+}
+
+/* Bytes are exchanged at once, completion intruppt comes after bus time of the transfer */
+void halDmaStart(spi_inst_t *spi, int txChannel, int rxChannel, const uint8_t *txBuf, uint8_t *rxBuf, uint len)
+{
+    spiTransfer(spi, txBuf, rxBuf, len, false);
+    sim.dmaPending[rxChannel] = true;
+    sim.dmaBus[rxChannel] = spi;
+    sim.dmaDoneNs[rxChannel] = sim.nowNs + byteNs(spi) * len;
+}
+
+bool halDmaAcknowledge(int rxChannel)
+{
+    if (!sim.dmaIrqStatus[rxChannel])
+    {
+        return false;
+    }
+    sim.dmaIrqStatus[rxChannel] = false;
+    return true;
+}
+
+/*------------------------------------------MAX30003 model------------------------------------------*/
+
+Max30003Sim::Max30003Sim(spi_inst_t *bus, uint csPin, uint intPin)
+{
+    _bus = bus;
+    _csPin = csPin;
+    _intPin = intPin;
+    _source = nullptr;
+    _sourceCtx = nullptr;
+    _bpm = 60;
+    _selected = false;
+    _byte = 0;
+    _nowNs = sim.nowNs;
+    _stats = Max30003SimStats();
+    softwareReset();
+    if (sim.deviceCount < SIM_MAX_DEVICES)
+    {
+        sim.devices[sim.deviceCount++] = this;
+    }
+}
+
+Max30003Sim::~Max30003Sim()
+{
+    for (int i = 0; i < sim.deviceCount; i++)
+    {
+        if (sim.devices[i] == this)
+        {
+            sim.devices[i] = sim.devices[--sim.deviceCount];
+            break;
+        }
+    }
+}
+
+void Max30003Sim::setSource(int32_t (*source)(uint32_t n, uint32_t sampleRate, void *ctx), void *ctx)
+{
+    _source = source;
+    _sourceCtx = ctx;
+}
+
+void Max30003Sim::setHeartRate(uint16_t bpm)
+{
+    _bpm = bpm;
+}
+
+void Max30003Sim::injectFastRecovery(uint32_t samples)
+{
+    _fastRemaining = samples;
+}
+
+/* Power on defaults of the registers the driver touches */
+void Max30003Sim::softwareReset()
+{
+    for (int i = 0; i < 128; i++)
+    {
+        _reg[i] = 0;
+    }
+    _reg[INFO] = 0x510000;
+    _reg[EN_INT] = 0x000003;
+    _reg[EN_INT2] = 0x000003;
+    _reg[MNGR_INT] = 0x780004;
+    _reg[CNFG_GEN] = 0x080004;
+    _reg[CNFG_ECG] = 0x805000;
+    _reg[CNFG_RTOR1] = 0x3F2300;
+    _reg[CNFG_RTOR2] = 0x202400;
+    _fastRemaining = 0;
+    _fastActive = false;
+    _rrint = false;
+    _haveBeat = false;
+    _lastBeatN = 0;
+    synch();
+}
+
+void Max30003Sim::fifoReset()
+{
+    _fifoHead = 0;
+    _fifoCount = 0;
+    _overflow = false;
+}
+
+/* Restart sampling with rate from CNFG_ECG, first sample one period later */
+void Max30003Sim::synch()
+{
+    fifoReset();
+    static const uint16_t rates[4] = {512, 256, 128, 128};
+    _rate = rates[(_reg[CNFG_ECG] >> 22) & 0x3];
+    _running = (_reg[CNFG_GEN] & (1u << 19)) != 0;
+    _syncNs = _nowNs;
+    _n = 0;
+    _sampCount = 0;
+    _samp = false;
+    _sampClearNs = 0;
+}
+
+uint64_t Max30003Sim::sampleTimeNs(uint64_t n) const
+{
+    return _syncNs + n * 1000000000ull / _rate;
+}
+
+uint32_t Max30003Sim::status() const
+{
+    uint32_t st = 0;
+    int threshold = (int)((_reg[MNGR_INT] >> 19) & 0x1F) + 1;
+    if (_fifoCount >= threshold || _overflow)
+        st |= ST_EINT;
+    if (_overflow)
+        st |= ST_EOVF;
+    if (_fastActive)
+        st |= ST_FSTINT;
+    if (_rrint)
+        st |= ST_RRINT;
+    if (_samp)
+        st |= ST_SAMP;
+    return st;
+}
+
+bool Max30003Sim::intb() const
+{
+    return (status() & _reg[EN_INT] & 0xFFFFFC) == 0;
+}
+
+uint64_t Max30003Sim::nextEventNs() const
+{
+    uint64_t next = _running ? sampleTimeNs(_n + 1) : SIM_NEVER;
+    if (_samp && _sampClearNs != 0 && _sampClearNs < next)
+    {
+        next = _sampClearNs;
+    }
+    return next;
+}
+
+void Max30003Sim::advanceTo(uint64_t ns)
+{
+    while (true)
+    {
+        uint64_t tSample = _running ? sampleTimeNs(_n + 1) : SIM_NEVER;
+        uint64_t tClear = (_samp && _sampClearNs != 0) ? _sampClearNs : SIM_NEVER;
+        uint64_t t = tSample < tClear ? tSample : tClear;
+        if (t > ns)
+        {
+            break;
+        }
+        _nowNs = t;
+        if (t == tClear)
+        {
+            _samp = false;
+            _sampClearNs = 0;
+        }
+        if (t == tSample)
+        {
+            _n++;
+            generateSample();
+        }
+    }
+    _nowNs = ns;
+}
+
+void Max30003Sim::generateSample()
+{
+    uint32_t idx = (uint32_t)(_n - 1);
+    int32_t v = _source != nullptr ? _source(idx, _rate, _sourceCtx) : max30003SimEcg(idx, _rate, _bpm);
+    bool fast = _fastRemaining > 0;
+    if (fast)
+        _fastRemaining--;
+    _fastActive = fast;
+    _stats.samplesGenerated++;
+
+    /* ETAG is completed when word is read, only FAST bit is stored */
+    uint32_t word = (((uint32_t)v & 0x3FFFF) << 6) | ((fast ? 1u : 0u) << ETAG_SHIFT);
+    if (_overflow || _fifoCount == MAX30003_FIFO_DEPTH)
+    {
+        if (!_overflow)
+        {
+            _overflow = true;
+            _stats.overflows++;
+        }
+        _stats.samplesLost++;
+    }
+    else
+    {
+        _fifo[(_fifoHead + _fifoCount) % MAX30003_FIFO_DEPTH] = word;
+        _fifoCount++;
+    }
+
+    /* SAMP every 1, 2, 4 or 16 samples, self clear after a quarter sample period if CLR_SAMP */
+    static const uint8_t sampIt[4] = {1, 2, 4, 16};
+    if (++_sampCount >= sampIt[_reg[MNGR_INT] & 0x3])
+    {
+        _sampCount = 0;
+        _samp = true;
+        _sampClearNs = (_reg[MNGR_INT] & 0x4) ? _nowNs + 250000000ull / _rate : 0;
+    }
+
+    /* RTOR reports a beat half a beat after its start, R peak is at 38% */
+    uint64_t beat = ((uint64_t)idx * _bpm * 2 + (uint64_t)_rate * 60) / ((uint64_t)_rate * 120);
+    if (idx > 0 && beat != ((uint64_t)(idx - 1) * _bpm * 2 + (uint64_t)_rate * 60) / ((uint64_t)_rate * 120))
+    {
+        /* RTOR block only runs with EN_RTOR (CNFG_RTOR1 D[15]) */
+        if (_haveBeat && (_reg[CNFG_RTOR1] & (1u << 15)))
+        {
+            /* RTOR counts in 7.8125ms steps, value is D[23:10] */
+            uint32_t rtor = (uint32_t)((idx - _lastBeatN) * 128 / _rate);
+            _reg[RTOR] = (rtor & 0x3FFF) << 10;
+            _rrint = true;
+            _stats.beats++;
+        }
+        _haveBeat = true;
+        _lastBeatN = idx;
+    }
+}
+
+void Max30003Sim::select()
+{
+    _selected = true;
+    _byte = 0;
+}
+
+void Max30003Sim::deselect()
+{
+    _selected = false;
+}
+
+uint8_t Max30003Sim::transfer(uint8_t mosi)
+{
+    uint8_t miso = 0;
+    if (_byte == 0)
+    {
+        _addr = mosi >> 1;
+        _read = (mosi & RREG) != 0;
+        _wdata = 0;
+        if (_read)
+        {
+            _word = readWord(_addr, true);
+        }
+    }
+    else if (_read)
+    {
+        int k = (_byte - 1) % 3;
+        if (k == 0 && _byte > 1)
+        {
+            _word = readWord(_addr, false);
+        }
+        miso = (uint8_t)(_word >> (16 - 8 * k));
+    }
+    else if (_byte <= 3)
+    {
+        /* Write executes on 32nd SCLK edge */
+        _wdata = (_wdata << 8) | mosi;
+        if (_byte == 3)
+        {
+            writeRegister(_addr, _wdata);
+        }
+    }
+    _byte++;
+    return miso;
+}
+
+/* first: first word of this transaction, later words only exist for ECG_FIFO_BURST */
+uint32_t Max30003Sim::readWord(uint8_t addr, bool first)
+{
+    switch (addr)
+    {
+    case STATUS:
+    {
+        if (!first)
+            return 0;
+        uint32_t st = status();
+        if ((_reg[MNGR_INT] & 0x4) == 0)
+            _samp = false;
+        if (((_reg[MNGR_INT] >> 4) & 0x3) == 0)
+            _rrint = false;
+        return st;
+    }
+    case RTOR:
+        if (!first)
+            return 0;
+        if (((_reg[MNGR_INT] >> 4) & 0x3) == 1)
+            _rrint = false;
+        return _reg[RTOR];
+
+    case ECG_FIFO:
+        if (!first)
+            return 0;
+        /* fall through */
+    case ECG_FIFO_BURST:
+    {
+        if (_overflow)
+        {
+            _stats.overflowReads++;
+            return (uint32_t)ECG_ETAG_OVERFLOW << ETAG_SHIFT;
+        }
+        if (_fifoCount == 0)
+        {
+            _stats.emptyReads++;
+            return (uint32_t)ECG_ETAG_EMPTY << ETAG_SHIFT;
+        }
+        uint32_t w = _fifo[_fifoHead];
+        _fifoHead = (_fifoHead + 1) % MAX30003_FIFO_DEPTH;
+        _fifoCount--;
+        _stats.fifoWordsRead++;
+        if (_fifoCount == 0)
+        {
+            /* Valid -> valid EOF, FAST -> FAST EOF */
+            w |= (uint32_t)ECG_ETAG_VALID_EOF << ETAG_SHIFT;
+        }
+        return w;
+    }
+
+    default:
+        return first ? _reg[addr & 0x7F] : 0;
+    }
+}
+
+void Max30003Sim::writeRegister(uint8_t addr, uint32_t value)
+{
+    switch (addr)
+    {
+    case SW_RST:
+        if (value == 0)
+            softwareReset();
+        break;
+
+    case SYNCH:
+        if (value == 0)
+            synch();
+        break;
+
+    case FIFO_RST:
+        fifoReset();
+        break;
+
+    case STATUS:
+    case INFO:
+    case RTOR:
+    case ECG_FIFO:
+    case ECG_FIFO_BURST:
+        /* Read only */
+        break;
+
+    case CNFG_GEN:
+    {
+        bool wasRunning = (_reg[CNFG_GEN] & (1u << 19)) != 0;
+        _reg[CNFG_GEN] = value;
+        bool running = (value & (1u << 19)) != 0;
+        if (running && !wasRunning)
+        {
+            _syncNs = _nowNs;
+            _n = 0;
+        }
+        _running = running;
+        break;
+    }
+
+    default:
+        _reg[addr & 0x7F] = value & 0xFFFFFF;
+        break;
+    }
+}
@@ -0,0 +1,161 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Register level MAX30003 simulator, implements max30003_hal.h for host builds
+
+    Time is virtual and deterministic: it only moves in simRun(), halSleepMs()
+    and by the SPI bus time of every transferred Byte.
+
+    Modelled:
+    - register file, SW_RST, SYNCH, FIFO_RST, INFO
+    - 32 word ECG FIFO, ETAG valid / EOF / FAST / FAST EOF / empty / overflow
+    - sampling rate from CNFG_ECG RATE (latched at SYNCH), EN_ECG of CNFG_GEN
+    - STATUS EINT (EFIT threshold), EOVF, FSTINT, RRINT, SAMP (SAMP_IT, CLR_SAMP)
+      and their clear behaviour from MNGR_INT
+    - RTOR register updated for every beat of the synthetic source when EN_RTOR is set
+    - INTB level (active low) from STATUS & EN_INT, falling edge intruppts
+    - ECG_FIFO returns one word per transaction, ECG_FIFO_BURST streams words
+    Not modelled: lead-off, calibration, MUX, PLL, clock frequencies other than 32768Hz
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "max30003_hal.h"
+#include "max30003.h"
+
+#define SIM_MAX_PINS 32
+#define SIM_MAX_DEVICES 8
+#define SIM_DMA_CHANNELS 12
+
+/* spi_inst_t of host build: simulated SPI bus */
+struct spi_inst
+{
+    uint32_t baudrate;
+    /* Bytes clocked and CS low periods on this bus */
+    uint64_t bytes;
+    uint64_t transactions;
+    /* Time bus was busy */
+    uint64_t busyNs;
+    /*  Extra time of every transaction from CS low to first clock, models a slow
+        or shared bus; DMA completion comes that much later too
+    */
+    uint64_t latencyNs;
+    /* Blocking transfers or CS changes while a DMA burst owned the bus, must stay 0 */
+    uint64_t collisions;
+};
+
+typedef struct
+{
+    uint64_t samplesGenerated;
+    /* Samples dropped because FIFO was full or in overflow state */
+    uint64_t samplesLost;
+    uint32_t overflows;
+    uint64_t fifoWordsRead;
+    uint64_t emptyReads;
+    uint64_t overflowReads;
+    uint32_t beats;
+    uint32_t intbEdges;
+} Max30003SimStats;
+
+class Max30003Sim
+{
+public:
+    Max30003Sim(spi_inst_t *bus, uint csPin, uint intPin);
+    ~Max30003Sim();
+
+    /* Sample source, default is max30003SimEcg() at configured heart rate */
+    void setSource(int32_t (*source)(uint32_t n, uint32_t sampleRate, void *ctx), void *ctx);
+    void setHeartRate(uint16_t bpm);
+    /* Next samples are tagged as FAST recovery */
+    void injectFastRecovery(uint32_t samples);
+
+    uint32_t reg(uint8_t addr) const { return _reg[addr & 0x7F]; }
+    int fifoCount() const { return _fifoCount; }
+    uint16_t sampleRate() const { return _rate; }
+    /* INTB pin level, false when intruppt is asserted */
+    bool intb() const;
+    uint32_t status() const;
+    const Max30003SimStats &stats() const { return _stats; }
+
+    /* Used by simulator core */
+    spi_inst_t *bus() const { return _bus; }
+    uint csPin() const { return _csPin; }
+    uint intPin() const { return _intPin; }
+    bool selected() const { return _selected; }
+    void select();
+    void deselect();
+    uint8_t transfer(uint8_t mosi);
+    void advanceTo(uint64_t ns);
+    uint64_t nextEventNs() const;
+    void noteIntbEdge() { _stats.intbEdges++; }
+
+private:
+    void softwareReset();
+    void synch();
+    void fifoReset();
+    void writeRegister(uint8_t addr, uint32_t value);
+    uint32_t readWord(uint8_t addr, bool first);
+    void generateSample();
+    uint64_t sampleTimeNs(uint64_t n) const;
+
+    spi_inst_t *_bus;
+    uint _csPin;
+    uint _intPin;
+    uint32_t _reg[128];
+
+    /* SPI transaction state */
+    bool _selected;
+    int _byte;
+    uint8_t _addr;
+    bool _read;
+    uint32_t _word;
+    uint32_t _wdata;
+
+    /* FIFO, words are D[23:0] as read over SPI */
+    uint32_t _fifo[MAX30003_FIFO_DEPTH];
+    int _fifoHead;
+    int _fifoCount;
+    bool _overflow;
+    uint32_t _fastRemaining;
+    bool _fastActive;
+
+    /* Timing */
+    uint64_t _nowNs;
+    uint64_t _syncNs;
+    uint64_t _n;
+    uint16_t _rate;
+    bool _running;
+    uint32_t _sampCount;
+    bool _samp;
+    uint64_t _sampClearNs;
+    bool _rrint;
+
+    /* Source */
+    int32_t (*_source)(uint32_t n, uint32_t sampleRate, void *ctx);
+    void *_sourceCtx;
+    uint16_t _bpm;
+    uint64_t _lastBeatN;
+    bool _haveBeat;
+
+    Max30003SimStats _stats;
+};
+
+/* Simulator core */
+/* Forget all devices and handlers, virtual time restarts at 0 */
+void simReset();
+uint64_t simTimeNs();
+/* Move virtual time, devices generate samples, no intruppt is dispatched */
+void simAdvanceNs(uint64_t ns);
+/* Move virtual time and dispatch INTB falling edges and DMA completions */
+void simRun(uint64_t us);
+void simSetGpioIrq(uint pin, void (*handler)(uint gpio, uint32_t events));
+void simSetDmaIrq(void (*handler)());
+/* Where halLog() writes, stdout until set, nullptr drops driver messages. Kept by simReset() */
+void simSetLog(FILE *out);
+
+/* Synthetic ECG in MAX30003 counts, R peak at 38% of every beat */
+int32_t max30003SimEcg(uint32_t n, uint32_t sampleRate, uint32_t bpm);
@@ -0,0 +1,326 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Run MAX30003 driver against simulated device, same init sequence as firmware
+    max30003_sim_run [-t seconds] [-r 128|256|512] [-b bpm] [-m direct|dma|pipeline] [-f fast samples]
+                     [-c live|record|adaptive] [-d ms] [-a rate@seconds] [-p ms] [-l ns] [-w capture.raw] [-s] [-q]
+    -s configures with max30003Begin(), max30003SetsamplingRate() and setIntruppts() instead of max30003Configure()
+    -d stalls the consumer (main loop) for given ms once per second during first half of run,
+    adaptive coalescing switches to RECORD and back to LIVE
+    -a changes sampling rate with a queued command while acquisition runs
+    -p polls STATUS with a queued command every given ms
+    -l adds latency to every SPI transaction, queued commands still run between FIFO bursts
+    -w writes raw blocks of pipeline mode as capture (src/raw_dump.h) for max30003_replay
+    Completed commands are printed as "CMD <type> <register> <value> <ok> <us from post to done>"
+    Prints "<sample index> <sample> <flags>" per sample and "RR <sample index> <ms>",
+    statistics go to stderr. Virtual time makes the output identical on every run,
+    so it can be diffed against a previous run after driver changes.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "max30003_sim.h"
+#include "raw_dump.h"
+
+#define SIM_CS 17
+#define SIM_INTPIN 20
+#define SIM_SPI_SPEED 2000000
+/* Main loop period of simulated firmware */
+#define SIM_LOOP_US 1000
+
+typedef enum
+{
+    RUN_DIRECT,
+    RUN_DMA,
+    RUN_PIPELINE
+} RunMode;
+
+static spi_inst_t simSpi = {SIM_SPI_SPEED};
+static MAX30003 max30003(SIM_CS, &simSpi, nullptr);
+static MAX30003BlockRing ring;
+static bool quiet;
+static uint64_t samples;
+static uint64_t fastSamples;
+static uint64_t gaps;
+static uint32_t rrCount;
+/* Virtual time of first delivered sample, power on is time 0 */
+static uint64_t firstSampleUs;
+
+static void onSamples(const MAX30003SampleBlock *block, void *ctx)
+{
+    if (samples == 0 && block->count > 0)
+        firstSampleUs = block->timestampUs;
+    for (uint16_t i = 0; i < block->count; i++)
+    {
+        uint8_t flags = block->flags[i];
+        samples++;
+        if (flags & ECG_FLAG_FAST)
+            fastSamples++;
+        if (flags & ECG_FLAG_GAP)
+            gaps++;
+        if (!quiet)
+            printf("%lu %ld %u\n", (unsigned long)(block->firstIndex + i), (long)block->samples[i], flags);
+    }
+}
+
+static void onRR(uint32_t rrMs, uint32_t sampleIndex, void *ctx)
+{
+    rrCount++;
+    if (!quiet)
+        printf("RR %lu %lu\n", (unsigned long)sampleIndex, (unsigned long)rrMs);
+}
+
+/* Post time of queued commands, command ctx points into it */
+#define POST_SLOTS 16
+static uint64_t postUs[POST_SLOTS];
+static uint32_t posted;
+static uint32_t commandsDone;
+static uint64_t commandMaxUs;
+
+static void onCommand(const MAX30003Command *command, void *ctx)
+{
+    uint64_t waitUs = command->doneUs - *(uint64_t *)ctx;
+    commandsDone++;
+    commandMaxUs = waitUs > commandMaxUs ? waitUs : commandMaxUs;
+    if (!quiet)
+        printf("CMD %u %02x %06lx %u %lu\n", command->type, command->reg, (unsigned long)command->value, command->ok,
+               (unsigned long)waitUs);
+}
+
+static bool post(MAX30003CommandType type, uint8_t reg, uint32_t value)
+{
+    uint64_t *slot = &postUs[posted++ % POST_SLOTS];
+    *slot = halTimeUs();
+    return max30003.postCommand(type, reg, value, onCommand, slot);
+}
+
+static void intbIrq(uint gpio, uint32_t events)
+{
+    max30003.getDataIntrupptCallback();
+}
+
+static void dmaIrq()
+{
+    max30003.dmaCompleteCallback();
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 10;
+    int rate = SAMPLINGRATE_512;
+    int bpm = 60;
+    int fast = 0;
+    RunMode mode = RUN_DIRECT;
+    MAX30003CoalesceMode coalesce = COALESCE_ADAPTIVE;
+    int stallMs = 0;
+    bool separate = false;
+    int newRate = 0;
+    double rateAt = 0;
+    int pollMs = 0;
+    const char *capturePath = nullptr;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:r:b:m:f:c:d:a:p:l:w:sq")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            seconds = atof(optarg);
+            break;
+        case 'r':
+            rate = atoi(optarg);
+            break;
+        case 'b':
+            bpm = atoi(optarg);
+            break;
+        case 'f':
+            fast = atoi(optarg);
+            break;
+        case 'm':
+            if (strcmp(optarg, "dma") == 0)
+                mode = RUN_DMA;
+            else if (strcmp(optarg, "pipeline") == 0)
+                mode = RUN_PIPELINE;
+            else
+                mode = RUN_DIRECT;
+            break;
+        case 'c':
+            if (strcmp(optarg, "live") == 0)
+                coalesce = COALESCE_LIVE;
+            else if (strcmp(optarg, "record") == 0)
+                coalesce = COALESCE_RECORD;
+            else
+                coalesce = COALESCE_ADAPTIVE;
+            break;
+        case 'd':
+            stallMs = atoi(optarg);
+            break;
+        case 'a':
+            newRate = atoi(optarg);
+            rateAt = strchr(optarg, '@') != nullptr ? atof(strchr(optarg, '@') + 1) : 0;
+            break;
+        case 'p':
+            pollMs = atoi(optarg);
+            break;
+        case 'l':
+            simSpi.latencyNs = (uint64_t)atoll(optarg);
+            break;
+        case 'w':
+            capturePath = optarg;
+            break;
+        case 's':
+            separate = true;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t seconds] [-r 128|256|512] [-b bpm] [-m direct|dma|pipeline] [-f fast samples]"
+                             " [-c live|record|adaptive] [-d ms] [-a rate@seconds] [-p ms] [-l ns] [-w capture.raw] [-s] [-q]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    FILE *capture = nullptr;
+    uint8_t record[RAW_DUMP_MAX_RECORD];
+    if (capturePath != nullptr)
+    {
+        if (mode != RUN_PIPELINE)
+        {
+            fprintf(stderr, "-w needs -m pipeline\n");
+            return 1;
+        }
+        capture = fopen(capturePath, "wb");
+        if (capture == nullptr)
+        {
+            perror(capturePath);
+            return 1;
+        }
+        fwrite(record, 1, rawDumpConfig((uint16_t)rate, record), capture);
+    }
+
+    Max30003Sim device(&simSpi, SIM_CS, SIM_INTPIN);
+    device.setHeartRate((uint16_t)bpm);
+
+    /* Driver prints go to stderr, stdout only carries samples */
+    simSetLog(stderr);
+    max30003.max30003ReadInfo();
+    uint64_t spiStart = simSpi.transactions;
+    max30003.setCoalescing(coalesce);
+    if (separate)
+    {
+        max30003.max30003Begin();
+        max30003.max30003SetsamplingRate((uint16_t)rate);
+        max30003.setIntruppts();
+    }
+    else
+    {
+        max30003.max30003Configure((uint16_t)rate);
+    }
+    uint64_t initUs = halTimeUs();
+    uint64_t initTransactions = simSpi.transactions - spiStart;
+    max30003.readIntruppt();
+
+    max30003.setBlockCallBack(onSamples, onRR, nullptr);
+    if (mode == RUN_PIPELINE)
+    {
+        max30003.setPipeline(&ring);
+    }
+    if (mode == RUN_DMA || mode == RUN_PIPELINE)
+    {
+        max30003.enableDmaAcquisition();
+        simSetDmaIrq(dmaIrq);
+    }
+    max30003.setIntPin(SIM_INTPIN);
+    simSetGpioIrq(SIM_INTPIN, intbIrq);
+    /* INTB may already be low, no falling edge would come for it */
+    max30003.getDataIntrupptCallback();
+    device.injectFastRecovery((uint32_t)fast);
+
+    uint64_t busyStartNs = simSpi.busyNs;
+    uint64_t startNs = simTimeNs();
+    uint64_t endNs = startNs + (uint64_t)(seconds * 1e9);
+    uint64_t nextStallNs = startNs + 1000000000ull;
+    uint64_t rateNs = startNs + (uint64_t)(rateAt * 1e9);
+    uint64_t nextPollNs = startNs + (uint64_t)pollMs * 1000000;
+    uint32_t postFailures = 0;
+    while (simTimeNs() < endNs)
+    {
+        simRun(SIM_LOOP_US);
+        if (newRate != 0 && simTimeNs() >= rateNs)
+        {
+            postFailures += post(CMD_SAMPLING_RATE, 0, (uint32_t)newRate) ? 0 : 1;
+            newRate = 0;
+        }
+        if (pollMs > 0 && simTimeNs() >= nextPollNs)
+        {
+            postFailures += post(CMD_READ, STATUS, 0) ? 0 : 1;
+            nextPollNs += (uint64_t)pollMs * 1000000;
+        }
+        if (stallMs > 0 && simTimeNs() >= nextStallNs && nextStallNs < startNs + (endNs - startNs) / 2)
+        {
+            /* Consumer busy, intruppts keep running */
+            simRun((uint32_t)stallMs * 1000);
+            nextStallNs += 1000000000ull;
+        }
+        if (mode == RUN_DMA)
+        {
+            while (max30003.processDmaBlock())
+                ;
+        }
+        else if (mode == RUN_PIPELINE)
+        {
+            const MAX30003RawBlock *block;
+            while ((block = ring.peek()) != nullptr)
+            {
+                if (capture != nullptr)
+                    fwrite(record, 1, rawDumpBlock(block, record), capture);
+                max30003.processRawBlock(block);
+                ring.release();
+            }
+        }
+    }
+
+    const Max30003SimStats &st = device.stats();
+    double runNs = (double)(simTimeNs() - startNs);
+    fprintf(stderr, "init: %lu us %lu spi transactions, first sample read at %lu us, device rate: %u sps\n",
+            (unsigned long)initUs, (unsigned long)initTransactions, (unsigned long)firstSampleUs, device.sampleRate());
+    fprintf(stderr, "generated: %lu delivered: %lu fast: %lu lost: %lu overflows: %lu gaps: %lu\n",
+            (unsigned long)st.samplesGenerated, (unsigned long)samples, (unsigned long)fastSamples,
+            (unsigned long)st.samplesLost, (unsigned long)st.overflows, (unsigned long)gaps);
+    fprintf(stderr, "beats: %lu rr: %lu intruppts: %lu\n",
+            (unsigned long)st.beats, (unsigned long)rrCount, (unsigned long)st.intbEdges);
+    fprintf(stderr, "fifo words: %lu empty reads: %lu overflow reads: %lu\n",
+            (unsigned long)st.fifoWordsRead, (unsigned long)st.emptyReads, (unsigned long)st.overflowReads);
+    fprintf(stderr, "spi: %lu transactions %lu bytes, bus busy %.2f%%, collisions %lu\n",
+            (unsigned long)simSpi.transactions, (unsigned long)simSpi.bytes,
+            100.0 * (double)(simSpi.busyNs - busyStartNs) / runNs, (unsigned long)simSpi.collisions);
+    fprintf(stderr, "commands: posted %lu done %lu rejected %lu, longest wait %lu us\n", (unsigned long)posted,
+            (unsigned long)commandsDone, (unsigned long)postFailures, (unsigned long)commandMaxUs);
+    MAX30003Telemetry t;
+    max30003.getTelemetry(&t);
+    fprintf(stderr, "driver: intruppts %lu blocks %lu samples %lu fast %lu empty reads %lu overflows %lu lost %lu rr %lu\n",
+            (unsigned long)t.intruppts, (unsigned long)t.blocks, (unsigned long)t.samples, (unsigned long)t.fastSamples,
+            (unsigned long)t.emptyReads, (unsigned long)t.overflows, (unsigned long)t.lostSamples, (unsigned long)t.rrEvents);
+    fprintf(stderr, "driver: samples per read");
+    for (int i = 0; i < TELEMETRY_BLOCK_BUCKETS; i++)
+        fprintf(stderr, " %lu", (unsigned long)t.blockHist[i]);
+    fprintf(stderr, ", dma dropped %lu, irq max %lu cycles\n", (unsigned long)t.dmaDropped, (unsigned long)t.irqMaxCycles);
+    MAX30003CoalesceInfo ci;
+    max30003.getCoalescing(&ci);
+    fprintf(stderr, "coalescing: threshold %u words burst %u words, latency %lu us, %.1f intruppts/s, switches %lu\n",
+            ci.thresholdWords, ci.burstWords, (unsigned long)ci.latencyUs, ci.intrupptsPerSecond, (unsigned long)ci.switches);
+    if (mode == RUN_PIPELINE)
+    {
+        fprintf(stderr, "ring: high water %lu dropped %lu\n", (unsigned long)ring.highWater(), (unsigned long)ring.dropped());
+    }
+    if (capture != nullptr)
+    {
+        fclose(capture);
+    }
+    return 0;
+}
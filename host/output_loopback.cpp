@@ -0,0 +1,60 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "output_loopback.h"
+
+OutputLoopback::OutputLoopback(uint32_t baud, void (*sink)(const uint8_t *, int, void *), void *ctx)
+{
+    _link.start = start;
+    _link.ctx = this;
+    _transport = nullptr;
+    _baud = baud;
+    _sink = sink;
+    _ctx = ctx;
+    _buf = nullptr;
+    _len = 0;
+    _active = false;
+    _lineFreeUs = 0;
+    _nowUs = 0;
+    _busyUs = 0;
+}
+
+bool OutputLoopback::start(const uint8_t *buf, uint32_t len, void *ctx)
+{
+    OutputLoopback *l = static_cast<OutputLoopback *>(ctx);
+    if (l->_active)
+    {
+        return false;
+    }
+    l->_buf = buf;
+    l->_len = len;
+    l->_active = true;
+    /* 8N1: start bit, 8 data bits, stop bit */
+    uint64_t us = (uint64_t)len * 10 * 1000000 / l->_baud;
+    uint64_t from = l->_lineFreeUs > l->_nowUs ? l->_lineFreeUs : l->_nowUs;
+    l->_lineFreeUs = from + us;
+    l->_busyUs += us;
+    return true;
+}
+
+void OutputLoopback::service(uint64_t nowUs)
+{
+    /* complete() may start the next buffer, it starts when the previous one ended like chained DMA */
+    while (_active && nowUs >= _lineFreeUs)
+    {
+        _nowUs = _lineFreeUs;
+        _active = false;
+        if (_sink != nullptr)
+        {
+            _sink(_buf, (int)_len, _ctx);
+        }
+        if (_transport != nullptr)
+        {
+            _transport->complete();
+        }
+    }
+    _nowUs = nowUs;
+}
@@ -0,0 +1,45 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  UART model for OutputTransport (src/output_transport.h) on host
+
+    Acts like UART TX drained by DMA: a started buffer takes 10 bit times per Byte
+    at the configured baud rate, service() completes it when that time has passed
+    and hands the Bytes to a sink (file, decoder) like the PC end of the cable would.
+    Time is given by the caller, virtual simulator time or wall clock.
+*/
+#pragma once
+
+#include <stdint.h>
+#include "output_transport.h"
+
+class OutputLoopback
+{
+public:
+    /* sink gets every sent buffer, nullptr discards */
+    OutputLoopback(uint32_t baud, void (*sink)(const uint8_t *, int, void *), void *ctx);
+    const OutputLink *link() const { return &_link; }
+    void attach(OutputTransport *transport) { _transport = transport; }
+    /* Complete transfers finished by nowUs */
+    void service(uint64_t nowUs);
+    /* Time the line was sending */
+    uint64_t busyUs() const { return _busyUs; }
+
+private:
+    static bool start(const uint8_t *buf, uint32_t len, void *ctx);
+    OutputLink _link;
+    OutputTransport *_transport;
+    uint32_t _baud;
+    void (*_sink)(const uint8_t *, int, void *);
+    void *_ctx;
+    const uint8_t *_buf;
+    uint32_t _len;
+    bool _active;
+    /* Line is busy until this time, next transfer starts at max(now, it) */
+    uint64_t _lineFreeUs;
+    uint64_t _nowUs;
+    uint64_t _busyUs;
+};
@@ -0,0 +1,92 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  QrsDetector on synthetic ECG at 60 bpm with lost samples: blocks are dropped, the
+    index keeps counting delivered samples and the first sample after the loss carries
+    ECG_FLAG_GAP, as the driver delivers them after a FIFO overflow
+    ctest runs it, exit code is number of failed checks
+*/
+
+#include "qrs_detector.h"
+#include "ecg_filter.h"
+#include "ecg_decoder.h"
+#include "bench_util.h"
+#include "test_util.h"
+
+#define TEST_RATE 512
+#define TEST_SECONDS 30
+/* Samples lost every 10 s, after a beat is confirmed and before the next R peak */
+#define TEST_LOST_SAMPLES (TEST_RATE * 3 / 10)
+
+typedef struct
+{
+    uint32_t beats;
+    uint32_t noRR;
+    uint32_t badRR;
+} BeatCounts;
+
+static void countBeat(const QrsBeat *beat, void *ctx)
+{
+    BeatCounts *c = static_cast<BeatCounts *>(ctx);
+    c->beats++;
+    if (beat->rrMs == 0)
+    {
+        c->noRR++;
+    }
+    else if (beat->rrMs < 1000 - QRS_RR_TOLERANCE_MS || beat->rrMs > 1000 + QRS_RR_TOLERANCE_MS)
+    {
+        c->badRR++;
+    }
+}
+
+/* markGap false feeds the same samples without flag, as before GAP was passed in */
+static void runGaps(bool markGap, BeatCounts *counts)
+{
+    EcgFilter filter;
+    filter.configure(TEST_RATE, 50, ECG_FILTER_ALL);
+    QrsDetector qrs;
+    qrs.configure(TEST_RATE);
+    *counts = BeatCounts();
+    qrs.setBeatCallBack(countBeat, counts);
+    uint32_t index = 0;
+    bool gap = false;
+    for (uint32_t n = 0; n < TEST_SECONDS * TEST_RATE; n++)
+    {
+        uint32_t phase = n % (10 * TEST_RATE);
+        if (n >= 10 * TEST_RATE && phase >= TEST_RATE * 8 / 10 && phase < TEST_RATE * 8 / 10 + TEST_LOST_SAMPLES)
+        {
+            gap = true;
+            continue;
+        }
+        uint8_t flags = gap && markGap ? ECG_FLAG_GAP : 0;
+        gap = false;
+        int32_t y = filter.processSample(benchSyntheticEcg(n, TEST_RATE), flags);
+        qrs.processSample(y, flags, index++);
+    }
+}
+
+static void testGap()
+{
+    BeatCounts c;
+    runGaps(true, &c);
+    printf("gap: %u beats, %u without RR, %u RR off\n", c.beats, c.noRR, c.badRR);
+    /* Learning takes 2 s, one beat per second after it, none lost in the gaps */
+    CHECK("gap", c.beats >= TEST_SECONDS - 3 && c.beats <= TEST_SECONDS);
+    /* First beat and first beat after each of the two gaps */
+    CHECK("gap", c.noRR == 3);
+    CHECK("gap", c.badRR == 0);
+
+    /* Without the flag the interval across a gap is short by the lost samples */
+    runGaps(false, &c);
+    printf("no_flag: %u beats, %u without RR, %u RR off\n", c.beats, c.noRR, c.badRR);
+    CHECK("no_flag", c.noRR == 1 && c.badRR >= 2);
+}
+
+int main()
+{
+    testGap();
+    return testResult();
+}
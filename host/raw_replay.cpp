@@ -0,0 +1,168 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "raw_replay.h"
+#include "raw_dump.h"
+#include <chrono>
+
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+void replayDefaultOptions(ReplayOptions *options)
+{
+    options->sampleRate = SAMPLINGRATE_512;
+    options->mainsHz = 50;
+    options->filterStages = ECG_FILTER_ALL;
+    options->compress = true;
+    options->qrs = true;
+    options->hrvSummaryMs = 0;
+    options->hrvOnly = false;
+}
+
+ReplayProcessor::ReplayProcessor(uint16_t sampleRate, const ReplayOptions *options,
+                                 void (*write)(const uint8_t *, int, void *), void *ctx)
+    : _stream(streamWrite, this, sampleRate, ECG_STREAM_MAX_SAMPLES)
+{
+    _options = *options;
+    _sampleRate = sampleRate;
+    _write = write;
+    _ctx = ctx;
+    _stream.setCompression(options->compress);
+    if (options->filterStages != 0 && !_filter.configure(sampleRate, options->mainsHz, options->filterStages))
+    {
+        /* No coefficients for this rate, samples go out unfiltered */
+        _options.filterStages = 0;
+    }
+    _qrs.configure(sampleRate);
+    _qrs.setBeatCallBack(beatCallBack, this);
+    _hrvSamples = (uint32_t)((uint64_t)options->hrvSummaryMs * sampleRate / 1000);
+    _nextHrv = _hrvSamples;
+    _sink = {_options.filterStages != 0 ? &_filter : nullptr,
+             &_stream,
+             nullptr,
+             options->qrs ? &_qrs : nullptr,
+             _hrvSamples != 0 ? &_hrv : nullptr,
+             options->hrvOnly,
+             0};
+    _samples = 0;
+    _fastSamples = 0;
+    _gaps = 0;
+    _rrIntervals = 0;
+    _beats = 0;
+    _outputBytes = 0;
+    _digest = FNV_OFFSET;
+}
+
+void ReplayProcessor::samplesCallBack(const MAX30003SampleBlock *block, void *ctx)
+{
+    ReplayProcessor *p = static_cast<ReplayProcessor *>(ctx);
+    for (uint16_t i = 0; i < block->count; i++)
+    {
+        uint8_t flags = block->flags[i];
+        p->_sink.onSample(block->samples[i], flags, block->firstIndex + i);
+        p->_fastSamples += (flags & ECG_FLAG_FAST) ? 1 : 0;
+        p->_gaps += (flags & ECG_FLAG_GAP) ? 1 : 0;
+    }
+    p->_samples += block->count;
+    p->blockDone(block->firstIndex + block->count);
+}
+
+/* Summaries at recording time, firmware sends them at wall clock time */
+void ReplayProcessor::blockDone(uint32_t nextIndex)
+{
+    if (_hrvSamples != 0 && nextIndex >= _nextHrv)
+    {
+        _sink.sendHrv();
+        _nextHrv += _hrvSamples;
+    }
+}
+
+void ReplayProcessor::rrCallBack(uint32_t rrMs, uint32_t sampleIndex, void *ctx)
+{
+    ReplayProcessor *p = static_cast<ReplayProcessor *>(ctx);
+    p->_sink.onRR(rrMs, sampleIndex);
+    p->_rrIntervals++;
+}
+
+void ReplayProcessor::beatCallBack(const QrsBeat *beat, void *ctx)
+{
+    ReplayProcessor *p = static_cast<ReplayProcessor *>(ctx);
+    p->_sink.onBeat(beat);
+    p->_beats++;
+}
+
+void ReplayProcessor::streamWrite(const uint8_t *buf, int len, void *ctx)
+{
+    ReplayProcessor *p = static_cast<ReplayProcessor *>(ctx);
+    for (int i = 0; i < len; i++)
+    {
+        p->_digest = (p->_digest ^ buf[i]) * FNV_PRIME;
+    }
+    p->_outputBytes += len;
+    if (p->_write != nullptr)
+    {
+        p->_write(buf, len, p->_ctx);
+    }
+}
+
+void ReplayProcessor::finish()
+{
+    _stream.flush();
+}
+
+void ReplayProcessor::getResult(ReplayResult *result) const
+{
+    memset(result, 0, sizeof(*result));
+    result->sampleRate = _sampleRate;
+    result->samples = _samples;
+    result->fastSamples = _fastSamples;
+    result->gaps = _gaps;
+    result->rrIntervals = _rrIntervals;
+    result->beats = _beats;
+    result->outputBytes = _outputBytes;
+    result->digest = _digest;
+    result->recordedSeconds = _sampleRate != 0 ? (double)_samples / _sampleRate : 0;
+}
+
+bool replayRecording(const uint8_t *buf, uint64_t len, const ReplayOptions *options,
+                     void (*write)(const uint8_t *, int, void *), void *ctx, ReplayResult *result)
+{
+    auto start = std::chrono::steady_clock::now();
+    RawDumpReader reader(buf, len);
+    /* Large, keep it off the stack of worker threads */
+    MAX30003RawBlock *block = new MAX30003RawBlock;
+    if (!reader.next(block))
+    {
+        delete block;
+        memset(result, 0, sizeof(*result));
+        result->crcErrors = reader.crcErrors();
+        result->skippedBytes = reader.skippedBytes();
+        return false;
+    }
+    /* Config record comes before first block */
+    uint16_t rate = reader.sampleRate() != 0 ? reader.sampleRate() : options->sampleRate;
+    /* Decoder only, no SPI and no pins are used */
+    MAX30003 *decoder = new MAX30003(-1, nullptr, nullptr);
+    decoder->setDecodeRate(rate);
+    ReplayProcessor *processor = new ReplayProcessor(rate, options, write, ctx);
+    decoder->setBlockCallBack(ReplayProcessor::samplesCallBack, ReplayProcessor::rrCallBack, processor);
+    uint64_t blocks = 0;
+    do
+    {
+        decoder->processRawBlock(block);
+        blocks++;
+    } while (reader.next(block));
+    processor->finish();
+    processor->getResult(result);
+    result->blocks = blocks;
+    result->crcErrors = reader.crcErrors();
+    result->skippedBytes = reader.skippedBytes();
+    result->processSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    delete processor;
+    delete decoder;
+    delete block;
+    return true;
+}
@@ -0,0 +1,107 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Replay of raw FIFO / RTOR captures (src/raw_dump.h) through the firmware path
+
+    Blocks go through MAX30003::processRawBlock() like on core 1 of the firmware,
+    samples, RR intervals and beats through EcgOutputSink (src/ecg_output_sink.h),
+    the sink of read_max30003.cpp. Only HRV summaries differ: they are sent at
+    recording time after a block, firmware sends them at wall clock time.
+    Output is the binary ECG stream, its FNV-1a digest tells two runs apart.
+    One ReplayProcessor per recording, processors share nothing, so recordings
+    can be replayed on several threads.
+*/
+#pragma once
+
+#include <stdint.h>
+#include "max30003.h"
+#include "ecg_stream.h"
+#include "ecg_filter.h"
+#include "qrs_detector.h"
+#include "hrv_engine.h"
+#include "ecg_output_sink.h"
+
+typedef struct
+{
+    /* Used when capture has no config record */
+    uint16_t sampleRate;
+    uint8_t mainsHz;
+    /* ECG_FILTER_* stages, 0 sends samples unfiltered */
+    uint8_t filterStages;
+    bool compress;
+    bool qrs;
+    /* HRV summary every this many ms of recording, 0 disables */
+    uint32_t hrvSummaryMs;
+    /* Stream carries only HRV summaries, like MAX30003_HRV_ONLY */
+    bool hrvOnly;
+} ReplayOptions;
+
+typedef struct
+{
+    uint16_t sampleRate;
+    uint64_t blocks;
+    uint64_t samples;
+    uint64_t fastSamples;
+    uint64_t gaps;
+    uint64_t rrIntervals;
+    uint64_t beats;
+    uint64_t crcErrors;
+    uint64_t skippedBytes;
+    uint64_t outputBytes;
+    uint64_t digest;
+    /* Length of recording and host time to process it */
+    double recordedSeconds;
+    double processSeconds;
+} ReplayResult;
+
+/* Firmware defaults: 512 sps, 50 Hz mains, all filters, compression, QRS, no HRV */
+void replayDefaultOptions(ReplayOptions *options);
+
+class ReplayProcessor
+{
+public:
+    /* write gets the output stream, nullptr only counts and digests it */
+    ReplayProcessor(uint16_t sampleRate, const ReplayOptions *options, void (*write)(const uint8_t *, int, void *), void *ctx);
+    /* MAX30003 block callbacks, ctx is the processor */
+    static void samplesCallBack(const MAX30003SampleBlock *block, void *ctx);
+    static void rrCallBack(uint32_t rrMs, uint32_t sampleIndex, void *ctx);
+    /* Stages of this processor, e.g. as sink of MAX30003WithSink<> on a live driver */
+    EcgOutputSink &sink() { return _sink; }
+    /* End of a decoded block, nextIndex is index after its last sample (HRV summary) */
+    void blockDone(uint32_t nextIndex);
+    /* Send queued samples */
+    void finish();
+    /* Counts of delivered data and output, block and capture counts are left 0 */
+    void getResult(ReplayResult *result) const;
+
+private:
+    static void streamWrite(const uint8_t *buf, int len, void *ctx);
+    static void beatCallBack(const QrsBeat *beat, void *ctx);
+    ReplayOptions _options;
+    uint16_t _sampleRate;
+    void (*_write)(const uint8_t *, int, void *);
+    void *_ctx;
+    EcgStreamEncoder _stream;
+    EcgFilter _filter;
+    QrsDetector _qrs;
+    HrvEngine _hrv;
+    EcgOutputSink _sink;
+    uint32_t _hrvSamples;
+    uint32_t _nextHrv;
+    uint64_t _samples;
+    uint64_t _fastSamples;
+    uint64_t _gaps;
+    uint64_t _rrIntervals;
+    uint64_t _beats;
+    uint64_t _outputBytes;
+    uint64_t _digest;
+};
+
+/*  Replay one capture held in memory (e.g. memory mapped file)
+    Returns false if it holds no block
+*/
+bool replayRecording(const uint8_t *buf, uint64_t len, const ReplayOptions *options,
+                     void (*write)(const uint8_t *, int, void *), void *ctx, ReplayResult *result);
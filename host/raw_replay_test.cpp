@@ -0,0 +1,151 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Replay parity with the firmware path: MAX30003WithSink<EcgOutputSink> in pipeline mode,
+    as in read_max30003.cpp, runs against simulated MAX30003 while every raw block is captured
+    (src/raw_dump.h). Replaying the capture has to give the same stream digest and counts.
+    A damaged record costs only its own block.
+    ctest runs it, exit code is number of failed checks
+*/
+
+#include "raw_replay.h"
+#include "raw_dump.h"
+#include "test_util.h"
+#include <vector>
+
+#define TEST_RATE 512
+#define TEST_SECONDS 20
+#define TEST_STALL_MS 500
+
+typedef enum
+{
+    /* Consumer keeps up */
+    RUN_CLEAN,
+    /* Consumer stops TEST_STALL_MS every second, block ring overflows */
+    RUN_STALL,
+    /* Intruppts held off longer than the FIFO lasts, device overflows */
+    RUN_OVERFLOW,
+    /* Burst of FAST recovery samples every second */
+    RUN_FAST
+} RunKind;
+
+static void append(std::vector<uint8_t> &v, const uint8_t *buf, int len)
+{
+    v.insert(v.end(), buf, buf + len);
+}
+
+/*  Runs live path, fills capture and offset of one sample record in the middle
+    Live counts: stream digest, output Bytes and beats from the processor whose stages the
+    sink uses, samples from driver telemetry
+*/
+static void runLive(RunKind kind, const ReplayOptions *options, std::vector<uint8_t> &capture, size_t *sampleRecord, ReplayResult *live)
+{
+    SimDriverFixture sim;
+    ReplayProcessor processor(TEST_RATE, options, nullptr, nullptr);
+    MAX30003WithSink<EcgOutputSink> driver(TEST_CS, &sim.bus, processor.sink());
+    MAX30003BlockRing ring;
+    MAX30003Telemetry t;
+    sim.configure(&driver, TEST_RATE);
+    driver.setPipeline(&ring);
+    driver.enableDmaAcquisition();
+    sim.start();
+
+    uint8_t record[RAW_DUMP_MAX_RECORD];
+    capture.clear();
+    append(capture, record, rawDumpConfig(TEST_RATE, record));
+    *sampleRecord = 0;
+    for (uint32_t ms = 0; ms < TEST_SECONDS * 1000; ms++)
+    {
+        if (kind == RUN_OVERFLOW && ms % 1000 == 500)
+        {
+            simAdvanceNs(100000000ull);
+        }
+        if (kind == RUN_FAST && ms % 1000 == 250)
+        {
+            sim.device.injectFastRecovery(40);
+        }
+        simRun(1000);
+        if (kind == RUN_STALL && ms % 1000 < TEST_STALL_MS)
+        {
+            continue;
+        }
+        const MAX30003RawBlock *block;
+        while ((block = ring.peek()) != nullptr)
+        {
+            if (*sampleRecord == 0 && ms >= TEST_SECONDS * 500 && block->type == BLOCK_ECG_FIFO && !block->gap)
+            {
+                *sampleRecord = capture.size();
+            }
+            append(capture, record, rawDumpBlock(block, record));
+            driver.processRawBlock(block);
+            ring.release();
+            driver.getTelemetry(&t);
+            processor.blockDone(t.samples);
+        }
+    }
+    processor.finish();
+    processor.getResult(live);
+    driver.getTelemetry(&t);
+    live->samples = t.samples;
+    live->fastSamples = t.fastSamples;
+}
+
+static void testParity(const char *name, RunKind kind, uint8_t filterStages, bool compress, bool hrvOnly = false)
+{
+    ReplayOptions options;
+    replayDefaultOptions(&options);
+    options.sampleRate = TEST_RATE;
+    options.filterStages = filterStages;
+    options.compress = compress;
+    options.hrvSummaryMs = 5000;
+    options.hrvOnly = hrvOnly;
+    std::vector<uint8_t> capture;
+    size_t sampleRecord;
+    ReplayResult live;
+    runLive(kind, &options, capture, &sampleRecord, &live);
+
+    ReplayResult r;
+    CHECK(name, replayRecording(capture.data(), capture.size(), &options, nullptr, nullptr, &r));
+    printf("%s: %llu samples, %llu gaps, %llu RR, digest live %016llx replay %016llx\n", name,
+           (unsigned long long)live.samples, (unsigned long long)r.gaps, (unsigned long long)r.rrIntervals,
+           (unsigned long long)live.digest, (unsigned long long)r.digest);
+    CHECK(name, live.samples > (uint64_t)TEST_RATE * TEST_SECONDS / 2);
+    CHECK(name, r.digest == live.digest);
+    CHECK(name, r.outputBytes == live.outputBytes);
+    CHECK(name, r.samples == live.samples);
+    CHECK(name, r.fastSamples == live.fastSamples);
+    CHECK(name, r.beats == live.beats);
+    CHECK(name, r.crcErrors == 0 && r.skippedBytes == 0);
+    CHECK(name, (kind == RUN_STALL || kind == RUN_OVERFLOW) == (r.gaps > 0));
+    CHECK(name, (kind == RUN_FAST) == (live.fastSamples > 0));
+    CHECK(name, r.rrIntervals > 0 && live.beats > 0);
+
+    /* One Byte of sample data damaged: that block is lost and marked as gap, rest replays */
+    CHECK(name, sampleRecord != 0);
+    if (sampleRecord == 0)
+    {
+        return;
+    }
+    uint64_t gaps = r.gaps;
+    std::vector<uint8_t> damaged = capture;
+    damaged[sampleRecord + RAW_DUMP_HEADER_LEN] ^= 0x40;
+    CHECK(name, replayRecording(damaged.data(), damaged.size(), &options, nullptr, nullptr, &r));
+    CHECK(name, r.crcErrors == 1);
+    CHECK(name, r.gaps == gaps + 1);
+    CHECK(name, r.samples < live.samples && r.samples >= live.samples - MAX30003_FIFO_DEPTH);
+    CHECK(name, r.digest != live.digest);
+}
+
+int main()
+{
+    testParity("clean", RUN_CLEAN, ECG_FILTER_ALL, true);
+    testParity("clean_raw", RUN_CLEAN, 0, false);
+    testParity("stall", RUN_STALL, ECG_FILTER_ALL, true);
+    testParity("overflow", RUN_OVERFLOW, ECG_FILTER_ALL, true);
+    testParity("fast", RUN_FAST, ECG_FILTER_ALL, true);
+    testParity("hrv_only", RUN_CLEAN, ECG_FILTER_ALL, true, true);
+    return testResult();
+}
@@ -0,0 +1,96 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Shared pieces of host tests (ctest)
+
+    CHECK() counts failed conditions, testResult() prints them and is the exit code of main().
+    SimDriverFixture: simulated SPI bus and MAX30003 with intruppts routed to one driver,
+    driver messages are dropped. One fixture at a time, it restarts virtual time.
+*/
+#pragma once
+
+#include <stdio.h>
+#include "max30003.h"
+#include "max30003_sim.h"
+
+#define TEST_CS 17
+#define TEST_INTPIN 20
+
+static int testFailures;
+
+#define CHECK(name, cond)                                                  \
+    do                                                                     \
+    {                                                                      \
+        if (!(cond))                                                       \
+        {                                                                  \
+            printf("FAIL %s: %s (line %d)\n", name, #cond, __LINE__);      \
+            testFailures++;                                                \
+        }                                                                  \
+    } while (0)
+
+static inline int testResult()
+{
+    printf("%s, %d failed checks\n", testFailures == 0 ? "PASS" : "FAIL", testFailures);
+    return testFailures;
+}
+
+class SimDriverFixture
+{
+public:
+    SimDriverFixture() : bus(simBus()), device(&bus, TEST_CS, TEST_INTPIN)
+    {
+    }
+
+    ~SimDriverFixture()
+    {
+        simSetGpioIrq(TEST_INTPIN, nullptr);
+        simSetDmaIrq(nullptr);
+        _driver = nullptr;
+    }
+
+    /* Driver on bus, chip select TEST_CS, configured for rate */
+    void configure(MAX30003 *driver, uint16_t rate)
+    {
+        _driver = driver;
+        driver->max30003Configure(rate);
+    }
+
+    /*  Route INTB and DMA completion to driver, call after callbacks, pipeline and DMA are set
+        INTB may already be low, no falling edge would come for it, so FIFO is read once
+    */
+    void start()
+    {
+        simSetGpioIrq(TEST_INTPIN, gpioIrq);
+        simSetDmaIrq(dmaIrq);
+        _driver->getDataIntrupptCallback();
+    }
+
+    spi_inst_t bus;
+    Max30003Sim device;
+
+private:
+    /* Runs before device is built: fresh simulator, quiet driver */
+    static spi_inst_t simBus()
+    {
+        simReset();
+        simSetLog(nullptr);
+        spi_inst_t b = {};
+        b.baudrate = 2000000;
+        return b;
+    }
+
+    static void gpioIrq(uint, uint32_t)
+    {
+        _driver->getDataIntrupptCallback();
+    }
+
+    static void dmaIrq()
+    {
+        _driver->dmaCompleteCallback();
+    }
+
+    static inline MAX30003 *_driver = nullptr;
+};
@@ -2,6 +2,10 @@
 #include "hardware/structs/spi.h"
 #include "hardware/regs/dreq.h"
 #include "hardware/irq.h"
+#include "hardware/dma.h"
+#include "hardware/sync.h"
+#include "hardware/uart.h"
+#include "hardware/timer.h"
 #include "pico/binary_info.h"
 #include "pico.h"
 #include "hardware/spi.h"
@@ -9,7 +13,18 @@
 #include <string.h>
 #include "hardware/gpio.h"
 #include "pico/multicore.h"
-#include "src/max30003.cpp"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+#include "src/max30003.h"
+#include "src/ecg_stream.h"
+#include "src/ecg_filter.h"
+#include "src/qrs_detector.h"
+#include "src/latency_probe.h"
+#include "src/flash_store.h"
+#include "src/hrv_engine.h"
+#include "src/ecg_output_sink.h"
+#include "src/raw_dump.h"
+#include "src/stage_scheduler.h"
 // SPI communication Pins
 #define SCLK 18
 #define SDA 19
@@ -21,8 +36,285 @@
 
 /* SPI SPEED */
 #define MAX30003_SPI_SPEED 2000000
+
+/*  1: FIFO burst is read by DMA and decoded in main loop
+    0: FIFO is read and decoded inside GPIO intruppt
+*/
+#define MAX30003_DMA_ACQUISITION 1
+
+/*  1: core 0 only acquires raw FIFO blocks, core 1 decodes and prints them
+    0: everything runs on core 0
+*/
+#define MAX30003_PIPELINE 1
+
+/*  1: samples and RR intervals are sent as binary frames (see src/ecg_stream.h),
+       decode them on PC with host/ecg_stream_decode
+    0: one printf line per sample
+*/
+#define MAX30003_BINARY_OUTPUT 1
+/*  1: sample frames are compressed without loss (see src/ecg_compress.h), about 2x less UART traffic
+    0: 18 bit packed samples
+*/
+#define MAX30003_COMPRESS 1
+
+/*  1: baseline wander removal, mains notch and 40Hz low-pass on every sample
+    0: only DHPF/DLPF of MAX30003
+*/
+#define MAX30003_FILTER 1
+/* Mains frequency for notch filter */
+#define MAINS_HZ 50
+
+/*  1: software QRS detector runs on filtered samples and is checked against RTOR
+    0: only RTOR of MAX30003
+*/
+#define MAX30003_QRS 1
+
+/*  1: measure intruppt duration, intruppt to callback and intruppt to UART latency,
+       results are printed as JSON lines every LATENCY_REPORT_MS
+       (binary stream decoder skips them)
+    0: no measurement
+*/
+#define MAX30003_LATENCY_PROBE 0
+#define LATENCY_REPORT_MS 10000
+
+/*  1: samples and RR intervals are also recorded to flash (see src/flash_store.h),
+       'D' on UART sends the recording as binary frames, 'C' clears it
+    0: no recording
+*/
+#define MAX30003_FLASH_RECORD 0
+/* Recording region: upper 1MB of flash, about 40 min at 512 sps */
+#define FLASH_RECORD_OFFSET (1024 * 1024)
+#define FLASH_RECORD_SIZE (PICO_FLASH_SIZE_BYTES - FLASH_RECORD_OFFSET)
+#if MAX30003_FLASH_RECORD && !MAX30003_BINARY_OUTPUT
+#error "Recording is read out as binary stream, enable MAX30003_BINARY_OUTPUT"
+#endif
+#if MAX30003_FLASH_RECORD && !(MAX30003_PIPELINE || MAX30003_DMA_ACQUISITION)
+#error "Flash is serviced right after FIFO reads from decoded blocks, enable MAX30003_PIPELINE or MAX30003_DMA_ACQUISITION"
+#endif
+/*  flash_safe_execute() holds core 0 and its intruppts while flash is busy, MAX30003 FIFO
+    keeps filling. Flash only goes busy within FLASH_ALIGN_US after a FIFO read and coalescing
+    stays at COALESCE_LIVE while recording, so FIFO is nearly empty when an erase starts and
+    a typical sector erase fits into what is left of the 32 words.
+    Only the typical erase is checked here: W25Q16JV sector erase can take up to 400 ms, such
+    an erase overflows the FIFO, the driver resets it and marks the next block ECG_FLAG_GAP.
+    Erases longer than FLASH_FIFO_HEADROOM_US are counted (flashEraseOverruns) and reported
+    with eraseMaxUs, FIFO overflows are in driver telemetry
+*/
+#define FLASH_ALIGN_US 2000
+/* Typical W25Q16JV sector erase */
+#define FLASH_ERASE_US 45000
+#define FLASH_FIFO_HEADROOM_US ((MAX30003_FIFO_DEPTH - 1) * 1000000ull / SAMPLINGRATE_512 - FLASH_ALIGN_US)
+static_assert(!MAX30003_FLASH_RECORD || FLASH_FIFO_HEADROOM_US > FLASH_ERASE_US, "typical sector erase would overflow MAX30003 FIFO");
+
+/*  1: HRV of RTOR intervals (see src/hrv_engine.h): mean HR, SDNN, RMSSD, pNN50 and LF/HF
+       of the last 5 minutes are sent every HRV_SUMMARY_MS as HRV frame or text line
+    0: no HRV
+*/
+#define MAX30003_HRV 1
+#define HRV_SUMMARY_MS 60000
+/*  1: binary stream carries only HRV summaries and telemetry, no samples or RR intervals,
+       a few KB per hour instead of about 1.5 KB per second
+    0: HRV summaries are sent in addition
+*/
+#define MAX30003_HRV_ONLY 0
+#if MAX30003_HRV_ONLY && !(MAX30003_HRV && MAX30003_BINARY_OUTPUT)
+#error "MAX30003_HRV_ONLY needs MAX30003_HRV and MAX30003_BINARY_OUTPUT"
+#endif
+
+/*  1: core 1 sends raw FIFO and RTOR blocks (see src/raw_dump.h) instead of decoded output,
+       capture UART to a file and replay it on PC with host/max30003_replay
+    0: normal output
+*/
+#define MAX30003_RAW_CAPTURE 0
+#if MAX30003_RAW_CAPTURE && !MAX30003_PIPELINE
+#error "Raw blocks only exist in pipeline mode, enable MAX30003_PIPELINE"
+#endif
+
+/* Driver counters (see src/max30003_telemetry.h) are sent every TELEMETRY_MS, 0 disables */
+#define TELEMETRY_MS 1000
+
+/*  1: binary frames are built in output buffers and DMA drains them to UART
+       (see src/output_transport.h), frames are dropped and counted when UART can not keep up
+    0: frames are written with uart_write_blocking()
+*/
+#define MAX30003_DMA_OUTPUT 1
+#define OUTPUT_BAUD 115200
+/* Buffer goes to DMA when it holds OUTPUT_BATCH Bytes or is older than OUTPUT_MAX_DELAY_US */
+#define OUTPUT_BATCH 256
+#define OUTPUT_MAX_DELAY_US 20000
+#if MAX30003_DMA_OUTPUT && !MAX30003_BINARY_OUTPUT
+#error "MAX30003_DMA_OUTPUT needs MAX30003_BINARY_OUTPUT"
+#endif
+
+/*  1: work after acquisition runs as stages of src/stage_scheduler.h (core 1 in pipeline mode,
+       main loop otherwise): decode and output first, telemetry and reports are shed when
+       decoding falls behind. Misses and WCET per stage come with the latency report
+    0: every tick runs after every decoded block
+*/
+#define MAX30003_SCHEDULER 1
+#if MAX30003_SCHEDULER && !(MAX30003_PIPELINE || MAX30003_DMA_ACQUISITION)
+#error "Scheduler needs decoding outside of intruppt, enable MAX30003_PIPELINE or MAX30003_DMA_ACQUISITION"
+#endif
+/* One FIFO intruppt period of COALESCE_LIVE, ring starts to back up after it */
+#define DECODE_DEADLINE_US 16000
+
+/*  FIFO intruppt threshold
+    COALESCE_LIVE: intruppt every 8 samples (16 ms at 512 sps)
+    COALESCE_RECORD: intruppt every 24 samples, fewer wakeups
+    COALESCE_ADAPTIVE: RECORD while ring/output is backed up, LIVE otherwise
+    MAX30003_FLASH_RECORD always uses COALESCE_LIVE
+*/
+#define MAX30003_COALESCING COALESCE_ADAPTIVE
 void max3003CallBack(signed int data, MAX30003CallBackType type);
+EcgFilter ecgFilter;
+QrsDetector qrsDetector;
+LatencyProbe latencyProbe;
+HrvEngine hrvEngine;
+#if MAX30003_SCHEDULER
+StageScheduler scheduler;
+#endif
+
+#if MAX30003_BINARY_OUTPUT
+/* Binary frames are written to stdio UART without CRLF translation */
+void ecgStreamWrite(const uint8_t *buf, int len, void *ctx)
+{
+    uart_write_blocking(uart0, buf, len);
+#if MAX30003_LATENCY_PROBE
+    latencyProbe.output();
+#endif
+}
+EcgStreamEncoder ecgStream(ecgStreamWrite, nullptr, SAMPLINGRATE_512, ECG_STREAM_MAX_SAMPLES);
+
+#if MAX30003_DMA_OUTPUT
+/* DMA channel paced by UART TX DREQ, one output buffer per transfer */
+int outputDmaChannel = -1;
+
+bool uartDmaStart(const uint8_t *buf, uint32_t len, void *ctx)
+{
+    if (outputDmaChannel < 0)
+    {
+        return false;
+    }
+    dma_channel_set_read_addr(outputDmaChannel, buf, false);
+    dma_channel_set_trans_count(outputDmaChannel, len, true);
+    return true;
+}
+
+const OutputLink uartDmaLink = {uartDmaStart, nullptr};
+OutputTransport outputTransport(&uartDmaLink);
+
+void outputDmaIntruppt()
+{
+    dma_channel_acknowledge_irq1(outputDmaChannel);
+#if MAX30003_LATENCY_PROBE
+    latencyProbe.output();
+#endif
+    outputTransport.complete();
+}
+
+/*  Claim DMA channel and route its intruppt to the calling core,
+    call from the core that writes output
+*/
+void initOutputDma()
+{
+    uart_set_baudrate(uart0, OUTPUT_BAUD);
+    outputDmaChannel = dma_claim_unused_channel(false);
+    if (outputDmaChannel < 0)
+    {
+        /* No channel free, stay with blocking writes */
+        return;
+    }
+    dma_channel_config c = dma_channel_get_default_config(outputDmaChannel);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, uart_get_dreq(uart0, true));
+    dma_channel_configure(outputDmaChannel, &c, &uart_get_hw(uart0)->dr, nullptr, 0, false);
+    dma_channel_set_irq1_enabled(outputDmaChannel, true);
+    irq_set_exclusive_handler(DMA_IRQ_1, outputDmaIntruppt);
+    irq_set_enabled(DMA_IRQ_1, true);
+    outputTransport.configure(OUTPUT_BATCH, OUTPUT_MAX_DELAY_US);
+    ecgStream.setTransport(&outputTransport);
+}
+#endif
+
+#if MAX30003_FLASH_RECORD
+typedef struct
+{
+    uint32_t offset;
+    const uint8_t *data;
+} FlashOp;
+
+static void flashEraseUnsafe(void *param)
+{
+    flash_range_erase(((FlashOp *)param)->offset, FLASH_SECTOR_SIZE);
+}
+
+static void flashProgramUnsafe(void *param)
+{
+    FlashOp *op = (FlashOp *)param;
+    flash_range_program(op->offset, op->data, FLASH_PAGE_SIZE);
+}
+
+/*  XIP is off while flash is erased or programmed, flash_safe_execute() holds the
+    other core and intruppts. MAX30003 FIFO keeps collecting meanwhile: 32 samples
+    are 62 ms at 512 sps, sector erase takes 45 ms typical and up to 400 ms. flashRecordTick()
+    only calls service() within FLASH_ALIGN_US after a FIFO read, see FLASH_FIFO_HEADROOM_US
+*/
+/* Erases longer than FLASH_FIFO_HEADROOM_US, each of them has probably overflowed the FIFO */
+uint32_t flashEraseOverruns = 0;
+
+bool flashErase(uint32_t offset, void *ctx)
+{
+    FlashOp op = {FLASH_RECORD_OFFSET + offset, nullptr};
+    uint32_t start = time_us_32();
+    bool ok = flash_safe_execute(flashEraseUnsafe, &op, 100) == PICO_OK;
+    if (time_us_32() - start > FLASH_FIFO_HEADROOM_US)
+    {
+        flashEraseOverruns++;
+    }
+    return ok;
+}
+
+bool flashProgram(uint32_t offset, const uint8_t *data, void *ctx)
+{
+    FlashOp op = {FLASH_RECORD_OFFSET + offset, data};
+    return flash_safe_execute(flashProgramUnsafe, &op, 100) == PICO_OK;
+}
+
+void flashRead(uint32_t offset, uint8_t *data, uint32_t len, void *ctx)
+{
+    memcpy(data, (const uint8_t *)(XIP_BASE + FLASH_RECORD_OFFSET + offset), len);
+}
+
+const FlashBackend flashBackend = {flashErase, flashProgram, flashRead, nullptr, FLASH_RECORD_SIZE};
+FlashStore flashStore(&flashBackend);
+/* Readout has its own frame sequence, decoder sees one gap when it starts */
+EcgStreamEncoder readoutStream(ecgStreamWrite, nullptr, SAMPLINGRATE_512, ECG_STREAM_MAX_SAMPLES);
+#endif
+
+/*  Sink bound at compile time, stages are inlined in driver block loop (src/ecg_output_sink.h)
+    Replay on PC (host/raw_replay.h) runs the same sink
+*/
+#if MAX30003_FLASH_RECORD
+#define SINK_FLASH &flashStore
+#else
+#define SINK_FLASH nullptr
+#endif
+EcgOutputSink binaryOutputSink = {
+    MAX30003_FILTER ? &ecgFilter : nullptr,
+    &ecgStream,
+    SINK_FLASH,
+    MAX30003_QRS ? &qrsDetector : nullptr,
+    MAX30003_HRV ? &hrvEngine : nullptr,
+    MAX30003_HRV_ONLY,
+    0,
+};
+MAX30003WithSink<EcgOutputSink> max30003(CS, spi0, binaryOutputSink);
+#else
 MAX30003 max30003(CS, spi0, max3003CallBack);
+#endif
+MAX30003BlockRing max30003Ring;
 
 /* This openocd command i used to connect debugger */
 // sudo openocd -f interface/cmsis-dap.cfg -c "adapter speed 5000" -f target/rp2040.cfg -s tcl
@@ -51,18 +343,435 @@ void max30003Intruppt(uint gpio, uint32_t events)
     max30003.getDataIntrupptCallback();
 }
 
+void max30003DmaIntruppt()
+{
+    max30003.dmaCompleteCallback();
+}
+
+void qrsBeatCallBack(const QrsBeat *beat, void *ctx)
+{
+#if MAX30003_BINARY_OUTPUT
+    binaryOutputSink.onBeat(beat);
+#else
+    printf("Beat: %lu RR: %u\n", beat->sampleIndex, beat->rrMs);
+#endif
+}
+
 void max3003CallBack(signed int data, MAX30003CallBackType type)
 {
+    /* Legacy callback has no sample index, valid samples are counted here */
+    static uint32_t sampleIndex = 0;
     if (type == ECGDATA)
     {
+#if MAX30003_FILTER
+        data = ecgFilter.processSample(data, 0);
+#endif
         printf("%ld\n", data);
+#if MAX30003_LATENCY_PROBE
+        latencyProbe.output();
+#endif
+#if MAX30003_QRS
+        qrsDetector.processSample(data, 0, sampleIndex);
+#endif
+        sampleIndex++;
     }
     else
     {
+#if MAX30003_QRS
+        qrsDetector.onHardwareRR(data, sampleIndex);
+#endif
+#if MAX30003_HRV
+        hrvEngine.addRR((uint16_t)data);
+#endif
         printf("RR Interval: %ld\n", data);
     }
 }
 
+#if MAX30003_LATENCY_PROBE
+/*  With DMA output a printf would write to UART while a frame is sent by DMA,
+    lines are queued in output transport after whole frames instead
+*/
+void latencyReportJson(const char *name, const char *metric, double value)
+{
+#if MAX30003_DMA_OUTPUT
+    char line[128];
+    int len = snprintf(line, sizeof(line), "{\"name\": \"%s\", \"metric\": \"%s\", \"value\": %.2f}\n", name, metric, value);
+    outputTransport.write((const uint8_t *)line, len < (int)sizeof(line) ? len : (int)sizeof(line) - 1);
+#else
+    printf("{\"name\": \"%s\", \"metric\": \"%s\", \"value\": %.2f}\n", name, metric, value);
+#endif
+}
+#endif
+
+#if MAX30003_LATENCY_PROBE && MAX30003_SCHEDULER
+/* Misses, shed releases and WCET per stage, metric names follow stage names */
+void schedulerReport(void (*report)(const char *name, const char *metric, double value))
+{
+    for (int i = 0; i < scheduler.stages(); i++)
+    {
+        StageStats st;
+        scheduler.getStageStats(i, &st);
+        report(scheduler.stageName(i), "stage_misses", st.misses);
+        report(scheduler.stageName(i), "stage_shed", st.shed);
+        report(scheduler.stageName(i), "stage_wcet_us", st.wcetUs);
+        report(scheduler.stageName(i), "stage_max_latency_us", st.maxLatencyUs);
+    }
+}
+#endif
+
+/* Latency results (and stage statistics) as JSON lines */
+void latencyReport()
+{
+#if MAX30003_LATENCY_PROBE
+    latencyProbe.report(latencyReportJson);
+#if MAX30003_SCHEDULER
+    schedulerReport(latencyReportJson);
+#endif
+#if MAX30003_FLASH_RECORD
+    /* Compile time check covers only the typical erase, these show the erases that did not fit */
+    latencyReportJson("flash", "erase_max_us", flashStore.stats().eraseMaxUs);
+    latencyReportJson("flash", "erase_overruns", flashEraseOverruns);
+#endif
+#endif
+}
+
+/*  Print latency results every LATENCY_REPORT_MS
+    Called from the context that writes output so lines never split a frame,
+    with DMA output they go through output transport (see latencyReportJson())
+*/
+void latencyReportTick()
+{
+#if MAX30003_LATENCY_PROBE
+    static uint32_t lastReportMs = 0;
+    uint32_t nowMs = to_ms_since_boot(get_absolute_time());
+    if (nowMs - lastReportMs >= LATENCY_REPORT_MS)
+    {
+        lastReportMs = nowMs;
+        latencyReport();
+    }
+#endif
+}
+
+/* Driver counters as TELEMETRY frame or text line */
+void telemetrySend()
+{
+#if TELEMETRY_MS
+    MAX30003Telemetry t;
+    max30003.getTelemetry(&t);
+#if MAX30003_BINARY_OUTPUT
+    t.clippedSamples = ecgStream.samplesClipped();
+    ecgStream.addTelemetry((const uint32_t *)&t, MAX30003_TELEMETRY_WORDS);
+#else
+    printf("Telemetry: samples %lu fast %lu empty %lu overflows %lu lost %lu rr %lu ring %lu/%lu dropped %lu irq max %lu cycles efit %lu\n",
+           t.samples, t.fastSamples, t.emptyReads, t.overflows, t.lostSamples, t.rrEvents,
+           t.ringHighWater, max30003Ring.capacity(), t.ringDropped + t.dmaDropped, t.irqMaxCycles, t.fifoThreshold);
+#endif
+#endif
+}
+
+/*  Send driver counters every TELEMETRY_MS
+    Called from the context that writes output, like latencyReportTick()
+*/
+void telemetryTick()
+{
+#if TELEMETRY_MS
+    static uint32_t lastMs = 0;
+    uint32_t nowMs = to_ms_since_boot(get_absolute_time());
+    if (nowMs - lastMs < TELEMETRY_MS)
+    {
+        return;
+    }
+    lastMs = nowMs;
+    telemetrySend();
+#endif
+}
+
+/* HRV summary of the 5 minute window */
+void hrvSend()
+{
+#if MAX30003_HRV
+#if MAX30003_BINARY_OUTPUT
+    binaryOutputSink.sendHrv();
+#else
+    HrvSummary h;
+    hrvEngine.summary(&h);
+    printf("HRV: window %lu s beats %u ectopic %u hr %u.%u sdnn %u.%u rmssd %u.%u pnn50 %u.%u lf %lu hf %lu\n",
+           h.windowMs / 1000, h.beats, h.ectopic, h.meanHrX10 / 10, h.meanHrX10 % 10, h.sdnnX10 / 10, h.sdnnX10 % 10,
+           h.rmssdX10 / 10, h.rmssdX10 % 10, h.pnn50X10 / 10, h.pnn50X10 % 10, h.lfPower, h.hfPower);
+#endif
+#endif
+}
+
+/*  Send HRV summary every HRV_SUMMARY_MS
+    Frequency domain part walks the 5 minute window, a few ms once per summary
+*/
+void hrvTick()
+{
+#if MAX30003_HRV
+    static uint32_t lastMs = 0;
+    uint32_t nowMs = to_ms_since_boot(get_absolute_time());
+    if (nowMs - lastMs < HRV_SUMMARY_MS)
+    {
+        return;
+    }
+    lastMs = nowMs;
+    hrvSend();
+#endif
+}
+
+/*  Send partly filled output buffer once it is OUTPUT_MAX_DELAY_US old and
+    let FIFO coalescing follow the output backlog
+*/
+void outputTick()
+{
+#if MAX30003_DMA_OUTPUT
+    outputTransport.poll(time_us_64());
+    max30003.setOutputBacklog(outputTransport.backlogPercent());
+#endif
+}
+
+/*  One flash operation of recording per call, called from the context that writes
+    output after every decoded block. Readout command blocks until whole recording
+    is sent (about 20x faster than real time at 115200 baud), blocks acquired
+    meanwhile are dropped and counted in telemetry
+*/
+void flashRecordTick()
+{
+#if MAX30003_FLASH_RECORD
+    int c = uart_is_readable(uart0) ? uart_getc(uart0) : -1;
+    if (c == 'D')
+    {
+#if MAX30003_DMA_OUTPUT
+        /* Readout writes blocking, queued frames go first */
+        outputTransport.flush();
+        while (!outputTransport.idle())
+        {
+        }
+#endif
+        flashStore.flush();
+        FlashStoreCursor cursor = flashStore.seek(flashStore.firstSampleIndex());
+        readoutStream.sendConfig();
+        while (flashStore.readout(&cursor, &readoutStream, 64) > 0)
+        {
+        }
+    }
+    else if (c == 'C')
+    {
+        flashStore.clear();
+    }
+    /* Flash goes busy only while FIFO is nearly empty, otherwise wait for next read */
+    if (time_us_32() - max30003.lastFifoReadUs() < FLASH_ALIGN_US)
+    {
+        flashStore.service();
+    }
+#endif
+}
+
+/*  Direct mode: GPIO intruppt decodes samples and writes them to ecgStream, flash and output.
+    Ticks run with GPIO intruppt masked so they never write into the middle of a frame,
+    INTB edge is latched meanwhile and served when it is unmasked. DMA output intruppt keeps running
+*/
+void directModeTicks()
+{
+    irq_set_enabled(IO_IRQ_BANK0, false);
+    flashRecordTick();
+    latencyReportTick();
+    outputTick();
+    telemetryTick();
+    hrvTick();
+    irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+/* Send raw block as capture record, config record goes first */
+void rawCaptureBlock(const MAX30003RawBlock *block)
+{
+    static bool started = false;
+    uint8_t record[RAW_DUMP_MAX_RECORD];
+    if (!started)
+    {
+        started = true;
+        uart_write_blocking(uart0, record, rawDumpConfig(SAMPLINGRATE_512, record));
+    }
+    uart_write_blocking(uart0, record, rawDumpBlock(block, record));
+}
+
+#if MAX30003_SCHEDULER
+/* Oldest acquired block waits for decoding, release is when its FIFO was read */
+bool decodeReady(void *ctx, uint64_t *releaseUs)
+{
+#if MAX30003_PIPELINE
+    const MAX30003RawBlock *block = max30003Ring.peek();
+    if (block == nullptr)
+    {
+        return false;
+    }
+    *releaseUs = block->timeUs;
+    return true;
+#else
+    return max30003.dmaBlockReady(releaseUs);
+#endif
+}
+
+void decodeStage(void *ctx)
+{
+#if MAX30003_PIPELINE
+    max30003.processRawBlock(max30003Ring.peek());
+    max30003Ring.release();
+#else
+    max30003.processDmaBlock();
+#endif
+}
+
+#if MAX30003_FLASH_RECORD
+/* Released once per FIFO read while FIFO is still nearly empty, see FLASH_ALIGN_US */
+bool flashReady(void *ctx, uint64_t *releaseUs)
+{
+    static uint32_t servedReadUs = 0;
+    uint32_t readUs = max30003.lastFifoReadUs();
+    uint32_t age = time_us_32() - readUs;
+    if (readUs == servedReadUs || age >= FLASH_ALIGN_US)
+    {
+        return false;
+    }
+    servedReadUs = readUs;
+    *releaseUs -= age;
+    return true;
+}
+#endif
+
+void flashStage(void *ctx)
+{
+    flashRecordTick();
+}
+
+void outputStage(void *ctx)
+{
+    outputTick();
+}
+
+void telemetryStage(void *ctx)
+{
+    telemetrySend();
+}
+
+void hrvStage(void *ctx)
+{
+    hrvSend();
+}
+
+void latencyStage(void *ctx)
+{
+    latencyReport();
+}
+
+/* Hardware alarm that wakes the scheduler core for next periodic release, -1 before initScheduler() */
+int schedulerAlarm = -1;
+
+/* Only wakes the core from __wfe() / __wfi() */
+void schedulerAlarmIntruppt(uint alarm)
+{
+}
+
+/*  Decode, flash and output can not be shed, reports go first when decoding falls behind.
+    Call from the core that runs the stages
+*/
+void initScheduler()
+{
+    const StageConfig stages[] = {
+        {"decode", decodeStage, decodeReady, nullptr, STAGE_DATA, 0, DECODE_DEADLINE_US, 0, false},
+#if MAX30003_FLASH_RECORD
+        {"flash", flashStage, flashReady, nullptr, STAGE_DATA, 0, FLASH_ALIGN_US + FLASH_ERASE_US, 1, false},
+#endif
+#if MAX30003_DMA_OUTPUT
+        {"output", outputStage, nullptr, nullptr, STAGE_PERIODIC, OUTPUT_MAX_DELAY_US / 4, OUTPUT_MAX_DELAY_US / 4, 1, false},
+#endif
+#if TELEMETRY_MS
+        {"telemetry", telemetryStage, nullptr, nullptr, STAGE_PERIODIC, TELEMETRY_MS * 1000, 100000, 2, true},
+#endif
+#if MAX30003_HRV
+        {"hrv", hrvStage, nullptr, nullptr, STAGE_PERIODIC, HRV_SUMMARY_MS * 1000, 1000000, 3, true},
+#endif
+#if MAX30003_LATENCY_PROBE
+        {"latency_report", latencyStage, nullptr, nullptr, STAGE_PERIODIC, LATENCY_REPORT_MS * 1000, 1000000, 3, true},
+#endif
+    };
+    for (const StageConfig &stage : stages)
+    {
+        scheduler.addStage(&stage);
+    }
+    /* Half of ring backed up counts as behind */
+    scheduler.configureShedding(50, 2000000);
+    /* Alarm intruppt is enabled on calling core, the one that sleeps in runScheduler() */
+    schedulerAlarm = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback((uint)schedulerAlarm, schedulerAlarmIntruppt);
+}
+
+/*  Run stages until none is released, then sleep until next block or periodic release.
+    Blocks come every 15.6 ms (LIVE) or 47 ms (RECORD), output stage is due every
+    OUTPUT_MAX_DELAY_US / 4, so sleep is cut short by alarm at nextReleaseUs()
+*/
+void runScheduler()
+{
+#if MAX30003_PIPELINE
+    scheduler.setBacklog((uint8_t)(max30003Ring.size() * 100 / max30003Ring.capacity()));
+#endif
+    if (scheduler.runOnce())
+    {
+        return;
+    }
+    uint64_t next = scheduler.nextReleaseUs();
+    /* true if release time has already passed, run again without sleeping */
+    if (next != UINT64_MAX && hardware_alarm_set_target((uint)schedulerAlarm, from_us_since_boot(next)))
+    {
+        return;
+    }
+#if MAX30003_PIPELINE
+    __wfe();
+#else
+    __wfi();
+#endif
+}
+#endif
+
+/* Core 1 decodes raw blocks pushed by core 0 and calls max3003CallBack */
+void core1Entry()
+{
+#if MAX30003_DMA_OUTPUT && !MAX30003_RAW_CAPTURE
+    /* Output DMA intruppt runs on core that writes output */
+    initOutputDma();
+#endif
+#if MAX30003_SCHEDULER && !MAX30003_RAW_CAPTURE
+    initScheduler();
+    while (1)
+    {
+        runScheduler();
+    }
+#endif
+    while (1)
+    {
+        const MAX30003RawBlock *block = max30003Ring.peek();
+        if (block == nullptr)
+        {
+            /* Core 0 sends event after every pushed block */
+            __wfe();
+            continue;
+        }
+#if MAX30003_RAW_CAPTURE
+        /* Nothing else goes to UART, capture stays a clean record sequence */
+        rawCaptureBlock(block);
+        max30003Ring.release();
+#else
+        max30003.processRawBlock(block);
+        max30003Ring.release();
+        flashRecordTick();
+        latencyReportTick();
+        outputTick();
+        telemetryTick();
+        hrvTick();
+#endif
+    }
+}
+
 int main()
 {
     /* initialise all stdio for printf */
@@ -71,21 +780,85 @@ int main()
     initiaLizeMAX30003SPI();
     /* Read MAX30003 Revesion ID */
     max30003.max30003ReadInfo();
-    /* Configure MAX30003 */
-    max30003.max30003Begin();
-    /* Set Sampling Rate */
-    max30003.max30003SetsamplingRate(SAMPLINGRATE_512);
-    /* Set Intruppts */
-    max30003.setIntruppts();
+#if MAX30003_BINARY_OUTPUT && MAX30003_COMPRESS
+    ecgStream.setCompression(true);
+#endif
+    /* Select FIFO threshold */
+#if MAX30003_FLASH_RECORD
+    /* Larger thresholds leave too little FIFO for a sector erase, see FLASH_FIFO_HEADROOM_US */
+    max30003.setCoalescing(COALESCE_LIVE);
+#else
+    max30003.setCoalescing(MAX30003_COALESCING);
+#endif
+    /* Configure MAX30003, Sampling Rate and Intruppts with one SYNCH */
+    max30003.max30003Configure(SAMPLINGRATE_512);
+    /* Filter coefficients have to match sampling rate */
+    ecgFilter.configure(SAMPLINGRATE_512, MAINS_HZ, ECG_FILTER_ALL);
+    qrsDetector.configure(SAMPLINGRATE_512);
+    qrsDetector.setBeatCallBack(qrsBeatCallBack, nullptr);
+#if MAX30003_FLASH_RECORD
+    /* Continue recording after newest sector, core 0 is held by flash_safe_execute() of core 1 */
+    flashStore.mount(SAMPLINGRATE_512);
+    multicore_lockout_victim_init();
+#endif
     /* Read Intruppt Configuration */
     max30003.readIntruppt();
+#if MAX30003_LATENCY_PROBE
+    max30003.setLatencyProbe(&latencyProbe);
+#endif
+#if MAX30003_PIPELINE
+    /* Start processing core before first block is pushed */
+    max30003.setPipeline(&max30003Ring);
+    multicore_launch_core1(core1Entry);
+#else
+#if MAX30003_DMA_OUTPUT
+    initOutputDma();
+#endif
+#if MAX30003_SCHEDULER
+    initScheduler();
+#endif
+#endif
+#if MAX30003_DMA_ACQUISITION
+    /* Setup DMA for FIFO burst reads */
+    if (max30003.enableDmaAcquisition())
+    {
+        irq_set_exclusive_handler(DMA_IRQ_0, max30003DmaIntruppt);
+        irq_set_enabled(DMA_IRQ_0, true);
+    }
+#endif
     /* PUll UP Intruppt pin */
     gpio_pull_up(INTPIN);
+    max30003.setIntPin(INTPIN);
     /* Setup intrupt on GPIO INTPIN */
     gpio_set_irq_enabled_with_callback(INTPIN, GPIO_IRQ_EDGE_FALL, true, &max30003Intruppt);
+    /*  INTB may already be low (FIFO filled during setup), falling edge would never come.
+        Serve it once with intruppts disabled so it does not race a real edge
+    */
+    uint32_t irqState = save_and_disable_interrupts();
+    max30003.getDataIntrupptCallback();
+    restore_interrupts(irqState);
     while (1)
     {
+#if MAX30003_PIPELINE
+        /* Core 0 only serves intruppts */
+        __wfi();
+#elif MAX30003_SCHEDULER
+        runScheduler();
+#elif MAX30003_DMA_ACQUISITION
+        /* Decode completed FIFO blocks, sleep until next intruppt otherwise */
+        if (!max30003.processDmaBlock())
+        {
+            __wfi();
+        }
+        flashRecordTick();
+        latencyReportTick();
+        outputTick();
+        telemetryTick();
+        hrvTick();
+#else
         sleep_ms(1000);
+        directModeTicks();
+#endif
     }
     return 0;
 }
@@ -0,0 +1,217 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "ecg_compress.h"
+
+#define ORDER_VERBATIM 0
+#define SAMPLE_BITS 18
+
+/* MSB first bit writer, stops writing at end of buffer and remembers it */
+typedef struct
+{
+    uint8_t *buf;
+    int cap;
+    int pos;
+    uint32_t acc;
+    int bits;
+    bool full;
+} BitWriter;
+
+static void bitWrite(BitWriter *w, uint32_t value, int n)
+{
+    /* acc holds < 8 bits between calls, so n up to 24 fits */
+    w->acc = (w->acc << n) | (value & ((1u << n) - 1));
+    w->bits += n;
+    while (w->bits >= 8)
+    {
+        w->bits -= 8;
+        if (w->pos >= w->cap)
+        {
+            w->full = true;
+            return;
+        }
+        w->buf[w->pos++] = (uint8_t)(w->acc >> w->bits);
+    }
+    w->acc &= (1u << w->bits) - 1;
+}
+
+static int bitFlush(BitWriter *w)
+{
+    if (w->bits > 0)
+    {
+        bitWrite(w, 0, 8 - w->bits);
+    }
+    return w->pos;
+}
+
+typedef struct
+{
+    const uint8_t *buf;
+    int len;
+    int pos;
+    uint32_t acc;
+    int bits;
+    bool error;
+} BitReader;
+
+static uint32_t bitRead(BitReader *r, int n)
+{
+    while (r->bits < n)
+    {
+        if (r->pos >= r->len)
+        {
+            r->error = true;
+            return 0;
+        }
+        r->acc = (r->acc << 8) | r->buf[r->pos++];
+        r->bits += 8;
+    }
+    r->bits -= n;
+    uint32_t v = (r->acc >> r->bits) & ((1u << n) - 1);
+    r->acc &= (1u << r->bits) - 1;
+    return v;
+}
+
+static inline uint32_t zigzag(int32_t r)
+{
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t u)
+{
+    return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+static inline int32_t residual(const int32_t *x, int n, int order)
+{
+    if (order == 1 || n == 1)
+    {
+        return x[n] - x[n - 1];
+    }
+    return x[n] - 2 * x[n - 1] + x[n - 2];
+}
+
+static inline int32_t signExtend18(uint32_t raw)
+{
+    return (int32_t)(raw << 14) >> 14;
+}
+
+static int writeVerbatim(const int32_t *samples, int count, uint8_t *out)
+{
+    BitWriter w = {out, ECG_COMPRESS_MAX_BYTES, 0, 0, 0, false};
+    bitWrite(&w, ORDER_VERBATIM, 2);
+    bitWrite(&w, (uint32_t)count, 6);
+    for (int i = 0; i < count; i++)
+    {
+        bitWrite(&w, (uint32_t)samples[i], SAMPLE_BITS);
+    }
+    return bitFlush(&w);
+}
+
+int ecgCompressBlock(const int32_t *samples, int count, uint8_t *out)
+{
+    if (count <= 0)
+    {
+        return 0;
+    }
+    if (count > ECG_COMPRESS_MAX_SAMPLES)
+    {
+        count = ECG_COMPRESS_MAX_SAMPLES;
+    }
+    /* Pass 1: cost of both predictors */
+    uint32_t sum1 = 0;
+    uint32_t sum2 = 0;
+    for (int n = 1; n < count; n++)
+    {
+        sum1 += zigzag(residual(samples, n, 1));
+        sum2 += zigzag(residual(samples, n, 2));
+    }
+    int order = sum2 < sum1 ? 2 : 1;
+    uint32_t sum = order == 2 ? sum2 : sum1;
+    /* K with mean of u close to 2^K, as FLAC does */
+    uint32_t residuals = (uint32_t)(count > 1 ? count - 1 : 1);
+    int k = 0;
+    while (k < ECG_RICE_RAW_BITS - 1 && (residuals << (k + 1)) < sum)
+    {
+        k++;
+    }
+
+    /* Pass 2: write, give up as soon as block is not smaller than verbatim */
+    int verbatimBytes = (8 + SAMPLE_BITS * count + 7) / 8;
+    BitWriter w = {out, verbatimBytes - 1, 0, 0, 0, false};
+    bitWrite(&w, (uint32_t)order, 2);
+    bitWrite(&w, (uint32_t)count, 6);
+    bitWrite(&w, (uint32_t)k, 5);
+    bitWrite(&w, (uint32_t)samples[0], SAMPLE_BITS);
+    for (int n = 1; n < count && !w.full; n++)
+    {
+        uint32_t u = zigzag(residual(samples, n, order));
+        uint32_t q = u >> k;
+        if (q >= ECG_RICE_ESCAPE)
+        {
+            bitWrite(&w, (1u << ECG_RICE_ESCAPE) - 1, ECG_RICE_ESCAPE);
+            bitWrite(&w, u, ECG_RICE_RAW_BITS);
+            continue;
+        }
+        /* q ones and a zero */
+        bitWrite(&w, ((1u << q) - 1) << 1, (int)q + 1);
+        if (k > 0)
+        {
+            bitWrite(&w, u, k);
+        }
+    }
+    int len = bitFlush(&w);
+    if (w.full)
+    {
+        return writeVerbatim(samples, count, out);
+    }
+    return len;
+}
+
+int ecgDecompressBlock(const uint8_t *in, int len, int32_t *samples, int maxCount)
+{
+    BitReader r = {in, len, 0, 0, 0, false};
+    int order = (int)bitRead(&r, 2);
+    int count = (int)bitRead(&r, 6);
+    if (r.error || count == 0 || count > maxCount || order > 2)
+    {
+        return -1;
+    }
+    if (order == ORDER_VERBATIM)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            samples[i] = signExtend18(bitRead(&r, SAMPLE_BITS));
+        }
+        return r.error ? -1 : count;
+    }
+    int k = (int)bitRead(&r, 5);
+    if (k >= ECG_RICE_RAW_BITS)
+    {
+        return -1;
+    }
+    samples[0] = signExtend18(bitRead(&r, SAMPLE_BITS));
+    for (int n = 1; n < count && !r.error; n++)
+    {
+        uint32_t q = 0;
+        while (q < ECG_RICE_ESCAPE && bitRead(&r, 1) == 1)
+        {
+            q++;
+        }
+        uint32_t u;
+        if (q == ECG_RICE_ESCAPE)
+        {
+            u = bitRead(&r, ECG_RICE_RAW_BITS);
+        }
+        else
+        {
+            u = (q << k) | (k > 0 ? bitRead(&r, k) : 0);
+        }
+        int32_t prediction = order == 1 || n == 1 ? samples[n - 1] : 2 * samples[n - 1] - samples[n - 2];
+        samples[n] = signExtend18((uint32_t)(prediction + unzigzag(u)));
+    }
+    return r.error ? -1 : count;
+}
@@ -0,0 +1,54 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Lossless compression of 18 bit ECG sample blocks
+
+    Every block is decoded on its own, a lost frame does not break the next one.
+    Block layout, bits MSB first:
+    ORDER[2] COUNT[6]
+    ORDER 0: SAMPLE[COUNT][18]                      verbatim
+    ORDER 1/2: K[5] SAMPLE0[18] RESIDUAL[COUNT - 1]   Rice coded
+        ORDER 1 residual: x[n] - x[n-1]
+        ORDER 2 residual: x[n] - 2x[n-1] + x[n-2] (x[1] uses order 1)
+    Residual r is mapped to u = 2r (r >= 0) or -2r - 1 (r < 0) and written as
+    u >> K in unary (ones, then a zero) and the low K bits of u.
+    Quotients of ECG_RICE_ESCAPE or more are written as ECG_RICE_ESCAPE ones
+    followed by u in ECG_RICE_RAW_BITS bits.
+
+    Cost is fixed per block: one pass to choose order and K, one pass to write,
+    a block that would not be smaller than verbatim is written verbatim, so output
+    never exceeds ECG_COMPRESS_MAX_BYTES and encoding does at most three passes.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#define ECG_COMPRESS_MAX_SAMPLES 32
+/* Verbatim block: 8 bit header + 18 bits per sample */
+#define ECG_COMPRESS_MAX_BYTES ((8 + 18 * ECG_COMPRESS_MAX_SAMPLES + 7) / 8)
+#define ECG_RICE_ESCAPE 16
+/* Order 2 residual of 18 bit samples needs 20 bits, mapped to unsigned 21 */
+#define ECG_RICE_RAW_BITS 21
+/* 18 bit two's complement range of one coded sample */
+#define ECG_SAMPLE_MAX 131071
+#define ECG_SAMPLE_MIN (-131072)
+
+/*  Filtered samples can overshoot the ADC range, callers saturate before coding
+    because 18 bit coding would wrap them to the other rail
+*/
+static inline int32_t ecgSaturate18(int32_t sample)
+{
+    return sample > ECG_SAMPLE_MAX ? ECG_SAMPLE_MAX : (sample < ECG_SAMPLE_MIN ? ECG_SAMPLE_MIN : sample);
+}
+
+/*  samples: count 18 bit two's complement samples, count 1 to ECG_COMPRESS_MAX_SAMPLES
+    out: at least ECG_COMPRESS_MAX_BYTES
+    Returns number of Bytes written
+*/
+int ecgCompressBlock(const int32_t *samples, int count, uint8_t *out);
+
+/* Returns number of samples, -1 if block is damaged or longer than maxCount */
+int ecgDecompressBlock(const uint8_t *in, int len, int32_t *samples, int maxCount);
@@ -0,0 +1,62 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "ecg_decoder.h"
+
+/*  Action for every ETAG, so decode loop has no branch per tag
+    D[0]   sample increments time base
+    D[1]   sample is FAST recovery (ECG_FLAG_FAST)
+    D[2]   stop reading after this word
+    D[7:4] ECG_DECODE_* status
+*/
+#define ETAG_KEEP 0x01
+#define ETAG_FAST 0x02
+#define ETAG_STOP 0x04
+#define ETAG_STATUS(x) ((x) << 4)
+
+static const uint8_t eTagTable[8] = {
+    /* 000 valid */ ETAG_KEEP,
+    /* 001 fast */ ETAG_KEEP | ETAG_FAST,
+    /* 010 valid EOF */ ETAG_KEEP | ETAG_STOP | ETAG_STATUS(ECG_DECODE_EOF),
+    /* 011 fast EOF */ ETAG_KEEP | ETAG_FAST | ETAG_STOP | ETAG_STATUS(ECG_DECODE_EOF),
+    /* 100 reserved */ ETAG_STOP | ETAG_STATUS(ECG_DECODE_INVALID),
+    /* 101 empty */ ETAG_STOP | ETAG_STATUS(ECG_DECODE_EMPTY),
+    /* 110 reserved */ ETAG_STOP | ETAG_STATUS(ECG_DECODE_INVALID),
+    /* 111 overflow */ ETAG_STOP | ETAG_STATUS(ECG_DECODE_OVERFLOW),
+};
+
+int ecgDecodeFifo(const uint8_t *buf, int words, int32_t *samples, uint8_t *flags, EcgDecodeSummary *summary)
+{
+    int count = 0;
+    int fast = 0;
+    int i = 0;
+    uint8_t status = 0;
+    while (i < words)
+    {
+        const uint8_t *w = &buf[i * 3];
+        uint32_t raw = ((uint32_t)w[0] << 16) | ((uint32_t)w[1] << 8) | w[2];
+        uint8_t action = eTagTable[(raw >> 3) & 0x7];
+        uint32_t isFast = (action >> 1) & 1;
+        /* Sign extend D[23:6]: move sample to top of word, arithmetic shift back */
+        int32_t sample = (int32_t)(raw << 8) >> 14;
+        /* Output slot is always written, count only advances for kept samples */
+        samples[count] = sample & (int32_t)(isFast - 1);
+        flags[count] = (uint8_t)(isFast * ECG_FLAG_FAST);
+        count += action & ETAG_KEEP;
+        fast += isFast;
+        status |= action >> 4;
+        i++;
+        if (action & ETAG_STOP)
+        {
+            break;
+        }
+    }
+    summary->count = (uint8_t)count;
+    summary->fast = (uint8_t)fast;
+    summary->words = (uint8_t)i;
+    summary->status = status;
+    return count;
+}
@@ -0,0 +1,71 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  ECG FIFO word decoder
+
+    ECG_FIFO word (3 Bytes, MSB first):
+    D[23:6] ECG sample, 18 bit two's complement
+    D[5:3]  ETAG
+    D[2:0]  PTAG (unused on MAX30003)
+
+    ETAG  Meaning                    Time base  Action
+    000   Valid sample               +1         keep
+    001   FAST recovery sample       +1         voltage invalid, keep time step
+    010   Last valid sample (EOF)    +1         keep, stop reading
+    011   Last FAST sample (EOF)     +1         voltage invalid, stop reading
+    101   FIFO empty                 0          discard, stop reading
+    111   FIFO overflow              0          discard, FIFO_RST required
+*/
+#pragma once
+
+#include <stdint.h>
+
+/* Per sample flags */
+/* Sample was taken in FAST recovery mode (ETAG 1/3), voltage is not valid but time step is */
+#define ECG_FLAG_FAST 0x01
+/* FIFO overflowed before this sample, samples are missing in front of it */
+#define ECG_FLAG_GAP 0x02
+
+/* EcgDecodeSummary status bits, tell why decoding stopped */
+#define ECG_DECODE_EOF 0x01
+#define ECG_DECODE_EMPTY 0x02
+#define ECG_DECODE_OVERFLOW 0x04
+/* ETAG 4 or 6, not defined by datasheet */
+#define ECG_DECODE_INVALID 0x08
+
+#define ECG_ETAG_VALID 0
+#define ECG_ETAG_FAST 1
+#define ECG_ETAG_VALID_EOF 2
+#define ECG_ETAG_FAST_EOF 3
+#define ECG_ETAG_EMPTY 5
+#define ECG_ETAG_OVERFLOW 7
+
+typedef struct
+{
+    /* Samples written to output, every one is one time step */
+    uint8_t count;
+    /* Samples with ECG_FLAG_FAST */
+    uint8_t fast;
+    /* FIFO words consumed, including the one that stopped decoding */
+    uint8_t words;
+    /* ECG_DECODE_* bits */
+    uint8_t status;
+} EcgDecodeSummary;
+
+/*  Decode up to words FIFO words in one pass
+    samples/flags must have room for words entries, FAST samples are written as 0
+    Returns number of samples written (summary->count)
+*/
+int ecgDecodeFifo(const uint8_t *buf, int words, int32_t *samples, uint8_t *flags, EcgDecodeSummary *summary);
+
+/* Build one FIFO word, used by simulators and benchmarks */
+static inline void ecgEncodeFifoWord(int32_t sample, uint8_t eTag, uint8_t *word)
+{
+    uint32_t raw = (((uint32_t)sample & 0x3FFFF) << 6) | ((uint32_t)(eTag & 0x7) << 3);
+    word[0] = (uint8_t)(raw >> 16);
+    word[1] = (uint8_t)(raw >> 8);
+    word[2] = (uint8_t)raw;
+}
@@ -0,0 +1,408 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "ecg_fanout.h"
+#include <string.h>
+
+/* Multiplies per sample of notch and low-pass biquads */
+#define ECG_FANOUT_BIQUAD_MACS 5
+
+EcgFanout::EcgFanout()
+{
+    configure(SAMPLINGRATE_512, 50, ECG_FILTER_ALL);
+}
+
+bool EcgFanout::configure(uint16_t sampleRate, uint8_t mainsHz, uint8_t stages)
+{
+    _sampleRate = sampleRate;
+    _mainsHz = mainsHz;
+    _stages = stages;
+    memset(_sources, 0, sizeof(_sources));
+    memset(_branches, 0, sizeof(_branches));
+    memset(_subscribers, 0, sizeof(_subscribers));
+    _nextIndex = 0;
+    _haveIndex = false;
+    _filterOk = stages == 0 || _filter.configure(sampleRate, mainsHz, stages);
+    return _filterOk;
+}
+
+int8_t EcgFanout::findBranch(EcgFanoutStream stream, uint16_t rate)
+{
+    for (int8_t i = 0; i < ECG_FANOUT_MAX_BRANCHES; i++)
+    {
+        if (_branches[i].used && _branches[i].stream == stream && _branches[i].rate == rate)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int8_t EcgFanout::addBranch(EcgFanoutStream stream, uint16_t rate)
+{
+    const EcgFanoutFir *fir = nullptr;
+    uint16_t factor = 1;
+    if (stream == ECG_FANOUT_RAW || stream == ECG_FANOUT_FILTERED || stream == ECG_FANOUT_STATS)
+    {
+        if (rate == 0 || rate > _sampleRate || _sampleRate % rate != 0)
+        {
+            return -1;
+        }
+        factor = _sampleRate / rate;
+    }
+    if ((stream == ECG_FANOUT_RAW || stream == ECG_FANOUT_FILTERED) && factor > 1)
+    {
+        for (const EcgFanoutFir &f : ECG_FANOUT_FIR)
+        {
+            if (f.factor == factor)
+            {
+                fir = &f;
+            }
+        }
+        if (fir == nullptr)
+        {
+            return -1;
+        }
+    }
+    if ((stream == ECG_FANOUT_FILTERED || stream == ECG_FANOUT_STATS) && !_filterOk)
+    {
+        return -1;
+    }
+    for (int8_t i = 0; i < ECG_FANOUT_MAX_BRANCHES; i++)
+    {
+        Branch &b = _branches[i];
+        if (b.used)
+        {
+            continue;
+        }
+        memset(&b, 0, sizeof(b));
+        b.used = true;
+        b.stream = stream;
+        b.rate = stream == ECG_FANOUT_RR ? 0 : rate;
+        /* Stats window in input samples */
+        b.factor = stream == ECG_FANOUT_STATS ? 0 : (uint8_t)factor;
+        b.fir = fir;
+        if (fir != nullptr && _sources[stream].branches++ == 0)
+        {
+            /* History was not kept while stream had no FIR branch */
+            memset(_sources[stream].history, 0, sizeof(_sources[stream].history));
+        }
+        return i;
+    }
+    return -1;
+}
+
+int EcgFanout::subscribe(EcgFanoutStream stream, uint16_t rate, void (*onBlock)(const EcgFanoutBlock *, void *), void *ctx)
+{
+    if (stream >= ECG_FANOUT_STREAMS || onBlock == nullptr)
+    {
+        return -1;
+    }
+    int id = -1;
+    for (int i = 0; i < ECG_FANOUT_MAX_SUBSCRIBERS && id < 0; i++)
+    {
+        id = _subscribers[i].used ? -1 : i;
+    }
+    if (id < 0)
+    {
+        return -1;
+    }
+    int8_t branch = findBranch(stream, stream == ECG_FANOUT_RR ? 0 : rate);
+    if (branch < 0)
+    {
+        branch = addBranch(stream, rate);
+    }
+    if (branch < 0)
+    {
+        return -1;
+    }
+    Subscriber &s = _subscribers[id];
+    memset(&s, 0, sizeof(s));
+    s.used = true;
+    s.branch = branch;
+    s.onBlock = onBlock;
+    s.ctx = ctx;
+    _branches[branch].subscribers++;
+    return id;
+}
+
+void EcgFanout::unsubscribe(int id)
+{
+    if (id < 0 || id >= ECG_FANOUT_MAX_SUBSCRIBERS || !_subscribers[id].used)
+    {
+        return;
+    }
+    Branch &b = _branches[_subscribers[id].branch];
+    _subscribers[id].used = false;
+    if (--b.subscribers == 0)
+    {
+        b.used = false;
+        if (b.fir != nullptr)
+        {
+            _sources[b.stream].branches--;
+        }
+    }
+}
+
+void EcgFanout::samplesCallBack(const MAX30003SampleBlock *block, void *ctx)
+{
+    static_cast<EcgFanout *>(ctx)->publish(block);
+}
+
+void EcgFanout::rrCallBack(uint32_t rrMs, uint32_t sampleIndex, void *ctx)
+{
+    static_cast<EcgFanout *>(ctx)->publishRR(rrMs, sampleIndex);
+}
+
+/* Hand one block to every subscriber of branch, same pointer for all */
+void EcgFanout::deliver(int8_t branch, const EcgFanoutBlock *block)
+{
+    for (Subscriber &s : _subscribers)
+    {
+        if (s.used && s.branch == branch)
+        {
+            s.blocks++;
+            s.samples += block->count;
+            s.onBlock(block, s.ctx);
+        }
+    }
+}
+
+void EcgFanout::publish(const MAX30003SampleBlock *block)
+{
+    uint16_t count = block->count > ECG_FANOUT_BLOCK ? ECG_FANOUT_BLOCK : block->count;
+    if (count == 0)
+    {
+        return;
+    }
+    bool jump = _haveIndex && (block->firstIndex != _nextIndex || (block->flags[0] & ECG_FLAG_GAP));
+    _haveIndex = true;
+    _nextIndex = block->firstIndex + count;
+    bool raw = false;
+    bool filtered = false;
+    for (const Branch &b : _branches)
+    {
+        raw |= b.used && b.stream == ECG_FANOUT_RAW;
+        filtered |= b.used && (b.stream == ECG_FANOUT_FILTERED || b.stream == ECG_FANOUT_STATS);
+    }
+    if (raw)
+    {
+        runSamples(ECG_FANOUT_RAW, block->samples, block->flags, count, block->firstIndex, jump);
+    }
+    if (filtered)
+    {
+        /* Filter runs once, filtered and stats branches share its output */
+        if (_stages != 0)
+        {
+            _filter.process(block->samples, _filtered, count, block->flags);
+        }
+        else
+        {
+            memcpy(_filtered, block->samples, count * sizeof(int32_t));
+        }
+        runSamples(ECG_FANOUT_FILTERED, _filtered, block->flags, count, block->firstIndex, jump);
+        runStats(_filtered, block->flags, count, block->firstIndex, jump);
+    }
+}
+
+void EcgFanout::runSamples(EcgFanoutStream stream, const int32_t *samples, const uint8_t *flags, uint16_t count, uint32_t firstIndex, bool jump)
+{
+    Source &src = _sources[stream];
+    if (src.branches > 0)
+    {
+        if (jump)
+        {
+            /* Samples before the gap are not neighbours of these, FIR starts from silence */
+            memset(src.history, 0, sizeof(src.history));
+        }
+        for (uint16_t i = 0; i < count; i++)
+        {
+            src.history[(src.head + i) & (ECG_FANOUT_HISTORY - 1)] = samples[i];
+        }
+        src.head += count;
+    }
+    for (int8_t n = 0; n < ECG_FANOUT_MAX_BRANCHES; n++)
+    {
+        Branch &b = _branches[n];
+        if (!b.used || b.stream != stream)
+        {
+            continue;
+        }
+        EcgFanoutBlock out = {stream, b.rate, samples, flags, count, firstIndex, 0, 0, nullptr};
+        if (b.fir != nullptr)
+        {
+            /* Output at every input index that ends a group of factor samples */
+            uint32_t mask = b.factor - 1;
+            uint16_t produced = 0;
+            uint32_t first = 0;
+            for (uint16_t i = 0; i < count; i++)
+            {
+                uint32_t index = firstIndex + i;
+                b.pendingFlags |= flags[i];
+                if ((index & mask) != mask)
+                {
+                    continue;
+                }
+                if (produced == 0)
+                {
+                    first = index / b.factor;
+                }
+                b.out[produced] = decimate(src, src.head - count + i, b.fir);
+                b.outFlags[produced] = b.pendingFlags;
+                b.pendingFlags = 0;
+                produced++;
+            }
+            if (produced == 0)
+            {
+                continue;
+            }
+            out.samples = b.out;
+            out.flags = b.outFlags;
+            out.count = produced;
+            out.firstIndex = first;
+        }
+        deliver(n, &out);
+    }
+}
+
+/* Symmetric FIR ending at history position newest, pairs are added before the multiply */
+int32_t EcgFanout::decimate(const Source &src, uint32_t newest, const EcgFanoutFir *fir) const
+{
+    const uint32_t m = ECG_FANOUT_HISTORY - 1;
+    int half = fir->taps / 2;
+    uint32_t oldest = newest - (fir->taps - 1);
+    int64_t acc = (int64_t)fir->coef[half] * src.history[(newest - half) & m];
+    for (int i = 0; i < half; i++)
+    {
+        acc += (int64_t)fir->coef[i] * (src.history[(oldest + i) & m] + src.history[(newest - i) & m]);
+    }
+    return (int32_t)((acc + (1 << 14)) >> 15);
+}
+
+void EcgFanout::runStats(const int32_t *samples, const uint8_t *flags, uint16_t count, uint32_t firstIndex, bool jump)
+{
+    for (int8_t n = 0; n < ECG_FANOUT_MAX_BRANCHES; n++)
+    {
+        Branch &b = _branches[n];
+        if (!b.used || b.stream != ECG_FANOUT_STATS)
+        {
+            continue;
+        }
+        if (jump)
+        {
+            /* Window open before the gap would merge with the next one */
+            memset(&b.stats, 0, sizeof(b.stats));
+        }
+        uint32_t window = _sampleRate / b.rate;
+        for (uint16_t i = 0; i < count; i++)
+        {
+            uint32_t index = firstIndex + i;
+            EcgFanoutStats &s = b.stats;
+            if (s.count == 0)
+            {
+                s.firstIndex = index;
+                s.min = samples[i];
+                s.max = samples[i];
+                b.statsSum = 0;
+            }
+            s.min = samples[i] < s.min ? samples[i] : s.min;
+            s.max = samples[i] > s.max ? samples[i] : s.max;
+            b.statsSum += samples[i];
+            s.count++;
+            s.flagged += (flags[i] & (ECG_FLAG_FAST | ECG_FLAG_GAP)) ? 1 : 0;
+            if ((index + 1) % window != 0)
+            {
+                continue;
+            }
+            s.mean = (int32_t)(b.statsSum / s.count);
+            EcgFanoutBlock out = {ECG_FANOUT_STATS, b.rate, nullptr, nullptr, 0, s.firstIndex, 0, 0, &s};
+            deliver(n, &out);
+            memset(&s, 0, sizeof(s));
+        }
+    }
+}
+
+void EcgFanout::publishRR(uint32_t rrMs, uint32_t sampleIndex)
+{
+    for (int8_t n = 0; n < ECG_FANOUT_MAX_BRANCHES; n++)
+    {
+        Branch &b = _branches[n];
+        if (!b.used)
+        {
+            continue;
+        }
+        if (b.stream == ECG_FANOUT_STATS)
+        {
+            b.stats.rrMs = (uint16_t)rrMs;
+        }
+        else if (b.stream == ECG_FANOUT_RR)
+        {
+            EcgFanoutBlock out = {ECG_FANOUT_RR, 0, nullptr, nullptr, 0, 0, rrMs, sampleIndex, nullptr};
+            deliver(n, &out);
+        }
+    }
+}
+
+uint32_t EcgFanout::branchMacsPerSecond(const Branch &b) const
+{
+    return b.fir != nullptr ? (uint32_t)b.rate * (b.fir->taps / 2 + 1) : 0;
+}
+
+/* Branch state plus its share of the stream history it reads */
+uint32_t EcgFanout::branchMemory(const Branch &b) const
+{
+    uint32_t bytes = sizeof(Branch);
+    if (b.fir != nullptr)
+    {
+        bytes += sizeof(Source) / _sources[b.stream].branches;
+    }
+    return bytes;
+}
+
+bool EcgFanout::getSubscriberInfo(int id, EcgFanoutSubscriberInfo *info) const
+{
+    if (id < 0 || id >= ECG_FANOUT_MAX_SUBSCRIBERS || !_subscribers[id].used)
+    {
+        return false;
+    }
+    const Subscriber &s = _subscribers[id];
+    const Branch &b = _branches[s.branch];
+    info->stream = b.stream;
+    info->rate = b.rate;
+    info->sharedWith = b.subscribers - 1;
+    info->blocks = s.blocks;
+    info->samples = s.samples;
+    info->macsPerSecond = branchMacsPerSecond(b) / b.subscribers;
+    info->memoryBytes = sizeof(Subscriber) + branchMemory(b) / b.subscribers;
+    return true;
+}
+
+void EcgFanout::getUsage(EcgFanoutUsage *usage) const
+{
+    memset(usage, 0, sizeof(*usage));
+    for (const Subscriber &s : _subscribers)
+    {
+        usage->subscribers += s.used ? 1 : 0;
+    }
+    usage->memoryBytes = usage->subscribers * sizeof(Subscriber);
+    for (const Branch &b : _branches)
+    {
+        if (!b.used)
+        {
+            continue;
+        }
+        usage->branches++;
+        usage->macsPerSecond += branchMacsPerSecond(b);
+        usage->memoryBytes += branchMemory(b);
+        usage->filterActive |= b.stream == ECG_FANOUT_FILTERED || b.stream == ECG_FANOUT_STATS;
+    }
+    if (usage->filterActive)
+    {
+        uint8_t biquads = ((_stages & ECG_FILTER_NOTCH) ? 1 : 0) + ((_stages & ECG_FILTER_LOWPASS) ? 1 : 0);
+        usage->macsPerSecond += (uint32_t)_sampleRate * biquads * ECG_FANOUT_BIQUAD_MACS;
+        usage->memoryBytes += sizeof(EcgFilter) + sizeof(_filtered);
+    }
+}
@@ -0,0 +1,243 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Publish/subscribe fan-out of decoded samples to consumers with different rates
+
+    Streams: raw samples, filtered samples (EcgFilter), RR intervals and stats
+    (min/max/mean of filtered samples and last RR every window).
+    A subscriber asks for a stream and an output rate, rate has to divide the device rate.
+    Every stream and rate is one branch: filter, anti-alias FIR and decimation run
+    once per branch and its output block is handed by pointer to every subscriber of
+    the branch, nothing is copied per subscriber. Raw samples at device rate are
+    the driver block itself.
+
+    Anti-alias: symmetric Hamming windowed sinc, cutoff at half the output rate,
+    8 * factor - 1 taps, Q15 coefficients generated at compile time. Only output
+    samples are computed, cost is about 4 multiplies per input sample for any factor.
+    Aliases only fall into the transition band (above 0.3 x output rate).
+    Output sample k is input sample k * factor + factor - 1 delayed by (taps - 1) / 2
+    input samples (29 ms at 512 -> 128 sps).
+
+    A block whose firstIndex does not follow the last one, or that starts with
+    ECG_FLAG_GAP, is a discontinuity: FIR history is cleared (outputs restart as from
+    silence) and open stats windows are dropped, nothing is averaged across the gap.
+    History is cleared too when the first FIR branch of a stream is added.
+
+    publish()/publishRR() and subscribe()/unsubscribe() run in one context
+    (processing core), callbacks run inside publish().
+*/
+#pragma once
+
+#include <stdint.h>
+#include "max30003.h"
+#include "ecg_filter.h"
+
+#define ECG_FANOUT_MAX_SUBSCRIBERS 8
+/* One branch per subscriber in the worst case */
+#define ECG_FANOUT_MAX_BRANCHES ECG_FANOUT_MAX_SUBSCRIBERS
+/* Largest decimation factor, 512 sps -> 32 Hz */
+#define ECG_FANOUT_MAX_FACTOR 16
+#define ECG_FANOUT_TAPS(factor) (8 * (factor) - 1)
+/* Input history shared by branches of one stream, power of 2 >= taps of largest factor + one block */
+#define ECG_FANOUT_HISTORY 256
+/* Largest output block, one driver block at device rate */
+#define ECG_FANOUT_BLOCK MAX30003_FIFO_DEPTH
+
+typedef enum
+{
+    ECG_FANOUT_RAW,
+    ECG_FANOUT_FILTERED,
+    ECG_FANOUT_RR,
+    ECG_FANOUT_STATS,
+    ECG_FANOUT_STREAMS
+} EcgFanoutStream;
+
+typedef struct
+{
+    /* Window is 1 / rate of subscription */
+    uint32_t firstIndex;
+    uint16_t count;
+    int32_t min;
+    int32_t max;
+    int32_t mean;
+    /* Last RR interval, 0 if none in window */
+    uint16_t rrMs;
+    /* Samples with ECG_FLAG_FAST or ECG_FLAG_GAP */
+    uint16_t flagged;
+} EcgFanoutStats;
+
+/*  Shared block, valid only during callback
+    Samples: samples[i] is at index firstIndex + i of output rate, flags are
+             ECG_FLAG_* of input samples that went into it
+    RR: rrMs and sampleIndex (device rate), count is 0
+    Stats: stats, count is 0
+*/
+typedef struct
+{
+    EcgFanoutStream stream;
+    uint16_t rate;
+    const int32_t *samples;
+    const uint8_t *flags;
+    uint16_t count;
+    uint32_t firstIndex;
+    uint32_t rrMs;
+    uint32_t sampleIndex;
+    const EcgFanoutStats *stats;
+} EcgFanoutBlock;
+
+/*  What one subscriber costs
+    macsPerSecond: FIR multiplies of its branch divided by subscribers sharing it
+    memoryBytes: subscriber entry plus its share of branch and stream history
+*/
+typedef struct
+{
+    EcgFanoutStream stream;
+    uint16_t rate;
+    uint8_t sharedWith;
+    uint32_t blocks;
+    uint32_t samples;
+    uint32_t macsPerSecond;
+    uint32_t memoryBytes;
+} EcgFanoutSubscriberInfo;
+
+typedef struct
+{
+    uint8_t subscribers;
+    uint8_t branches;
+    /* FIR multiplies per second over all branches */
+    uint32_t macsPerSecond;
+    /* Filter runs once for all filtered branches */
+    bool filterActive;
+    uint32_t memoryBytes;
+} EcgFanoutUsage;
+
+/*------------------------------compile time anti-alias coefficients------------------------------------*/
+typedef struct
+{
+    uint8_t factor;
+    uint8_t taps;
+    /* coef[0..taps/2], coef[taps/2] is centre tap, rest is mirrored */
+    int16_t coef[ECG_FANOUT_TAPS(ECG_FANOUT_MAX_FACTOR) / 2 + 1];
+} EcgFanoutFir;
+
+namespace ecg_fanout_constexpr
+{
+    constexpr double PI = ecg_filter_constexpr::PI;
+
+    constexpr EcgFanoutFir fir(uint8_t factor)
+    {
+        EcgFanoutFir f = {};
+        f.factor = factor;
+        f.taps = ECG_FANOUT_TAPS(factor);
+        int half = f.taps / 2;
+        double h[ECG_FANOUT_TAPS(ECG_FANOUT_MAX_FACTOR) / 2 + 1] = {};
+        double sum = 0;
+        for (int i = 0; i <= half; i++)
+        {
+            /* Distance from centre, cutoff at 0.5 / factor of input rate */
+            double n = half - i;
+            double x = PI * n / factor;
+            double sinc = n == 0 ? 1.0 / factor : ecg_filter_constexpr::sin(x) / (PI * n);
+            double window = 0.54 - 0.46 * ecg_filter_constexpr::cos(2 * PI * i / (f.taps - 1));
+            h[i] = sinc * window;
+            sum += i == half ? h[i] : 2 * h[i];
+        }
+        for (int i = 0; i <= half; i++)
+        {
+            double v = h[i] / sum * 32768.0;
+            f.coef[i] = (int16_t)(v + (v >= 0 ? 0.5 : -0.5));
+        }
+        return f;
+    }
+}
+
+constexpr EcgFanoutFir ECG_FANOUT_FIR[] = {
+    ecg_fanout_constexpr::fir(2),
+    ecg_fanout_constexpr::fir(4),
+    ecg_fanout_constexpr::fir(8),
+    ecg_fanout_constexpr::fir(16),
+};
+static_assert(ECG_FANOUT_TAPS(ECG_FANOUT_MAX_FACTOR) + ECG_FANOUT_BLOCK <= ECG_FANOUT_HISTORY, "history has to hold every tap of a whole block");
+/*--------------------------------------------END---------------------------------------------------------------------------*/
+
+class EcgFanout
+{
+public:
+    EcgFanout();
+    /*  sampleRate: device rate, mainsHz/stages: EcgFilter of filtered stream
+        Drops all subscriptions, returns false if filter has no coefficients for this rate
+    */
+    bool configure(uint16_t sampleRate, uint8_t mainsHz, uint8_t stages);
+    /*  rate: output rate of RAW/FILTERED, summaries per second of STATS, ignored for RR
+        Returns subscriber id, -1 if rate does not divide device rate or no slot is free
+    */
+    int subscribe(EcgFanoutStream stream, uint16_t rate, void (*onBlock)(const EcgFanoutBlock *, void *), void *ctx);
+    void unsubscribe(int id);
+    /* MAX30003 block callbacks (setBlockCallBack()), ctx is the fan-out */
+    static void samplesCallBack(const MAX30003SampleBlock *block, void *ctx);
+    static void rrCallBack(uint32_t rrMs, uint32_t sampleIndex, void *ctx);
+    void publish(const MAX30003SampleBlock *block);
+    void publishRR(uint32_t rrMs, uint32_t sampleIndex);
+    bool getSubscriberInfo(int id, EcgFanoutSubscriberInfo *info) const;
+    void getUsage(EcgFanoutUsage *usage) const;
+
+private:
+    typedef struct
+    {
+        bool used;
+        EcgFanoutStream stream;
+        uint16_t rate;
+        uint8_t factor;
+        const EcgFanoutFir *fir;
+        uint8_t subscribers;
+        /* Flags of input samples since last output */
+        uint8_t pendingFlags;
+        int32_t out[ECG_FANOUT_BLOCK];
+        uint8_t outFlags[ECG_FANOUT_BLOCK];
+        uint16_t outCount;
+        EcgFanoutStats stats;
+        int64_t statsSum;
+    } Branch;
+
+    typedef struct
+    {
+        bool used;
+        int8_t branch;
+        void (*onBlock)(const EcgFanoutBlock *, void *);
+        void *ctx;
+        uint32_t blocks;
+        uint32_t samples;
+    } Subscriber;
+
+    /* Input of one sample stream, shared by its branches */
+    typedef struct
+    {
+        int32_t history[ECG_FANOUT_HISTORY];
+        uint32_t head;
+        uint8_t branches;
+    } Source;
+
+    int8_t findBranch(EcgFanoutStream stream, uint16_t rate);
+    int8_t addBranch(EcgFanoutStream stream, uint16_t rate);
+    void runSamples(EcgFanoutStream stream, const int32_t *samples, const uint8_t *flags, uint16_t count, uint32_t firstIndex, bool jump);
+    void runStats(const int32_t *samples, const uint8_t *flags, uint16_t count, uint32_t firstIndex, bool jump);
+    int32_t decimate(const Source &src, uint32_t newest, const EcgFanoutFir *fir) const;
+    void deliver(int8_t branch, const EcgFanoutBlock *block);
+    uint32_t branchMacsPerSecond(const Branch &b) const;
+    uint32_t branchMemory(const Branch &b) const;
+    uint16_t _sampleRate;
+    uint8_t _mainsHz;
+    uint8_t _stages;
+    EcgFilter _filter;
+    bool _filterOk;
+    int32_t _filtered[ECG_FANOUT_BLOCK];
+    Source _sources[2];
+    /* firstIndex expected for next block, valid after first block */
+    uint32_t _nextIndex;
+    bool _haveIndex;
+    Branch _branches[ECG_FANOUT_MAX_BRANCHES];
+    Subscriber _subscribers[ECG_FANOUT_MAX_SUBSCRIBERS];
+};
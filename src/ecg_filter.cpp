@@ -0,0 +1,56 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "ecg_filter.h"
+
+EcgFilter::EcgFilter()
+{
+    _coeffs = &ECG_FILTER_COEFFS[4];
+    _stages = ECG_FILTER_BASELINE | ECG_FILTER_NOTCH;
+    reset();
+}
+
+bool EcgFilter::configure(uint16_t sampleRate, uint8_t mainsHz, uint8_t stages)
+{
+    for (unsigned int i = 0; i < sizeof(ECG_FILTER_COEFFS) / sizeof(ECG_FILTER_COEFFS[0]); i++)
+    {
+        if (ECG_FILTER_COEFFS[i].sampleRate == sampleRate && ECG_FILTER_COEFFS[i].mainsHz == mainsHz)
+        {
+            _coeffs = &ECG_FILTER_COEFFS[i];
+            _stages = stages;
+            reset();
+            return true;
+        }
+    }
+    return false;
+}
+
+void EcgFilter::reset()
+{
+    _primed = false;
+    _last = 0;
+}
+
+/* Start from steady state for input x so the first samples have no step response */
+void EcgFilter::prime(int32_t x)
+{
+    _baselineAcc = 0;
+    _baselineX1 = x;
+    /* Notch and low-pass have unity DC gain, baseline stage outputs 0 for constant input */
+    int32_t v = (_stages & ECG_FILTER_BASELINE) ? 0 : x;
+    _notch.x1 = _notch.x2 = _notch.y1 = _notch.y2 = v;
+    _lowpass.x1 = _lowpass.x2 = _lowpass.y1 = _lowpass.y2 = v;
+    _last = x;
+    _primed = true;
+}
+
+void EcgFilter::process(const int32_t *in, int32_t *out, int count, const uint8_t *flags)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = processSample(in[i], flags != nullptr ? flags[i] : 0);
+    }
+}
@@ -0,0 +1,220 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Streaming fixed-point ECG filter chain
+    baseline wander removal -> mains notch (50/60Hz) -> optional low-pass
+
+    Baseline: one pole DC blocker, pole is 1 - 2^-k so it needs only shifts,
+              k is chosen per sampling rate for ~0.5Hz corner
+    Notch:    biquad, zeros on unit circle at mains frequency, pole radius ECG_NOTCH_RADIUS
+    Low-pass: 2nd order Butterworth biquad at ECG_LOWPASS_HZ (bilinear transform)
+
+    Biquad coefficients are Q30 and generated at compile time for every sampRate
+    and mains frequency, accumulation is 64 bit so 18 bit samples never overflow.
+
+    Budget at 512 sps on Cortex-M0+ (125MHz, no 64 bit multiplier, __aeabi_lmul ~ 20 cycles):
+        baseline ~15, notch ~150, low-pass ~150 cycles per sample
+        whole chain < 400 cycles per sample = 205k cycles/s = 0.2% of one core
+*/
+#pragma once
+
+#include <stdint.h>
+#include "ecg_decoder.h"
+
+#define ECG_FILTER_BASELINE 0x01
+#define ECG_FILTER_NOTCH 0x02
+#define ECG_FILTER_LOWPASS 0x04
+#define ECG_FILTER_ALL (ECG_FILTER_BASELINE | ECG_FILTER_NOTCH | ECG_FILTER_LOWPASS)
+
+#define ECG_BASELINE_HZ 0.5
+#define ECG_NOTCH_RADIUS 0.97
+#define ECG_LOWPASS_HZ 40.0
+#define ECG_FILTER_Q 30
+/* Extra fraction bits of baseline accumulator */
+#define ECG_BASELINE_FRAC 8
+
+typedef struct
+{
+    int32_t b0, b1, b2, a1, a2;
+} EcgBiquadCoeffs;
+
+typedef struct
+{
+    uint16_t sampleRate;
+    uint8_t mainsHz;
+    uint8_t baselineShift;
+    EcgBiquadCoeffs notch;
+    EcgBiquadCoeffs lowpass;
+} EcgFilterCoeffs;
+
+/*------------------------------compile time coefficient generation-------------------------------------*/
+namespace ecg_filter_constexpr
+{
+    constexpr double PI = 3.14159265358979323846;
+
+    /* Taylor series after reducing x to [-pi, pi], exact to double precision for filter use */
+    constexpr double sin(double x)
+    {
+        while (x > PI)
+            x -= 2 * PI;
+        while (x < -PI)
+            x += 2 * PI;
+        double term = x;
+        double sum = x;
+        for (int n = 1; n < 20; n++)
+        {
+            term *= -x * x / ((2 * n) * (2 * n + 1));
+            sum += term;
+        }
+        return sum;
+    }
+
+    constexpr double cos(double x)
+    {
+        return sin(x + PI / 2);
+    }
+
+    constexpr int32_t q(double v)
+    {
+        return (int32_t)(v * (double)(1L << ECG_FILTER_Q) + (v >= 0 ? 0.5 : -0.5));
+    }
+
+    /* Pole of DC blocker is 1 - 2^-k, corner ~ fs / (2 pi 2^k), pick k closest to ECG_BASELINE_HZ */
+    constexpr uint8_t baselineShift(uint16_t fs)
+    {
+        uint8_t best = 1;
+        double bestErr = 1e9;
+        for (uint8_t k = 1; k < 16; k++)
+        {
+            double fc = fs / (2 * PI * (double)(1L << k));
+            double err = fc > ECG_BASELINE_HZ ? fc - ECG_BASELINE_HZ : ECG_BASELINE_HZ - fc;
+            if (err < bestErr)
+            {
+                bestErr = err;
+                best = k;
+            }
+        }
+        return best;
+    }
+
+    /* Notch normalised to unity gain at DC */
+    constexpr EcgBiquadCoeffs notch(uint16_t fs, uint8_t f0)
+    {
+        double w = 2 * PI * f0 / fs;
+        double c = cos(w);
+        double r = ECG_NOTCH_RADIUS;
+        double gain = (1 - 2 * r * c + r * r) / (2 - 2 * c);
+        return EcgBiquadCoeffs{q(gain), q(-2 * c * gain), q(gain), q(-2 * r * c), q(r * r)};
+    }
+
+    constexpr EcgBiquadCoeffs lowpass(uint16_t fs, double fc)
+    {
+        double w = PI * fc / fs;
+        double k = sin(w) / cos(w);
+        double qf = 0.70710678118654752;
+        double norm = 1 / (1 + k / qf + k * k);
+        double b0 = k * k * norm;
+        return EcgBiquadCoeffs{q(b0), q(2 * b0), q(b0), q(2 * (k * k - 1) * norm), q((1 - k / qf + k * k) * norm)};
+    }
+
+    constexpr EcgFilterCoeffs coeffs(uint16_t fs, uint8_t mainsHz)
+    {
+        return EcgFilterCoeffs{fs, mainsHz, baselineShift(fs), notch(fs, mainsHz), lowpass(fs, ECG_LOWPASS_HZ)};
+    }
+}
+
+/* Every sampRate x mains frequency, evaluated by compiler */
+constexpr EcgFilterCoeffs ECG_FILTER_COEFFS[] = {
+    ecg_filter_constexpr::coeffs(128, 50),
+    ecg_filter_constexpr::coeffs(128, 60),
+    ecg_filter_constexpr::coeffs(256, 50),
+    ecg_filter_constexpr::coeffs(256, 60),
+    ecg_filter_constexpr::coeffs(512, 50),
+    ecg_filter_constexpr::coeffs(512, 60),
+};
+static_assert(ECG_FILTER_COEFFS[4].baselineShift == 7, "baseline corner at 512 sps is 512 / (2 pi 2^7) = 0.64Hz");
+/*--------------------------------------------END---------------------------------------------------------------------------*/
+
+typedef struct
+{
+    int32_t x1, x2, y1, y2;
+} EcgBiquadState;
+
+class EcgFilter
+{
+public:
+    EcgFilter();
+    /*  sampleRate: 128, 256 or 512
+        mainsHz: 50 or 60
+        stages: ECG_FILTER_* bits
+        Returns false if there are no coefficients for this combination
+    */
+    bool configure(uint16_t sampleRate, uint8_t mainsHz, uint8_t stages);
+    /* Forget filter history, next sample primes the state */
+    void reset();
+    /*  Filter block, in and out may be the same buffer
+        flags: ECG_FLAG_* per sample or nullptr
+    */
+    void process(const int32_t *in, int32_t *out, int count, const uint8_t *flags);
+
+    /*  Filter one sample
+        FAST recovery samples repeat previous input, GAP restarts the filter
+    */
+    inline int32_t processSample(int32_t x, uint8_t flags)
+    {
+        if (flags & ECG_FLAG_GAP)
+        {
+            _primed = false;
+        }
+        if (flags & ECG_FLAG_FAST)
+        {
+            x = _last;
+        }
+        if (!_primed)
+        {
+            prime(x);
+        }
+        _last = x;
+        int32_t y = x;
+        if (_stages & ECG_FILTER_BASELINE)
+        {
+            _baselineAcc += (y - _baselineX1) * (1 << ECG_BASELINE_FRAC);
+            _baselineX1 = y;
+            _baselineAcc -= _baselineAcc >> _coeffs->baselineShift;
+            y = _baselineAcc >> ECG_BASELINE_FRAC;
+        }
+        if (_stages & ECG_FILTER_NOTCH)
+        {
+            y = biquad(_coeffs->notch, _notch, y);
+        }
+        if (_stages & ECG_FILTER_LOWPASS)
+        {
+            y = biquad(_coeffs->lowpass, _lowpass, y);
+        }
+        return y;
+    }
+
+private:
+    static inline int32_t biquad(const EcgBiquadCoeffs &c, EcgBiquadState &s, int32_t x)
+    {
+        int64_t acc = (int64_t)c.b0 * x + (int64_t)c.b1 * s.x1 + (int64_t)c.b2 * s.x2 - (int64_t)c.a1 * s.y1 - (int64_t)c.a2 * s.y2;
+        int32_t y = (int32_t)((acc + (1L << (ECG_FILTER_Q - 1))) >> ECG_FILTER_Q);
+        s.x2 = s.x1;
+        s.x1 = x;
+        s.y2 = s.y1;
+        s.y1 = y;
+        return y;
+    }
+    void prime(int32_t x);
+    const EcgFilterCoeffs *_coeffs;
+    uint8_t _stages;
+    bool _primed;
+    int32_t _last;
+    int32_t _baselineAcc;
+    int32_t _baselineX1;
+    EcgBiquadState _notch;
+    EcgBiquadState _lowpass;
+};
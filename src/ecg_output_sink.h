@@ -0,0 +1,106 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Processing and output of decoded samples, RR intervals and QRS beats
+
+    One sink for firmware (read_max30003.cpp, bound at compile time by MAX30003WithSink<>)
+    and host replay (host/raw_replay.h), so a replayed capture gives the stream of the board.
+
+    Sample: filter -> stream -> flash -> QRS
+    RR:     stream -> flash -> HRV -> QRS
+    Beat:   stream (QrsDetector beat callback, see beatCallBack())
+
+    Stages are pointers set once before the first sample, nullptr skips a stage.
+    FAST recovery samples are sent and stored as 0 so time base of stream stays correct,
+    QRS sees the filtered sample with its flags.
+    hrvOnly: stream carries no samples, RR intervals or beats, only what is added
+    outside the sink (HRV summaries via sendHrv(), telemetry).
+*/
+#pragma once
+
+#include <stdint.h>
+#include "ecg_decoder.h"
+#include "ecg_filter.h"
+#include "ecg_stream.h"
+#include "flash_store.h"
+#include "qrs_detector.h"
+#include "hrv_engine.h"
+
+struct EcgOutputSink
+{
+    EcgFilter *filter;
+    EcgStreamEncoder *stream;
+    FlashStore *flash;
+    QrsDetector *qrs;
+    HrvEngine *hrv;
+    bool hrvOnly;
+    /* Sample index of last RR interval, HRV summaries are stamped with it */
+    uint32_t lastRRIndex;
+
+    inline void onSample(int32_t sample, uint8_t flags, uint32_t sampleIndex)
+    {
+        if (filter != nullptr)
+        {
+            sample = filter->processSample(sample, flags);
+        }
+        int32_t out = (flags & ECG_FLAG_FAST) ? 0 : sample;
+        if (!hrvOnly)
+        {
+            stream->addSample(out);
+        }
+        if (flash != nullptr)
+        {
+            flash->addSample(out);
+        }
+        if (qrs != nullptr)
+        {
+            qrs->processSample(sample, flags, sampleIndex);
+        }
+    }
+
+    inline void onRR(uint32_t rrMs, uint32_t sampleIndex)
+    {
+        if (!hrvOnly)
+        {
+            stream->addRR((uint16_t)rrMs);
+        }
+        if (flash != nullptr)
+        {
+            flash->addRR((uint16_t)rrMs);
+        }
+        if (hrv != nullptr)
+        {
+            hrv->addRR((uint16_t)rrMs);
+            lastRRIndex = sampleIndex;
+        }
+        if (qrs != nullptr)
+        {
+            qrs->onHardwareRR(rrMs, sampleIndex);
+        }
+    }
+
+    inline void onBeat(const QrsBeat *beat)
+    {
+        if (!hrvOnly)
+        {
+            stream->addBeat(beat->sampleIndex, beat->rrMs);
+        }
+    }
+
+    /* HRV summary of the window, stamped with index of last RR interval */
+    void sendHrv()
+    {
+        HrvSummary h;
+        hrv->summary(&h);
+        stream->addHrv(lastRRIndex, &h);
+    }
+
+    /* QrsDetector::setBeatCallBack(), ctx is the sink */
+    static void beatCallBack(const QrsBeat *beat, void *ctx)
+    {
+        static_cast<EcgOutputSink *>(ctx)->onBeat(beat);
+    }
+};
@@ -0,0 +1,494 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "ecg_stream.h"
+#include <string.h>
+
+/* CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), 4 bit table keeps flash usage small */
+uint16_t ecgStreamCrc16(const uint8_t *buf, int len)
+{
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF};
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < len; i++)
+    {
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (buf[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (buf[i] & 0x0F)]);
+    }
+    return crc;
+}
+
+static void putU16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void putU32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t getU16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t getU32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+EcgStreamEncoder::EcgStreamEncoder(void (*write)(const uint8_t *, int, void *), void *ctx, uint16_t sampleRate, uint8_t samplesPerFrame)
+{
+    _write = write;
+    _ctx = ctx;
+    _sampleRate = sampleRate;
+    if (samplesPerFrame == 0 || samplesPerFrame > ECG_STREAM_MAX_SAMPLES)
+    {
+        samplesPerFrame = ECG_STREAM_MAX_SAMPLES;
+    }
+    _samplesPerFrame = samplesPerFrame;
+    _seq = 0;
+    /* First frame is always preceded by CONFIG */
+    _framesSinceConfig = ECG_STREAM_CONFIG_INTERVAL;
+    _sampleIndex = 0;
+    _bytesWritten = 0;
+    _count = 0;
+    _compress = false;
+    _transport = nullptr;
+    _frame = _frameBuff;
+    _inTransport = false;
+    _framesDropped = 0;
+    _samplesClipped = 0;
+}
+
+/*  Queue one decoded sample, frame is sent when samplesPerFrame samples are queued
+    Samples outside 18 bits are saturated and counted
+*/
+void EcgStreamEncoder::addSample(int32_t sample)
+{
+    int32_t coded = ecgSaturate18(sample);
+    if (coded != sample)
+    {
+        _samplesClipped++;
+    }
+    _samples[_count++] = coded;
+    if (_count >= _samplesPerFrame)
+    {
+        flush();
+    }
+}
+
+/* Send RR interval, queued samples are sent first so order of events is kept */
+void EcgStreamEncoder::addRR(uint16_t rrMs)
+{
+    flush();
+    sendEvent(ECG_FRAME_RR, _sampleIndex, rrMs);
+}
+
+/* Send software detected beat, it carries its own sample index so queued samples are not flushed */
+void EcgStreamEncoder::addBeat(uint32_t sampleIndex, uint16_t rrMs)
+{
+    sendEvent(ECG_FRAME_BEAT, sampleIndex, rrMs);
+}
+
+/* Send counter snapshot, queued samples are not flushed so sample frames stay full */
+void EcgStreamEncoder::addTelemetry(const uint32_t *values, int count)
+{
+    for (int first = 0; first < count; first += ECG_STREAM_TELEMETRY_WORDS)
+    {
+        int n = count - first < ECG_STREAM_TELEMETRY_WORDS ? count - first : ECG_STREAM_TELEMETRY_WORDS;
+        if (_framesSinceConfig >= ECG_STREAM_CONFIG_INTERVAL)
+        {
+            sendConfig();
+        }
+        uint8_t *payload = beginFrame();
+        payload[0] = (uint8_t)first;
+        payload[1] = (uint8_t)n;
+        for (int i = 0; i < n; i++)
+        {
+            putU32(&payload[2 + i * 4], values[first + i]);
+        }
+        sendFrame(ECG_FRAME_TELEMETRY, 2 + n * 4);
+    }
+}
+
+/* Send HRV summary, queued samples are not flushed like for telemetry */
+void EcgStreamEncoder::addHrv(uint32_t sampleIndex, const HrvSummary *hrv)
+{
+    if (_framesSinceConfig >= ECG_STREAM_CONFIG_INTERVAL)
+    {
+        sendConfig();
+    }
+    uint8_t *payload = beginFrame();
+    putU32(&payload[0], sampleIndex);
+    putU32(&payload[4], hrv->windowMs);
+    putU16(&payload[8], hrv->beats);
+    putU16(&payload[10], hrv->nnCount);
+    putU16(&payload[12], hrv->meanNnMs);
+    putU16(&payload[14], hrv->meanHrX10);
+    putU16(&payload[16], hrv->sdnnX10);
+    putU16(&payload[18], hrv->rmssdX10);
+    putU16(&payload[20], hrv->pnn50X10);
+    putU32(&payload[22], hrv->lfPower);
+    putU32(&payload[26], hrv->hfPower);
+    putU16(&payload[30], hrv->lfHfX100);
+    sendFrame(ECG_FRAME_HRV, ECG_STREAM_HRV_LEN);
+}
+
+/* Send compressed block as ECG_FRAME_COMPRESSED without decoding it, blocks longer than a frame are skipped */
+void EcgStreamEncoder::addStoredBlock(uint32_t sampleIndex, const uint8_t *block, int len)
+{
+    if (len <= 0 || len > ECG_COMPRESS_MAX_BYTES)
+    {
+        return;
+    }
+    if (_framesSinceConfig >= ECG_STREAM_CONFIG_INTERVAL)
+    {
+        sendConfig();
+    }
+    uint8_t *payload = beginFrame();
+    putU32(payload, sampleIndex);
+    memcpy(&payload[4], block, len);
+    sendFrame(ECG_FRAME_COMPRESSED, 4 + len);
+}
+
+void EcgStreamEncoder::addStoredRR(uint32_t sampleIndex, uint16_t rrMs)
+{
+    sendEvent(ECG_FRAME_RR, sampleIndex, rrMs);
+}
+
+void EcgStreamEncoder::sendEvent(uint8_t type, uint32_t sampleIndex, uint16_t rrMs)
+{
+    if (_framesSinceConfig >= ECG_STREAM_CONFIG_INTERVAL)
+    {
+        sendConfig();
+    }
+    uint8_t *payload = beginFrame();
+    putU32(payload, sampleIndex);
+    putU16(&payload[4], rrMs);
+    sendFrame(type, 6);
+}
+
+/* Send queued samples as one ECG_FRAME_SAMPLES frame */
+void EcgStreamEncoder::flush()
+{
+    if (_count == 0)
+    {
+        return;
+    }
+    if (_framesSinceConfig >= ECG_STREAM_CONFIG_INTERVAL)
+    {
+        sendConfig();
+    }
+    uint8_t *payload = beginFrame();
+    putU32(payload, _sampleIndex);
+    if (_compress)
+    {
+        /* Compressed block is never longer than packed samples, it fits the same frame */
+        int len = ecgCompressBlock(_samples, _count, &payload[4]);
+        _sampleIndex += _count;
+        _count = 0;
+        sendFrame(ECG_FRAME_COMPRESSED, 4 + len);
+        return;
+    }
+    payload[4] = _count;
+    int pos = 5;
+    uint32_t acc = 0;
+    int bits = 0;
+    for (int i = 0; i < _count; i++)
+    {
+        acc = (acc << 18) | ((uint32_t)_samples[i] & 0x3FFFF);
+        bits += 18;
+        while (bits >= 8)
+        {
+            bits -= 8;
+            payload[pos++] = (uint8_t)(acc >> bits);
+        }
+        acc &= (1u << bits) - 1;
+    }
+    if (bits > 0)
+    {
+        payload[pos++] = (uint8_t)(acc << (8 - bits));
+    }
+    _sampleIndex += _count;
+    _count = 0;
+    sendFrame(ECG_FRAME_SAMPLES, pos);
+}
+
+/* Send stream configuration, decoder needs it to know the time base */
+void EcgStreamEncoder::sendConfig()
+{
+    uint8_t *payload = beginFrame();
+    payload[0] = ECG_STREAM_VERSION;
+    putU16(&payload[1], _sampleRate);
+    payload[3] = _samplesPerFrame;
+    sendFrame(ECG_FRAME_CONFIG, 4);
+    _framesSinceConfig = 0;
+}
+
+/*  Memory for next frame: reserved in output transport, so frame is built where
+    DMA sends it from, or own buffer. Returns payload position
+*/
+uint8_t *EcgStreamEncoder::beginFrame()
+{
+    _frame = _frameBuff;
+    _inTransport = false;
+    if (_transport != nullptr)
+    {
+        uint8_t *space = _transport->reserve(ECG_STREAM_MAX_FRAME);
+        if (space != nullptr)
+        {
+            _frame = space;
+            _inTransport = true;
+        }
+    }
+    return &_frame[ECG_STREAM_HEADER_LEN];
+}
+
+/*  Add header and CRC around payload already placed by beginFrame()
+    Frame the transport had no room for is dropped, SEQ still counts it so decoder sees the gap
+*/
+void EcgStreamEncoder::sendFrame(uint8_t type, int payloadLen)
+{
+    _frame[0] = ECG_STREAM_SYNC0;
+    _frame[1] = ECG_STREAM_SYNC1;
+    _frame[2] = type;
+    putU16(&_frame[3], _seq);
+    _frame[5] = (uint8_t)payloadLen;
+    uint16_t crc = ecgStreamCrc16(&_frame[2], ECG_STREAM_HEADER_LEN - 2 + payloadLen);
+    putU16(&_frame[ECG_STREAM_HEADER_LEN + payloadLen], crc);
+    int len = ECG_STREAM_HEADER_LEN + payloadLen + 2;
+    if (_inTransport)
+    {
+        _transport->commit(len);
+        _bytesWritten += len;
+    }
+    else if (_transport != nullptr)
+    {
+        _framesDropped++;
+    }
+    else
+    {
+        _write(_frame, len, _ctx);
+        _bytesWritten += len;
+    }
+    _seq++;
+    _framesSinceConfig++;
+}
+
+EcgStreamDecoder::EcgStreamDecoder()
+{
+    onConfig = nullptr;
+    onSample = nullptr;
+    onRR = nullptr;
+    onBeat = nullptr;
+    onTelemetry = nullptr;
+    onHrv = nullptr;
+    ctx = nullptr;
+    frames = 0;
+    crcErrors = 0;
+    seqGaps = 0;
+    blockErrors = 0;
+    _pos = 0;
+    _need = ECG_STREAM_HEADER_LEN;
+    _haveSeq = false;
+    _lastSeq = 0;
+}
+
+/* Byte wise state machine, resynchronises on SYNC0 SYNC1 after any error */
+void EcgStreamDecoder::feed(const uint8_t *buf, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        uint8_t b = buf[i];
+        if (_pos == 0)
+        {
+            if (b == ECG_STREAM_SYNC0)
+            {
+                _frame[_pos++] = b;
+            }
+            continue;
+        }
+        if (_pos == 1)
+        {
+            if (b == ECG_STREAM_SYNC1)
+            {
+                _frame[_pos++] = b;
+            }
+            else if (b != ECG_STREAM_SYNC0)
+            {
+                _pos = 0;
+            }
+            continue;
+        }
+        _frame[_pos++] = b;
+        if (_pos == ECG_STREAM_HEADER_LEN)
+        {
+            int payloadLen = _frame[5];
+            if (payloadLen > ECG_STREAM_MAX_PAYLOAD)
+            {
+                _pos = 0;
+                continue;
+            }
+            _need = ECG_STREAM_HEADER_LEN + payloadLen + 2;
+        }
+        else if (_pos > ECG_STREAM_HEADER_LEN && _pos == _need)
+        {
+            uint16_t crc = ecgStreamCrc16(&_frame[2], _need - 4);
+            if (crc == getU16(&_frame[_need - 2]))
+            {
+                handleFrame();
+            }
+            else
+            {
+                crcErrors++;
+            }
+            _pos = 0;
+        }
+    }
+}
+
+void EcgStreamDecoder::handleFrame()
+{
+    uint16_t seq = getU16(&_frame[3]);
+    if (_haveSeq && seq != (uint16_t)(_lastSeq + 1))
+    {
+        seqGaps += (uint16_t)(seq - _lastSeq - 1);
+    }
+    _haveSeq = true;
+    _lastSeq = seq;
+    frames++;
+
+    const uint8_t *payload = &_frame[ECG_STREAM_HEADER_LEN];
+    int payloadLen = _frame[5];
+    switch (_frame[2])
+    {
+    case ECG_FRAME_CONFIG:
+        if (payloadLen >= 4 && onConfig != nullptr)
+        {
+            onConfig(getU16(&payload[1]), payload[3], ctx);
+        }
+        break;
+
+    case ECG_FRAME_SAMPLES:
+    {
+        if (payloadLen < 5)
+        {
+            break;
+        }
+        uint32_t index = getU32(payload);
+        int count = payload[4];
+        if (5 + (count * 18 + 7) / 8 > payloadLen)
+        {
+            break;
+        }
+        int pos = 5;
+        uint32_t acc = 0;
+        int bits = 0;
+        for (int i = 0; i < count; i++)
+        {
+            while (bits < 18)
+            {
+                acc = (acc << 8) | payload[pos++];
+                bits += 8;
+            }
+            bits -= 18;
+            uint32_t raw = (acc >> bits) & 0x3FFFF;
+            acc &= (1u << bits) - 1;
+            /* Sign extend 18 bit value */
+            int32_t sample = (int32_t)(raw << 14) >> 14;
+            if (onSample != nullptr)
+            {
+                onSample(index + i, sample, ctx);
+            }
+        }
+        break;
+    }
+
+    case ECG_FRAME_COMPRESSED:
+    {
+        int32_t samples[ECG_COMPRESS_MAX_SAMPLES];
+        int count = payloadLen > 4 ? ecgDecompressBlock(&payload[4], payloadLen - 4, samples, ECG_COMPRESS_MAX_SAMPLES) : -1;
+        if (count < 0)
+        {
+            blockErrors++;
+            break;
+        }
+        uint32_t index = getU32(payload);
+        for (int i = 0; i < count && onSample != nullptr; i++)
+        {
+            onSample(index + i, samples[i], ctx);
+        }
+        break;
+    }
+
+    case ECG_FRAME_RR:
+        if (payloadLen >= 6 && onRR != nullptr)
+        {
+            onRR(getU32(payload), getU16(&payload[4]), ctx);
+        }
+        break;
+
+    case ECG_FRAME_BEAT:
+        if (payloadLen >= 6 && onBeat != nullptr)
+        {
+            onBeat(getU32(payload), getU16(&payload[4]), ctx);
+        }
+        break;
+
+    case ECG_FRAME_TELEMETRY:
+    {
+        if (payloadLen < 2 || onTelemetry == nullptr)
+        {
+            break;
+        }
+        int count = payload[1];
+        if (count > ECG_STREAM_TELEMETRY_WORDS || 2 + count * 4 > payloadLen)
+        {
+            break;
+        }
+        uint32_t values[ECG_STREAM_TELEMETRY_WORDS];
+        for (int i = 0; i < count; i++)
+        {
+            values[i] = getU32(&payload[2 + i * 4]);
+        }
+        onTelemetry(payload[0], values, count, ctx);
+        break;
+    }
+
+    case ECG_FRAME_HRV:
+    {
+        if (payloadLen < ECG_STREAM_HRV_LEN || onHrv == nullptr)
+        {
+            break;
+        }
+        HrvSummary hrv;
+        hrv.windowMs = getU32(&payload[4]);
+        hrv.beats = getU16(&payload[8]);
+        hrv.nnCount = getU16(&payload[10]);
+        hrv.ectopic = hrv.beats - hrv.nnCount;
+        hrv.meanNnMs = getU16(&payload[12]);
+        hrv.meanHrX10 = getU16(&payload[14]);
+        hrv.sdnnX10 = getU16(&payload[16]);
+        hrv.rmssdX10 = getU16(&payload[18]);
+        hrv.pnn50X10 = getU16(&payload[20]);
+        hrv.lfPower = getU32(&payload[22]);
+        hrv.hfPower = getU32(&payload[26]);
+        hrv.lfHfX100 = getU16(&payload[30]);
+        onHrv(getU32(payload), &hrv, ctx);
+        break;
+    }
+
+    default:
+        break;
+    }
+}
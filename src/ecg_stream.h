@@ -0,0 +1,143 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Compact binary framing for ECG output link
+
+    Every frame:
+    SYNC0 SYNC1 TYPE SEQ[2] LEN PAYLOAD[LEN] CRC[2]
+    SEQ is incremented for every frame, multi Byte fields are little endian
+    CRC is CRC-16/CCITT-FALSE over TYPE..PAYLOAD
+
+    ECG_FRAME_CONFIG payload: VERSION SAMPLERATE[2] SAMPLES_PER_FRAME
+    ECG_FRAME_SAMPLES payload: SAMPLE_INDEX[4] COUNT PACKED[(COUNT * 18 + 7) / 8]
+        samples are 18 bit two's complement, packed MSB first
+    ECG_FRAME_RR payload: SAMPLE_INDEX[4] RR_MS[2]
+        SAMPLE_INDEX is index of next ECG sample when RR interval was received
+    ECG_FRAME_BEAT payload: SAMPLE_INDEX[4] RR_MS[2]
+        beat found by software QRS detector, SAMPLE_INDEX is index of R peak
+    ECG_FRAME_TELEMETRY payload: FIRST COUNT VALUE[COUNT][4]
+        words FIRST..FIRST+COUNT-1 of a counter snapshot (MAX30003Telemetry),
+        long snapshots are split into several frames
+    ECG_FRAME_COMPRESSED payload: SAMPLE_INDEX[4] BLOCK
+        same samples as ECG_FRAME_SAMPLES, BLOCK is described in src/ecg_compress.h
+    ECG_FRAME_HRV payload: SAMPLE_INDEX[4] WINDOW_MS[4] BEATS[2] NN_COUNT[2] MEAN_NN_MS[2]
+        MEAN_HR_X10[2] SDNN_X10[2] RMSSD_X10[2] PNN50_X10[2] LF[4] HF[4] LF_HF_X100[2]
+        rolling window HRV summary (HrvSummary of src/hrv_engine.h), LF and HF are 0
+        until the window holds 2 minutes
+*/
+#pragma once
+
+#include <stdint.h>
+#include "ecg_compress.h"
+#include "hrv_engine.h"
+#include "output_transport.h"
+
+#define ECG_STREAM_SYNC0 0xA5
+#define ECG_STREAM_SYNC1 0x5A
+#define ECG_STREAM_VERSION 1
+#define ECG_STREAM_MAX_SAMPLES 32
+#define ECG_STREAM_HEADER_LEN 6
+#define ECG_STREAM_MAX_PAYLOAD (5 + (ECG_STREAM_MAX_SAMPLES * 18 + 7) / 8)
+#define ECG_STREAM_MAX_FRAME (ECG_STREAM_HEADER_LEN + ECG_STREAM_MAX_PAYLOAD + 2)
+/* CONFIG frame is repeated so decoder joining mid stream learns sample rate */
+#define ECG_STREAM_CONFIG_INTERVAL 64
+#define ECG_STREAM_TELEMETRY_WORDS ((ECG_STREAM_MAX_PAYLOAD - 2) / 4)
+#define ECG_STREAM_HRV_LEN 32
+
+typedef enum
+{
+    ECG_FRAME_CONFIG = 1,
+    ECG_FRAME_SAMPLES = 2,
+    ECG_FRAME_RR = 3,
+    ECG_FRAME_BEAT = 4,
+    ECG_FRAME_TELEMETRY = 5,
+    ECG_FRAME_COMPRESSED = 6,
+    ECG_FRAME_HRV = 7
+} EcgFrameType;
+
+uint16_t ecgStreamCrc16(const uint8_t *buf, int len);
+
+class EcgStreamEncoder
+{
+public:
+    /*  write: called with every complete frame
+        samplesPerFrame: 1 to ECG_STREAM_MAX_SAMPLES
+    */
+    EcgStreamEncoder(void (*write)(const uint8_t *, int, void *), void *ctx, uint16_t sampleRate, uint8_t samplesPerFrame);
+    void addSample(int32_t sample);
+    void addRR(uint16_t rrMs);
+    void addBeat(uint32_t sampleIndex, uint16_t rrMs);
+    void addTelemetry(const uint32_t *values, int count);
+    /* HRV summary, sampleIndex is the sample it was taken at */
+    void addHrv(uint32_t sampleIndex, const HrvSummary *hrv);
+    /* Replay of recorded data (src/flash_store.h), sample index is taken from the recording */
+    void addStoredBlock(uint32_t sampleIndex, const uint8_t *block, int len);
+    void addStoredRR(uint32_t sampleIndex, uint16_t rrMs);
+    void flush();
+    void sendConfig();
+    /* Send samples as ECG_FRAME_COMPRESSED instead of ECG_FRAME_SAMPLES */
+    void setCompression(bool enable) { _compress = enable; }
+    /*  Build frames in place in transport buffers instead of calling write,
+        frames are dropped while transport has no free buffer
+    */
+    void setTransport(OutputTransport *transport) { _transport = transport; }
+    uint32_t bytesWritten() const { return _bytesWritten; }
+    uint32_t framesDropped() const { return _framesDropped; }
+    /* Samples outside 18 bits, sent saturated */
+    uint32_t samplesClipped() const { return _samplesClipped; }
+
+private:
+    uint8_t *beginFrame();
+    void sendFrame(uint8_t type, int payloadLen);
+    void sendEvent(uint8_t type, uint32_t sampleIndex, uint16_t rrMs);
+    void (*_write)(const uint8_t *, int, void *);
+    void *_ctx;
+    uint16_t _sampleRate;
+    uint8_t _samplesPerFrame;
+    uint16_t _seq;
+    uint16_t _framesSinceConfig;
+    uint32_t _sampleIndex;
+    uint32_t _bytesWritten;
+    uint8_t _count;
+    bool _compress;
+    int32_t _samples[ECG_STREAM_MAX_SAMPLES];
+    OutputTransport *_transport;
+    /* Frame being built: _frameBuff or space reserved in transport */
+    uint8_t *_frame;
+    bool _inTransport;
+    uint32_t _framesDropped;
+    uint32_t _samplesClipped;
+    uint8_t _frameBuff[ECG_STREAM_MAX_FRAME];
+};
+
+class EcgStreamDecoder
+{
+public:
+    EcgStreamDecoder();
+    /* Feed any number of received Bytes, callbacks are called for every valid frame */
+    void feed(const uint8_t *buf, int len);
+    void (*onConfig)(uint16_t sampleRate, uint8_t samplesPerFrame, void *ctx);
+    void (*onSample)(uint32_t sampleIndex, int32_t sample, void *ctx);
+    void (*onRR)(uint32_t sampleIndex, uint16_t rrMs, void *ctx);
+    void (*onBeat)(uint32_t sampleIndex, uint16_t rrMs, void *ctx);
+    void (*onTelemetry)(uint8_t first, const uint32_t *values, int count, void *ctx);
+    void (*onHrv)(uint32_t sampleIndex, const HrvSummary *hrv, void *ctx);
+    void *ctx;
+    uint32_t frames;
+    uint32_t crcErrors;
+    /* Frames missing according to SEQ */
+    uint32_t seqGaps;
+    /* Compressed blocks with valid CRC that did not decode */
+    uint32_t blockErrors;
+
+private:
+    void handleFrame();
+    uint8_t _frame[ECG_STREAM_MAX_FRAME];
+    int _pos;
+    int _need;
+    bool _haveSeq;
+    uint16_t _lastSeq;
+};
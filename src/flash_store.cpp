@@ -0,0 +1,435 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "flash_store.h"
+#include "max30003_hal.h"
+#include <string.h>
+
+static void putU16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void putU32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t getU16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t getU32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+FlashStore::FlashStore(const FlashBackend *backend)
+{
+    _backend = backend;
+    _sectors = 0;
+    _sampleRate = 0;
+    _oldest = 0;
+    _count = 0;
+    _seq = 0;
+    _fillSector = 0;
+    _fillUsed = 0;
+    _fillActive = false;
+    _fillErased = false;
+    _fillProgrammed = 0;
+    _progSector = 0;
+    _progPage = 0;
+    _progPages = 0;
+    _progActive = false;
+    _progErased = false;
+    _queued = 0;
+    _sampleIndex = 0;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool FlashStore::readHeader(uint32_t sector, uint32_t *seq, uint32_t *first, uint16_t *rate) const
+{
+    uint8_t header[FLASH_STORE_HEADER_LEN];
+    _backend->read(sector * FLASH_STORE_SECTOR, header, sizeof(header), _backend->ctx);
+    if (getU32(header) != FLASH_STORE_MAGIC ||
+        getU16(&header[14]) != ecgStreamCrc16(header, FLASH_STORE_HEADER_LEN - 2))
+    {
+        return false;
+    }
+    *seq = getU32(&header[4]);
+    *first = getU32(&header[8]);
+    *rate = getU16(&header[12]);
+    return true;
+}
+
+/*  Newest sector has highest SEQ, recording is every sector before it whose
+    SEQ is one less, cost is one header read per sector
+*/
+bool FlashStore::mount(uint16_t sampleRate)
+{
+    _sampleRate = sampleRate;
+    _sectors = _backend->size / FLASH_STORE_SECTOR;
+    if (_sectors > FLASH_STORE_MAX_SECTORS)
+    {
+        _sectors = FLASH_STORE_MAX_SECTORS;
+    }
+    /* Fill and program sector must never be the oldest one */
+    if (_sectors < 3)
+    {
+        return false;
+    }
+    _fillActive = false;
+    _progActive = false;
+    _queued = 0;
+    _count = 0;
+    _oldest = 0;
+    _seq = 0;
+    _sampleIndex = 0;
+    bool found = false;
+    uint32_t newest = 0;
+    for (uint32_t s = 0; s < _sectors; s++)
+    {
+        uint32_t seq, first;
+        uint16_t rate;
+        if (readHeader(s, &seq, &first, &rate) && (!found || seq > _seq))
+        {
+            found = true;
+            newest = s;
+            _seq = seq;
+        }
+    }
+    if (found)
+    {
+        uint32_t seq = _seq;
+        uint16_t rate;
+        _oldest = newest;
+        _count = 1;
+        readHeader(newest, &seq, &_first[newest], &rate);
+        if (_sampleRate == 0)
+        {
+            _sampleRate = rate;
+        }
+        while (_count < _sectors)
+        {
+            uint32_t s = (_oldest + _sectors - 1) % _sectors;
+            uint32_t prevSeq, first;
+            if (!readHeader(s, &prevSeq, &first, &rate) || prevSeq != seq - 1)
+            {
+                break;
+            }
+            seq = prevSeq;
+            _first[s] = first;
+            _oldest = s;
+            _count++;
+        }
+        _seq++;
+        /* Continue sample index after last block of newest sector */
+        _sampleIndex = _first[newest];
+        FlashStoreCursor cursor = {_count - 1, FLASH_STORE_HEADER_LEN};
+        uint8_t payload[255];
+        uint8_t len;
+        uint8_t type;
+        while ((type = next(&cursor, payload, &len)) != 0)
+        {
+            if (type == FLASH_RECORD_SAMPLES && len > 4)
+            {
+                _sampleIndex = getU32(payload) + (payload[4] & 0x3F);
+            }
+        }
+    }
+    _stats.sectorsUsed = _count;
+    startSector();
+    return true;
+}
+
+void FlashStore::clear()
+{
+    _fillActive = false;
+    _progActive = false;
+    _queued = 0;
+    /* SEQ jump so mount() does not join old sectors to new recording */
+    _seq += _sectors;
+    _oldest = (_fillSector + 1) % _sectors;
+    _count = 0;
+    startSector();
+}
+
+/* Next sector in ring becomes fill sector, oldest sector is dropped if ring is full */
+void FlashStore::startSector()
+{
+    if (_count == _sectors)
+    {
+        _oldest = (_oldest + 1) % _sectors;
+        _count--;
+    }
+    _fillSector = physical(_count);
+    _count++;
+    _stats.sectorsUsed = _count;
+    _first[_fillSector] = _sampleIndex;
+    memset(_fill, FLASH_STORE_ERASED, sizeof(_fill));
+    putU32(_fill, FLASH_STORE_MAGIC);
+    putU32(&_fill[4], _seq++);
+    putU32(&_fill[8], _sampleIndex);
+    putU16(&_fill[12], _sampleRate);
+    putU16(&_fill[14], ecgStreamCrc16(_fill, FLASH_STORE_HEADER_LEN - 2));
+    _fillUsed = FLASH_STORE_HEADER_LEN;
+    _fillErased = false;
+    _fillProgrammed = 0;
+    _fillActive = true;
+}
+
+/* Hand full fill sector to service(), caller checks _progActive first */
+void FlashStore::sealSector()
+{
+    memcpy(_prog, _fill, sizeof(_prog));
+    _progSector = _fillSector;
+    _progPage = _fillProgrammed;
+    _progPages = (_fillUsed + FLASH_STORE_PAGE - 1) / FLASH_STORE_PAGE;
+    _progErased = _fillErased;
+    _progActive = true;
+    startSector();
+}
+
+bool FlashStore::append(uint8_t type, const uint8_t *payload, uint8_t len)
+{
+    if (!_fillActive)
+    {
+        _stats.dropped++;
+        return false;
+    }
+    if (_fillUsed + 2 + len > FLASH_STORE_SECTOR)
+    {
+        if (_progActive)
+        {
+            /* Flash is slower than data, keep what is already collected */
+            _stats.dropped++;
+            return false;
+        }
+        sealSector();
+    }
+    _fill[_fillUsed] = type;
+    _fill[_fillUsed + 1] = len;
+    memcpy(&_fill[_fillUsed + 2], payload, len);
+    _fillUsed += 2 + len;
+    _stats.records++;
+    return true;
+}
+
+/* Queued samples as one SAMPLES record, sample index advances even if record is dropped */
+void FlashStore::writeRecords()
+{
+    if (_queued == 0)
+    {
+        return;
+    }
+    uint8_t payload[4 + ECG_COMPRESS_MAX_BYTES];
+    putU32(payload, _sampleIndex);
+    int len = ecgCompressBlock(_samples, _queued, &payload[4]);
+    append(FLASH_RECORD_SAMPLES, payload, (uint8_t)(4 + len));
+    _sampleIndex += _queued;
+    _queued = 0;
+}
+
+void FlashStore::addSample(int32_t sample)
+{
+    int32_t coded = ecgSaturate18(sample);
+    if (coded != sample)
+    {
+        _stats.clipped++;
+    }
+    _samples[_queued++] = coded;
+    if (_queued >= FLASH_STORE_BLOCK_SAMPLES)
+    {
+        writeRecords();
+    }
+}
+
+void FlashStore::addRR(uint16_t rrMs)
+{
+    writeRecords();
+    uint8_t payload[6];
+    putU32(payload, _sampleIndex);
+    putU16(&payload[4], rrMs);
+    append(FLASH_RECORD_RR, payload, sizeof(payload));
+}
+
+/* Erase is the longest flash operation, its time is kept to check it against FIFO headroom */
+bool FlashStore::eraseSector(uint32_t sector)
+{
+    uint64_t start = halTimeUs();
+    bool ok = _backend->erase(sector * FLASH_STORE_SECTOR, _backend->ctx);
+    uint32_t us = (uint32_t)(halTimeUs() - start);
+    _stats.eraseMaxUs = us > _stats.eraseMaxUs ? us : _stats.eraseMaxUs;
+    _stats.erases++;
+    return ok;
+}
+
+/*  Program sector first so RAM is free for next seal, erase fill sector ahead
+    of time so sealing never has to wait for an erase
+*/
+bool FlashStore::service()
+{
+    if (_progActive)
+    {
+        bool ok;
+        if (!_progErased)
+        {
+            ok = eraseSector(_progSector);
+            _progErased = true;
+        }
+        else
+        {
+            uint32_t offset = _progPage * FLASH_STORE_PAGE;
+            ok = _backend->program(_progSector * FLASH_STORE_SECTOR + offset, &_prog[offset], _backend->ctx);
+            _stats.pagePrograms++;
+            if (++_progPage >= _progPages)
+            {
+                _progActive = false;
+            }
+        }
+        if (!ok)
+        {
+            _stats.flashErrors++;
+        }
+        return true;
+    }
+    if (_fillActive && !_fillErased)
+    {
+        if (!eraseSector(_fillSector))
+        {
+            _stats.flashErrors++;
+        }
+        _fillErased = true;
+        return true;
+    }
+    return false;
+}
+
+/*  Complete pages of fill sector are not programmed again when it is sealed,
+    last partial page is: NOR flash only clears bits, so programming the same
+    Bytes again with more records behind them is allowed
+*/
+void FlashStore::flush()
+{
+    writeRecords();
+    while (service())
+    {
+    }
+    if (!_fillActive || _fillUsed == FLASH_STORE_HEADER_LEN)
+    {
+        return;
+    }
+    uint32_t pages = (_fillUsed + FLASH_STORE_PAGE - 1) / FLASH_STORE_PAGE;
+    for (uint32_t p = _fillProgrammed; p < pages; p++)
+    {
+        uint32_t offset = p * FLASH_STORE_PAGE;
+        if (!_backend->program(_fillSector * FLASH_STORE_SECTOR + offset, &_fill[offset], _backend->ctx))
+        {
+            _stats.flashErrors++;
+        }
+        _stats.pagePrograms++;
+    }
+    _fillProgrammed = _fillUsed / FLASH_STORE_PAGE;
+}
+
+uint32_t FlashStore::firstSampleIndex() const
+{
+    return _count > 0 ? _first[physical(0)] : _sampleIndex;
+}
+
+/* Binary search in sector index, sectors are in sample order */
+FlashStoreCursor FlashStore::seek(uint32_t sampleIndex) const
+{
+    uint32_t lo = 0;
+    uint32_t hi = _count;
+    while (hi - lo > 1)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (_first[physical(mid)] <= sampleIndex)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    FlashStoreCursor cursor = {lo, FLASH_STORE_HEADER_LEN};
+    return cursor;
+}
+
+/* Sectors not programmed yet are read from RAM */
+void FlashStore::readAt(uint32_t sector, uint32_t offset, uint8_t *data, uint32_t len) const
+{
+    if (_fillActive && sector == _fillSector)
+    {
+        memcpy(data, &_fill[offset], len);
+    }
+    else if (_progActive && sector == _progSector)
+    {
+        memcpy(data, &_prog[offset], len);
+    }
+    else
+    {
+        _backend->read(sector * FLASH_STORE_SECTOR + offset, data, len, _backend->ctx);
+    }
+}
+
+uint8_t FlashStore::next(FlashStoreCursor *cursor, uint8_t *payload, uint8_t *len) const
+{
+    while (cursor->sector < _count)
+    {
+        uint32_t sector = physical(cursor->sector);
+        if (cursor->offset + 2 <= FLASH_STORE_SECTOR)
+        {
+            uint8_t head[2];
+            readAt(sector, cursor->offset, head, 2);
+            bool known = head[0] == FLASH_RECORD_SAMPLES || head[0] == FLASH_RECORD_RR;
+            /* Erased or torn record ends sector */
+            if (known && cursor->offset + 2 + head[1] <= FLASH_STORE_SECTOR)
+            {
+                readAt(sector, cursor->offset + 2, payload, head[1]);
+                cursor->offset += 2 + head[1];
+                *len = head[1];
+                return head[0];
+            }
+        }
+        cursor->sector++;
+        cursor->offset = FLASH_STORE_HEADER_LEN;
+    }
+    return 0;
+}
+
+/* Stored blocks are sent as they are, no decompression on the way out */
+uint32_t FlashStore::readout(FlashStoreCursor *cursor, EcgStreamEncoder *stream, uint32_t maxRecords) const
+{
+    uint8_t payload[255];
+    uint8_t len;
+    uint32_t records = 0;
+    while (records < maxRecords)
+    {
+        uint8_t type = next(cursor, payload, &len);
+        if (type == 0)
+        {
+            break;
+        }
+        if (type == FLASH_RECORD_SAMPLES && len > 4)
+        {
+            stream->addStoredBlock(getU32(payload), &payload[4], len - 4);
+        }
+        else if (type == FLASH_RECORD_RR && len == 6)
+        {
+            stream->addStoredRR(getU32(payload), getU16(&payload[4]));
+        }
+        records++;
+    }
+    return records;
+}
@@ -0,0 +1,157 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Log structured ECG recording on NOR flash (Holter mode)
+
+    Region is a ring of 4K sectors, oldest sector is erased and reused when the
+    region is full, so every sector is erased equally often.
+    Sector layout:
+    HEADER: MAGIC[4] SEQ[4] FIRST_INDEX[4] SAMPLE_RATE[2] CRC[2]
+        SEQ counts sectors written since region was formatted, newest has highest SEQ
+        FIRST_INDEX is sample index of first SAMPLES record in sector (time index)
+    RECORDS: TYPE LEN PAYLOAD[LEN], up to end of sector or first TYPE 0xFF (erased)
+        FLASH_RECORD_SAMPLES payload: SAMPLE_INDEX[4] BLOCK (src/ecg_compress.h)
+        FLASH_RECORD_RR payload: SAMPLE_INDEX[4] RR_MS[2]
+    Multi Byte fields are little endian. Records never cross a sector.
+
+    Writes never block the caller: records are collected in a RAM sector,
+    service() does at most one flash operation (erase one sector or program one
+    256 Byte page) per call. While one sector is being programmed the next one
+    is filled; if both are busy new records are dropped and counted.
+*/
+#pragma once
+
+#include <stdint.h>
+#include "ecg_stream.h"
+
+#define FLASH_STORE_SECTOR 4096
+#define FLASH_STORE_PAGE 256
+#define FLASH_STORE_HEADER_LEN 16
+#define FLASH_STORE_MAGIC 0x4C474345
+/* 2MB region, sector index kept in RAM */
+#define FLASH_STORE_MAX_SECTORS 512
+/* Samples per SAMPLES record, same as one ECG stream frame */
+#define FLASH_STORE_BLOCK_SAMPLES ECG_COMPRESS_MAX_SAMPLES
+#define FLASH_STORE_ERASED 0xFF
+
+typedef enum
+{
+    FLASH_RECORD_SAMPLES = 1,
+    FLASH_RECORD_RR = 2
+} FlashRecordType;
+
+/*  Flash access, offsets are relative to start of region
+    erase: one FLASH_STORE_SECTOR aligned sector
+    program: one FLASH_STORE_PAGE aligned page, bits only go from 1 to 0
+*/
+typedef struct
+{
+    bool (*erase)(uint32_t offset, void *ctx);
+    bool (*program)(uint32_t offset, const uint8_t *data, void *ctx);
+    void (*read)(uint32_t offset, uint8_t *data, uint32_t len, void *ctx);
+    void *ctx;
+    /* Multiple of FLASH_STORE_SECTOR */
+    uint32_t size;
+} FlashBackend;
+
+/* Read position, from seek() */
+typedef struct
+{
+    /* Sectors from oldest, FLASH_STORE_MAX_SECTORS when done */
+    uint32_t sector;
+    uint32_t offset;
+} FlashStoreCursor;
+
+typedef struct
+{
+    uint32_t records;
+    /* Records lost because RAM sector and program buffer were both full */
+    uint32_t dropped;
+    uint32_t erases;
+    uint32_t pagePrograms;
+    uint32_t sectorsUsed;
+    uint32_t flashErrors;
+    /* Samples outside 18 bits, stored saturated */
+    uint32_t clipped;
+    /* Longest sector erase, flash is busy and the caller blocked that long */
+    uint32_t eraseMaxUs;
+} FlashStoreStats;
+
+class FlashStore
+{
+public:
+    FlashStore(const FlashBackend *backend);
+    /*  Read sector headers and continue after newest sector
+        sampleRate: written to new sectors, 0 takes it from newest sector
+        Returns false if backend is unusable
+    */
+    bool mount(uint16_t sampleRate);
+    /* Forget recording, sectors are erased again when they are reused */
+    void clear();
+    /* Queue one sample, a SAMPLES record is written every FLASH_STORE_BLOCK_SAMPLES samples */
+    void addSample(int32_t sample);
+    /* RR interval, queued samples are written first so order of events is kept */
+    void addRR(uint16_t rrMs);
+    /* One erase or page program, call from output context; returns false if there was nothing to do */
+    bool service();
+    /* Write everything collected so far, blocks until it is on flash */
+    void flush();
+    const FlashStoreStats &stats() const { return _stats; }
+    uint16_t sampleRate() const { return _sampleRate; }
+
+    /* Recording from oldest to newest */
+    uint32_t sectorCount() const { return _count; }
+    uint32_t firstSampleIndex() const;
+    uint32_t nextSampleIndex() const { return _sampleIndex + _queued; }
+    /* Cursor at sector holding sampleIndex (or oldest/newest sector if out of range) */
+    FlashStoreCursor seek(uint32_t sampleIndex) const;
+    /*  Read next record into payload (at least 255 Bytes)
+        Returns record type, 0 at end of recording; len gets payload length
+    */
+    uint8_t next(FlashStoreCursor *cursor, uint8_t *payload, uint8_t *len) const;
+    /*  Bulk readout: send up to maxRecords records from cursor as ECG stream frames
+        Returns records sent, 0 at end of recording
+    */
+    uint32_t readout(FlashStoreCursor *cursor, EcgStreamEncoder *stream, uint32_t maxRecords) const;
+
+private:
+    uint32_t physical(uint32_t logical) const { return (_oldest + logical) % _sectors; }
+    bool append(uint8_t type, const uint8_t *payload, uint8_t len);
+    void writeRecords();
+    void startSector();
+    void sealSector();
+    bool readHeader(uint32_t sector, uint32_t *seq, uint32_t *first, uint16_t *rate) const;
+    void readAt(uint32_t sector, uint32_t offset, uint8_t *data, uint32_t len) const;
+    bool eraseSector(uint32_t sector);
+    const FlashBackend *_backend;
+    uint32_t _sectors;
+    uint16_t _sampleRate;
+    /* Ring of recorded sectors */
+    uint32_t _oldest;
+    uint32_t _count;
+    uint32_t _seq;
+    uint32_t _first[FLASH_STORE_MAX_SECTORS];
+    /* Sector collected in RAM */
+    uint8_t _fill[FLASH_STORE_SECTOR];
+    uint32_t _fillSector;
+    uint32_t _fillUsed;
+    bool _fillActive;
+    bool _fillErased;
+    /* Pages of _fill already programmed by flush() */
+    uint32_t _fillProgrammed;
+    /* Sector being programmed */
+    uint8_t _prog[FLASH_STORE_SECTOR];
+    uint32_t _progSector;
+    uint32_t _progPage;
+    uint32_t _progPages;
+    bool _progActive;
+    bool _progErased;
+    /* Sample queue */
+    int32_t _samples[FLASH_STORE_BLOCK_SAMPLES];
+    uint8_t _queued;
+    uint32_t _sampleIndex;
+    FlashStoreStats _stats;
+};
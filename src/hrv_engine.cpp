@@ -0,0 +1,290 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "hrv_engine.h"
+#include <string.h>
+
+/*  Goertzel coefficients 2cos(2pi f / HRV_RESAMPLE_HZ) in Q14 for
+    f = HRV_LF_FIRST_BIN .. HRV_HF_LAST_BIN times 1 / HRV_SEGMENT_S
+*/
+static const int32_t HRV_GOERTZEL_COEF[HRV_BINS] = {
+    32510, 32365, 32188, 31979, 31739, 31467, 31164, 30831, 30467, 30073,
+    29649, 29197, 28715, 28205, 27667, 27102, 26510, 25892, 25248, 24580,
+    23887, 23170, 22431, 21670, 20887, 20084, 19261, 18418, 17558, 16680,
+    15786, 14876, 13952, 13014, 12063, 11100, 10126,
+};
+#define HRV_RESAMPLE_MS (1000 / HRV_RESAMPLE_HZ)
+
+static uint32_t isqrt64(uint64_t v)
+{
+    uint64_t root = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+    while (bit > v)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (v >= root + bit)
+        {
+            v -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+static uint16_t clampU16(uint64_t v)
+{
+    return v > 0xFFFF ? 0xFFFF : (uint16_t)v;
+}
+
+HrvEngine::HrvEngine()
+{
+    _windowLimitMs = HRV_WINDOW_MS;
+    reset();
+}
+
+void HrvEngine::configure(uint32_t windowMs)
+{
+    _windowLimitMs = windowMs;
+    reset();
+}
+
+void HrvEngine::reset()
+{
+    _first = 0;
+    _count = 0;
+    _windowMs = 0;
+    _sumNn = 0;
+    _sumNn2 = 0;
+    _sumDiff2 = 0;
+    _nnCount = 0;
+    _diffCount = 0;
+    _nn50 = 0;
+    _levelX8 = 0;
+    _rejectRun = 0;
+    _prevNn = false;
+    _prevRR = 0;
+    _totalBeats = 0;
+    _totalEctopic = 0;
+}
+
+void HrvEngine::addRR(uint16_t rrMs)
+{
+    _totalBeats++;
+    bool nn = rrMs >= HRV_MIN_RR_MS && rrMs <= HRV_MAX_RR_MS;
+    if (nn && _levelX8 != 0)
+    {
+        uint32_t level = _levelX8 >> 3;
+        uint32_t dev = rrMs > level ? rrMs - level : level - rrMs;
+        nn = dev * 100 <= level * HRV_ECTOPIC_PERCENT;
+        /* Rhythm really changed: follow it instead of rejecting everything */
+        if (!nn && ++_rejectRun >= HRV_RELEARN_BEATS)
+        {
+            _levelX8 = 0;
+            nn = true;
+        }
+    }
+    if (nn)
+    {
+        _rejectRun = 0;
+        _levelX8 = _levelX8 == 0 ? (uint32_t)rrMs << 3 : _levelX8 - (_levelX8 >> 3) + rrMs;
+    }
+    else
+    {
+        _totalEctopic++;
+    }
+
+    if (_count == HRV_MAX_BEATS)
+    {
+        evictOldest();
+    }
+    HrvEntry *e = &_ring[(_first + _count) % HRV_MAX_BEATS];
+    e->rrMs = rrMs;
+    e->diffMs = 0;
+    e->flags = 0;
+    if (nn)
+    {
+        e->flags = HRV_ENTRY_NN;
+        _sumNn += rrMs;
+        _sumNn2 += (uint32_t)rrMs * rrMs;
+        _nnCount++;
+        if (_prevNn)
+        {
+            int32_t d = (int32_t)rrMs - _prevRR;
+            e->diffMs = (int16_t)d;
+            e->flags |= HRV_ENTRY_DIFF;
+            _sumDiff2 += (uint32_t)(d * d);
+            _diffCount++;
+            if (d > HRV_NN50_MS || d < -HRV_NN50_MS)
+            {
+                _nn50++;
+            }
+        }
+    }
+    _prevNn = nn;
+    _prevRR = rrMs;
+    _count++;
+    _windowMs += rrMs;
+    while (_windowMs > _windowLimitMs && _count > 1)
+    {
+        evictOldest();
+    }
+}
+
+/* Take oldest interval out of the window sums */
+void HrvEngine::evictOldest()
+{
+    const HrvEntry *e = &_ring[_first];
+    _windowMs -= e->rrMs;
+    if (e->flags & HRV_ENTRY_NN)
+    {
+        _sumNn -= e->rrMs;
+        _sumNn2 -= (uint32_t)e->rrMs * e->rrMs;
+        _nnCount--;
+    }
+    if (e->flags & HRV_ENTRY_DIFF)
+    {
+        int32_t d = e->diffMs;
+        _sumDiff2 -= (uint32_t)(d * d);
+        _diffCount--;
+        if (d > HRV_NN50_MS || d < -HRV_NN50_MS)
+        {
+            _nn50--;
+        }
+    }
+    _first = (_first + 1) % HRV_MAX_BEATS;
+    _count--;
+}
+
+void HrvEngine::metrics(HrvSummary *out) const
+{
+    memset(out, 0, sizeof(*out));
+    out->windowMs = _windowMs;
+    out->beats = _count;
+    out->nnCount = _nnCount;
+    out->ectopic = _count - _nnCount;
+    if (_nnCount > 0)
+    {
+        out->meanNnMs = (uint16_t)(_sumNn / _nnCount);
+        out->meanHrX10 = clampU16((uint64_t)600000 * _nnCount / _sumNn);
+    }
+    if (_nnCount > 1)
+    {
+        /* n * sum(x^2) - sum(x)^2 is exact in integers */
+        uint64_t n = _nnCount;
+        uint64_t spread = n * _sumNn2 - (uint64_t)_sumNn * _sumNn;
+        out->sdnnX10 = clampU16(isqrt64(spread * 100 / (n * (n - 1))));
+    }
+    if (_diffCount > 0)
+    {
+        out->rmssdX10 = clampU16(isqrt64(_sumDiff2 * 100 / _diffCount));
+        out->pnn50X10 = (uint16_t)((uint32_t)_nn50 * 1000 / _diffCount);
+    }
+}
+
+void HrvEngine::summary(HrvSummary *out) const
+{
+    metrics(out);
+    if (_windowMs >= HRV_MIN_SPECTRUM_MS && _nnCount > 1)
+    {
+        spectrum(out);
+    }
+}
+
+/*  LF and HF power of NN tachogram
+    Resampled points are x * 256 around mean NN, Goertzel state is kept in 64 bit.
+    One sided power of bin k is 2 |X(k)|^2 / N^2, a sine of amplitude A gives A^2 / 2.
+    Mean is removed only to keep state small, DFT bins k > 0 do not see it.
+*/
+void HrvEngine::spectrum(HrvSummary *out) const
+{
+    int64_t s1[HRV_BINS];
+    int64_t s2[HRV_BINS];
+    memset(s1, 0, sizeof(s1));
+    memset(s2, 0, sizeof(s2));
+    uint64_t lf = 0;
+    uint64_t hf = 0;
+    uint32_t segments = 0;
+    uint32_t points = 0;
+    int32_t meanQ8 = (int32_t)(((uint64_t)_sumNn << 8) / _nnCount);
+    /* Beat time is end of its interval, rejected intervals advance time only */
+    uint32_t t = 0;
+    uint32_t tPrev = 0;
+    int32_t vPrev = -1;
+    uint32_t grid = 0;
+    for (uint16_t i = 0; i < _count; i++)
+    {
+        const HrvEntry *e = &_ring[(_first + i) % HRV_MAX_BEATS];
+        t += e->rrMs;
+        if (!(e->flags & HRV_ENTRY_NN))
+        {
+            continue;
+        }
+        int32_t v = e->rrMs;
+        if (vPrev < 0)
+        {
+            tPrev = t;
+            vPrev = v;
+            grid = t;
+            continue;
+        }
+        for (; grid <= t; grid += HRV_RESAMPLE_MS)
+        {
+            int32_t x = (vPrev << 8) + (int32_t)(((int64_t)(v - vPrev) << 8) * (grid - tPrev) / (t - tPrev)) - meanQ8;
+            for (int k = 0; k < HRV_BINS; k++)
+            {
+                int64_t s0 = x + ((HRV_GOERTZEL_COEF[k] * s1[k]) >> 14) - s2[k];
+                s2[k] = s1[k];
+                s1[k] = s0;
+            }
+            if (++points < HRV_SEGMENT_POINTS)
+            {
+                continue;
+            }
+            /* Segment complete: |X(k)|^2 = s1^2 + s2^2 - coef s1 s2 */
+            for (int k = 0; k < HRV_BINS; k++)
+            {
+                int64_t power = s1[k] * s1[k] + s2[k] * s2[k] - ((HRV_GOERTZEL_COEF[k] * s1[k]) >> 14) * s2[k];
+                if (power < 0)
+                {
+                    power = 0;
+                }
+                if (k < HRV_HF_FIRST_BIN - HRV_LF_FIRST_BIN)
+                {
+                    lf += power;
+                }
+                else
+                {
+                    hf += power;
+                }
+            }
+            memset(s1, 0, sizeof(s1));
+            memset(s2, 0, sizeof(s2));
+            points = 0;
+            segments++;
+        }
+        tPrev = t;
+        vPrev = v;
+    }
+    if (segments == 0)
+    {
+        return;
+    }
+    out->lfHfX100 = hf > 0 ? clampU16(lf * 100 / hf) : 0;
+    /* 2 / N^2 per segment, Q16 of resampled points removed */
+    uint64_t div = (uint64_t)65536 * HRV_SEGMENT_POINTS * HRV_SEGMENT_POINTS * segments / 2;
+    lf /= div;
+    hf /= div;
+    out->lfPower = lf > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)lf;
+    out->hfPower = hf > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)hf;
+}
@@ -0,0 +1,128 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Streaming heart rate variability of RR intervals
+
+    Every interval is kept in a ring covering the last windowMs (at most HRV_MAX_BEATS),
+    sums of NN intervals, their squares and squared successive differences are updated
+    when an interval enters or leaves the window, so addRR() costs the same for any window.
+    Sums are integers, metrics do not drift in long recordings.
+
+    Ectopic / artefact filter: an interval outside HRV_MIN_RR_MS..HRV_MAX_RR_MS or more than
+    HRV_ECTOPIC_PERCENT away from the recent NN level is not used. Successive differences
+    are only taken between two accepted neighbours. After HRV_RELEARN_BEATS rejected
+    intervals in a row the NN level follows the new rhythm.
+
+    summary() adds LF (0.04-0.15 Hz) and HF (0.15-0.4 Hz) power: NN tachogram of the window
+    is resampled at HRV_RESAMPLE_HZ by linear interpolation and cut into HRV_SEGMENT_S
+    segments. Every DFT bin of a segment inside the bands is one fixed point Goertzel filter,
+    band power is the sum of its bins averaged over the segments (Welch, no overlap).
+    It walks the whole window once (600 resampled points for 5 minutes),
+    call it from thread context every few seconds or minutes, not per beat.
+*/
+#pragma once
+
+#include <stdint.h>
+
+/* 5 minutes at up to 100 bpm */
+#ifndef HRV_MAX_BEATS
+#define HRV_MAX_BEATS 512
+#endif
+/* Short term HRV window */
+#define HRV_WINDOW_MS 300000
+#define HRV_MIN_RR_MS 300
+#define HRV_MAX_RR_MS 2000
+#define HRV_ECTOPIC_PERCENT 20
+#define HRV_RELEARN_BEATS 4
+/* Successive difference counted by pNN50 */
+#define HRV_NN50_MS 50
+/* Frequency domain: resampling rate and segment length, bins are 1 / HRV_SEGMENT_S apart */
+#define HRV_RESAMPLE_HZ 2
+#define HRV_SEGMENT_S 100
+#define HRV_SEGMENT_POINTS (HRV_SEGMENT_S * HRV_RESAMPLE_HZ)
+/* Bands as bin numbers: LF 0.04 up to below 0.15 Hz, HF 0.15 to 0.4 Hz */
+#define HRV_LF_FIRST_BIN 4
+#define HRV_HF_FIRST_BIN 15
+#define HRV_HF_LAST_BIN 40
+#define HRV_BINS (HRV_HF_LAST_BIN - HRV_LF_FIRST_BIN + 1)
+/* LF/HF need at least this much data in the window, they are 0 before */
+#define HRV_MIN_SPECTRUM_MS 120000
+
+/*  Rolling window metrics
+    fixed point: X10 is value * 10, power in ms^2
+*/
+typedef struct
+{
+    /* Time covered by window */
+    uint32_t windowMs;
+    /* Intervals in window, accepted ones, rejected ones */
+    uint16_t beats;
+    uint16_t nnCount;
+    uint16_t ectopic;
+    uint16_t meanNnMs;
+    uint16_t meanHrX10;
+    uint16_t sdnnX10;
+    uint16_t rmssdX10;
+    uint16_t pnn50X10;
+    uint32_t lfPower;
+    uint32_t hfPower;
+    /* LF / HF * 100, 0 if HF is 0 */
+    uint16_t lfHfX100;
+} HrvSummary;
+
+/* One RR interval of the window */
+typedef struct
+{
+    uint16_t rrMs;
+    /* Difference to previous interval, valid if HRV_ENTRY_DIFF */
+    int16_t diffMs;
+    uint8_t flags;
+} HrvEntry;
+
+#define HRV_ENTRY_NN 0x01
+#define HRV_ENTRY_DIFF 0x02
+
+class HrvEngine
+{
+public:
+    HrvEngine();
+    /* windowMs: 10 s up to HRV_WINDOW_MS or more if HRV_MAX_BEATS is raised */
+    void configure(uint32_t windowMs);
+    void reset();
+    /* Add one RR interval, constant time */
+    void addRR(uint16_t rrMs);
+    /* Time domain metrics only, constant time */
+    void metrics(HrvSummary *out) const;
+    /* Time and frequency domain metrics, walks the window */
+    void summary(HrvSummary *out) const;
+    /* Intervals seen and rejected since reset */
+    uint32_t totalBeats() const { return _totalBeats; }
+    uint32_t totalEctopic() const { return _totalEctopic; }
+
+private:
+    void evictOldest();
+    void spectrum(HrvSummary *out) const;
+    uint32_t _windowLimitMs;
+    HrvEntry _ring[HRV_MAX_BEATS];
+    /* Oldest entry and number of entries */
+    uint16_t _first;
+    uint16_t _count;
+    /* Sums over window */
+    uint32_t _windowMs;
+    uint32_t _sumNn;
+    uint64_t _sumNn2;
+    uint64_t _sumDiff2;
+    uint16_t _nnCount;
+    uint16_t _diffCount;
+    uint16_t _nn50;
+    /* Recent NN level, ms * 8 */
+    uint32_t _levelX8;
+    uint8_t _rejectRun;
+    bool _prevNn;
+    uint16_t _prevRR;
+    uint32_t _totalBeats;
+    uint32_t _totalEctopic;
+};
@@ -0,0 +1,87 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "latency_probe.h"
+#include <string.h>
+
+static const char *const stageNames[LATENCY_STAGES] = {
+    "irq_duration_cycles",
+    "irq_to_callback_us",
+    "irq_to_output_us",
+    "fifo_words"};
+
+LatencyProbe::LatencyProbe()
+{
+    reset();
+}
+
+void LatencyProbe::reset()
+{
+    memset(_hist, 0, sizeof(_hist));
+    for (int i = 0; i < LATENCY_STAGES; i++)
+    {
+        _hist[i].min = UINT32_MAX;
+    }
+    _irqUs = 0;
+    _irqCycles = 0;
+    _pendingCallback = false;
+    _pendingOutput = false;
+}
+
+void LatencyProbe::add(LatencyStage stage, uint32_t value)
+{
+    LatencyHistogram &h = _hist[stage];
+    h.count++;
+    h.sum += value;
+    if (value < h.min)
+        h.min = value;
+    if (value > h.max)
+        h.max = value;
+    int bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+    if (bucket >= LATENCY_BUCKETS)
+        bucket = LATENCY_BUCKETS - 1;
+    h.buckets[bucket]++;
+}
+
+uint32_t LatencyProbe::percentile(LatencyStage stage, uint8_t pct) const
+{
+    const LatencyHistogram &h = _hist[stage];
+    if (h.count == 0)
+    {
+        return 0;
+    }
+    uint64_t need = ((uint64_t)h.count * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        seen += h.buckets[b];
+        if (seen >= need)
+        {
+            uint32_t upper = b == 0 ? 0 : (uint32_t)((1ull << b) - 1);
+            /* Bucket bound is never reported above real maximum */
+            return upper < h.max ? upper : h.max;
+        }
+    }
+    return h.max;
+}
+
+void LatencyProbe::report(void (*report)(const char *name, const char *metric, double value)) const
+{
+    for (int i = 0; i < LATENCY_STAGES; i++)
+    {
+        const LatencyHistogram &h = _hist[i];
+        report(stageNames[i], "count", h.count);
+        if (h.count == 0)
+        {
+            continue;
+        }
+        report(stageNames[i], "min", h.min);
+        report(stageNames[i], "mean", (double)h.sum / h.count);
+        report(stageNames[i], "p50", percentile((LatencyStage)i, 50));
+        report(stageNames[i], "p99", percentile((LatencyStage)i, 99));
+        report(stageNames[i], "max", h.max);
+    }
+}
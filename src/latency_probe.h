@@ -0,0 +1,95 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Latency probe for acquisition path
+    Driver marks intruppt entry/exit and every delivered sample block, application
+    marks end of output write. Timestamps come from max30003_hal.h so the same
+    probe runs on RP2040 (timer + SysTick) and against the host simulator.
+
+    LATENCY_IRQ_DURATION      clk_sys cycles spent in getDataIntrupptCallback()
+    LATENCY_IRQ_TO_CALLBACK   us from intruppt to sample block callback
+    LATENCY_IRQ_TO_OUTPUT     us from intruppt to end of next output write
+    LATENCY_FIFO_WORDS        words per delivered block, FIFO headroom is depth - max
+    Only the first block / write after every intruppt is measured.
+*/
+#pragma once
+
+#include <stdint.h>
+#include "max30003_hal.h"
+
+/* Bucket b counts values in [2^(b-1), 2^b), bucket 0 counts 0 */
+#define LATENCY_BUCKETS 25
+
+typedef enum
+{
+    LATENCY_IRQ_DURATION,
+    LATENCY_IRQ_TO_CALLBACK,
+    LATENCY_IRQ_TO_OUTPUT,
+    LATENCY_FIFO_WORDS,
+    LATENCY_STAGES
+} LatencyStage;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+class LatencyProbe
+{
+public:
+    LatencyProbe();
+    void reset();
+
+    /* Called from intruppt handler */
+    void irqEntry()
+    {
+        _irqUs = halTimeUs32();
+        _irqCycles = halCycles();
+        _pendingCallback = true;
+        _pendingOutput = true;
+    }
+    void irqExit()
+    {
+        add(LATENCY_IRQ_DURATION, (halCycles() - _irqCycles) & 0xFFFFFF);
+    }
+    /* Called when a block of samples is delivered, may run on other core */
+    void block(uint16_t words)
+    {
+        add(LATENCY_FIFO_WORDS, words);
+        if (_pendingCallback)
+        {
+            _pendingCallback = false;
+            add(LATENCY_IRQ_TO_CALLBACK, halTimeUs32() - _irqUs);
+        }
+    }
+    /* Called after output link accepted a frame or line */
+    void output()
+    {
+        if (_pendingOutput)
+        {
+            _pendingOutput = false;
+            add(LATENCY_IRQ_TO_OUTPUT, halTimeUs32() - _irqUs);
+        }
+    }
+
+    const LatencyHistogram &histogram(LatencyStage stage) const { return _hist[stage]; }
+    /* Upper bound of bucket holding pct percent of values */
+    uint32_t percentile(LatencyStage stage, uint8_t pct) const;
+    /* Call report once per metric, metric names are stable for regression tracking */
+    void report(void (*report)(const char *name, const char *metric, double value)) const;
+
+private:
+    void add(LatencyStage stage, uint32_t value);
+    LatencyHistogram _hist[LATENCY_STAGES];
+    volatile uint32_t _irqUs;
+    uint32_t _irqCycles;
+    volatile bool _pendingCallback;
+    volatile bool _pendingOutput;
+};
@@ -10,19 +10,58 @@ MAX30003::MAX30003(int cs, spi_inst_t *spiId, void (*callBack)(signed int, MAX30
 {
     _spiId = spiId;
     _cs = cs;
+    _intPin = -1;
     _callBack = callBack;
+    /* MNGR_INT EFIT is written by setIntruppts() */
+    _coalesceMode = COALESCE_ADAPTIVE;
+    _fifoThreshold = COALESCE_LIVE_WORDS;
+    _burstWords = COALESCE_LIVE_WORDS + COALESCE_MARGIN_WORDS;
+    _pendingThreshold = 0;
+    _outputBacklog = 0;
+    _idleSamples = 0;
+    _dropNext = false;
+    _irqDeferred = false;
+    _dmaDst = nullptr;
+    _dmaGap[0] = _dmaGap[1] = false;
+    _dmaMode = false;
+    _txDma = -1;
+    _rxDma = -1;
+    _dmaFull[0] = _dmaFull[1] = false;
+    _dmaLen[0] = _dmaLen[1] = 0;
+    _dmaBusy = false;
+    _dmaWriteIdx = 0;
+    _dmaReadIdx = 0;
+    _dmaCompleted = 0;
+    _fifoReads = 0;
+    _lastFifoReadUs = 0;
+    _blockReadSequence = 0;
+    _readsWithoutSamples = 0;
+    _dmaDecoded = 0;
+    _fifoResetPending = false;
+    _ring = nullptr;
+    _dmaSlot = nullptr;
+    _onSamples = nullptr;
+    _onRR = nullptr;
+    _blockCtx = nullptr;
+    _sampleIndex = 0;
+    _sampleGap = false;
+    _blockCount = 0;
+    _probe = nullptr;
+    /* CNFG_ECG written by max30003Begin() selects 128 sps */
+    _sampleRate = SAMPLINGRATE_128;
+    _lastReadUs = 0;
 }
 
 /*  Make the CS pin high to deselect device for SPI communication */
 void MAX30003::cs_deselect()
 {
-    gpio_put(_cs, true);
+    halGpioPut(_cs, true);
 }
 
 /*  Make the CS pin LOW to select device for SPI communication */
 void MAX30003::cs_select()
 {
-    gpio_put(_cs, false);
+    halGpioPut(_cs, false);
 }
 
 /* This read_registers function is used to read the perticuler Register
@@ -38,8 +77,8 @@ void MAX30003::read_registers(uint8_t reg, uint8_t *buf, int len)
     /* Shift register address to left to store address on First 7 bits and make last bit 1 for Read operation */
     uint8_t read = (reg << 1) | RREG;
     cs_select();
-    spi_write_blocking(_spiId, &read, 1);
-    spi_read_blocking(_spiId, 0, buf, len);
+    halSpiWrite(_spiId, &read, 1);
+    halSpiRead(_spiId, buf, len);
     cs_deselect();
 }
 
@@ -56,55 +95,42 @@ void MAX30003::max30003RegWrite(uint8_t reg, uint32_t data)
     */
     uint8_t buffer[4] = {(uint8_t)((reg << 1) | WREG), (uint8_t)(data >> 16), (uint8_t)(data >> 8), (uint8_t)data};
     cs_select();
-    spi_write_blocking(_spiId, buffer, 4);
+    halSpiWrite(_spiId, buffer, 4);
     cs_deselect();
 }
 
+/* Stage RATE field of CNFG_ECG, false if rate is not supported */
+bool MAX30003::stageSamplingRate(uint16_t samplingRate)
+{
+    uint8_t rate = ecgRateBits(samplingRate);
+    if (rate == 0xFF)
+    {
+        halLog("Wrong samplingRate, please choose between 128, 256 or 512");
+        return false;
+    }
+    /* Shadow holds CNFG_ECG, no read back needed */
+    _shadow.set(CNFG_ECG, cnfgEcgWithRate(_shadow.get(CNFG_ECG), (MAX30003EcgRate)rate));
+    _sampleRate = samplingRate;
+    return true;
+}
+
 /* max30003SetsamplingRate is used to setup a SAMPLING Rate */
 void MAX30003::max30003SetsamplingRate(uint16_t samplingRate)
 {
-    uint8_t regBuff[4] = {0};
-    read_registers(CNFG_ECG, regBuff, 4);
-
-    switch (samplingRate)
+    if (stageSamplingRate(samplingRate))
     {
-    case SAMPLINGRATE_128:
-        regBuff[0] = (regBuff[0] | 0x80);
-        break;
-
-    case SAMPLINGRATE_256:
-        regBuff[0] = (regBuff[0] | 0x40);
-        break;
-
-    case SAMPLINGRATE_512:
-        regBuff[0] = (regBuff[0] | 0x00);
-        break;
-
-    default:
-        printf("Wrong samplingRate, please choose between 128, 256 or 512");
-        break;
+        /* Writes CNFG_ECG and SYNCH only if rate changed */
+        applyConfig();
     }
-
-    unsigned long cnfgEcg;
-    memcpy(&cnfgEcg, regBuff, 4);
-    max30003RegWrite(CNFG_ECG, (cnfgEcg >> 8));
-    /* Sync Configuration */
-    max30003RegWrite(SYNCH, 0x0000);
-    sleep_ms(10);
 }
 
-void MAX30003::max30003Begin()
+/* Stage configuration of max30003Begin(), field values are in max30003_config.h */
+void MAX30003::stageBeginConfig()
 {
-    /* Reset MAX30003 to its original default state */
-    max30003RegWrite(SW_RST, 0x000000);
-    sleep_ms(10);
-    max30003RegWrite(CNFG_GEN, 0x080000);
-    sleep_ms(10);
+    _shadow.set(CNFG_GEN, MAX30003_CNFG_GEN_VALUE);
     /* Configure Calibration */
-    max30003RegWrite(CNFG_CAL, 0x000000);
-    sleep_ms(10);
-    max30003RegWrite(CNFG_EMUX, 0x000000);
-    sleep_ms(10);
+    _shadow.set(CNFG_CAL, MAX30003_CNFG_CAL_VALUE);
+    _shadow.set(CNFG_EMUX, MAX30003_CNFG_EMUX_VALUE);
     /* Configure ECG Channel
     D[14]    DHPF       1       ECG Channel Digital High-Pass Filter Cutoff Frequency
                                 0 = Bypass (DC)
@@ -118,119 +144,299 @@ void MAX30003::max30003Begin()
                                 (DLPF[1:0] = 01) will be used internally; the CNFG_ECG register will continue to hold
                                 the value as written, but return the effective internal value when read back.
 */
-    max30003RegWrite(CNFG_ECG, 0x805000); // d23 - d22 : 10 for 250sps , 00:500 sps
-    sleep_ms(10);
+    _shadow.set(CNFG_ECG, MAX30003_CNFG_ECG_VALUE);
+    _sampleRate = SAMPLINGRATE_128;
     /* Configure R to R Peak Detection Algorithm*/
-    max30003RegWrite(CNFG_RTOR1, 0x3f6300);
-    sleep_ms(10);
-    max30003RegWrite(CNFG_RTOR2, 0x202400);
-    sleep_ms(10);
-    /* Sync Configuration */
-    max30003RegWrite(SYNCH, 0x0000);
-    sleep_ms(10);
+    _shadow.set(CNFG_RTOR1, MAX30003_CNFG_RTOR1_VALUE);
+    _shadow.set(CNFG_RTOR2, MAX30003_CNFG_RTOR2_VALUE);
+}
+
+void MAX30003::max30003Begin()
+{
+    /* Reset MAX30003 to its original default state, shadow follows */
+    max30003RegWrite(SW_RST, 0x000000);
+    _shadow.reset();
+    stageBeginConfig();
+    applyConfig();
+}
+
+void MAX30003::max30003Configure(uint16_t samplingRate)
+{
+    max30003RegWrite(SW_RST, 0x000000);
+    _shadow.reset();
+    stageBeginConfig();
+    stageSamplingRate(samplingRate);
+    stageIntruppts();
+    applyConfig();
+    /* Intruppt duration is counted with SysTick of the core that sets up intruppts */
+    halCycleCounterInit();
+}
+
+void MAX30003::setConfig(uint8_t reg, uint32_t value)
+{
+    _shadow.set(reg, value);
+}
+
+uint32_t MAX30003::getConfig(uint8_t reg) const
+{
+    return _shadow.get(reg);
+}
+
+/*  Write staged registers that differ from device
+    Registers changing the time base are written last, then one SYNCH restarts
+    sampling with all of them. Unchanged registers are not written, so changing
+    intruppt setup does not disturb the ECG record
+*/
+void MAX30003::applyConfig()
+{
+    uint8_t reg;
+    uint32_t value;
+    bool needSynch;
+    bool synch = false;
+    while (_shadow.nextDirty(&reg, &value, &needSynch))
+    {
+        max30003RegWrite(reg, value);
+        synch |= needSynch;
+    }
+    if (synch)
+    {
+        /* Sync Configuration */
+        max30003RegWrite(SYNCH, 0x0000);
+    }
 }
 
 /* Read and Decode RR interval and Heart rate */
 void MAX30003::getHRandRR(void)
 {
+    if (_ring != nullptr)
+    {
+        /* Pipeline mode: only copy RTOR, it is decoded on processing core */
+        MAX30003RawBlock *block = _ring->producerSlot();
+        if (block == nullptr)
+        {
+            /* RTOR is still read because that clears RRINT and releases INTB */
+            uint8_t discard[3];
+            read_registers(RTOR, discard, 3);
+            return;
+        }
+        read_registers(RTOR, block->data, 3);
+        block->type = BLOCK_RTOR;
+        block->offset = 0;
+        block->gap = 0;
+        block->len = 3;
+        block->timeUs = halTimeUs();
+        _ring->commit();
+        halNotify();
+        return;
+    }
+    if (_dmaMode)
+    {
+        /* Samples are decoded in thread context, RR has to come from there too */
+        MAX30003RtorEvent *rtor = _rtorQueue.producerSlot();
+        if (rtor == nullptr)
+        {
+            uint8_t discard[3];
+            read_registers(RTOR, discard, 3);
+            return;
+        }
+        read_registers(RTOR, rtor->data, 3);
+        rtor->afterBlocks = _dmaCompleted;
+        rtor->timeUs = halTimeUs();
+        _rtorQueue.commit();
+        halNotify();
+        return;
+    }
     uint8_t regReadBuff[4];
     read_registers(RTOR, regReadBuff, 4);
+    decodeRtor(regReadBuff);
+}
 
+/* Decode RR interval and Heart rate from RTOR register value */
+void MAX30003::decodeRtor(const uint8_t *regReadBuff)
+{
     unsigned long RTOR_msb = (unsigned long)(regReadBuff[0]);
     unsigned char RTOR_lsb = (unsigned char)(regReadBuff[1]);
     unsigned long rtor = (RTOR_msb << 8 | RTOR_lsb);
     rtor = ((rtor >> 2) & 0x3fff);
 
-    float hr = 60 / ((float)rtor * 0.0078125);
-    heartRate = (unsigned int)hr;
+    /*  RTOR counts 7.8125 ms (1/128 s): RR = rtor * 125 / 16 ms, HR = 60 * 128 / rtor bpm
+        Integer math gives the same truncated values as float, without soft float in the intruppt
+    */
+    RRinterval = rtor * 125 / 16;
+    heartRate = rtor != 0 ? 7680 / rtor : 0;
+    _counters.rrEvents.add();
+    if (_onRR != nullptr)
+    {
+        _onRR(RRinterval, _sampleIndex, _blockCtx);
+    }
+    else if (_callBack != nullptr)
+    {
+        _callBack((signed int)RRinterval, RRINTERVAL);
+    }
+}
 
-    unsigned int RR = (unsigned int)rtor * (7.8125); // 8ms
-    RRinterval = RR;
-    _callBack((signed int)RRinterval, RRINTERVAL);
+/*  True if last word of a burst is a sample without EOF tag:
+    FIFO may still hold threshold words, then EINT stays active and no new INTB edge comes
+*/
+static bool fifoMayHaveMore(const uint8_t *buf, int len)
+{
+    uint8_t eTag = (buf[len - 1] >> 3) & 0x7;
+    return eTag == ECG_ETAG_VALID || eTag == ECG_ETAG_FAST;
 }
 
 /* Read ECG data samples from MAX30003 */
 void MAX30003::getEcgSamples(void)
 {
-    uint8_t regReadBuff[48];
-    read_registers(ECG_FIFO, regReadBuff, 48);
-    for (int i = 0; i < 48; i = i + 3)
+    /* ECG_FIFO returns one word per transaction, burst register streams consecutive words */
+    int len = _burstWords * MAX30003_FIFO_WORD_LEN;
+    for (int pass = 0; pass < 2; pass++)
     {
-        int eTag = (int)((regReadBuff[i + 2] >> 3) & 0x7);
-        if (eTag == 0 || eTag == 2)
+        uint8_t regReadBuff[MAX30003_FIFO_DEPTH * MAX30003_FIFO_WORD_LEN];
+        uint64_t timeUs = halTimeUs();
+        _lastFifoReadUs = (uint32_t)timeUs;
+        /* Pipeline mode: read FIFO directly into ring slot, no decoding in intruppt */
+        MAX30003RawBlock *block = _ring != nullptr ? _ring->producerSlot() : nullptr;
+        uint8_t *dst = block != nullptr ? block->data : regReadBuff;
+        read_registers(ECG_FIFO_BURST, dst, len);
+        bool more = fifoMayHaveMore(dst, len);
+        uint32_t sequence = _fifoReads++;
+        if (block != nullptr)
         {
-            /* This is valid sample */
-           unsigned int data = (regReadBuff[0] << 16 | regReadBuff[1] << 8 | regReadBuff[2] & 0xc0) >> 6;
-            if ((data & 0x20000) == 0x20000)
-            {
-                signed int value = data - 262144;
-                _callBack(value, ECGDATA);
-            }
-            else
-            {
-                _callBack((signed int)data, ECGDATA);
-            }
-            if (eTag == 2)
+            block->timeUs = timeUs;
+            block->sequence = sequence;
+            block->type = BLOCK_ECG_FIFO;
+            block->offset = 0;
+            block->gap = _dropNext;
+            block->len = (uint16_t)len;
+            _dropNext = false;
+            _ring->commit();
+            halNotify();
+        }
+        else if (_ring != nullptr)
+        {
+            /* Ring is full, FIFO was read anyway to release INTB, ring->dropped() counts this */
+            _dropNext = true;
+        }
+        else
+        {
+            if (_dropNext)
             {
-                /*Last Valid Sample (EOF)*/
-                return;
+                _sampleGap = true;
+                _dropNext = false;
             }
+            decodeEcgBlock(dst, len, timeUs, sequence);
         }
-        else if (eTag == 1)
+        if (!more)
         {
-            /*  This sample was taken while the ECG
-                channel was in a FAST recovery mode.
-                The voltage information is not valid,
-                but the sample represents a valid time
-                step.
-                Action:
-                Discard, note, or post-process this voltage sample, but increment the time base. Continue to gather data from the ECG FIFO.
-            */
-            // printf("Data is not valid ETAG: 1\n");
+            break;
         }
-        else if (eTag == 3)
+    }
+}
+
+/*  Decode a block of raw ECG FIFO words and deliver it as one sample block
+    buf: FIFO words, 3 Bytes each
+    len: length of buf in Bytes
+    timeUs: time when FIFO was read
+    readSequence: FIFO read number given in intruppt
+*/
+void MAX30003::decodeEcgBlock(const uint8_t *buf, int len, uint64_t timeUs, uint32_t readSequence)
+{
+    EcgDecodeSummary summary;
+    int words = len / MAX30003_FIFO_WORD_LEN;
+    if (words > MAX30003_FIFO_DEPTH)
+    {
+        words = MAX30003_FIFO_DEPTH;
+    }
+    _blockFirstIndex = _sampleIndex;
+    _blockTimeUs = timeUs;
+    /* Reads without samples are never delivered, numbers after them move down so they are no jump */
+    _blockReadSequence = readSequence - _readsWithoutSamples;
+    _blockCount = ecgDecodeFifo(buf, words, _blockSamples, _blockFlags, &summary);
+    _counters.blocks.add();
+    _counters.samples.add(_blockCount);
+    _counters.fastSamples.add(summary.fast);
+    _counters.blockHist[telemetryBlockBucket(_blockCount)].add();
+    if (_blockCount == 0)
+    {
+        _readsWithoutSamples++;
+        if (summary.status & ECG_DECODE_EMPTY)
         {
-            /*  Last Fast Mode Sample (EOF)
-                See above (ETAG=001), but in addition, this is the last sample
-                currently available in the FIFO (End of File indicator).
-                Recommended Action:
-                    Discard, note, or post-process this voltage
-                    sample, but increment the time base.
-                    Suspend read back operations on the ECG
-                    FIFO until more samples are available.
-            */
-            // printf("Data is not valid ETAG: 3\n");
-            return;
+            _counters.emptyReads.add();
         }
-        else if (eTag == 5)
+    }
+    if (_blockCount > 0)
+    {
+        if (_sampleGap)
         {
-            /*  FIFO Empty (Exception)
-                This is an invalid sample provided in
-                response to an SPI request to read an
-                empty FIFO.
-                Recommended Action:
-                    Discard this sample, without incrementing
-                    the time base.
-                    Suspend read back operations on this FIFO
-                    until more samples are available.
+            _blockFlags[0] |= ECG_FLAG_GAP;
+            _sampleGap = false;
+            /*  Samples the device took since last good read that did not reach us
+                Not known before first good read, time since boot is not lost samples
             */
-            // printf("There are not ECG samples to read Empty Data ETAG: 5\n");
-            return;
+            uint32_t expected = _lastReadUs != 0 ? (uint32_t)((timeUs - _lastReadUs) * _sampleRate / 1000000) : 0;
+            if (expected > _blockCount)
+            {
+                _counters.lostSamples.add(expected - _blockCount);
+            }
         }
-        else if (eTag == 7)
+        _lastReadUs = timeUs;
+    }
+    _sampleIndex += _blockCount;
+    if (summary.status & ECG_DECODE_OVERFLOW)
+    {
+        /*  FIFO Overflow (Exception)
+            The FIFO has been allowed to overflow - the data is corrupted.
+            Recommended Action:
+                issue a FIFO_RST command to clear the
+                FIFOs or re-SYNCH if necessary.
+                Note the corresponding halt and resumption
+                in ECG/BIOZ time/voltage records.
+        */
+        /*  SPI bus may be owned by DMA or this may run on other core,
+            FIFO_RST is issued from intruppt context by resetFifo()
+        */
+        _fifoResetPending = true;
+        /* Next sample starts after a gap in time base, no printf here as this may run in intruppt */
+        _sampleGap = true;
+    }
+    deliverSampleBlock();
+}
+
+/*  Hand decoded block to the user
+    Block callback gets whole block with one call, legacy callback gets
+    every sample with valid voltage
+*/
+void MAX30003::deliverSampleBlock()
+{
+    if (_blockCount == 0)
+    {
+        return;
+    }
+    if (_probe != nullptr)
+    {
+        _probe->block(_blockCount);
+    }
+    if (_onSamples != nullptr)
+    {
+        MAX30003SampleBlock block;
+        block.samples = _blockSamples;
+        block.flags = _blockFlags;
+        block.count = _blockCount;
+        block.firstIndex = _blockFirstIndex;
+        block.timestampUs = _blockTimeUs;
+        block.readSequence = _blockReadSequence;
+        _onSamples(&block, _blockCtx);
+        return;
+    }
+    if (_callBack == nullptr)
+    {
+        return;
+    }
+    for (int i = 0; i < _blockCount; i++)
+    {
+        if ((_blockFlags[i] & ECG_FLAG_FAST) == 0)
         {
-            /*  FIFO Overflow (Exception)
-                The FIFO has been allowed to overflow - the data is corrupted.
-                Recommended Action:
-                    issue a FIFO_RST command to clear the
-                    FIFOs or re-SYNCH if necessary.
-                    Note the corresponding halt and resumption
-                    in ECG/BIOZ time/voltage records.
-            */
-            max30003RegWrite(FIFO_RST, 0x0);
-            printf("FIFO Overflow ETAG: 7\n");
-            // printf("issued FIFO_RST command\n");
-            return;
+            _callBack((signed int)_blockSamples[i], ECGDATA);
         }
     }
 }
@@ -246,7 +452,7 @@ void MAX30003::max30003ReadInfo(void)
     */
     uint8_t readBuff[1];
     read_registers(INFO, readBuff, 1);
-    printf("MAX3003 Revesion Id: %d\n", (readBuff[0] & 0x0f));
+    halLog("MAX3003 Revesion Id: %d\n", (readBuff[0] & 0x0f));
 }
 
 /* Read STATUS Register of MAX30003 to check what is current status of MAX30003 */
@@ -255,31 +461,36 @@ void MAX30003::readStatus(uint8_t *readBuff)
     read_registers(STATUS, readBuff, 3);
 }
 
-/* Setup Intruppts */
-void MAX30003::setIntruppts()
+/* Stage intruppt configuration */
+void MAX30003::stageIntruppts()
 {
     /*
         ENINT
         Lead off and Lead on Intrupt
         000100000000100000000011 (0x100803)
     */
-    // max30003RegWrite(EN_INT2, 0x100803);
-    /*  RR AND SAMPLING INT
-        000000000000011000000001 (0x601)
+    // _shadow.set(EN_INT2, 0x100803);
+    /*  ECG FIFO, FIFO OVERFLOW AND RR INT
+        D[23] EN_EINT, D[22] EN_EOVF, D[10] EN_RRINT, D[1:0] INTB_TYPE = 01 (CMOS driver)
+        EINT is issued when FIFO holds EFIT + 1 words, so one intruppt per block
+        instead of SAMP intruppt for every sample
     */
-    max30003RegWrite(EN_INT, 0x000601);
-    sleep_ms(10);
-    /*  Manage Inrupt
-        111110000000000000010100
-        issu intrupt on every 32th sample instant
-        Self-clear SAMP after approximately one-fourth of one data rate cycle
-        Clear RRINT on RTOR Register Read Back
-    */
-    max30003RegWrite(MNGR_INT, 0xF80014);
-    sleep_ms(10);
-    /* Sync Configuration */
-    max30003RegWrite(SYNCH, 0x0000);
-    sleep_ms(10);
+    _shadow.set(EN_INT, MAX30003_EN_INT_VALUE);
+    /* Manage Inrupt, EFIT from coalescing mode */
+    uint8_t words = _pendingThreshold != 0 ? _pendingThreshold : _fifoThreshold;
+    _pendingThreshold = 0;
+    _shadow.set(MNGR_INT, mngrInt(words));
+    _fifoThreshold = words;
+    _burstWords = words + COALESCE_MARGIN_WORDS > MAX30003_FIFO_DEPTH ? MAX30003_FIFO_DEPTH : words + COALESCE_MARGIN_WORDS;
+}
+
+/* Setup Intruppts */
+void MAX30003::setIntruppts()
+{
+    stageIntruppts();
+    applyConfig();
+    /* Intruppt duration is counted with SysTick of the core that sets up intruppts */
+    halCycleCounterInit();
 }
 
 /* Read Intruppt Configuration */
@@ -287,26 +498,97 @@ void MAX30003::readIntruppt()
 {
     uint8_t readBuff[3];
     read_registers(EN_INT, readBuff, 3);
-    printf("EN_INT STATUS0: %x  ", readBuff[0]);
-    printf("STATUS1: %x  ", readBuff[1]);
-    printf("STATUS2: %x\n", readBuff[2]);
+    halLog("EN_INT STATUS0: %x  ", readBuff[0]);
+    halLog("STATUS1: %x  ", readBuff[1]);
+    halLog("STATUS2: %x\n", readBuff[2]);
     read_registers(EN_INT2, readBuff, 3);
-    printf("EN_INT2 STATUS0: %x  ", readBuff[0]);
-    printf("STATUS1: %x  ", readBuff[1]);
-    printf("STATUS2: %x\n", readBuff[2]);
+    halLog("EN_INT2 STATUS0: %x  ", readBuff[0]);
+    halLog("STATUS1: %x  ", readBuff[1]);
+    halLog("STATUS2: %x\n", readBuff[2]);
 }
 
 /* This is our callback function which is triggeres when we get Intruppt */
 void MAX30003::getDataIntrupptCallback()
+{
+    uint32_t start = halCycles();
+    if (_probe != nullptr)
+    {
+        _probe->irqEntry();
+    }
+    serviceIntruppt();
+    /* FIFO burst is done unless DMA still owns the bus, then dmaCompleteCallback() runs them */
+    if (!_dmaBusy)
+    {
+        executeCommands();
+    }
+    /* Event came while intruppt was running, INTB stayed low */
+    for (int pass = 0; pass < 2 && !_dmaBusy && intbLow(); pass++)
+    {
+        serviceIntruppt();
+        if (!_dmaBusy)
+        {
+            executeCommands();
+        }
+    }
+    if (_probe != nullptr)
+    {
+        _probe->irqExit();
+    }
+    uint32_t cycles = (halCycles() - start) & 0xFFFFFF;
+    _counters.intruppts.add();
+    _counters.irqMaxCycles.max(cycles);
+    _counters.irqHist[telemetryIrqBucket(cycles)].add();
+}
+
+/*  STATUS bits: status[0] D[23] EINT, D[22] EOVF, status[1] D[10] RRINT
+    INTB is level based now (EINT stays active while FIFO is above threshold),
+    so every path has to leave FIFO below threshold or INTB never rises again
+*/
+void MAX30003::serviceIntruppt()
 {
     uint8_t status[3];
+    /* Previous DMA burst still owns the SPI bus, intruppt is serviced again when it completes */
+    if (_dmaBusy)
+    {
+        _irqDeferred = true;
+        return;
+    }
     /* Read Status to check for what event caused to trigger intrupt */
     readStatus(status);
-    if ((int)(status[1] & 0x2) == 2)
+    if (_fifoResetPending || (status[0] & 0x40))
+    {
+        /* FIFO data is corrupted */
+        resetFifo();
+        if ((int)(status[1] & 0x4) == 4)
+        {
+            getHRandRR();
+        }
+        return;
+    }
+    if (_pendingThreshold != 0)
+    {
+        applyThreshold(_pendingThreshold);
+        _pendingThreshold = 0;
+    }
+    updateCoalescing();
+    if (_dmaMode)
+    {
+        /*  RTOR is read first with blocking transfer because FIFO burst
+            keeps CS low until DMA completes
+        */
+        if ((int)(status[1] & 0x4) == 4)
+        {
+            getHRandRR();
+        }
+        if (status[0] & 0x80)
+        {
+            startDmaBurst();
+        }
+        return;
+    }
+    if (status[0] & 0x80)
     {
-        // printf("Intruppt for SAMP\n");
         getEcgSamples();
-        // printf("ECG: %lu    ", ecgdata);
     }
 
     if ((int)(status[1] & 0x4) == 4)
@@ -314,4 +596,459 @@ void MAX30003::getDataIntrupptCallback()
         // printf("Intruppt for RR Interval\n");
         getHRandRR();
     }
-}
\ No newline at end of file
+    /* Overflow decoded in this intruppt */
+    if (_fifoResetPending)
+    {
+        resetFifo();
+    }
+}
+
+bool MAX30003::postCommand(MAX30003CommandType type, uint8_t reg, uint32_t value,
+                           void (*done)(const MAX30003Command *, void *), void *ctx)
+{
+    if (type == CMD_READ && (reg == ECG_FIFO || reg == ECG_FIFO_BURST || reg == RTOR))
+    {
+        return false;
+    }
+    if (type == CMD_SAMPLING_RATE && ecgRateBits((uint16_t)value) == 0xFF)
+    {
+        return false;
+    }
+    /* Driver state follows these: EFIT with setCoalescing(), RATE with CMD_SAMPLING_RATE */
+    if (type == CMD_WRITE && (reg == MNGR_INT || reg == CNFG_ECG))
+    {
+        return false;
+    }
+    MAX30003Command *command = _commands.producerSlot();
+    if (command == nullptr)
+    {
+        return false;
+    }
+    command->type = (uint8_t)type;
+    command->reg = reg;
+    command->value = value & 0xFFFFFF;
+    command->ok = false;
+    command->doneUs = 0;
+    command->done = done;
+    command->ctx = ctx;
+    _commands.commit();
+    return true;
+}
+
+void MAX30003::runCommands()
+{
+    uint32_t state = halIrqSave();
+    if (!_dmaBusy)
+    {
+        executeCommands();
+    }
+    halIrqRestore(state);
+}
+
+/* SYNCH restarts sampling, FIFO content is lost and next block starts after a gap */
+void MAX30003::synchNow()
+{
+    max30003RegWrite(SYNCH, 0x0000);
+    _dropNext = true;
+}
+
+/*  Run commands queued so far, SPI bus has to be free
+    Commands posted from done() wait for next intruppt, so time spent here is
+    bounded by MAX30003_COMMAND_SLOTS register transactions plus one SYNCH
+*/
+void MAX30003::executeCommands()
+{
+    MAX30003Command done[MAX30003_COMMAND_SLOTS];
+    int count = 0;
+    bool synch = false;
+    uint16_t rate = 0;
+    while (count < MAX30003_COMMAND_SLOTS && _commands.pop(done[count]))
+    {
+        MAX30003Command &command = done[count++];
+        command.ok = true;
+        switch (command.type)
+        {
+        case CMD_READ:
+        {
+            uint8_t buf[3];
+            read_registers(command.reg, buf, 3);
+            command.value = (uint32_t)buf[0] << 16 | (uint32_t)buf[1] << 8 | buf[2];
+            /* EOVF: recovery runs with next intruppt as if it had seen it */
+            if (command.reg == STATUS && (buf[0] & 0x40))
+            {
+                _fifoResetPending = true;
+            }
+            break;
+        }
+        case CMD_WRITE:
+            max30003RegWrite(command.reg, command.value);
+            if (command.reg == SW_RST)
+            {
+                /* Device is back to power on defaults, intruppts are off until configured again */
+                _shadow.reset();
+                _sampleRate = SAMPLINGRATE_128;
+                synch = false;
+                break;
+            }
+            _shadow.set(command.reg, command.value);
+            _shadow.take(command.reg);
+            synch |= MAX30003Shadow::needsSynch(command.reg);
+            break;
+        case CMD_SAMPLING_RATE:
+            _shadow.set(CNFG_ECG, cnfgEcgWithRate(_shadow.get(CNFG_ECG), (MAX30003EcgRate)ecgRateBits((uint16_t)command.value)));
+            max30003RegWrite(CNFG_ECG, _shadow.take(CNFG_ECG));
+            rate = (uint16_t)command.value;
+            synch = true;
+            break;
+        case CMD_SYNCH:
+            synchNow();
+            synch = false;
+            break;
+        case CMD_FIFO_RST:
+            max30003RegWrite(FIFO_RST, 0x0);
+            _dropNext = true;
+            break;
+        default:
+            command.ok = false;
+            break;
+        }
+        command.doneUs = halTimeUs();
+    }
+    if (synch)
+    {
+        synchNow();
+    }
+    /* New rate is in effect from SYNCH, samples decoded before were taken with old one */
+    if (rate != 0)
+    {
+        _sampleRate = rate;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        _counters.commands.add();
+        if (done[i].done != nullptr)
+        {
+            done[i].done(&done[i], done[i].ctx);
+        }
+    }
+}
+
+/* FIFO_RST after overflow, samples taken until now are lost */
+void MAX30003::resetFifo()
+{
+    max30003RegWrite(FIFO_RST, 0x0);
+    _fifoResetPending = false;
+    _dropNext = true;
+    _counters.overflows.add();
+}
+/*  Claim two DMA channels (SPI TX and SPI RX) for FIFO burst reads.
+    After this SAMP intruppt only starts the transfer and samples are
+    decoded in thread context by processDmaBlock(), RTOR too
+    DMA_IRQ_0 handler has to call dmaCompleteCallback()
+*/
+bool MAX30003::enableDmaAcquisition()
+{
+    if (!halDmaInit(_spiId, &_txDma, &_rxDma))
+    {
+        halLog("MAX30003: no free DMA channel\n");
+        return false;
+    }
+
+    /*  TX sends ECG_FIFO_BURST command Byte followed by dummy Bytes,
+        every dummy Byte clocks one FIFO Byte out of MAX30003
+    */
+    memset(_dmaTxBuff, 0, sizeof(_dmaTxBuff));
+    _dmaTxBuff[0] = (ECG_FIFO_BURST << 1) | RREG;
+    _dmaMode = true;
+    return true;
+}
+
+/* Start FIFO burst read of _burstWords words into free ping-pong buffer */
+void MAX30003::startDmaBurst()
+{
+    uint8_t idx = _dmaWriteIdx;
+    uint8_t *dst = _dmaBuff[idx];
+    if (_ring != nullptr)
+    {
+        /* Pipeline mode: DMA writes straight into ring slot, ring->dropped() counts full ring */
+        _dmaSlot = _ring->producerSlot();
+        dst = _dmaSlot != nullptr ? _dmaSlot->data : _dmaScratch;
+    }
+    else if (_dmaFull[idx])
+    {
+        /*  Both buffers are waiting for thread context, FIFO is read into scratch
+            buffer and discarded, leaving it in FIFO would keep INTB low
+        */
+        _counters.dmaDropped.add();
+        dst = _dmaScratch;
+    }
+    _dmaDst = dst;
+    uint len = (uint)_burstWords * MAX30003_FIFO_WORD_LEN + 1;
+    _dmaLen[idx] = (uint16_t)len;
+    _dmaTimeUs[idx] = halTimeUs();
+    _lastFifoReadUs = (uint32_t)_dmaTimeUs[idx];
+    _dmaBusy = true;
+    cs_select();
+    halDmaStart(_spiId, _txDma, _rxDma, _dmaTxBuff, dst, len);
+}
+
+/* Called from DMA_IRQ_0 when FIFO burst is completely received */
+bool MAX30003::dmaCompleteCallback()
+{
+    if (_rxDma < 0 || !halDmaAcknowledge(_rxDma))
+    {
+        return false;
+    }
+    cs_deselect();
+    uint8_t idx = _dmaWriteIdx;
+    /* Skip junk Byte received while command Byte was sent */
+    bool more = fifoMayHaveMore(_dmaDst + 1, _dmaLen[idx] - 1);
+    uint32_t sequence = _fifoReads++;
+    if (_dmaDst == _dmaScratch)
+    {
+        _dropNext = true;
+    }
+    else if (_dmaSlot != nullptr)
+    {
+        _dmaSlot->type = BLOCK_ECG_FIFO;
+        _dmaSlot->offset = 1;
+        _dmaSlot->gap = _dropNext;
+        _dmaSlot->timeUs = _dmaTimeUs[idx];
+        _dmaSlot->sequence = sequence;
+        _dmaSlot->len = _dmaLen[idx] - 1;
+        _dmaSlot = nullptr;
+        _dropNext = false;
+        _ring->commit();
+        halNotify();
+    }
+    else
+    {
+        _dmaGap[idx] = _dropNext;
+        _dmaSequence[idx] = sequence;
+        _dropNext = false;
+        _dmaFull[idx] = true;
+        _dmaWriteIdx ^= 1;
+        _dmaCompleted++;
+    }
+    _dmaBusy = false;
+    executeCommands();
+    /* INTB edge during burst was skipped, FIFO still holds a block, or INTB is still low */
+    if (_irqDeferred || more || intbLow())
+    {
+        _irqDeferred = false;
+        serviceIntruppt();
+    }
+    return true;
+}
+
+/*  Decode one completed DMA block in thread context
+    Returns true if a block was processed
+*/
+bool MAX30003::processDmaBlock()
+{
+    deliverRtor();
+    uint8_t idx = _dmaReadIdx;
+    if (!_dmaFull[idx])
+    {
+        return false;
+    }
+    if (_dmaGap[idx])
+    {
+        _sampleGap = true;
+    }
+    /* Skip junk Byte received while command Byte was sent */
+    decodeEcgBlock(&_dmaBuff[idx][1], _dmaLen[idx] - 1, _dmaTimeUs[idx], _dmaSequence[idx]);
+    _dmaFull[idx] = false;
+    _dmaReadIdx ^= 1;
+    _dmaDecoded++;
+    deliverRtor();
+    return true;
+}
+
+/* Decode queued RTOR values that were read before next undecoded DMA block */
+void MAX30003::deliverRtor()
+{
+    const MAX30003RtorEvent *rtor;
+    while ((rtor = _rtorQueue.peek()) != nullptr && (int32_t)(rtor->afterBlocks - _dmaDecoded) <= 0)
+    {
+        decodeRtor(rtor->data);
+        _rtorQueue.release();
+    }
+}
+
+/*  Enable pipeline mode, intruppt only pushes raw blocks into ring
+    ring: consumed with processRawBlock() on processing core, nullptr disables pipeline mode
+*/
+void MAX30003::setPipeline(MAX30003BlockRing *ring)
+{
+    _ring = ring;
+}
+
+/* Decode one raw block taken from pipeline ring, all callbacks are called from here */
+void MAX30003::processRawBlock(const MAX30003RawBlock *block)
+{
+    if (block->type == BLOCK_RTOR)
+    {
+        decodeRtor(&block->data[block->offset]);
+    }
+    else
+    {
+        if (block->gap)
+        {
+            _sampleGap = true;
+        }
+        decodeEcgBlock(&block->data[block->offset], block->len, block->timeUs, block->sequence);
+    }
+}
+
+/*  Block API: every FIFO read is delivered as one MAX30003SampleBlock
+    onSamples: decoded samples with flags, nullptr falls back to legacy callback
+    onRR: RR interval in ms with index of next sample, nullptr falls back to legacy callback
+*/
+void MAX30003::setBlockCallBack(void (*onSamples)(const MAX30003SampleBlock *, void *),
+                                void (*onRR)(uint32_t, uint32_t, void *), void *ctx)
+{
+    _onSamples = onSamples;
+    _onRR = onRR;
+    _blockCtx = ctx;
+}
+
+/* Measure intruppt and block delivery latency, nullptr disables measurement */
+void MAX30003::setLatencyProbe(LatencyProbe *probe)
+{
+    _probe = probe;
+}
+
+/*  Snapshot of runtime counters
+    Safe to call from any core or context, see max30003_telemetry.h
+*/
+void MAX30003::getTelemetry(MAX30003Telemetry *t) const
+{
+    t->intruppts = _counters.intruppts.get();
+    t->blocks = _counters.blocks.get();
+    t->samples = _counters.samples.get();
+    t->fastSamples = _counters.fastSamples.get();
+    t->emptyReads = _counters.emptyReads.get();
+    t->overflows = _counters.overflows.get();
+    t->lostSamples = _counters.lostSamples.get();
+    t->rrEvents = _counters.rrEvents.get();
+    t->ringDepth = _ring != nullptr ? _ring->size() : 0;
+    t->ringHighWater = _ring != nullptr ? _ring->highWater() : 0;
+    t->ringDropped = _ring != nullptr ? _ring->dropped() : 0;
+    t->dmaDropped = _counters.dmaDropped.get();
+    t->irqMaxCycles = _counters.irqMaxCycles.get();
+    t->fifoThreshold = _fifoThreshold;
+    t->coalesceSwitches = _counters.coalesceSwitches.get();
+    t->commands = _counters.commands.get();
+    for (int i = 0; i < TELEMETRY_BLOCK_BUCKETS; i++)
+    {
+        t->blockHist[i] = _counters.blockHist[i].get();
+    }
+    for (int i = 0; i < TELEMETRY_IRQ_BUCKETS; i++)
+    {
+        t->irqHist[i] = _counters.irqHist[i].get();
+    }
+    t->clippedSamples = 0;
+}
+
+/*  Write EFIT threshold and burst length together, called from intruppt context or before intruppts are enabled
+    words: 1 to MAX30003_FIFO_DEPTH
+*/
+void MAX30003::applyThreshold(uint8_t words)
+{
+    if (words < 1)
+        words = 1;
+    if (words > MAX30003_FIFO_DEPTH)
+        words = MAX30003_FIFO_DEPTH;
+    /*  EFIT[23:19] = words - 1
+        Self-clear SAMP after approximately one-fourth of one data rate cycle
+        Clear RRINT on RTOR Register Read Back
+        Written at once, MNGR_INT does not need SYNCH
+    */
+    _shadow.set(MNGR_INT, mngrInt(words));
+    max30003RegWrite(MNGR_INT, _shadow.take(MNGR_INT));
+    if (words != _fifoThreshold)
+    {
+        _counters.coalesceSwitches.add();
+    }
+    _fifoThreshold = words;
+    _burstWords = words + COALESCE_MARGIN_WORDS > MAX30003_FIFO_DEPTH ? MAX30003_FIFO_DEPTH : words + COALESCE_MARGIN_WORDS;
+}
+
+/* Fill of ring, DMA buffers or output path in percent, whichever is highest */
+uint8_t MAX30003::consumerBacklog() const
+{
+    uint32_t backlog = _outputBacklog;
+    if (_ring != nullptr)
+    {
+        uint32_t ring = _ring->size() * 100 / _ring->capacity();
+        backlog = ring > backlog ? ring : backlog;
+    }
+    else if (_dmaMode)
+    {
+        uint32_t dma = (_dmaFull[0] + _dmaFull[1]) * 50;
+        backlog = dma > backlog ? dma : backlog;
+    }
+    return (uint8_t)backlog;
+}
+
+/*  Adaptive coalescing, runs in intruppt before FIFO is read
+    Consumer backlog switches to RECORD at once, LIVE comes back after COALESCE_IDLE_MS without backlog
+*/
+void MAX30003::updateCoalescing()
+{
+    if (_coalesceMode != COALESCE_ADAPTIVE)
+    {
+        return;
+    }
+    uint8_t backlog = consumerBacklog();
+    uint8_t words = _fifoThreshold;
+    if (backlog >= COALESCE_HIGH_BACKLOG)
+    {
+        words = COALESCE_RECORD_WORDS;
+        _idleSamples = 0;
+    }
+    else if (backlog == 0)
+    {
+        _idleSamples += _fifoThreshold;
+        if (_idleSamples >= (uint32_t)_sampleRate * COALESCE_IDLE_MS / 1000)
+        {
+            words = COALESCE_LIVE_WORDS;
+        }
+    }
+    else
+    {
+        _idleSamples = 0;
+    }
+    if (words != _fifoThreshold)
+    {
+        applyThreshold(words);
+    }
+}
+
+/*  Select coalescing mode
+    MNGR_INT is written from next intruppt because SPI bus may be in use now
+*/
+void MAX30003::setCoalescing(MAX30003CoalesceMode mode)
+{
+    _coalesceMode = mode;
+    _idleSamples = 0;
+    _pendingThreshold = mode == COALESCE_RECORD ? COALESCE_RECORD_WORDS : COALESCE_LIVE_WORDS;
+}
+
+void MAX30003::setOutputBacklog(uint8_t percent)
+{
+    _outputBacklog = percent > 100 ? 100 : percent;
+}
+
+/* Threshold currently in use and what it costs */
+void MAX30003::getCoalescing(MAX30003CoalesceInfo *info) const
+{
+    uint8_t words = _fifoThreshold;
+    info->mode = _coalesceMode;
+    info->thresholdWords = words;
+    info->burstWords = _burstWords;
+    info->latencyUs = (uint32_t)words * 1000000 / _sampleRate;
+    info->intrupptsPerSecond = (float)_sampleRate / words;
+    info->switches = _counters.coalesceSwitches.get();
+}
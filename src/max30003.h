@@ -67,6 +67,10 @@
 
 #define RTOR_INTR_MASK 0x04
 
+/* ECG FIFO is 32 words deep, every word is 3 Bytes (18 bit sample + 3 bit ETAG) */
+#define MAX30003_FIFO_DEPTH 32
+#define MAX30003_FIFO_WORD_LEN 3
+
 typedef enum
 {
     SAMPLINGRATE_128 = 128,
@@ -90,23 +94,202 @@ typedef enum
 #define WREG 0x00
 #define RREG 0x01
 
-#include "hardware/spi.h"
+#include "max30003_hal.h"
+#include "spsc_ring.h"
+#include "ecg_decoder.h"
+#include "latency_probe.h"
+#include "max30003_telemetry.h"
+#include "max30003_config.h"
+#include "max30003_command.h"
 #include <stdio.h>
+#include <string.h>
 #include <vector>
 using namespace std;
 
+/*  Decoded FIFO read
+    samples[i] was taken at sample index firstIndex + i, flags[i] are ECG_FLAG_* bits
+    timestampUs is halTimeUs() when FIFO was read
+    readSequence is number of FIFO reads with samples before this one, numbered in intruppt when
+    FIFO is read, a jump means reads were discarded before decoding (DMA buffers or ring full)
+*/
+typedef struct
+{
+    const int32_t *samples;
+    const uint8_t *flags;
+    uint16_t count;
+    uint32_t firstIndex;
+    uint64_t timestampUs;
+    uint32_t readSequence;
+} MAX30003SampleBlock;
+
+/* Type of raw block passed from acquisition core to processing core */
+typedef enum
+{
+    BLOCK_ECG_FIFO,
+    BLOCK_RTOR
+} MAX30003BlockType;
+
+/*  Raw register data as read from MAX30003, decoded later on processing core
+    data[offset] is first valid Byte, len is number of valid Bytes
+*/
+typedef struct
+{
+    uint8_t type;
+    uint8_t offset;
+    /* Samples were lost before this block (ring or DMA buffers full, FIFO overflow) */
+    uint8_t gap;
+    uint16_t len;
+    uint64_t timeUs;
+    /* FIFO read number (MAX30003SampleBlock::readSequence), not used by RTOR blocks */
+    uint32_t sequence;
+    uint8_t data[MAX30003_FIFO_DEPTH * MAX30003_FIFO_WORD_LEN + 1];
+} MAX30003RawBlock;
+
+/*  Ring between core 0 and core 1
+    8 blocks of 32 samples are 0.5 s of output stall at 512 sps,
+    check highWater() and dropped() before changing this
+*/
+#ifndef MAX30003_RING_BLOCKS
+#define MAX30003_RING_BLOCKS 8
+#endif
+typedef SpscRing<MAX30003RawBlock, MAX30003_RING_BLOCKS> MAX30003BlockRing;
+
+/*  RTOR read in intruppt in DMA mode, delivered by processDmaBlock() with the samples
+    afterBlocks: DMA blocks completed when RTOR was read, it is delivered after them
+*/
+typedef struct
+{
+    uint8_t data[3];
+    uint32_t afterBlocks;
+    uint64_t timeUs;
+} MAX30003RtorEvent;
+#define MAX30003_RTOR_QUEUE 4
+
+/*  Intruppt coalescing: EFIT threshold (EINT is issued when FIFO holds that many words)
+    and FIFO burst length are always changed together
+*/
+typedef enum
+{
+    /* Small blocks, low latency for live display */
+    COALESCE_LIVE,
+    /* Large blocks, few intruppts and SPI transactions when samples are only stored or uploaded */
+    COALESCE_RECORD,
+    /* LIVE while consumer keeps up, RECORD while it has a backlog */
+    COALESCE_ADAPTIVE
+} MAX30003CoalesceMode;
+
+/* 8 words are 15.6 ms at 512 sps */
+#define COALESCE_LIVE_WORDS 8
+/* 24 words leave 8 words (15.6 ms at 512 sps) for intruppt latency before overflow */
+#define COALESCE_RECORD_WORDS 24
+/* Words read after threshold, covers samples taken between INTB and end of burst */
+#define COALESCE_MARGIN_WORDS 2
+/* Consumer backlog in percent which switches adaptive mode to RECORD */
+#define COALESCE_HIGH_BACKLOG 50
+/* Adaptive mode goes back to LIVE after this long without backlog */
+#define COALESCE_IDLE_MS 1000
+
+typedef struct
+{
+    uint8_t mode;
+    uint8_t thresholdWords;
+    uint8_t burstWords;
+    /* Time to collect one block, added to output latency */
+    uint32_t latencyUs;
+    float intrupptsPerSecond;
+    uint32_t switches;
+} MAX30003CoalesceInfo;
+
 class MAX30003
 {
 public:
     MAX30003(int cs, spi_inst_t *spiId, void (*callBack)(signed int, MAX30003CallBackType));
+    /* Blocking, before acquisition starts; while it runs use postCommand(CMD_SAMPLING_RATE) */
     void max30003SetsamplingRate(uint16_t samplingRate);
     void max30003Begin();
+    /*  Fast startup: reset, configuration of max30003Begin(), sampling rate and
+        intruppts written as one batch with one SYNCH
+    */
+    void max30003Configure(uint16_t samplingRate);
+    /*  Stage register value in shadow, applyConfig() writes all staged registers
+        that differ from device, followed by SYNCH if needed
+    */
+    void setConfig(uint8_t reg, uint32_t value);
+    uint32_t getConfig(uint8_t reg) const;
+    void applyConfig();
     void getHRandRR(void);
     void getEcgSamples(void);
     void max30003ReadInfo(void);
     void setIntruppts();
     void readIntruppt();
     void getDataIntrupptCallback();
+    /*  INTB pin, intruppt checks it before returning: an event that came after
+        STATUS was read keeps level based INTB low and no new falling edge comes
+    */
+    void setIntPin(uint pin) { _intPin = (int)pin; }
+    /* DMA acquisition mode: FIFO burst is read by DMA into ping-pong buffers */
+    bool enableDmaAcquisition();
+    /* Returns false if DMA intruppt was not raised by this device */
+    bool dmaCompleteCallback();
+    /* DMA burst of this device owns the SPI bus */
+    bool dmaBusy() const { return _dmaBusy; }
+    spi_inst_t *spi() const { return _spiId; }
+    /*  Decode completed DMA block in thread context, true if a block was decoded
+        RTOR values read in intruppt are delivered here too, in order with the blocks
+    */
+    bool processDmaBlock();
+    /*  Low 32 bit of halTimeUs() when FIFO was last read (burst start in DMA mode),
+        FIFO is nearly empty right after it, e.g. time to make flash busy
+    */
+    uint32_t lastFifoReadUs() const { return _lastFifoReadUs; }
+    /* Completed DMA block or RTOR waits for processDmaBlock(), timeUs is when FIFO was read */
+    bool dmaBlockReady(uint64_t *timeUs)
+    {
+        const MAX30003RtorEvent *rtor = _rtorQueue.peek();
+        if (rtor != nullptr && (int32_t)(rtor->afterBlocks - _dmaDecoded) <= 0)
+        {
+            *timeUs = rtor->timeUs;
+            return true;
+        }
+        if (!_dmaFull[_dmaReadIdx])
+        {
+            return false;
+        }
+        *timeUs = _dmaTimeUs[_dmaReadIdx];
+        return true;
+    }
+    /*  Pipeline mode: intruppt only pushes raw blocks into ring,
+        processRawBlock() decodes them on other core
+    */
+    void setPipeline(MAX30003BlockRing *ring);
+    void processRawBlock(const MAX30003RawBlock *block);
+    /* Sampling rate of raw blocks when they are decoded without device, e.g. replay of a capture */
+    void setDecodeRate(uint16_t sampleRate) { _sampleRate = sampleRate; }
+    /* Block API, replaces per sample callback */
+    void setBlockCallBack(void (*onSamples)(const MAX30003SampleBlock *, void *),
+                          void (*onRR)(uint32_t, uint32_t, void *), void *ctx);
+    void setLatencyProbe(LatencyProbe *probe);
+    /* Coalescing mode, takes effect with next intruppt (or setIntruppts()) */
+    void setCoalescing(MAX30003CoalesceMode mode);
+    /* Backlog of output path in percent (0-100), used by adaptive coalescing */
+    void setOutputBacklog(uint8_t percent);
+    void getCoalescing(MAX30003CoalesceInfo *info) const;
+    /*  Queue register command (see max30003_command.h), never blocks
+        Runs after next FIFO burst, done is called from intruppt context when
+        command and any SYNCH it needs were written. Post from one context only
+        Returns false if queue is full or command is not allowed (CMD_WRITE to MNGR_INT
+        or CNFG_ECG, use setCoalescing() and CMD_SAMPLING_RATE)
+    */
+    bool postCommand(MAX30003CommandType type, uint8_t reg, uint32_t value,
+                     void (*done)(const MAX30003Command *, void *), void *ctx);
+    /*  Run queued commands now unless a DMA burst of this driver owns the SPI bus, for use
+        before intruppts are enabled or while INTB is idle; call from the core that serves
+        the intruppts. Devices sharing a bus use MAX30003Manager::runCommands()
+    */
+    void runCommands();
+    uint32_t pendingCommands() const { return _commands.size(); }
+    /* Copy of runtime counters, can be called from any core */
+    void getTelemetry(MAX30003Telemetry *telemetry) const;
     /* These Vars are used to store last value of */
     unsigned int RRinterval;
     signed long ecgdata;
@@ -116,9 +299,125 @@ private:
     void cs_deselect();
     void cs_select();
     void readStatus(uint8_t *readBuff);
+    void serviceIntruppt();
+    bool intbLow() const { return _intPin >= 0 && !halGpioGet((uint)_intPin); }
+    void resetFifo();
+    void applyThreshold(uint8_t words);
+    void updateCoalescing();
+    uint8_t consumerBacklog() const;
     void read_registers(uint8_t reg, uint8_t *buf, int len);
     void max30003RegWrite(uint8_t reg, uint32_t data);
+    void decodeEcgBlock(const uint8_t *buf, int len, uint64_t timeUs, uint32_t readSequence);
+    void deliverRtor();
+    void deliverSampleBlock();
+    void decodeRtor(const uint8_t *buf);
+    void startDmaBurst();
+    void stageBeginConfig();
+    bool stageSamplingRate(uint16_t samplingRate);
+    void stageIntruppts();
+    void executeCommands();
+    void synchNow();
     int _cs;
+    int _intPin;
     spi_inst_t *_spiId;
     void (*_callBack)(signed int, MAX30003CallBackType);
+    /* Configuration registers as written to device, plus staged changes */
+    MAX30003Shadow _shadow;
+    /* Posted by thread context, run by intruppt context */
+    MAX30003CommandQueue _commands;
+    /* Number of samples in FIFO when EINT is issued (EFIT + 1) */
+    volatile uint8_t _fifoThreshold;
+    /* Words read with every FIFO burst */
+    volatile uint8_t _burstWords;
+    /* Coalescing state, written from intruppt */
+    volatile uint8_t _coalesceMode;
+    volatile uint8_t _pendingThreshold;
+    volatile uint8_t _outputBacklog;
+    uint32_t _idleSamples;
+    /* Samples were dropped in intruppt, next block carries gap */
+    bool _dropNext;
+    /* Intruppt came while DMA burst was running */
+    volatile bool _irqDeferred;
+    /* DMA acquisition state */
+    bool _dmaMode;
+    int _txDma;
+    int _rxDma;
+    /*  First Byte of every buffer is the junk clocked in while command Byte is sent,
+        FIFO words start from second Byte
+    */
+    uint8_t _dmaTxBuff[MAX30003_FIFO_DEPTH * MAX30003_FIFO_WORD_LEN + 1];
+    uint8_t _dmaBuff[2][MAX30003_FIFO_DEPTH * MAX30003_FIFO_WORD_LEN + 1];
+    /* FIFO is still read when no buffer is free so INTB is released, data is discarded */
+    uint8_t _dmaScratch[MAX30003_FIFO_DEPTH * MAX30003_FIFO_WORD_LEN + 1];
+    uint8_t *_dmaDst;
+    bool _dmaGap[2];
+    volatile uint16_t _dmaLen[2];
+    uint64_t _dmaTimeUs[2];
+    uint32_t _dmaSequence[2];
+    volatile bool _dmaFull[2];
+    volatile bool _dmaBusy;
+    volatile uint8_t _dmaWriteIdx;
+    uint8_t _dmaReadIdx;
+    /* Blocks put into ping-pong buffers (intruppt) and decoded (thread context) */
+    volatile uint32_t _dmaCompleted;
+    uint32_t _dmaDecoded;
+    /* RTOR waits for thread context so RR and samples come from one context */
+    SpscRing<MAX30003RtorEvent, MAX30003_RTOR_QUEUE> _rtorQueue;
+    volatile bool _fifoResetPending;
+    /* Pipeline state */
+    MAX30003BlockRing *_ring;
+    MAX30003RawBlock *_dmaSlot;
+    /* Block API state */
+    void (*_onSamples)(const MAX30003SampleBlock *, void *);
+    void (*_onRR)(uint32_t, uint32_t, void *);
+    void *_blockCtx;
+    uint32_t _sampleIndex;
+    bool _sampleGap;
+    uint16_t _blockCount;
+    uint32_t _blockFirstIndex;
+    uint32_t _blockReadSequence;
+    /* FIFO reads in intruppt, discarded ones too, and decoded reads without samples */
+    volatile uint32_t _fifoReads;
+    volatile uint32_t _lastFifoReadUs;
+    uint32_t _readsWithoutSamples;
+    uint64_t _blockTimeUs;
+    int32_t _blockSamples[MAX30003_FIFO_DEPTH];
+    uint8_t _blockFlags[MAX30003_FIFO_DEPTH];
+    LatencyProbe *_probe;
+    /* Telemetry */
+    MAX30003Counters _counters;
+    uint16_t _sampleRate;
+    /* Time of last FIFO read that returned samples, used to estimate lost samples, 0 before first one */
+    uint64_t _lastReadUs;
+};
+
+/*  Driver with sink bound at compile time
+    Sink has to provide:
+        void onSample(int32_t sample, uint8_t flags, uint32_t sampleIndex);
+        void onRR(uint32_t rrMs, uint32_t sampleIndex);
+    There is one indirect call per FIFO read, onSample() is inlined in the block loop
+*/
+template <class Sink>
+class MAX30003WithSink : public MAX30003
+{
+public:
+    MAX30003WithSink(int cs, spi_inst_t *spiId, Sink &sink) : MAX30003(cs, spiId, nullptr), _sink(sink)
+    {
+        setBlockCallBack(samplesThunk, rrThunk, this);
+    }
+
+private:
+    static void samplesThunk(const MAX30003SampleBlock *block, void *ctx)
+    {
+        Sink &sink = static_cast<MAX30003WithSink *>(ctx)->_sink;
+        for (uint16_t i = 0; i < block->count; i++)
+        {
+            sink.onSample(block->samples[i], block->flags[i], block->firstIndex + i);
+        }
+    }
+    static void rrThunk(uint32_t rrMs, uint32_t sampleIndex, void *ctx)
+    {
+        static_cast<MAX30003WithSink *>(ctx)->_sink.onRR(rrMs, sampleIndex);
+    }
+    Sink &_sink;
 };
\ No newline at end of file
@@ -0,0 +1,62 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Asynchronous register commands of MAX30003 driver
+
+    Thread context posts commands into a queue and returns at once. The driver
+    runs them where it owns the SPI bus anyway: at the end of the INTB intruppt,
+    after the FIFO burst (DMA completion in DMA mode), so samples taken with the
+    old configuration are read before SYNCH or FIFO_RST throws them away.
+    Commands run in posting order, done() is called from that intruppt context.
+
+    Datasheet ordering the queue keeps:
+    - writes to CNFG_GEN, CNFG_EMUX, CNFG_ECG and CNFG_RTOR are followed by one SYNCH
+      after the last of them, unless a posted SYNCH follows anyway
+    - SYNCH and FIFO_RST come after the FIFO burst, next block is marked as gap
+    - reading STATUS does not clear EINT, EOVF or RRINT with MNGR_INT of this driver,
+      EOVF seen by a poll still starts overflow recovery
+    - ECG_FIFO, ECG_FIFO_BURST and RTOR can not be read, that would take samples
+      or RR intervals away from the acquisition path
+*/
+#pragma once
+
+#include <stdint.h>
+#include "spsc_ring.h"
+
+typedef enum
+{
+    /* Read 24 bit register, result in value */
+    CMD_READ,
+    /* Write 24 bit value, configuration registers also update shadow;
+       not MNGR_INT or CNFG_ECG, driver keeps FIFO threshold and sampling rate of them */
+    CMD_WRITE,
+    /* Restart sampling with current configuration */
+    CMD_SYNCH,
+    /* Empty FIFO, samples in it are lost */
+    CMD_FIFO_RST,
+    /* value is 128, 256 or 512: RATE of CNFG_ECG, then SYNCH */
+    CMD_SAMPLING_RATE
+} MAX30003CommandType;
+
+typedef struct MAX30003Command MAX30003Command;
+struct MAX30003Command
+{
+    uint8_t type;
+    uint8_t reg;
+    /* Value to write, sampling rate, or value read */
+    uint32_t value;
+    bool ok;
+    /* halTimeUs() when command was written to device */
+    uint64_t doneUs;
+    void (*done)(const MAX30003Command *command, void *ctx);
+    void *ctx;
+};
+
+/* Commands waiting for next intruppt, a sampling rate change needs one */
+#ifndef MAX30003_COMMAND_SLOTS
+#define MAX30003_COMMAND_SLOTS 8
+#endif
+typedef SpscRing<MAX30003Command, MAX30003_COMMAND_SLOTS> MAX30003CommandQueue;
@@ -0,0 +1,257 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  MAX30003 configuration registers
+
+    Register values are built from named fields at compile time instead of
+    magic constants, and kept in a RAM shadow. Changes are staged in the
+    shadow and written as one batch: only registers that differ from the
+    device are written, followed by one SYNCH if a register that changes
+    the time base (CNFG_GEN, CNFG_EMUX, CNFG_ECG, CNFG_RTOR*) was written.
+
+    Datasheet has no wait time between register writes, SW_RST and SYNCH
+    execute at the end of their SPI transaction, so no delays are needed.
+*/
+#pragma once
+
+#include <stdint.h>
+
+/* Put value into field at D[shift + width - 1 : shift] of reg */
+constexpr uint32_t max30003Field(uint32_t reg, uint8_t shift, uint8_t width, uint32_t value)
+{
+    return (reg & ~(((1u << width) - 1) << shift)) | ((value & ((1u << width) - 1)) << shift);
+}
+
+/*  CNFG_GEN (0x10)
+    D[21:20] FMSTR      00 = 32768Hz master clock, ECG rates 512/256/128 sps
+    D[19]    EN_ECG     ECG channel enable
+    D[17:16] EN_DCLOFF  01 = DC lead-off detection on ECGP/ECGN
+    D[5:4]   EN_RBIAS   01 = resistive bias on ECG channel
+*/
+constexpr uint32_t cnfgGen(bool enEcg, uint8_t fmstr = 0, uint8_t enDcloff = 0, uint8_t enRbias = 0)
+{
+    return max30003Field(max30003Field(max30003Field(max30003Field(0, 20, 2, fmstr), 19, 1, enEcg), 16, 2, enDcloff), 4, 2, enRbias);
+}
+
+/* CNFG_ECG RATE[1:0] with FMSTR = 00 */
+typedef enum
+{
+    ECG_RATE_512 = 0,
+    ECG_RATE_256 = 1,
+    ECG_RATE_128 = 2
+} MAX30003EcgRate;
+
+/* GAIN[1:0] */
+typedef enum
+{
+    ECG_GAIN_20 = 0,
+    ECG_GAIN_40 = 1,
+    ECG_GAIN_80 = 2,
+    ECG_GAIN_160 = 3
+} MAX30003EcgGain;
+
+/* DLPF[1:0], 100Hz and 150Hz are not available at every rate (40Hz is used then) */
+typedef enum
+{
+    ECG_DLPF_BYPASS = 0,
+    ECG_DLPF_40HZ = 1,
+    ECG_DLPF_100HZ = 2,
+    ECG_DLPF_150HZ = 3
+} MAX30003EcgDlpf;
+
+/* Samples per second to RATE field, 0xFF if rate is not supported */
+constexpr uint8_t ecgRateBits(uint16_t samplingRate)
+{
+    return samplingRate == 512 ? ECG_RATE_512 : samplingRate == 256 ? ECG_RATE_256
+                                            : samplingRate == 128   ? ECG_RATE_128
+                                                                    : 0xFF;
+}
+
+/*  CNFG_ECG (0x15)
+    D[23:22] RATE, D[17:16] GAIN, D[14] DHPF (1 = 0.5Hz high-pass), D[13:12] DLPF
+*/
+constexpr uint32_t cnfgEcg(MAX30003EcgRate rate, MAX30003EcgGain gain, bool dhpf, MAX30003EcgDlpf dlpf)
+{
+    return max30003Field(max30003Field(max30003Field(max30003Field(0, 22, 2, rate), 16, 2, gain), 14, 1, dhpf), 12, 2, dlpf);
+}
+
+constexpr uint32_t cnfgEcgWithRate(uint32_t reg, MAX30003EcgRate rate)
+{
+    return max30003Field(reg, 22, 2, rate);
+}
+
+/*  CNFG_RTOR1 (0x1D)
+    D[23:20] WNDW      averaging window, 6 + 2 * WNDW RTOR periods (8 ms), 3 = 96 ms
+    D[19:16] GAIN      0xF = auto-scale
+    D[15]    EN_RTOR   RTOR detection enable
+    D[13:12] PAVG      peak averaging, 2 = 8 values
+    D[11:8]  PTSF      peak threshold, (PTSF + 1) / 16 of average peak
+*/
+constexpr uint32_t cnfgRtor1(uint8_t wndw, uint8_t gain, bool enRtor, uint8_t pavg, uint8_t ptsf)
+{
+    return max30003Field(max30003Field(max30003Field(max30003Field(max30003Field(0, 20, 4, wndw), 16, 4, gain), 15, 1, enRtor), 12, 2, pavg), 8, 4, ptsf);
+}
+
+/*  CNFG_RTOR2 (0x1E)
+    D[21:16] HOFF  minimum hold off in RTOR periods (8 ms)
+    D[13:12] RAVG  RR interval averaging, 2 = 8 values
+    D[10:8]  RHSF  hold off scaling, RHSF / 8 of average RR interval
+*/
+constexpr uint32_t cnfgRtor2(uint8_t hoff, uint8_t ravg, uint8_t rhsf)
+{
+    return max30003Field(max30003Field(max30003Field(0, 16, 6, hoff), 12, 2, ravg), 8, 3, rhsf);
+}
+
+/*  MNGR_INT (0x04)
+    D[23:19] EFIT       EINT is issued when FIFO holds EFIT + 1 words
+    D[6]     CLR_FAST   1 = FSTINT clears when FAST mode ends
+    D[5:4]   CLR_RRINT  01 = RRINT clears on RTOR read back
+    D[2]     CLR_SAMP   1 = SAMP self-clears after 1/4 of data rate cycle
+    D[1:0]   SAMP_IT    SAMP every 1/2/4/16 samples
+*/
+constexpr uint32_t mngrInt(uint8_t fifoWords, uint8_t clrRrint = 1, bool clrSamp = true, bool clrFast = false, uint8_t sampIt = 0)
+{
+    return max30003Field(max30003Field(max30003Field(max30003Field(max30003Field(0, 19, 5, fifoWords - 1), 6, 1, clrFast), 4, 2, clrRrint), 2, 1, clrSamp), 0, 2, sampIt);
+}
+
+/* EN_INT / EN_INT2 bits */
+#define INT_EINT (1u << 23)
+#define INT_EOVF (1u << 22)
+#define INT_FSTINT (1u << 21)
+#define INT_DCLOFF (1u << 20)
+#define INT_RRINT (1u << 10)
+#define INT_SAMP (1u << 9)
+#define INT_PLL (1u << 8)
+/* INTB_TYPE[1:0] = 01, CMOS driver */
+#define INTB_CMOS 0x1u
+
+constexpr uint32_t enInt(uint32_t sources, uint8_t intbType = INTB_CMOS)
+{
+    return (sources & 0xFFFFFC) | (intbType & 0x3);
+}
+
+/* Configuration written by max30003Begin() and setIntruppts() */
+/* ECG on, 32768Hz master clock, no lead-off detection or bias */
+constexpr uint32_t MAX30003_CNFG_GEN_VALUE = cnfgGen(true);
+/* Calibration sources off */
+constexpr uint32_t MAX30003_CNFG_CAL_VALUE = 0x000000;
+/* Inputs connected to ECGP/ECGN, no calibration source on inputs */
+constexpr uint32_t MAX30003_CNFG_EMUX_VALUE = 0x000000;
+/* 128 sps, 20V/V, 0.5Hz high-pass, 40Hz low-pass (0x805000) */
+constexpr uint32_t MAX30003_CNFG_ECG_VALUE = cnfgEcg(ECG_RATE_128, ECG_GAIN_20, true, ECG_DLPF_40HZ);
+/*  96 ms window, auto gain, RTOR on, 8 peak average, 4/16 threshold (0x3FA300)
+    Was 0x3F6300 before, which sets reserved D[14] instead of EN_RTOR, so RTOR never ran
+*/
+constexpr uint32_t MAX30003_CNFG_RTOR1_VALUE = cnfgRtor1(3, 0xF, true, 2, 3);
+/* 32 * 8 ms hold off, 8 interval average, 4/8 hold off scaling (0x202400) */
+constexpr uint32_t MAX30003_CNFG_RTOR2_VALUE = cnfgRtor2(0x20, 2, 4);
+/* ECG FIFO threshold, FIFO overflow and RR intruppts on INTB (0xC00401) */
+constexpr uint32_t MAX30003_EN_INT_VALUE = enInt(INT_EINT | INT_EOVF | INT_RRINT);
+
+static_assert(MAX30003_CNFG_ECG_VALUE == 0x805000, "CNFG_ECG fields");
+static_assert(MAX30003_CNFG_RTOR2_VALUE == 0x202400, "CNFG_RTOR2 fields");
+static_assert(MAX30003_EN_INT_VALUE == 0xC00401, "EN_INT fields");
+static_assert(mngrInt(32) == 0xF80014, "MNGR_INT fields");
+static_assert(mngrInt(16, 0) == 0x780004, "MNGR_INT power on value, EFIT 16 words");
+
+/* Configuration registers kept in shadow */
+#define MAX30003_SHADOW_REGS 10
+
+/*  RAM copy of configuration registers
+    Holds what the device contains plus staged changes; a register is dirty
+    while its staged value was not written yet
+*/
+class MAX30003Shadow
+{
+public:
+    MAX30003Shadow() { reset(); }
+    /* Power on defaults, device was just reset so nothing is dirty */
+    void reset()
+    {
+        for (int i = 0; i < MAX30003_SHADOW_REGS; i++)
+        {
+            _value[i] = defaults[i];
+        }
+        _dirty = 0;
+    }
+    /* Stage value, register only becomes dirty if value differs */
+    void set(uint8_t reg, uint32_t value)
+    {
+        int i = index(reg);
+        if (i < 0)
+        {
+            return;
+        }
+        value &= 0xFFFFFF;
+        if (_value[i] != value)
+        {
+            _value[i] = value;
+            _dirty |= (uint16_t)(1u << i);
+        }
+    }
+    uint32_t get(uint8_t reg) const
+    {
+        int i = index(reg);
+        return i < 0 ? 0 : _value[i];
+    }
+    bool dirty() const { return _dirty != 0; }
+    /*  Take next dirty register, returns false when all are written
+        synch is set if the register needs SYNCH afterwards
+    */
+    bool nextDirty(uint8_t *reg, uint32_t *value, bool *synch)
+    {
+        for (int i = 0; i < MAX30003_SHADOW_REGS; i++)
+        {
+            if (_dirty & (1u << i))
+            {
+                _dirty &= (uint16_t)~(1u << i);
+                *reg = regs[i];
+                *value = _value[i];
+                *synch = i >= SYNCH_FROM;
+                return true;
+            }
+        }
+        return false;
+    }
+    /* Take staged value of one register to write it now, clears its dirty bit */
+    uint32_t take(uint8_t reg)
+    {
+        int i = index(reg);
+        if (i < 0)
+        {
+            return 0;
+        }
+        _dirty &= (uint16_t)~(1u << i);
+        return _value[i];
+    }
+    /* Register changes time base, SYNCH has to follow a write to it */
+    static bool needsSynch(uint8_t reg) { return index(reg) >= SYNCH_FROM; }
+    /* Device content is unknown (e.g. after brown-out), write everything with next batch */
+    void invalidate() { _dirty = (1u << MAX30003_SHADOW_REGS) - 1; }
+
+private:
+    static int index(uint8_t reg)
+    {
+        for (int i = 0; i < MAX30003_SHADOW_REGS; i++)
+        {
+            if (regs[i] == reg)
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+    /*  Write order of a batch: intruppt setup first, registers changing the time base
+        last (index SYNCH_FROM and up) so SYNCH follows them
+        EN_INT, EN_INT2, MNGR_INT, MNGR_DYN, CNFG_CAL, CNFG_GEN, CNFG_EMUX, CNFG_ECG, CNFG_RTOR1, CNFG_RTOR2
+    */
+    static constexpr uint8_t regs[MAX30003_SHADOW_REGS] = {0x02, 0x03, 0x04, 0x05, 0x12, 0x10, 0x14, 0x15, 0x1D, 0x1E};
+    static constexpr uint32_t defaults[MAX30003_SHADOW_REGS] = {0x000003, 0x000003, 0x780004, 0x3F0000, 0x704800,
+                                                                0x080004, 0x300000, 0x805000, 0x3F2300, 0x202400};
+    static constexpr int SYNCH_FROM = 5;
+    uint32_t _value[MAX30003_SHADOW_REGS];
+    uint16_t _dirty;
+};
@@ -0,0 +1,187 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Hardware abstraction used by MAX30003 driver
+    Selected at compile time:
+    - default: inline wrappers around Raspberry Pi Pico SDK, firmware pays nothing
+    - MAX30003_HOST: functions are implemented by host simulator (host/max30003_sim.cpp)
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef MAX30003_HOST
+
+typedef unsigned int uint;
+/* On host spi_inst_t is a simulated SPI bus */
+typedef struct spi_inst spi_inst_t;
+
+void halGpioPut(uint pin, bool value);
+bool halGpioGet(uint pin);
+void halSpiWrite(spi_inst_t *spi, const uint8_t *buf, size_t len);
+void halSpiRead(spi_inst_t *spi, uint8_t *buf, size_t len);
+void halSleepMs(uint32_t ms);
+uint64_t halTimeUs();
+uint32_t halTimeUs32();
+void halCycleCounterInit();
+uint32_t halCycles();
+void halNotify();
+uint32_t halIrqSave();
+void halIrqRestore(uint32_t state);
+bool halDmaInit(spi_inst_t *spi, int *txChannel, int *rxChannel);
+void halDmaStart(spi_inst_t *spi, int txChannel, int rxChannel, const uint8_t *txBuf, uint8_t *rxBuf, uint len);
+bool halDmaAcknowledge(int rxChannel);
+/* Driver messages, host simulator sends them where simSetLog() says */
+void halLog(const char *format, ...);
+
+#else
+
+#include "pico/time.h"
+#include "hardware/gpio.h"
+#include "hardware/spi.h"
+#include "hardware/dma.h"
+#include "hardware/sync.h"
+#include "hardware/structs/systick.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+static inline void halGpioPut(uint pin, bool value)
+{
+    gpio_put(pin, value);
+}
+
+static inline bool halGpioGet(uint pin)
+{
+    return gpio_get(pin);
+}
+
+static inline void halSpiWrite(spi_inst_t *spi, const uint8_t *buf, size_t len)
+{
+    spi_write_blocking(spi, buf, len);
+}
+
+static inline void halSpiRead(spi_inst_t *spi, uint8_t *buf, size_t len)
+{
+    spi_read_blocking(spi, 0, buf, len);
+}
+
+/* Driver messages (register dump at init, errors), stdio on the board */
+static inline void halLog(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+static inline void halSleepMs(uint32_t ms)
+{
+    sleep_ms(ms);
+}
+
+static inline uint64_t halTimeUs()
+{
+    return time_us_64();
+}
+
+/* Lower 32 bit of timer, same value on both cores and safe to read from both */
+static inline uint32_t halTimeUs32()
+{
+    return time_us_32();
+}
+
+/* SysTick of calling core as free running 24 bit down counter at clk_sys */
+static inline void halCycleCounterInit()
+{
+    systick_hw->rvr = 0xFFFFFF;
+    systick_hw->cvr = 0;
+    /* CLKSOURCE = processor clock, ENABLE */
+    systick_hw->csr = 0x5;
+}
+
+/* clk_sys cycles of calling core, wraps at 2^24 (134ms at 125MHz) */
+static inline uint32_t halCycles()
+{
+    return 0xFFFFFF - systick_hw->cvr;
+}
+
+/* Wake other core waiting in __wfe() */
+static inline void halNotify()
+{
+    __sev();
+}
+
+/* Intruppts of calling core off, returns previous state */
+static inline uint32_t halIrqSave()
+{
+    return save_and_disable_interrupts();
+}
+
+static inline void halIrqRestore(uint32_t state)
+{
+    restore_interrupts(state);
+}
+
+/*  Claim and configure SPI TX/RX DMA channel pair
+    TX reads incrementing buffer into SPI data register, RX writes SPI data register
+    into incrementing buffer, only RX raises DMA_IRQ_0
+*/
+static inline bool halDmaInit(spi_inst_t *spi, int *txChannel, int *rxChannel)
+{
+    int tx = dma_claim_unused_channel(false);
+    int rx = dma_claim_unused_channel(false);
+    if (tx < 0 || rx < 0)
+    {
+        if (tx >= 0)
+            dma_channel_unclaim(tx);
+        if (rx >= 0)
+            dma_channel_unclaim(rx);
+        return false;
+    }
+
+    dma_channel_config c = dma_channel_get_default_config(tx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(spi, true));
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(tx, &c, &spi_get_hw(spi)->dr, nullptr, 0, false);
+
+    c = dma_channel_get_default_config(rx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(spi, false));
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    dma_channel_configure(rx, &c, nullptr, &spi_get_hw(spi)->dr, 0, false);
+
+    dma_channel_set_irq0_enabled(rx, true);
+    *txChannel = tx;
+    *rxChannel = rx;
+    return true;
+}
+
+/* Start both channels together so RX never misses a Byte */
+static inline void halDmaStart(spi_inst_t *spi, int txChannel, int rxChannel, const uint8_t *txBuf, uint8_t *rxBuf, uint len)
+{
+    dma_channel_set_read_addr(txChannel, txBuf, false);
+    dma_channel_set_trans_count(txChannel, len, false);
+    dma_channel_set_write_addr(rxChannel, rxBuf, false);
+    dma_channel_set_trans_count(rxChannel, len, false);
+    dma_start_channel_mask((1u << txChannel) | (1u << rxChannel));
+}
+
+/* Returns true (and clears intruppt) if RX channel raised DMA_IRQ_0 */
+static inline bool halDmaAcknowledge(int rxChannel)
+{
+    if (!dma_channel_get_irq0_status(rxChannel))
+    {
+        return false;
+    }
+    dma_channel_acknowledge_irq0(rxChannel);
+    return true;
+}
+
+#endif
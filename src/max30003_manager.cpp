@@ -0,0 +1,228 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "max30003_manager.h"
+
+MAX30003Manager *MAX30003Manager::_active = nullptr;
+
+MAX30003Manager::MAX30003Manager()
+{
+    _count = 0;
+    _busCount = 0;
+    _waiting = 0;
+    _busWaits = 0;
+    _onBlock = nullptr;
+    _onRR = nullptr;
+    _ctx = nullptr;
+    for (int i = 0; i < MAX30003_MAX_BUSES; i++)
+    {
+        _buses[i] = nullptr;
+        _lastServed[i] = 0;
+    }
+    for (int i = 0; i < MAX30003_MAX_PINS; i++)
+    {
+        _pinDevice[i] = -1;
+    }
+}
+
+int MAX30003Manager::addDevice(MAX30003 *device, uint intPin)
+{
+    if (_count >= MAX30003_MAX_DEVICES || intPin >= MAX30003_MAX_PINS || _pinDevice[intPin] >= 0)
+    {
+        return -1;
+    }
+    int bus = -1;
+    for (int i = 0; i < _busCount; i++)
+    {
+        if (_buses[i] == device->spi())
+        {
+            bus = i;
+        }
+    }
+    if (bus < 0)
+    {
+        if (_busCount >= MAX30003_MAX_BUSES)
+        {
+            return -1;
+        }
+        bus = _busCount++;
+        _buses[bus] = device->spi();
+    }
+    Slot &slot = _devices[_count];
+    slot.device = device;
+    slot.manager = this;
+    slot.index = _count;
+    slot.bus = (uint8_t)bus;
+    _pinDevice[intPin] = (int8_t)_count;
+    device->setIntPin(intPin);
+    device->setBlockCallBack(samplesThunk, rrThunk, &slot);
+    return _count++;
+}
+
+void MAX30003Manager::configureAll(uint16_t samplingRate)
+{
+    for (int i = 0; i < _count; i++)
+    {
+        _devices[i].device->max30003Configure(samplingRate);
+    }
+}
+
+bool MAX30003Manager::enableDmaAll()
+{
+    for (int i = 0; i < _count; i++)
+    {
+        if (!_devices[i].device->enableDmaAcquisition())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MAX30003Manager::setBlockCallBack(void (*onBlock)(const MAX30003DeviceBlock *, void *),
+                                       void (*onRR)(uint8_t device, uint32_t rrMs, uint32_t sampleIndex, void *), void *ctx)
+{
+    _onBlock = onBlock;
+    _onRR = onRR;
+    _ctx = ctx;
+}
+
+void MAX30003Manager::makeActive()
+{
+    _active = this;
+}
+
+void MAX30003Manager::gpioIntruppt(uint gpio, uint32_t events)
+{
+    if (_active != nullptr)
+    {
+        _active->onGpio(gpio);
+    }
+}
+
+void MAX30003Manager::dmaIntruppt()
+{
+    if (_active != nullptr)
+    {
+        _active->onDma();
+    }
+}
+
+bool MAX30003Manager::busBusy(uint8_t bus) const
+{
+    for (int i = 0; i < _count; i++)
+    {
+        if (_devices[i].bus == bus && _devices[i].device->dmaBusy())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Serve device now, or remember it until its bus is free */
+void MAX30003Manager::service(int index)
+{
+    uint8_t bus = _devices[index].bus;
+    if (busBusy(bus))
+    {
+        _waiting |= 1u << index;
+        _busWaits++;
+        return;
+    }
+    _waiting &= ~(1u << index);
+    _lastServed[bus] = (uint8_t)index;
+    _devices[index].device->getDataIntrupptCallback();
+}
+
+/* Bus became free: serve waiting devices round robin until one of them starts a DMA burst */
+void MAX30003Manager::serveWaiting(uint8_t bus)
+{
+    for (int n = 1; n <= _count && !busBusy(bus); n++)
+    {
+        int i = (_lastServed[bus] + n) % _count;
+        if (_devices[i].bus == bus && (_waiting & (1u << i)))
+        {
+            service(i);
+        }
+    }
+}
+
+void MAX30003Manager::onGpio(uint gpio)
+{
+    if (gpio >= MAX30003_MAX_PINS || _pinDevice[gpio] < 0)
+    {
+        return;
+    }
+    service(_pinDevice[gpio]);
+}
+
+void MAX30003Manager::onDma()
+{
+    for (int i = 0; i < _count; i++)
+    {
+        /* Only the device whose RX channel completed acknowledges it */
+        if (_devices[i].device->dmaCompleteCallback())
+        {
+            serveWaiting(_devices[i].bus);
+        }
+    }
+}
+
+void MAX30003Manager::kick()
+{
+    for (int i = 0; i < _count; i++)
+    {
+        service(i);
+    }
+}
+
+void MAX30003Manager::runCommands()
+{
+    for (int i = 0; i < _count; i++)
+    {
+        uint32_t state = halIrqSave();
+        if (!busBusy(_devices[i].bus))
+        {
+            _devices[i].device->runCommands();
+        }
+        halIrqRestore(state);
+    }
+}
+
+int MAX30003Manager::process()
+{
+    int blocks = 0;
+    for (int i = 0; i < _count; i++)
+    {
+        while (_devices[i].device->processDmaBlock())
+        {
+            blocks++;
+        }
+    }
+    return blocks;
+}
+
+void MAX30003Manager::samplesThunk(const MAX30003SampleBlock *block, void *ctx)
+{
+    Slot *slot = static_cast<Slot *>(ctx);
+    MAX30003Manager *m = slot->manager;
+    MAX30003DeviceBlock out = {slot->index, block->readSequence, block};
+    if (m->_onBlock != nullptr)
+    {
+        m->_onBlock(&out, m->_ctx);
+    }
+}
+
+void MAX30003Manager::rrThunk(uint32_t rrMs, uint32_t sampleIndex, void *ctx)
+{
+    Slot *slot = static_cast<Slot *>(ctx);
+    MAX30003Manager *m = slot->manager;
+    if (m->_onRR != nullptr)
+    {
+        m->_onRR(slot->index, rrMs, sampleIndex, m->_ctx);
+    }
+}
@@ -0,0 +1,102 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Several MAX30003 on one or more SPI buses
+
+    Every device has its own CS and INTB pin. Pico SDK has one GPIO callback
+    per core, gpioIntruppt() finds the device from the pin. Devices on the same
+    bus are serviced one at a time: while a DMA burst of one device owns the
+    bus, INTB of other devices on that bus is remembered and served round
+    robin when the burst completes. dmaIntruppt() finds the device from the
+    completed DMA channel, so all devices can share DMA_IRQ_0.
+
+    GPIO and DMA intruppts have to run on the same core with the same
+    priority, so they never preempt each other.
+
+    Sample blocks of all devices are handed to one callback with device
+    number and per device FIFO read number, taken when the FIFO is read, so a
+    gap in sequence means blocks of that device were read and lost on the way
+    (DMA buffers full). Samples lost in FIFO overflow are marked ECG_FLAG_GAP.
+
+    Every device in DMA mode claims two DMA channels, RP2040 has 12.
+*/
+#pragma once
+
+#include "max30003.h"
+
+#define MAX30003_MAX_DEVICES 8
+#define MAX30003_MAX_BUSES 2
+/* RP2040 GPIO count */
+#define MAX30003_MAX_PINS 30
+
+/* Sample block of one device */
+typedef struct
+{
+    uint8_t device;
+    /* FIFO read number of this device, given in intruppt when FIFO is read (MAX30003SampleBlock::readSequence) */
+    uint32_t sequence;
+    const MAX30003SampleBlock *block;
+} MAX30003DeviceBlock;
+
+class MAX30003Manager
+{
+public:
+    MAX30003Manager();
+    /* Returns device number, -1 if there is no free slot or pin is used */
+    int addDevice(MAX30003 *device, uint intPin);
+    /* Same configuration for every device, one after another */
+    void configureAll(uint16_t samplingRate);
+    /* Every device switches to DMA acquisition, false if DMA channels ran out */
+    bool enableDmaAll();
+    void setBlockCallBack(void (*onBlock)(const MAX30003DeviceBlock *, void *),
+                          void (*onRR)(uint8_t device, uint32_t rrMs, uint32_t sampleIndex, void *), void *ctx);
+    /*  Manager that gpioIntruppt() / dmaIntruppt() dispatch to, Pico SDK callbacks
+        have no context pointer
+    */
+    void makeActive();
+    static void gpioIntruppt(uint gpio, uint32_t events);
+    static void dmaIntruppt();
+    /* Serve devices whose INTB is already low, call once after intruppts are enabled */
+    void kick();
+    /* Run queued commands of every device whose bus has no DMA burst of any device on it */
+    void runCommands();
+    /* Decode completed DMA blocks of all devices in thread context, returns blocks decoded */
+    int process();
+    int deviceCount() const { return _count; }
+    MAX30003 *device(int index) const { return _devices[index].device; }
+    /* Intruppts that had to wait for another device on the same bus */
+    uint32_t busWaits() const { return _busWaits; }
+
+private:
+    typedef struct
+    {
+        MAX30003 *device;
+        MAX30003Manager *manager;
+        uint8_t index;
+        uint8_t bus;
+    } Slot;
+    void onGpio(uint gpio);
+    void onDma();
+    void service(int index);
+    void serveWaiting(uint8_t bus);
+    bool busBusy(uint8_t bus) const;
+    static void samplesThunk(const MAX30003SampleBlock *block, void *ctx);
+    static void rrThunk(uint32_t rrMs, uint32_t sampleIndex, void *ctx);
+    static MAX30003Manager *_active;
+    Slot _devices[MAX30003_MAX_DEVICES];
+    uint8_t _count;
+    spi_inst_t *_buses[MAX30003_MAX_BUSES];
+    uint8_t _busCount;
+    /* Devices waiting for their bus, bit per device */
+    volatile uint32_t _waiting;
+    /* Device served last on every bus, round robin starts after it */
+    uint8_t _lastServed[MAX30003_MAX_BUSES];
+    int8_t _pinDevice[MAX30003_MAX_PINS];
+    uint32_t _busWaits;
+    void (*_onBlock)(const MAX30003DeviceBlock *, void *);
+    void (*_onRR)(uint8_t, uint32_t, uint32_t, void *);
+    void *_ctx;
+};
@@ -0,0 +1,108 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Runtime counters of MAX30003 driver
+
+    Every counter has exactly one writer (intruppt, DMA/thread context or
+    processing core, depending on acquisition mode) and is only updated with
+    32 bit atomic load/store, so updating costs a few cycles and a snapshot
+    can be taken from any core without locking. A snapshot is not one instant:
+    counters are read one after another, each of them is never torn.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+/* Samples per FIFO read: 0, 1, 2-3, 4-7, 8-15, 16-31, 32 */
+#define TELEMETRY_BLOCK_BUCKETS 7
+/* Intruppt duration in clk_sys cycles: <1k, <2k, <4k, ... <64k, >=64k */
+#define TELEMETRY_IRQ_BUCKETS 8
+
+/* Snapshot, all fields are uint32_t so it can be sent as array of words */
+typedef struct
+{
+    uint32_t intruppts;
+    uint32_t blocks;
+    uint32_t samples;
+    /* ETAG 1/3 samples */
+    uint32_t fastSamples;
+    /* FIFO reads that returned no sample (ETAG 5 first) */
+    uint32_t emptyReads;
+    /* ETAG 7 events */
+    uint32_t overflows;
+    /* Estimated from time between last read before and first read after overflow */
+    uint32_t lostSamples;
+    uint32_t rrEvents;
+    /* Raw blocks waiting for processing core, and its maximum */
+    uint32_t ringDepth;
+    uint32_t ringHighWater;
+    uint32_t ringDropped;
+    /* FIFO bursts skipped because both DMA buffers were waiting */
+    uint32_t dmaDropped;
+    uint32_t irqMaxCycles;
+    /* EFIT threshold in words and number of coalescing changes */
+    uint32_t fifoThreshold;
+    uint32_t coalesceSwitches;
+    /* Queued register commands executed */
+    uint32_t commands;
+    uint32_t blockHist[TELEMETRY_BLOCK_BUCKETS];
+    uint32_t irqHist[TELEMETRY_IRQ_BUCKETS];
+    /* Output samples saturated to 18 bits, driver leaves 0, filled in by the sender (EcgStreamEncoder::samplesClipped()) */
+    uint32_t clippedSamples;
+} MAX30003Telemetry;
+
+#define MAX30003_TELEMETRY_WORDS (sizeof(MAX30003Telemetry) / sizeof(uint32_t))
+
+/* Single writer counter */
+class TelemetryCounter
+{
+public:
+    TelemetryCounter() : _v(0) {}
+    void add(uint32_t n = 1) { _v.store(_v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void max(uint32_t n)
+    {
+        if (n > _v.load(std::memory_order_relaxed))
+            _v.store(n, std::memory_order_relaxed);
+    }
+    uint32_t get() const { return _v.load(std::memory_order_relaxed); }
+    void clear() { _v.store(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint32_t> _v;
+};
+
+/* Live counters inside driver, fields match MAX30003Telemetry */
+typedef struct
+{
+    TelemetryCounter intruppts;
+    TelemetryCounter blocks;
+    TelemetryCounter samples;
+    TelemetryCounter fastSamples;
+    TelemetryCounter emptyReads;
+    TelemetryCounter overflows;
+    TelemetryCounter lostSamples;
+    TelemetryCounter rrEvents;
+    TelemetryCounter dmaDropped;
+    TelemetryCounter irqMaxCycles;
+    TelemetryCounter coalesceSwitches;
+    TelemetryCounter commands;
+    TelemetryCounter blockHist[TELEMETRY_BLOCK_BUCKETS];
+    TelemetryCounter irqHist[TELEMETRY_IRQ_BUCKETS];
+} MAX30003Counters;
+
+static inline int telemetryBlockBucket(uint32_t samples)
+{
+    int b = samples == 0 ? 0 : 32 - __builtin_clz(samples);
+    return b < TELEMETRY_BLOCK_BUCKETS ? b : TELEMETRY_BLOCK_BUCKETS - 1;
+}
+
+static inline int telemetryIrqBucket(uint32_t cycles)
+{
+    uint32_t k = cycles >> 10;
+    int b = k == 0 ? 0 : 32 - __builtin_clz(k);
+    return b < TELEMETRY_IRQ_BUCKETS ? b : TELEMETRY_IRQ_BUCKETS - 1;
+}
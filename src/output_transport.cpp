@@ -0,0 +1,182 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "output_transport.h"
+#include "max30003_hal.h"
+#include <string.h>
+
+OutputTransport::OutputTransport(const OutputLink *link)
+{
+    _link = link;
+    _batchSize = OUTPUT_TRANSPORT_BUFFER_SIZE;
+    _maxDelayUs = 0;
+    for (int i = 0; i < OUTPUT_TRANSPORT_BUFFERS; i++)
+    {
+        _len[i] = 0;
+        _free.push((uint8_t)i);
+    }
+    _fill = -1;
+    _sending = -1;
+    _fillSinceUs = 0;
+    _fillTimed = false;
+    _reserved = nullptr;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void OutputTransport::configure(uint16_t batchSize, uint32_t maxDelayUs)
+{
+    if (batchSize == 0 || batchSize > OUTPUT_TRANSPORT_BUFFER_SIZE)
+    {
+        batchSize = OUTPUT_TRANSPORT_BUFFER_SIZE;
+    }
+    _batchSize = batchSize;
+    _maxDelayUs = maxDelayUs;
+}
+
+uint8_t *OutputTransport::reserve(int len)
+{
+    _reserved = nullptr;
+    if (len <= 0 || len > OUTPUT_TRANSPORT_BUFFER_SIZE)
+    {
+        return nullptr;
+    }
+    if (_fill >= 0 && _len[_fill] + len > OUTPUT_TRANSPORT_BUFFER_SIZE)
+    {
+        submit();
+    }
+    if (_fill < 0)
+    {
+        uint8_t idx;
+        if (!_free.pop(idx))
+        {
+            _stats.framesDropped++;
+            _stats.bytesDropped += len;
+            return nullptr;
+        }
+        _fill = idx;
+        _len[idx] = 0;
+        _fillTimed = false;
+    }
+    _reserved = &_buffers[_fill][_len[_fill]];
+    return _reserved;
+}
+
+void OutputTransport::commit(int len)
+{
+    if (_reserved == nullptr || _fill < 0)
+    {
+        return;
+    }
+    _reserved = nullptr;
+    _len[_fill] += (uint16_t)len;
+    _stats.bytesCommitted += len;
+    if (_len[_fill] >= _batchSize)
+    {
+        submit();
+    }
+}
+
+bool OutputTransport::write(const uint8_t *buf, int len)
+{
+    uint8_t *dst = reserve(len);
+    if (dst == nullptr)
+    {
+        return false;
+    }
+    memcpy(dst, buf, len);
+    commit(len);
+    return true;
+}
+
+void OutputTransport::poll(uint64_t nowUs)
+{
+    if (_fill < 0 || _len[_fill] == 0)
+    {
+        return;
+    }
+    if (!_fillTimed)
+    {
+        _fillTimed = true;
+        _fillSinceUs = nowUs;
+    }
+    if (nowUs - _fillSinceUs >= _maxDelayUs)
+    {
+        submit();
+    }
+}
+
+void OutputTransport::flush()
+{
+    if (_fill >= 0 && _len[_fill] > 0)
+    {
+        submit();
+    }
+}
+
+/* Queue buffer being filled, start link if it is idle */
+void OutputTransport::submit()
+{
+    /* Queue has room for every buffer, push never fails */
+    _queue.push((uint8_t)_fill);
+    _fill = -1;
+    uint32_t used = OUTPUT_TRANSPORT_BUFFERS - _free.size();
+    if (used > _stats.highWater)
+    {
+        _stats.highWater = used;
+    }
+    uint32_t state = halIrqSave();
+    if (_sending < 0)
+    {
+        startNext();
+    }
+    halIrqRestore(state);
+}
+
+/* Hand next queued buffer to link, intruppts are disabled or this is the link intruppt */
+void OutputTransport::startNext()
+{
+    uint8_t idx;
+    while (_queue.pop(idx))
+    {
+        _sending = idx;
+        if (_link->start(_buffers[idx], _len[idx], _link->ctx))
+        {
+            return;
+        }
+        _stats.linkErrors++;
+        _sending = -1;
+        _free.push(idx);
+    }
+}
+
+void OutputTransport::complete()
+{
+    int idx = _sending;
+    if (idx < 0)
+    {
+        return;
+    }
+    _stats.bytesSent += _len[idx];
+    _stats.buffersSent++;
+    _sending = -1;
+    _free.push((uint8_t)idx);
+    startNext();
+}
+
+uint8_t OutputTransport::backlogPercent() const
+{
+    return (uint8_t)((OUTPUT_TRANSPORT_BUFFERS - _free.size()) * 100 / OUTPUT_TRANSPORT_BUFFERS);
+}
+
+bool OutputTransport::idle() const
+{
+    return _free.size() == OUTPUT_TRANSPORT_BUFFERS;
+}
+
+void OutputTransport::getStats(OutputTransportStats *stats) const
+{
+    *stats = _stats;
+}
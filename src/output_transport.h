@@ -0,0 +1,104 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Output transport: pool of preallocated buffers drained by DMA
+
+    Producers reserve space in the buffer being filled and build frames in place
+    (EcgStreamEncoder::setTransport()), nothing is copied on the way to the UART.
+    A buffer is handed to the link when it holds batchSize Bytes or poll() finds it
+    older than maxDelayUs. The link sends one buffer at a time without CPU
+    (DMA paced by UART DREQ on RP2040, OutputLoopback on host) and calls complete()
+    from its intruppt, which returns the buffer to the pool and starts the next one.
+
+    Backpressure: when every buffer is queued or sending reserve() returns nullptr,
+    the frame is dropped and counted, producers never wait for the UART.
+    backlogPercent() is meant for MAX30003::setOutputBacklog().
+
+    reserve()/commit()/poll()/flush() run in one context, complete() in an intruppt
+    of the same core (queue is started from both, intruppts are disabled meanwhile).
+*/
+#pragma once
+
+#include <stdint.h>
+#include "spsc_ring.h"
+
+#ifndef OUTPUT_TRANSPORT_BUFFERS
+#define OUTPUT_TRANSPORT_BUFFERS 4
+#endif
+#ifndef OUTPUT_TRANSPORT_BUFFER_SIZE
+#define OUTPUT_TRANSPORT_BUFFER_SIZE 512
+#endif
+
+/*  Link that drains buffers
+    start: begin sending len Bytes at buf without blocking, buf stays valid until
+           OutputTransport::complete() is called. Returns false if transfer could not start
+*/
+typedef struct
+{
+    bool (*start)(const uint8_t *buf, uint32_t len, void *ctx);
+    void *ctx;
+} OutputLink;
+
+typedef struct
+{
+    uint32_t bytesCommitted;
+    uint32_t bytesSent;
+    uint32_t buffersSent;
+    /* Reservations refused because no buffer was free */
+    uint32_t framesDropped;
+    uint32_t bytesDropped;
+    /* Most buffers queued or sending at the same time */
+    uint32_t highWater;
+    /* start() of link failed, buffer was dropped */
+    uint32_t linkErrors;
+} OutputTransportStats;
+
+class OutputTransport
+{
+public:
+    OutputTransport(const OutputLink *link);
+    /*  batchSize: buffer is sent when it holds this many Bytes, up to OUTPUT_TRANSPORT_BUFFER_SIZE
+        maxDelayUs: poll() sends a partly filled buffer after this time, 0 sends at every poll()
+    */
+    void configure(uint16_t batchSize, uint32_t maxDelayUs);
+    /* Space for len Bytes in current buffer, nullptr if no buffer is free (counted as drop) */
+    uint8_t *reserve(int len);
+    /* len Bytes of last reservation were written, len may be less than reserved */
+    void commit(int len);
+    /* Copy len Bytes in, for producers that can not build in place, false if dropped */
+    bool write(const uint8_t *buf, int len);
+    /* Send partly filled buffer once it is older than maxDelayUs */
+    void poll(uint64_t nowUs);
+    /* Send partly filled buffer now */
+    void flush();
+    /* Link finished current buffer, call from its intruppt */
+    void complete();
+    /* Buffers queued, sending or filling in percent of pool */
+    uint8_t backlogPercent() const;
+    bool idle() const;
+    void getStats(OutputTransportStats *stats) const;
+
+private:
+    void submit();
+    void startNext();
+    const OutputLink *_link;
+    uint16_t _batchSize;
+    uint32_t _maxDelayUs;
+    uint8_t _buffers[OUTPUT_TRANSPORT_BUFFERS][OUTPUT_TRANSPORT_BUFFER_SIZE];
+    uint16_t _len[OUTPUT_TRANSPORT_BUFFERS];
+    /* Free buffers, filled by complete() */
+    SpscRing<uint8_t, OUTPUT_TRANSPORT_BUFFERS> _free;
+    /* Full buffers waiting for link */
+    SpscRing<uint8_t, OUTPUT_TRANSPORT_BUFFERS> _queue;
+    /* Buffer being filled and sent, -1 if none */
+    int _fill;
+    volatile int _sending;
+    /* poll() time when current buffer got its first Byte */
+    uint64_t _fillSinceUs;
+    bool _fillTimed;
+    uint8_t *_reserved;
+    OutputTransportStats _stats;
+};
@@ -0,0 +1,353 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "qrs_detector.h"
+#include "ecg_decoder.h"
+
+QrsDetector::QrsDetector()
+{
+    _onBeat = nullptr;
+    _ctx = nullptr;
+    configure(512);
+}
+
+void QrsDetector::configure(uint16_t sampleRate)
+{
+    _sampleRate = sampleRate;
+    _maLen = (uint8_t)(sampleRate * 25 / 1000);
+    if (_maLen < 1)
+        _maLen = 1;
+    if (_maLen > QRS_MA_MAX)
+        _maLen = QRS_MA_MAX;
+    _mwiLen = (uint8_t)(sampleRate * 150 / 1000);
+    if (_mwiLen > QRS_MWI_MAX)
+        _mwiLen = QRS_MWI_MAX;
+    _refractory = sampleRate / 5;
+    /* Hardware RTOR is reported at most this long after R peak */
+    _matchWindow = sampleRate / 2;
+    _learnSamples = sampleRate * 2;
+    reset();
+}
+
+void QrsDetector::reset()
+{
+    for (int i = 0; i < QRS_MA_MAX; i++)
+        _ma[i] = 0;
+    for (int i = 0; i < QRS_MWI_MAX; i++)
+        _mwi[i] = 0;
+    for (int i = 0; i < 4; i++)
+        _d[i] = 0;
+    _maSum = 0;
+    _maPos = 0;
+    _mwiSum = 0;
+    _mwiPos = 0;
+    _last = 0;
+    _count = 0;
+    _mwiPeak = 0;
+    _mwiPrev = 0;
+    _falling = false;
+    _candAbs = 0;
+    _candValue = 0;
+    _candIndex = 0;
+    _spk = 0;
+    _npk = 0;
+    _threshold = 0xFFFFFFFF;
+    _learnMax = 0;
+    _haveBeat = false;
+    _lastBeat = 0;
+    _rrPos = 0;
+    _rrCount = 0;
+    _rrSum = 0;
+    _sbLimit = 0;
+    _sbPeak = 0;
+    _sbIndex = 0;
+    _sbValue = 0;
+    _swCount = 0;
+    _hwCount = 0;
+    _agreement = QrsAgreement();
+}
+
+void QrsDetector::setBeatCallBack(void (*onBeat)(const QrsBeat *, void *), void *ctx)
+{
+    _onBeat = onBeat;
+    _ctx = ctx;
+}
+
+void QrsDetector::process(const int32_t *samples, const uint8_t *flags, int count, uint32_t firstIndex)
+{
+    for (int i = 0; i < count; i++)
+    {
+        processSample(samples[i], flags != nullptr ? flags[i] : 0, firstIndex + i);
+    }
+}
+
+/*  Samples after a gap: filters start from x instead of stepping to it, next beat has no RR
+    interval and searchback waits for new intervals. An R peak not yet confirmed before the gap
+    is dropped. Thresholds and hardware matching stay
+*/
+void QrsDetector::restart(int32_t x)
+{
+    for (int i = 0; i < _maLen; i++)
+        _ma[i] = x;
+    _maSum = x * _maLen;
+    for (int i = 0; i < 4; i++)
+        _d[i] = _maSum;
+    for (int i = 0; i < QRS_MWI_MAX; i++)
+        _mwi[i] = 0;
+    _mwiSum = 0;
+    _mwiPeak = 0;
+    _mwiPrev = 0;
+    _falling = false;
+    _candAbs = 0;
+    _haveBeat = false;
+    _rrPos = 0;
+    _rrCount = 0;
+    _rrSum = 0;
+    _sbLimit = 0;
+    _sbPeak = 0;
+}
+
+void QrsDetector::processSample(int32_t x, uint8_t flags, uint32_t sampleIndex)
+{
+    if (flags & ECG_FLAG_FAST)
+    {
+        x = _last;
+    }
+    if ((flags & ECG_FLAG_GAP) && _count > 0)
+    {
+        restart(x);
+    }
+    _last = x;
+    _count++;
+
+    /* Low-pass: moving average, sum is kept scaled by _maLen */
+    _maSum += x - _ma[_maPos];
+    _ma[_maPos] = x;
+    if (++_maPos >= _maLen)
+        _maPos = 0;
+
+    /* 5 point derivative, high-pass part of the band-pass */
+    int32_t d = 2 * _maSum + _d[0] - _d[2] - 2 * _d[3];
+    _d[3] = _d[2];
+    _d[2] = _d[1];
+    _d[1] = _d[0];
+    _d[0] = _maSum;
+
+    /* Square, scaled so integration window fits 32 bit */
+    d >>= 6;
+    if (d > 32767)
+        d = 32767;
+    if (d < -32767)
+        d = -32767;
+    uint32_t sq = (uint32_t)(d * d) >> 10;
+
+    /* Moving window integration */
+    _mwiSum += sq - _mwi[_mwiPos];
+    _mwi[_mwiPos] = sq;
+    if (++_mwiPos >= _mwiLen)
+        _mwiPos = 0;
+    uint32_t mwi = _mwiSum;
+
+    /* R peak candidate is largest |x| since last integration peak */
+    int32_t ax = x < 0 ? -x : x;
+    if (ax > _candAbs)
+    {
+        _candAbs = ax;
+        _candValue = x;
+        _candIndex = sampleIndex;
+    }
+
+    if (_count <= _learnSamples)
+    {
+        /* Learning phase: thresholds from largest integrated value in first 2 s */
+        if (mwi > _learnMax)
+            _learnMax = mwi;
+        if (_count == _learnSamples)
+        {
+            _spk = _learnMax / 2;
+            _npk = _learnMax / 8;
+            _threshold = _npk + (_spk - _npk) / 4;
+            _candAbs = 0;
+        }
+        _mwiPrev = mwi;
+        return;
+    }
+
+    /* Integration peak is confirmed once signal dropped to half of it */
+    if (_falling)
+    {
+        if (mwi > _mwiPrev)
+        {
+            _falling = false;
+            _mwiPeak = mwi;
+        }
+    }
+    else if (mwi >= _mwiPeak)
+    {
+        _mwiPeak = mwi;
+    }
+    else if (mwi < _mwiPeak / 2)
+    {
+        handlePeak(_mwiPeak, sampleIndex);
+        _mwiPeak = 0;
+        _falling = true;
+    }
+    _mwiPrev = mwi;
+
+    /* Searchback: take largest noise peak above half threshold if a beat was missed */
+    if (_sbPeak > 0 && _sbLimit > 0 && sampleIndex - _lastBeat > _sbLimit)
+    {
+        _spk = (_sbPeak + 3 * _spk) / 4;
+        _threshold = _npk + (_spk > _npk ? (_spk - _npk) / 4 : 0);
+        emitBeat(_sbIndex, _sbValue);
+    }
+
+    if (_swCount > 0 || _hwCount > 0)
+    {
+        matchEvents(sampleIndex);
+    }
+}
+
+void QrsDetector::handlePeak(uint32_t peak, uint32_t sampleIndex)
+{
+    uint32_t rIndex = _candIndex;
+    int32_t rValue = _candValue;
+    _candAbs = 0;
+    bool outsideRefractory = !_haveBeat || rIndex - _lastBeat >= _refractory;
+    if (peak > _threshold && outsideRefractory)
+    {
+        _spk = (peak + 7 * _spk) / 8;
+        emitBeat(rIndex, rValue);
+    }
+    else
+    {
+        _npk = (peak + 7 * _npk) / 8;
+        if (outsideRefractory && peak > _threshold / 2 && peak > _sbPeak)
+        {
+            _sbPeak = peak;
+            _sbIndex = rIndex;
+            _sbValue = rValue;
+        }
+    }
+    _threshold = _npk + (_spk > _npk ? (_spk - _npk) / 4 : 0);
+}
+
+void QrsDetector::emitBeat(uint32_t index, int32_t amplitude)
+{
+    QrsBeat beat;
+    beat.sampleIndex = index;
+    beat.amplitude = amplitude;
+    beat.rrMs = 0;
+    if (_haveBeat)
+    {
+        uint32_t rr = index - _lastBeat;
+        beat.rrMs = (uint16_t)(rr * 1000 / _sampleRate);
+        /* Mean of last 8 RR intervals for searchback */
+        if (_rrCount == 8)
+            _rrSum -= _rr[_rrPos];
+        else
+            _rrCount++;
+        _rr[_rrPos] = rr;
+        _rrSum += rr;
+        _rrPos = (_rrPos + 1) & 7;
+        _sbLimit = _rrSum / _rrCount * 166 / 100;
+    }
+    _haveBeat = true;
+    _lastBeat = index;
+    _sbPeak = 0;
+    _agreement.beats++;
+
+    if (_swCount == QRS_MATCH_MAX)
+    {
+        dropSwBeat();
+    }
+    _swBeats[_swCount].index = index;
+    _swBeats[_swCount].rrMs = beat.rrMs;
+    _swBeats[_swCount].matched = false;
+    _swCount++;
+
+    if (_onBeat != nullptr)
+    {
+        _onBeat(&beat, _ctx);
+    }
+}
+
+void QrsDetector::onHardwareRR(uint32_t rrMs, uint32_t sampleIndex)
+{
+    _agreement.hwIntervals++;
+    if (_hwCount == QRS_MATCH_MAX)
+    {
+        dropHwRR();
+    }
+    _hwRR[_hwCount].index = sampleIndex;
+    _hwRR[_hwCount].rrMs = (uint16_t)rrMs;
+    _hwRR[_hwCount].matched = false;
+    _hwCount++;
+}
+
+/* Oldest software beat leaves the window, without hardware partner it was missed by RTOR */
+void QrsDetector::dropSwBeat()
+{
+    if (!_swBeats[0].matched && _agreement.hwIntervals > 0)
+    {
+        _agreement.hwMissed++;
+    }
+    for (int i = 1; i < _swCount; i++)
+        _swBeats[i - 1] = _swBeats[i];
+    _swCount--;
+}
+
+/* Match oldest hardware interval to latest free software beat in front of it */
+void QrsDetector::dropHwRR()
+{
+    uint32_t hwIndex = _hwRR[0].index;
+    int best = -1;
+    for (int i = 0; i < _swCount; i++)
+    {
+        uint32_t age = hwIndex - _swBeats[i].index;
+        if (!_swBeats[i].matched && age <= _matchWindow)
+        {
+            best = i;
+        }
+    }
+    if (best >= 0)
+    {
+        _swBeats[best].matched = true;
+        _agreement.matched++;
+        if (_swBeats[best].rrMs > 0)
+        {
+            int err = (int)_swBeats[best].rrMs - (int)_hwRR[0].rrMs;
+            if (err < 0)
+                err = -err;
+            if (err <= QRS_RR_TOLERANCE_MS)
+                _agreement.rrAgree++;
+            if (err > _agreement.maxRRErrorMs)
+                _agreement.maxRRErrorMs = (uint16_t)err;
+        }
+    }
+    else
+    {
+        _agreement.swMissed++;
+    }
+    for (int i = 1; i < _hwCount; i++)
+        _hwRR[i - 1] = _hwRR[i];
+    _hwCount--;
+}
+
+/*  Software beat is emitted ~200ms after R peak, so hardware interval is resolved
+    half a window after it was read and software beat is given up 1.5 windows after R
+*/
+void QrsDetector::matchEvents(uint32_t sampleIndex)
+{
+    while (_hwCount > 0 && (int32_t)(sampleIndex - _hwRR[0].index) > _matchWindow / 2)
+    {
+        dropHwRR();
+    }
+    while (_swCount > 0 && (int32_t)(sampleIndex - _swBeats[0].index) > _matchWindow + _matchWindow / 2)
+    {
+        dropSwBeat();
+    }
+}
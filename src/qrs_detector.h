@@ -0,0 +1,157 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Streaming Pan-Tompkins style QRS detector
+    moving average low-pass (25ms) -> 5 point derivative -> square ->
+    moving window integration (150ms) -> adaptive thresholds with searchback
+
+    Cost per sample is constant, memory is fixed (see QRS_*_MAX)
+    Input should be baseline free (EcgFilter), beat position is the sample with
+    largest |input| between two integration peaks, so it is sample accurate.
+
+    Hardware RTOR intervals can be passed to onHardwareRR(), they are matched to
+    software beats to count missed beats on both sides.
+*/
+#pragma once
+
+#include <stdint.h>
+
+/* 25ms moving average at 512 sps */
+#define QRS_MA_MAX 16
+/* 150ms integration window at 512 sps */
+#define QRS_MWI_MAX 80
+/* Beats and hardware RR intervals waiting to be matched */
+#define QRS_MATCH_MAX 8
+/* Software and hardware RR interval agree if they differ less than this */
+#define QRS_RR_TOLERANCE_MS 20
+
+typedef struct
+{
+    /* Sample index of R peak */
+    uint32_t sampleIndex;
+    /* Distance to previous beat, 0 for first beat */
+    uint16_t rrMs;
+    /* Input value at R peak */
+    int32_t amplitude;
+} QrsBeat;
+
+typedef struct
+{
+    /* Beats found by software */
+    uint32_t beats;
+    /* RR intervals received from MAX30003 RTOR */
+    uint32_t hwIntervals;
+    /* Hardware intervals with a matching software beat */
+    uint32_t matched;
+    /* Matched intervals where software RR is within QRS_RR_TOLERANCE_MS */
+    uint32_t rrAgree;
+    /* Software beats without hardware interval */
+    uint32_t hwMissed;
+    /* Hardware intervals without software beat */
+    uint32_t swMissed;
+    /* Largest |software RR - hardware RR| of matched intervals */
+    uint16_t maxRRErrorMs;
+} QrsAgreement;
+
+/* Beat or hardware interval waiting for its counterpart */
+typedef struct
+{
+    uint32_t index;
+    uint16_t rrMs;
+    bool matched;
+} QrsMatchEntry;
+
+class QrsDetector
+{
+public:
+    QrsDetector();
+    /* sampleRate: 128, 256 or 512 */
+    void configure(uint16_t sampleRate);
+    void reset();
+    void setBeatCallBack(void (*onBeat)(const QrsBeat *, void *), void *ctx);
+
+    /*  Feed one block of samples
+        flags: ECG_FLAG_* per sample or nullptr, FAST samples are fed as previous value
+        firstIndex: sample index of samples[0]
+    */
+    void process(const int32_t *samples, const uint8_t *flags, int count, uint32_t firstIndex);
+    /*  flags: ECG_FLAG_* of sample, FAST is fed as previous value, GAP restarts filters,
+        RR history and searchback so no interval is measured across lost samples
+    */
+    void processSample(int32_t x, uint8_t flags, uint32_t sampleIndex);
+
+    /*  RR interval from MAX30003 RTOR
+        sampleIndex: index of next ECG sample when interval was read
+    */
+    void onHardwareRR(uint32_t rrMs, uint32_t sampleIndex);
+
+    const QrsAgreement &agreement() const { return _agreement; }
+    /* Current detection threshold on integrated signal, for tuning */
+    uint32_t threshold() const { return _threshold; }
+
+private:
+    void restart(int32_t x);
+    void handlePeak(uint32_t peak, uint32_t sampleIndex);
+    void emitBeat(uint32_t index, int32_t amplitude);
+    void matchEvents(uint32_t sampleIndex);
+    void dropSwBeat();
+    void dropHwRR();
+
+    uint16_t _sampleRate;
+    uint8_t _maLen;
+    uint8_t _mwiLen;
+    uint16_t _refractory;
+    uint16_t _matchWindow;
+    uint16_t _learnSamples;
+
+    /* Filter state */
+    int32_t _ma[QRS_MA_MAX];
+    int32_t _maSum;
+    uint8_t _maPos;
+    int32_t _d[4];
+    uint32_t _mwi[QRS_MWI_MAX];
+    uint32_t _mwiSum;
+    uint8_t _mwiPos;
+    int32_t _last;
+    uint32_t _count;
+
+    /* Peak tracking */
+    uint32_t _mwiPeak;
+    uint32_t _mwiPrev;
+    bool _falling;
+    int32_t _candAbs;
+    int32_t _candValue;
+    uint32_t _candIndex;
+
+    /* Adaptive thresholds */
+    uint32_t _spk;
+    uint32_t _npk;
+    uint32_t _threshold;
+    uint32_t _learnMax;
+
+    /* Beat history */
+    bool _haveBeat;
+    uint32_t _lastBeat;
+    uint32_t _rr[8];
+    uint8_t _rrPos;
+    uint8_t _rrCount;
+    uint32_t _rrSum;
+    /* No beat for 166% of mean RR starts searchback */
+    uint32_t _sbLimit;
+    uint32_t _sbPeak;
+    uint32_t _sbIndex;
+    int32_t _sbValue;
+
+    /* Hardware agreement */
+    QrsMatchEntry _swBeats[QRS_MATCH_MAX];
+    QrsMatchEntry _hwRR[QRS_MATCH_MAX];
+    uint8_t _swCount;
+    uint8_t _hwCount;
+    QrsAgreement _agreement;
+
+    void (*_onBeat)(const QrsBeat *, void *);
+    void *_ctx;
+};
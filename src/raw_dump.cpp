@@ -0,0 +1,150 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "raw_dump.h"
+#include "ecg_stream.h"
+#include <string.h>
+
+static void putU16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void putU32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static uint16_t getU16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t getU32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int rawDumpRecord(uint8_t type, uint8_t gap, uint32_t timeUs, const uint8_t *data, int len, uint8_t *out)
+{
+    out[0] = RAW_DUMP_SYNC0;
+    out[1] = RAW_DUMP_SYNC1;
+    out[2] = type;
+    out[3] = gap;
+    out[4] = (uint8_t)len;
+    putU32(&out[5], timeUs);
+    memcpy(&out[RAW_DUMP_HEADER_LEN], data, len);
+    putU16(&out[RAW_DUMP_HEADER_LEN + len], ecgStreamCrc16(&out[2], RAW_DUMP_HEADER_LEN - 2 + len));
+    return RAW_DUMP_HEADER_LEN + len + 2;
+}
+
+int rawDumpBlock(const MAX30003RawBlock *block, uint8_t *out)
+{
+    int len = block->len > RAW_DUMP_MAX_DATA ? RAW_DUMP_MAX_DATA : block->len;
+    return rawDumpRecord(block->type, block->gap, (uint32_t)block->timeUs, &block->data[block->offset], len, out);
+}
+
+int rawDumpConfig(uint16_t sampleRate, uint8_t *out)
+{
+    uint8_t payload[3];
+    payload[0] = RAW_DUMP_VERSION;
+    putU16(&payload[1], sampleRate);
+    return rawDumpRecord(RAW_DUMP_CONFIG, 0, 0, payload, sizeof(payload), out);
+}
+
+RawDumpReader::RawDumpReader(const uint8_t *buf, uint64_t len)
+{
+    _buf = buf;
+    _len = len;
+    _pos = 0;
+    _sampleRate = 0;
+    _records = 0;
+    _crcErrors = 0;
+    _skippedBytes = 0;
+    _timeHigh = 0;
+    _lastTime = 0;
+    _haveTime = false;
+    _lostRecord = false;
+    _fifoSequence = 0;
+}
+
+bool RawDumpReader::next(MAX30003RawBlock *block)
+{
+    while (_pos + RAW_DUMP_HEADER_LEN + 2 <= _len)
+    {
+        const uint8_t *r = &_buf[_pos];
+        int len = r[4];
+        if (r[0] != RAW_DUMP_SYNC0 || r[1] != RAW_DUMP_SYNC1 || len > RAW_DUMP_MAX_DATA ||
+            _pos + RAW_DUMP_HEADER_LEN + len + 2 > _len)
+        {
+            _lostRecord = true;
+            _pos++;
+            _skippedBytes++;
+            continue;
+        }
+        if (ecgStreamCrc16(&r[2], RAW_DUMP_HEADER_LEN - 2 + len) != getU16(&r[RAW_DUMP_HEADER_LEN + len]))
+        {
+            /* SYNC inside data or damaged record, search from next Byte */
+            _crcErrors++;
+            _lostRecord = true;
+            _pos++;
+            _skippedBytes++;
+            continue;
+        }
+        _pos += RAW_DUMP_HEADER_LEN + len + 2;
+        _records++;
+        const uint8_t *data = &r[RAW_DUMP_HEADER_LEN];
+        if (r[2] == RAW_DUMP_CONFIG)
+        {
+            if (len >= 3)
+            {
+                _sampleRate = getU16(&data[1]);
+            }
+            continue;
+        }
+        if (r[2] != BLOCK_ECG_FIFO && r[2] != BLOCK_RTOR)
+        {
+            continue;
+        }
+        block->type = r[2];
+        block->offset = 0;
+        block->gap = r[3];
+        block->len = (uint16_t)len;
+        block->sequence = 0;
+        memcpy(block->data, data, len);
+        uint32_t timeUs = getU32(&r[5]);
+        if (r[2] == BLOCK_RTOR)
+        {
+            /* RTOR time does not move the 32 bit wrap, it is read between FIFO blocks */
+            uint64_t high = _haveTime && timeUs < _lastTime && _lastTime - timeUs > 0x80000000u ? _timeHigh + ((uint64_t)1 << 32) : _timeHigh;
+            block->timeUs = high | timeUs;
+        }
+        else
+        {
+            if (_haveTime && timeUs < _lastTime)
+            {
+                _timeHigh += (uint64_t)1 << 32;
+            }
+            _haveTime = true;
+            _lastTime = timeUs;
+            block->timeUs = _timeHigh | timeUs;
+            if (_lostRecord)
+            {
+                /* Damaged records were at least one FIFO read */
+                block->gap = 1;
+                _lostRecord = false;
+                _fifoSequence++;
+            }
+            block->sequence = _fifoSequence++;
+        }
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,67 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Raw FIFO / RTOR capture, replayed on PC through the same decode path
+
+    Every raw block of the pipeline ring (MAX30003RawBlock) is written as one record:
+    SYNC0 SYNC1 TYPE GAP LEN TIME_US[4] DATA[LEN] CRC[2]
+    TYPE is MAX30003BlockType or RAW_DUMP_CONFIG, TIME_US is low 32 bit of halTimeUs()
+    (reader extends it to 64 bit), CRC is CRC-16/CCITT-FALSE over TYPE..DATA.
+    RAW_DUMP_CONFIG record carries VERSION SAMPLERATE[2] and starts every capture.
+
+    Reader skips Bytes until next SYNC0 SYNC1 with valid CRC, so a capture from UART
+    with lost Bytes loses only the damaged blocks (they are marked as gap).
+*/
+#pragma once
+
+#include <stdint.h>
+#include "max30003.h"
+
+#define RAW_DUMP_SYNC0 0xD5
+#define RAW_DUMP_SYNC1 0x3C
+#define RAW_DUMP_VERSION 1
+#define RAW_DUMP_CONFIG 0x10
+#define RAW_DUMP_HEADER_LEN 9
+#define RAW_DUMP_MAX_DATA (MAX30003_FIFO_DEPTH * MAX30003_FIFO_WORD_LEN)
+#define RAW_DUMP_MAX_RECORD (RAW_DUMP_HEADER_LEN + RAW_DUMP_MAX_DATA + 2)
+
+/* Write record for block into out (RAW_DUMP_MAX_RECORD Bytes), returns length */
+int rawDumpBlock(const MAX30003RawBlock *block, uint8_t *out);
+/* Write RAW_DUMP_CONFIG record, returns length */
+int rawDumpConfig(uint16_t sampleRate, uint8_t *out);
+
+class RawDumpReader
+{
+public:
+    /* buf must stay valid while reading, e.g. a memory mapped file */
+    RawDumpReader(const uint8_t *buf, uint64_t len);
+    /*  Next FIFO or RTOR block, data starts at offset 0
+        Config records are taken in and skipped. Returns false at end of capture
+    */
+    bool next(MAX30003RawBlock *block);
+    /* From last config record, 0 if capture has none */
+    uint16_t sampleRate() const { return _sampleRate; }
+    uint64_t records() const { return _records; }
+    /* Records with bad CRC and Bytes skipped to find next record */
+    uint64_t crcErrors() const { return _crcErrors; }
+    uint64_t skippedBytes() const { return _skippedBytes; }
+
+private:
+    const uint8_t *_buf;
+    uint64_t _len;
+    uint64_t _pos;
+    uint16_t _sampleRate;
+    uint64_t _records;
+    uint64_t _crcErrors;
+    uint64_t _skippedBytes;
+    /* Time extension: high word and last low word */
+    uint64_t _timeHigh;
+    uint32_t _lastTime;
+    bool _haveTime;
+    bool _lostRecord;
+    /* FIFO read number given to next FIFO block, capture does not carry it */
+    uint32_t _fifoSequence;
+};
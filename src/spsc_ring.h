@@ -0,0 +1,110 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Lock-free single producer / single consumer ring
+    Producer (core 0 intruppt) and consumer (core 1) never share a writable index:
+    producer only writes _head, _dropped and _highWater
+    consumer only writes _tail
+    Only 32 bit atomic load/store is used, so this works on Cortex-M0+ without
+    libatomic and on host with two threads.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, uint32_t N>
+class SpscRing
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be power of 2");
+
+public:
+    SpscRing() : _head(0), _tail(0), _dropped(0), _highWater(0) {}
+
+    /*  Producer: get free slot to fill in place
+        Returns nullptr (and counts a drop) if ring is full
+    */
+    T *producerSlot()
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t tail = _tail.load(std::memory_order_acquire);
+        if (head - tail >= N)
+        {
+            _dropped.store(_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &_buff[head & (N - 1)];
+    }
+
+    /* Producer: publish slot returned by producerSlot() */
+    void commit()
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed) + 1;
+        _head.store(head, std::memory_order_release);
+        uint32_t used = head - _tail.load(std::memory_order_relaxed);
+        if (used > _highWater.load(std::memory_order_relaxed))
+        {
+            _highWater.store(used, std::memory_order_relaxed);
+        }
+    }
+
+    /* Producer: copy item in, returns false if ring was full */
+    bool push(const T &item)
+    {
+        T *slot = producerSlot();
+        if (slot == nullptr)
+        {
+            return false;
+        }
+        *slot = item;
+        commit();
+        return true;
+    }
+
+    /* Consumer: oldest item or nullptr if ring is empty */
+    const T *peek()
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        return &_buff[tail & (N - 1)];
+    }
+
+    /* Consumer: free item returned by peek() */
+    void release()
+    {
+        _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /* Consumer: copy oldest item out, returns false if ring was empty */
+    bool pop(T &item)
+    {
+        const T *slot = peek();
+        if (slot == nullptr)
+        {
+            return false;
+        }
+        item = *slot;
+        release();
+        return true;
+    }
+
+    uint32_t size() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+    uint32_t capacity() const { return N; }
+    /* Maximum number of items which were waiting at same time */
+    uint32_t highWater() const { return _highWater.load(std::memory_order_relaxed); }
+    /* Number of items producer could not push because ring was full */
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    T _buff[N];
+    std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _tail;
+    std::atomic<uint32_t> _dropped;
+    std::atomic<uint32_t> _highWater;
+};
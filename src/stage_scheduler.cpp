@@ -0,0 +1,251 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+#include "stage_scheduler.h"
+#include "max30003_hal.h"
+#include <string.h>
+
+StageScheduler::StageScheduler(uint64_t (*clock)(void *ctx), void *clockCtx)
+{
+    _clock = clock;
+    _clockCtx = clockCtx;
+    _count = 0;
+    _shedBacklog = 75;
+    _restoreUs = 2000000;
+    _backlog = 0;
+    _shedPriority = STAGE_SHED_NONE;
+    _lastBehindUs = 0;
+    _lastShedUs = 0;
+    _shedSteps = 0;
+    memset(_stages, 0, sizeof(_stages));
+}
+
+uint64_t StageScheduler::now()
+{
+    return _clock != nullptr ? _clock(_clockCtx) : halTimeUs();
+}
+
+int StageScheduler::addStage(const StageConfig *config)
+{
+    if (_count >= STAGE_SCHEDULER_MAX_STAGES || config->run == nullptr ||
+        (config->trigger == STAGE_PERIODIC && config->periodUs == 0) || config->priority == STAGE_SHED_NONE)
+    {
+        return -1;
+    }
+    Stage &s = _stages[_count];
+    memset(&s, 0, sizeof(s));
+    s.config = *config;
+    s.nextUs = now() + config->periodUs;
+    return _count++;
+}
+
+void StageScheduler::configureShedding(uint8_t shedBacklog, uint32_t restoreUs)
+{
+    _shedBacklog = shedBacklog;
+    _restoreUs = restoreUs;
+}
+
+void StageScheduler::setBacklog(uint8_t percent)
+{
+    _backlog = percent;
+}
+
+void StageScheduler::release(Stage &s, uint64_t releaseUs)
+{
+    s.stats.releases++;
+    if (s.config.sheddable && s.config.priority >= _shedPriority)
+    {
+        s.stats.shed++;
+        return;
+    }
+    s.pending = true;
+    s.releaseUs = releaseUs;
+}
+
+void StageScheduler::notify(int id)
+{
+    if (id >= 0 && id < _count && !_stages[id].pending)
+    {
+        release(_stages[id], now());
+    }
+}
+
+/* Shed lowest priority class that still runs */
+void StageScheduler::behind(uint64_t nowUs)
+{
+    _lastBehindUs = nowUs;
+    if (_shedSteps != 0 && nowUs - _lastShedUs < STAGE_SHED_HOLDOFF_US)
+    {
+        return;
+    }
+    int lowest = -1;
+    for (int i = 0; i < _count; i++)
+    {
+        const StageConfig &c = _stages[i].config;
+        if (c.sheddable && c.priority < _shedPriority && c.priority > lowest)
+        {
+            lowest = c.priority;
+        }
+    }
+    if (lowest < 0)
+    {
+        return;
+    }
+    _shedPriority = (uint8_t)lowest;
+    _lastShedUs = nowUs;
+    _shedSteps++;
+    /* Waiting jobs of shed class are dropped too */
+    for (int i = 0; i < _count; i++)
+    {
+        Stage &s = _stages[i];
+        if (s.pending && s.config.sheddable && s.config.priority >= _shedPriority)
+        {
+            s.pending = false;
+            s.stats.shed++;
+        }
+    }
+}
+
+/* Bring back highest priority shed class after restoreUs without being behind */
+void StageScheduler::restore(uint64_t nowUs)
+{
+    if (_shedPriority == STAGE_SHED_NONE || nowUs - _lastBehindUs < _restoreUs)
+    {
+        return;
+    }
+    int next = STAGE_SHED_NONE;
+    for (int i = 0; i < _count; i++)
+    {
+        const StageConfig &c = _stages[i].config;
+        if (c.sheddable && c.priority > _shedPriority && c.priority < next)
+        {
+            next = c.priority;
+        }
+    }
+    _shedPriority = (uint8_t)next;
+    /* Next class waits another restoreUs */
+    _lastBehindUs = nowUs;
+}
+
+bool StageScheduler::runOnce()
+{
+    uint64_t t = now();
+    for (int i = 0; i < _count; i++)
+    {
+        Stage &s = _stages[i];
+        if (s.config.trigger == STAGE_PERIODIC)
+        {
+            if (t < s.nextUs)
+            {
+                continue;
+            }
+            if (s.pending)
+            {
+                s.stats.overruns++;
+                behind(t);
+            }
+            else
+            {
+                release(s, s.nextUs);
+            }
+            s.nextUs += s.config.periodUs;
+            if (s.nextUs <= t)
+            {
+                /* Fell more than one period behind, releases in between are lost */
+                s.nextUs = t + s.config.periodUs;
+            }
+        }
+        else if (!s.pending && s.config.ready != nullptr)
+        {
+            uint64_t releaseUs = t;
+            if (s.config.ready(s.config.ctx, &releaseUs))
+            {
+                release(s, releaseUs);
+            }
+        }
+    }
+    if (_backlog >= _shedBacklog)
+    {
+        behind(t);
+    }
+    restore(t);
+
+    Stage *next = nullptr;
+    for (int i = 0; i < _count; i++)
+    {
+        Stage &s = _stages[i];
+        if (!s.pending)
+        {
+            continue;
+        }
+        if (next == nullptr || s.config.priority < next->config.priority ||
+            (s.config.priority == next->config.priority &&
+             s.releaseUs + s.config.deadlineUs < next->releaseUs + next->config.deadlineUs))
+        {
+            next = &s;
+        }
+    }
+    if (next == nullptr)
+    {
+        return false;
+    }
+    next->pending = false;
+    uint64_t start = now();
+    next->config.run(next->config.ctx);
+    uint64_t end = now();
+    StageStats &st = next->stats;
+    uint32_t exec = (uint32_t)(end - start);
+    uint32_t latency = (uint32_t)(start - next->releaseUs);
+    st.runs++;
+    st.totalUs += exec;
+    st.wcetUs = exec > st.wcetUs ? exec : st.wcetUs;
+    st.maxLatencyUs = latency > st.maxLatencyUs ? latency : st.maxLatencyUs;
+    if (end > next->releaseUs + next->config.deadlineUs)
+    {
+        st.misses++;
+        behind(end);
+    }
+    return true;
+}
+
+uint64_t StageScheduler::nextReleaseUs() const
+{
+    uint64_t next = UINT64_MAX;
+    for (int i = 0; i < _count; i++)
+    {
+        if (_stages[i].config.trigger == STAGE_PERIODIC && _stages[i].nextUs < next)
+        {
+            next = _stages[i].nextUs;
+        }
+    }
+    return next;
+}
+
+const char *StageScheduler::stageName(int id) const
+{
+    return id >= 0 && id < _count ? _stages[id].config.name : nullptr;
+}
+
+void StageScheduler::getStageStats(int id, StageStats *stats) const
+{
+    if (id >= 0 && id < _count)
+    {
+        *stats = _stages[id].stats;
+    }
+    else
+    {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+
+void StageScheduler::resetStats()
+{
+    for (int i = 0; i < _count; i++)
+    {
+        memset(&_stages[i].stats, 0, sizeof(StageStats));
+    }
+    _shedSteps = 0;
+}
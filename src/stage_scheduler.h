@@ -0,0 +1,125 @@
+/*
+    Written By Premchand Gat
+    Github: PremchandGat
+    Email: Premchandg278@gmail.com
+*/
+
+/*  Run to completion scheduler for work after acquisition (decode, filter, output, reports)
+
+    Acquisition stays in intruppts and is never scheduled here. Every stage is
+    released by its period or by data (ready() polled or notify()) and has a deadline
+    from release to completion and a priority (0 is highest). runOnce() runs the
+    released stage with highest priority, earliest deadline first among equals.
+    Runs are timed: worst case execution time, release to start latency and
+    deadline misses are kept per stage.
+
+    Shedding: a deadline miss, a periodic release that finds the stage still pending,
+    or acquisition backlog at or above shedBacklog means the system is behind. Then
+    the lowest priority class of sheddable stages is shed (released jobs are dropped
+    and counted), one class per STAGE_SHED_HOLDOFF_US. Classes come back one by one
+    after restoreUs without being behind.
+
+    Clock is halTimeUs() unless one is given, on host a simulated clock makes runs repeatable.
+    Everything runs in one context, notify() too is not intruppt safe.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#define STAGE_SCHEDULER_MAX_STAGES 8
+/* Least time between two shed steps, a miss takes a while to drain */
+#define STAGE_SHED_HOLDOFF_US 100000
+/* shedPriority() when nothing is shed */
+#define STAGE_SHED_NONE 0xFF
+
+typedef enum
+{
+    STAGE_PERIODIC,
+    STAGE_DATA
+} StageTrigger;
+
+typedef struct
+{
+    const char *name;
+    void (*run)(void *ctx);
+    /*  STAGE_DATA: true while input is waiting, nullptr if only notify() releases the stage
+        releaseUs is poll time, set it to when input arrived if that is known (block timestamp)
+    */
+    bool (*ready)(void *ctx, uint64_t *releaseUs);
+    void *ctx;
+    StageTrigger trigger;
+    uint32_t periodUs;
+    /* From release to end of run */
+    uint32_t deadlineUs;
+    uint8_t priority;
+    bool sheddable;
+} StageConfig;
+
+typedef struct
+{
+    uint32_t releases;
+    uint32_t runs;
+    uint32_t misses;
+    /* Releases dropped while stage was shed */
+    uint32_t shed;
+    /* Periodic releases that found previous one still waiting */
+    uint32_t overruns;
+    uint32_t wcetUs;
+    /* Release to start of run */
+    uint32_t maxLatencyUs;
+    uint64_t totalUs;
+} StageStats;
+
+class StageScheduler
+{
+public:
+    /* clock: microseconds, nullptr uses halTimeUs() */
+    StageScheduler(uint64_t (*clock)(void *ctx) = nullptr, void *clockCtx = nullptr);
+    /* Returns stage id, -1 if table is full or config is invalid */
+    int addStage(const StageConfig *config);
+    /* Release data stage, ignored while it is still waiting */
+    void notify(int id);
+    /*  shedBacklog: percent of acquisition backlog (setBacklog()) that counts as behind, above 100 never
+        restoreUs: time without being behind before one shed class comes back
+    */
+    void configureShedding(uint8_t shedBacklog, uint32_t restoreUs);
+    /* Acquisition ring / buffer use in percent, call before runOnce() */
+    void setBacklog(uint8_t percent);
+    /* Run one released stage, false if none was released (caller may sleep) */
+    bool runOnce();
+    /* Earliest release of a periodic stage */
+    uint64_t nextReleaseUs() const;
+    int stages() const { return _count; }
+    const char *stageName(int id) const;
+    void getStageStats(int id, StageStats *stats) const;
+    /* Sheddable stages with priority >= this are shed */
+    uint8_t shedPriority() const { return _shedPriority; }
+    uint32_t shedSteps() const { return _shedSteps; }
+    void resetStats();
+
+private:
+    typedef struct
+    {
+        StageConfig config;
+        bool pending;
+        uint64_t releaseUs;
+        uint64_t nextUs;
+        StageStats stats;
+    } Stage;
+
+    uint64_t now();
+    void release(Stage &s, uint64_t releaseUs);
+    void behind(uint64_t nowUs);
+    void restore(uint64_t nowUs);
+    uint64_t (*_clock)(void *ctx);
+    void *_clockCtx;
+    Stage _stages[STAGE_SCHEDULER_MAX_STAGES];
+    int _count;
+    uint8_t _shedBacklog;
+    uint32_t _restoreUs;
+    uint8_t _backlog;
+    uint8_t _shedPriority;
+    uint64_t _lastBehindUs;
+    uint64_t _lastShedUs;
+    uint32_t _shedSteps;
+};